@@ -50,6 +50,8 @@ cbuffer cbPerObject : register(b0)
 cbuffer cbSkinned : register(b1)
 {
     float4x4 gBoneMatrices[50];
+    float4 gPositionScale;
+    float4 gPositionOffset;
 };
 
 cbuffer cbPass : register(b2)
@@ -16,8 +16,13 @@
 
 struct VertexIn
 {
+#ifdef COMPACT_VERTICES
+	float4 PosQ    : POSITION;
+    float2 NormalQ : NORMAL;
+#else
 	float3 PosL    : POSITION;
     float3 NormalL : NORMAL;
+#endif
 	float2 TexC    : TEXCOORD;
 #ifdef SKINNED
     uint4 BoneWeights : WEIGHTS;
@@ -33,10 +38,30 @@ struct VertexOut
 	float2 TexC    : TEXCOORD;
 };
 
+#ifdef COMPACT_VERTICES
+// Unfolds a normal stored on the octahedron |x| + |y| + |z| = 1.
+float3 OctahedralDecode(float2 e)
+{
+    float3 n = float3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+    float fold = max(-n.z, 0.0f);
+    n.x += (n.x >= 0.0f) ? -fold : fold;
+    n.y += (n.y >= 0.0f) ? -fold : fold;
+    return normalize(n);
+}
+#endif
+
 VertexOut VS(VertexIn vin)
 {
 	VertexOut vout = (VertexOut)0.0f;
 
+#ifdef COMPACT_VERTICES
+    float3 posL = gPositionOffset.xyz + vin.PosQ.xyz * gPositionScale.xyz;
+    float3 normalL = OctahedralDecode(vin.NormalQ);
+#else
+    float3 posL = vin.PosL;
+    float3 normalL = vin.NormalL;
+#endif
+
 #ifdef SKINNED
     float3 gForce = float3(0.0f, -5.0f, 0.0f);
     float boneWeights[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
@@ -45,8 +70,8 @@ VertexOut VS(VertexIn vin)
     boneWeights[2] = vin.BoneWeights.z / 255.0f;
     boneWeights[3] = vin.BoneWeights.w / 255.0f;
     
-    float4 inPos = float4(vin.PosL, 1.0f);
-    float3 inNorm = vin.NormalL;
+    float4 inPos = float4(posL, 1.0f);
+    float3 inNorm = normalL;
     float3 blendedPosition = float3(0.0f, 0.0f, 0.0f);
     float3 blendedNorm = float3(0.0f, 0.0f, 0.0f);
 
@@ -58,13 +83,13 @@ VertexOut VS(VertexIn vin)
         blendedNorm += normalizedBoneWeight * mul(inNorm, (float3x3)boneMatrix);
     }
 
-    vin.PosL = blendedPosition;
-    vin.NormalL = blendedNorm;
+    posL = blendedPosition;
+    normalL = blendedNorm;
 #endif
 
 	MaterialData matData = gMaterialData[gMaterialIndex];
 
-    vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+    vout.NormalW = mul(normalL, (float3x3)gWorld);
 
 #ifdef SKINNED
     float3 normalizedForceVector =
@@ -91,7 +116,7 @@ VertexOut VS(VertexIn vin)
         }
     }
 #endif
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(posL, 1.0f), gWorld);
 #ifdef SKINNED
     vout.PosW = posW.xyz + forceVector;
 #else
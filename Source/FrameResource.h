@@ -39,6 +39,10 @@ struct PassConstants
 struct SkinnedConstants
 {
 	DirectX::XMFLOAT4X4 BoneTransforms[50];
+
+	// Dequantizes compact vertex points, point = offset + unorm * scale.
+	DirectX::XMFLOAT4 PositionScale = { 1.0f, 1.0f, 1.0f, 0.0f };
+	DirectX::XMFLOAT4 PositionOffset = { 0.0f, 0.0f, 0.0f, 0.0f };
 };
 
 struct FurConstants
@@ -76,7 +80,7 @@ struct FrameResource
 {
 public:
 
-	FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT skinnedObjectCount, UINT furObjectCount, UINT materialCount);
+	FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT skinnedObjectCount, UINT furObjectCount, UINT materialCount, UINT clusterIndexByteSize);
 	FrameResource(const FrameResource& rhs) = delete;
 	FrameResource& operator=(const FrameResource& rhs) = delete;
 	~FrameResource();
@@ -90,5 +94,9 @@ public:
 
 	std::unique_ptr<UploadBuffer<MaterialData>> MaterialBuffer = nullptr;
 
+	// Indices of the skinned model clusters that face the camera this
+	// frame, rewritten every frame and drawn by every shell.
+	std::unique_ptr<UploadBuffer<BYTE>> ClusterIndexBuffer = nullptr;
+
 	UINT64 Fence = 0;
 };
\ No newline at end of file
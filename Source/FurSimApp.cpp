@@ -10,6 +10,9 @@
 #include "ModelLoader.h"
 
 #define SCORPION 0
+#define COMPACT_VERTICES 0
+#define SPLIT_VERTEX_STREAMS 1
+#define CLUSTER_CULLING 1
 #define PI 3.14159
 
 using Microsoft::WRL::ComPtr;
@@ -20,6 +23,15 @@ using namespace DirectX::PackedVector;
 #pragma comment(lib, "D3D12.lib")
 
 const int gNumFrameResources = 3;
+
+// Fur shells over the skinned model, shell n is pushed (n + 1) times
+// gFurLengthStep out from the skin.
+#if SCORPION
+const int gNumFurShells = 12;
+#else
+const int gNumFurShells = 20;
+#endif
+const float gFurLengthStep = 0.02f;
 ModelLoader        g_ModelLoader;
 FurTexture         g_furTextureLoader;
 
@@ -87,6 +99,8 @@ private:
 	void AnimateMaterials(const GameTimer& gt);
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateSkinnedCBs(const GameTimer& gt);
+	void UpdateClusterIndices(const GameTimer& gt);
+	void ReportClipStats(const GameTimer& gt);
 	void UpdateFurCBs(const GameTimer& gt);
 	void UpdateMaterialBuffer(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
@@ -126,6 +140,12 @@ private:
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mSkinnedInputLayout;
 
+	// COMPACT_VERTICES and SPLIT_VERTEX_STREAMS ask for these layouts, the
+	// loader keeps the interleaved full width one for a rig whose bone
+	// indices do not fit 8 bits.
+	bool mCompactVertices = false;
+	bool mSplitVertexStreams = false;
+
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
 
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
@@ -136,6 +156,20 @@ private:
 
 	Camera mCamera;
 
+	// Visible clusters of the skinned model this frame. The indices of
+	// submesh n are at [mVisibleSubmeshStarts[n], mVisibleSubmeshStarts[n + 1])
+	// of the frame's ClusterIndexBuffer.
+	std::vector<std::uint32_t> mVisibleClusterVector;
+	std::vector<UINT> mVisibleSubmeshStarts;
+
+	// Indices culled and indices considered since mClusterStatsTime.
+	UINT64 mCulledIndexCount = 0;
+	UINT64 mClusterIndexCount = 0;
+	float mClusterStatsTime = 0.0f;
+
+	// Last time the compressed clips were reported.
+	float mClipStatsTime = 0.0f;
+
 	POINT mLastMousePos;
 };
 
@@ -180,11 +214,36 @@ bool FurSimApp::Initialize()
 	mCbvSrvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
 	mCamera.SetPosition(0.0f, 2.0f, -15.0f);
+
+	ModelLoader::tLoadSettings loadSettings = {};
+	loadSettings.useModelCache = true;
+	loadSettings.optimizeVertexOrder = true;
+#if COMPACT_VERTICES
+	loadSettings.compactVertices = true;
+#endif
+#if SPLIT_VERTEX_STREAMS
+	loadSettings.splitVertexStreams = true;
+#endif
+	loadSettings.mergeMeshes = true;
+	loadSettings.partitionSkin = true;
+	loadSettings.pruneBones = true;
+	loadSettings.bakeClips = true;
+	loadSettings.compressClips = true;
+	loadSettings.clipTolerances.translation = 0.0001f;
+	loadSettings.clipTolerances.rotation = 0.0005f;
+	loadSettings.clipTolerances.scale = 0.0001f;
+	loadSettings.skipStaticBones = true;
+#if CLUSTER_CULLING
+	loadSettings.clusterTriangleCount = 64;
+#endif
+	g_ModelLoader.setLoadSettings(loadSettings);
 #if SCORPION
 	g_ModelLoader.load(md3dDevice, "Models//scorpid.fbx", 50);
 #else
 	g_ModelLoader.load(md3dDevice, "Models//yeti-monster.fbx", 50);
 #endif
+	mCompactVertices = g_ModelLoader.m_mergedModel.compactVertices;
+	mSplitVertexStreams = g_ModelLoader.m_mergedModel.splitVertexStreams;
 	g_furTextureLoader.generate();
 
 	LoadTextures();
@@ -230,10 +289,12 @@ void FurSimApp::Update(const GameTimer& gt)
 	}
 
 	g_ModelLoader.advanceTime();
+	ReportClipStats(gt);
 
 	AnimateMaterials(gt);
 	UpdateObjectCBs(gt);
 	UpdateSkinnedCBs(gt);
+	UpdateClusterIndices(gt);
 	UpdateFurCBs(gt);
 	UpdateMaterialBuffer(gt);
 	UpdateMainPassCB(gt);
@@ -388,26 +449,117 @@ void FurSimApp::UpdateSkinnedCBs(const GameTimer& gt)
 
 	g_ModelLoader.loadBoneMatriceVector();
 
-	SkinnedConstants skinnedConstants;
-	std::copy(
-		std::begin(g_ModelLoader.m_boneMatrixVector),
-		std::end(g_ModelLoader.m_boneMatrixVector),
-		&skinnedConstants.BoneTransforms[0]);
+	// Every skin partition has its own palette and constant buffer.
+	const auto& modelRec = g_ModelLoader.m_mergedModel;
+
+	for (size_t submeshIndex = 0; submeshIndex < modelRec.submeshVector.size(); ++submeshIndex)
+	{
+		SkinnedConstants skinnedConstants;
+		g_ModelLoader.loadPaletteMatrices(modelRec.submeshVector[submeshIndex], &skinnedConstants.BoneTransforms[0]);
 
-	currSkinnedCB->CopyData(0, skinnedConstants);
+		if (mCompactVertices)
+		{
+			// Compact points are relative to the bounds of their mesh.
+			XMVECTOR vMax = XMLoadFloat3(&modelRec.maxVertex);
+			XMVECTOR vMin = XMLoadFloat3(&modelRec.minVertex);
+			XMStoreFloat4(&skinnedConstants.PositionScale, vMax - vMin);
+			XMStoreFloat4(&skinnedConstants.PositionOffset, vMin);
+		}
+
+		currSkinnedCB->CopyData((int)submeshIndex, skinnedConstants);
+	}
+}
+
+void FurSimApp::UpdateClusterIndices(const GameTimer& gt)
+{
+#if CLUSTER_CULLING
+	auto currClusterIndexBuffer = mCurrFrameResource->ClusterIndexBuffer.get();
+	const auto& modelRec = g_ModelLoader.m_mergedModel;
+	const bool use32BitIndices = (modelRec.indexFormat == DXGI_FORMAT_R32_UINT);
+	const BYTE* indexData = use32BitIndices ? (const BYTE*)modelRec.indexVector.data() : (const BYTE*)modelRec.indexVector16.data();
+	const UINT indexByteStride = use32BitIndices ? sizeof(std::uint32_t) : sizeof(std::uint16_t);
+
+	const auto& skinnedRitems = mRitemLayer[(int)RenderLayer::SkinnedOpaque];
+
+	mVisibleClusterVector.clear();
+	mVisibleSubmeshStarts.assign(modelRec.submeshVector.size() + 1, 0);
+
+	if (skinnedRitems.empty())
+	{
+		return;
+	}
+
+	// Every partition item shares the world of the model.
+	g_ModelLoader.cullClusters(modelRec, skinnedRitems[0]->World, mCamera.GetPosition3f(),
+		gNumFurShells * gFurLengthStep, mVisibleClusterVector);
+
+	// Clusters are in index order, so each submesh gets one visible range.
+	UINT visibleIndexCount = 0;
+
+	for (auto clusterIndex : mVisibleClusterVector)
+	{
+		const auto& clusterRec = modelRec.clusterVector[clusterIndex];
+
+		currClusterIndexBuffer->CopyData(visibleIndexCount * indexByteStride,
+			indexData + clusterRec.startIndex * indexByteStride, clusterRec.indexCount * indexByteStride);
+
+		visibleIndexCount += clusterRec.indexCount;
+		mVisibleSubmeshStarts[clusterRec.submeshIndex + 1] = visibleIndexCount;
+	}
+
+	// Submeshes without a visible cluster are empty ranges.
+	for (size_t i = 1; i < mVisibleSubmeshStarts.size(); ++i)
+	{
+		mVisibleSubmeshStarts[i] = std::max(mVisibleSubmeshStarts[i], mVisibleSubmeshStarts[i - 1]);
+	}
+
+	// Reports the share of the triangles culled over the last second.
+	mCulledIndexCount += modelRec.indexVector.size() - visibleIndexCount;
+	mClusterIndexCount += modelRec.indexVector.size();
+
+	if ((gt.TotalTime() - mClusterStatsTime >= 1.0f) && (mClusterIndexCount > 0))
+	{
+		std::string text = "cluster culling: "
+			+ std::to_string(100.0 * mCulledIndexCount / mClusterIndexCount)
+			+ "% of the triangles culled\n";
+
+		::OutputDebugStringA(text.c_str());
+
+		mCulledIndexCount = 0;
+		mClusterIndexCount = 0;
+		mClusterStatsTime = gt.TotalTime();
+	}
+#endif
+}
+
+// Reports the compression ratio of the clips and their average decode
+// time once per second.
+void FurSimApp::ReportClipStats(const GameTimer& gt)
+{
+	const float compressionRatio = g_ModelLoader.getClipCompressionRatio();
+
+	if ((gt.TotalTime() - mClipStatsTime < 1.0f) || (compressionRatio == 0.0f))
+	{
+		return;
+	}
+
+	std::string text = "compressed clips: "
+		+ std::to_string(compressionRatio)
+		+ " to 1, "
+		+ std::to_string(g_ModelLoader.getClipDecodeNanosecondsPerBone())
+		+ " ns per bone decoded\n";
+
+	::OutputDebugStringA(text.c_str());
+
+	mClipStatsTime = gt.TotalTime();
 }
 
 void FurSimApp::UpdateFurCBs(const GameTimer& gt)
 {
 	auto currFurCB = mCurrFrameResource->FurCB.get();
-#if SCORPION
-	const int kNumberOfShells = 12;
-#else
-	const int kNumberOfShells = 20;
-#endif
-	for (int shellIndex = 0; shellIndex < kNumberOfShells; ++shellIndex)
+	for (int shellIndex = 0; shellIndex < gNumFurShells; ++shellIndex)
 	{
-		float layer = float(shellIndex + 1) / float(kNumberOfShells);
+		float layer = float(shellIndex + 1) / float(gNumFurShells);
 		float layer_scaled = float(shellIndex + 1) / float(40);
 		float stiffness = powf(layer_scaled, lerp(0.3f, 8.0f, 0.5f));
 		float minShadow = lerp(1.0f, 0.0f, 0.5f);
@@ -416,7 +568,7 @@ void FurSimApp::UpdateFurCBs(const GameTimer& gt)
 
 		FurConstants FurConstants;
 		FurConstants.furIndex = shellIndex;
-		FurConstants.furLengh = 0.02f * float(shellIndex + 1);
+		FurConstants.furLengh = gFurLengthStep * float(shellIndex + 1);
 		FurConstants.stiffness = stiffness;
 		FurConstants.shadowFactor = shadowFactor;
 		FurConstants.alphaDecay = alphaDecay;
@@ -633,12 +785,21 @@ void FurSimApp::BuildShadersAndInputLayout()
 		NULL, NULL
 	};
 
-	const D3D_SHADER_MACRO skinnedDefines[] =
+	const D3D_SHADER_MACRO fullWidthSkinnedDefines[] =
+	{
+		"SKINNED", "1",
+		NULL, NULL
+	};
+
+	const D3D_SHADER_MACRO compactSkinnedDefines[] =
 	{
 		"SKINNED", "1",
+		"COMPACT_VERTICES", "1",
 		NULL, NULL
 	};
 
+	const D3D_SHADER_MACRO* skinnedDefines = mCompactVertices ? compactSkinnedDefines : fullWidthSkinnedDefines;
+
 	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
 	mShaders["standardskinnedVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", skinnedDefines, "VS", "vs_5_1");
 	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "PS", "ps_5_1");
@@ -654,14 +815,50 @@ void FurSimApp::BuildShadersAndInputLayout()
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	};
 
-	mSkinnedInputLayout =
+	if (mSplitVertexStreams && mCompactVertices)
 	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "WEIGHTS", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "BONEINDICES", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 36, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
-	};
+		mSkinnedInputLayout =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "WEIGHTS", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "BONEINDICES", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 1, 4, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+		};
+	}
+	else if (mSplitVertexStreams)
+	{
+		mSkinnedInputLayout =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "WEIGHTS", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "BONEINDICES", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+		};
+	}
+	else if (mCompactVertices)
+	{
+		mSkinnedInputLayout =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "WEIGHTS", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "BONEINDICES", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 20, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+		};
+	}
+	else
+	{
+		mSkinnedInputLayout =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "WEIGHTS", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "BONEINDICES", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, 36, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+		};
+	}
 }
 
 void FurSimApp::BuildShapeGeometry()
@@ -748,11 +945,27 @@ void FurSimApp::BuildShapeGeometry()
 
 void FurSimApp::BuildSkinnedModel()
 {
-	std::vector<ModelLoader::tSkinnedVertice> vertices;
-	std::vector<unsigned short> indices;
+	// Every mesh of the character shares one vertex and index buffer.
+	const auto& modelRec = g_ModelLoader.m_mergedModel;
+	const UINT vertexCount = (UINT)modelRec.verticeVector.size();
+	const void* vertexData = mCompactVertices ? (const void*)modelRec.compactVerticeVector.data() : (const void*)modelRec.verticeVector.data();
+	UINT vertexByteStride = mCompactVertices ? sizeof(ModelLoader::tCompactSkinnedVertice) : sizeof(ModelLoader::tSkinnedVertice);
+	const void* shadingData = nullptr;
+	UINT shadingByteStride = 0;
+
+	if (mSplitVertexStreams)
+	{
+		vertexData = mCompactVertices ? (const void*)modelRec.compactPositionStreamVector.data() : (const void*)modelRec.positionStreamVector.data();
+		vertexByteStride = mCompactVertices ? sizeof(ModelLoader::tCompactPositionStreamVertice) : sizeof(ModelLoader::tPositionStreamVertice);
+		shadingData = mCompactVertices ? (const void*)modelRec.compactShadingStreamVector.data() : (const void*)modelRec.shadingStreamVector.data();
+		shadingByteStride = mCompactVertices ? sizeof(ModelLoader::tCompactShadingStreamVertice) : sizeof(ModelLoader::tShadingStreamVertice);
+	}
 
-	vertices = g_ModelLoader.m_modelVector[0].verticeVector;
-	indices = g_ModelLoader.m_modelVector[0].indexVector;
+	// Large meshes need 32 bit indices, the rest keep 16 bit ones.
+	const bool use32BitIndices = (modelRec.indexFormat == DXGI_FORMAT_R32_UINT);
+	const void* indexData = use32BitIndices ? (const void*)modelRec.indexVector.data() : (const void*)modelRec.indexVector16.data();
+	const UINT indexCount = (UINT)modelRec.indexVector.size();
+	const UINT indexByteStride = use32BitIndices ? sizeof(std::uint32_t) : sizeof(std::uint16_t);
 
 	XMVECTOR vMax = XMLoadFloat3(&(g_ModelLoader.maxVertex));
 	XMVECTOR vMin = XMLoadFloat3(&(g_ModelLoader.minVertex));
@@ -761,36 +974,62 @@ void FurSimApp::BuildSkinnedModel()
 	XMStoreFloat3(&bounds.Center, 0.5f * (vMin + vMax));
 	XMStoreFloat3(&bounds.Extents, 0.5f * (vMax - vMin));
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(ModelLoader::tSkinnedVertice);
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	const UINT vbByteSize = vertexCount * vertexByteStride;
+	const UINT ibByteSize = indexCount * indexByteStride;
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "scorpModel";
 
 	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertexData, vbByteSize);
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indexData, ibByteSize);
 
 	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+		mCommandList.Get(), vertexData, vbByteSize, geo->VertexBufferUploader);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		mCommandList.Get(), indexData, ibByteSize, geo->IndexBufferUploader);
 
-	geo->VertexByteStride = sizeof(ModelLoader::tSkinnedVertice);
+	geo->VertexByteStride = vertexByteStride;
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexFormat = modelRec.indexFormat;
 	geo->IndexBufferByteSize = ibByteSize;
 
+	if (mSplitVertexStreams)
+	{
+		// Normals and uvs go to slot 1, the CPU copy only keeps the positions.
+		VertexStream shadingStream;
+		shadingStream.ByteStride = shadingByteStride;
+		shadingStream.BufferByteSize = vertexCount * shadingStream.ByteStride;
+		shadingStream.BufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+			mCommandList.Get(), shadingData, shadingStream.BufferByteSize, shadingStream.BufferUploader);
+
+		geo->ExtraVertexStreams.push_back(shadingStream);
+	}
+
 	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
+	submesh.IndexCount = indexCount;
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
 	submesh.Bounds = bounds;
 
 	geo->DrawArgs["scorp"] = submesh;
+
+	// One range per material and skin partition, sorted by material.
+	for (size_t submeshIndex = 0; submeshIndex < modelRec.submeshVector.size(); ++submeshIndex)
+	{
+		const auto& submeshRec = modelRec.submeshVector[submeshIndex];
+
+		SubmeshGeometry partitionSubmesh;
+		partitionSubmesh.IndexCount = submeshRec.indexCount;
+		partitionSubmesh.StartIndexLocation = submeshRec.startIndex;
+		partitionSubmesh.BaseVertexLocation = 0;
+		partitionSubmesh.Bounds = bounds;
+
+		geo->DrawArgs["scorp" + std::to_string(submeshIndex)] = partitionSubmesh;
+	}
 	mGeometries[geo->Name] = std::move(geo);
 }
 
@@ -887,7 +1126,8 @@ void FurSimApp::BuildFrameResources()
 	for (int i = 0; i < gNumFrameResources; ++i)
 	{
 		mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-			1, (UINT)mAllRitems.size(), 1, 40, (UINT)mMaterials.size()));
+			1, (UINT)mAllRitems.size(), (UINT)g_ModelLoader.m_mergedModel.submeshVector.size(), 40, (UINT)mMaterials.size(),
+			mGeometries["scorpModel"]->IndexBufferByteSize));
 	}
 }
 
@@ -970,25 +1210,31 @@ void FurSimApp::BuildRenderItems()
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
 	mAllRitems.push_back(std::move(gridRitem));
 
-	auto scorpRitem = std::make_unique<RenderItem>();
+	// One item per skin partition, each with its own palette.
+	for (size_t submeshIndex = 0; submeshIndex < g_ModelLoader.m_mergedModel.submeshVector.size(); ++submeshIndex)
+	{
+		const std::string drawArgName = "scorp" + std::to_string(submeshIndex);
+
+		auto scorpRitem = std::make_unique<RenderItem>();
 #if SCORPION
-	XMStoreFloat4x4(&scorpRitem->World, XMMatrixTranslation(0.0f, 1.3f, -5.0f));
+		XMStoreFloat4x4(&scorpRitem->World, XMMatrixTranslation(0.0f, 1.3f, -5.0f));
 #else
-	XMStoreFloat4x4(&scorpRitem->World, XMMatrixTranslation(0.0f, 1.3f, 5.0f) * XMMatrixRotationY(PI));
+		XMStoreFloat4x4(&scorpRitem->World, XMMatrixTranslation(0.0f, 1.3f, 5.0f) * XMMatrixRotationY(PI));
 #endif
-	scorpRitem->TexTransform = MathHelper::Identity4x4();
-	scorpRitem->ObjCBIndex = 2;
-	scorpRitem->Mat = mMaterials["scorp"].get();
-	scorpRitem->Geo = mGeometries["scorpModel"].get();
-	scorpRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	scorpRitem->IndexCount = scorpRitem->Geo->DrawArgs["scorp"].IndexCount;
-	scorpRitem->StartIndexLocation = scorpRitem->Geo->DrawArgs["scorp"].StartIndexLocation;
-	scorpRitem->BaseVertexLocation = scorpRitem->Geo->DrawArgs["scorp"].BaseVertexLocation;
-
-	scorpRitem->SkinnedCBIndex = 0;
-
-	mRitemLayer[(int)RenderLayer::SkinnedOpaque].push_back(scorpRitem.get());
-	mAllRitems.push_back(std::move(scorpRitem));
+		scorpRitem->TexTransform = MathHelper::Identity4x4();
+		scorpRitem->ObjCBIndex = 2 + (UINT)submeshIndex;
+		scorpRitem->Mat = mMaterials["scorp"].get();
+		scorpRitem->Geo = mGeometries["scorpModel"].get();
+		scorpRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		scorpRitem->IndexCount = scorpRitem->Geo->DrawArgs[drawArgName].IndexCount;
+		scorpRitem->StartIndexLocation = scorpRitem->Geo->DrawArgs[drawArgName].StartIndexLocation;
+		scorpRitem->BaseVertexLocation = scorpRitem->Geo->DrawArgs[drawArgName].BaseVertexLocation;
+
+		scorpRitem->SkinnedCBIndex = (UINT)submeshIndex;
+
+		mRitemLayer[(int)RenderLayer::SkinnedOpaque].push_back(scorpRitem.get());
+		mAllRitems.push_back(std::move(scorpRitem));
+	}
 
 }
 
@@ -1008,7 +1254,10 @@ void FurSimApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::v
 		D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex * objCBByteSize;
 		D3D12_GPU_VIRTUAL_ADDRESS skinnedCBAddress = skinnedCB->GetGPUVirtualAddress() + ri->SkinnedCBIndex * skinnedCBByteSize;
 
-		cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+		D3D12_VERTEX_BUFFER_VIEW vertexBufferViews[MeshGeometry::MaxVertexStreams];
+		UINT vertexStreamCount = ri->Geo->VertexBufferViews(vertexBufferViews);
+
+		cmdList->IASetVertexBuffers(0, vertexStreamCount, vertexBufferViews);
 		cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
 		cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
 
@@ -1020,12 +1269,32 @@ void FurSimApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::v
 
 			cmdList->SetGraphicsRootConstantBufferView(1, skinnedCBAddress);
 
+			UINT indexCount = ri->IndexCount;
+			UINT startIndexLocation = ri->StartIndexLocation;
+
+#if CLUSTER_CULLING
+			// Every shell draws the clusters that face the camera.
+			D3D12_INDEX_BUFFER_VIEW clusterIndexBufferView;
+			clusterIndexBufferView.BufferLocation = mCurrFrameResource->ClusterIndexBuffer->Resource()->GetGPUVirtualAddress();
+			clusterIndexBufferView.Format = ri->Geo->IndexFormat;
+			clusterIndexBufferView.SizeInBytes = ri->Geo->IndexBufferByteSize;
+			cmdList->IASetIndexBuffer(&clusterIndexBufferView);
+
+			startIndexLocation = mVisibleSubmeshStarts[ri->SkinnedCBIndex];
+			indexCount = mVisibleSubmeshStarts[ri->SkinnedCBIndex + 1] - startIndexLocation;
+
+			if (indexCount == 0)
+			{
+				continue;
+			}
+#endif
+
 			const int kNumberOfShells = 40;
 			for (int shellIndex = 0; shellIndex < kNumberOfShells; ++shellIndex)
 			{
 				D3D12_GPU_VIRTUAL_ADDRESS furCBAddress = furCB->GetGPUVirtualAddress() + (shellIndex * furCBByteSize);
 				cmdList->SetGraphicsRootConstantBufferView(3, furCBAddress);
-				cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+				cmdList->DrawIndexedInstanced(indexCount, 1, startIndexLocation, ri->BaseVertexLocation, 0);
 
 			}
 		}
@@ -1,7 +1,21 @@
 #include "ModelLoader.h"
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <numeric>
+#include <ppl.h>
 
 using namespace fbxsdk;
 using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+// The input layouts in FurSimApp depend on these sizes.
+static_assert(sizeof(ModelLoader::tSkinnedVertice) == 44, "tSkinnedVertice must stay 44 bytes");
+static_assert(sizeof(ModelLoader::tCompactSkinnedVertice) == 24, "tCompactSkinnedVertice must stay 24 bytes");
+static_assert(sizeof(ModelLoader::tPositionStreamVertice) == 20, "tPositionStreamVertice must stay 20 bytes");
+static_assert(sizeof(ModelLoader::tShadingStreamVertice) == 20, "tShadingStreamVertice must stay 20 bytes");
+static_assert(sizeof(ModelLoader::tCompactPositionStreamVertice) == 16, "tCompactPositionStreamVertice must stay 16 bytes");
+static_assert(sizeof(ModelLoader::tCompactShadingStreamVertice) == 8, "tCompactShadingStreamVertice must stay 8 bytes");
 
 template<class T>
 constexpr const T& clamp(const T& v, const T& lo, const T& hi)
@@ -26,6 +40,281 @@ void writeToLogFile(
 	fclose(fp);
 }
 
+// FNV-1a, used to key the model cache on its source file and settings.
+unsigned long long hashBytes(
+	const void* data,
+	size_t size,
+	unsigned long long hash = 14695981039346656037ULL)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+// Bounds checked cursor over a mapped model cache.
+class tModelCacheReader
+{
+public:
+	tModelCacheReader(
+		const unsigned char* data,
+		size_t size)
+		:_data(data)
+		, _size(size)
+		, _position(0)
+	{
+	}
+
+	bool read(
+		void* destination,
+		size_t size)
+	{
+		const void* source = take(size);
+
+		if (nullptr == source)
+		{
+			return false;
+		}
+
+		memcpy(destination, source, size);
+		return true;
+	}
+
+	// Returns a pointer into the mapping, the block is padded to 4 bytes.
+	const void* take(
+		size_t size)
+	{
+		size_t paddedSize = (size + 3) & ~size_t(3);
+
+		if (paddedSize > _size - _position)
+		{
+			return nullptr;
+		}
+
+		const void* block = _data + _position;
+
+		_position += paddedSize;
+		return block;
+	}
+
+	bool atEnd() const
+	{
+		return _position == _size;
+	}
+
+private:
+	const unsigned char* _data;
+	size_t _size;
+	size_t _position;
+};
+
+void writeModelCacheBlock(
+	std::ofstream& file,
+	const void* data,
+	size_t size)
+{
+	static const char padding[4] = { 0, 0, 0, 0 };
+
+	file.write(static_cast<const char*>(data), size);
+	file.write(padding, ((size + 3) & ~size_t(3)) - size);
+}
+
+// Splits a polygon in polygonSize - 2 triangles of local corner numbers,
+// keeping the polygon winding. The polygon is ear clipped on the plane
+// it mostly faces, what cannot be clipped is closed with a fan.
+void triangulatePolygon(
+	const FbxVector4* controlPoints,
+	const int* polygonCorners,
+	long polygonSize,
+	std::uint32_t* triangleCorners)
+{
+	long triangleIndex = 0;
+
+	if (polygonSize > 3)
+	{
+		double normal[3] = { 0.0, 0.0, 0.0 };
+
+		// Newell's normal, robust to collinear and slightly warped corners.
+		for (long i = 0; i < polygonSize; ++i)
+		{
+			const FbxVector4& a = controlPoints[polygonCorners[i]];
+			const FbxVector4& b = controlPoints[polygonCorners[(i + 1) % polygonSize]];
+
+			normal[0] += (a[1] - b[1]) * (a[2] + b[2]);
+			normal[1] += (a[2] - b[2]) * (a[0] + b[0]);
+			normal[2] += (a[0] - b[0]) * (a[1] + b[1]);
+		}
+
+		long axis = 0;
+
+		for (long i = 1; i < 3; ++i)
+		{
+			if (fabs(normal[i]) > fabs(normal[axis]))
+			{
+				axis = i;
+			}
+		}
+
+		// Dropping the axis and keeping the other two in cyclic order
+		// keeps the winding, facing the normal is counter clockwise.
+		const long uAxis = (axis + 1) % 3;
+		const long vAxis = (axis + 2) % 3;
+		const double orientation = (normal[axis] < 0.0) ? -1.0 : 1.0;
+		std::vector<long> remaining(polygonSize);
+		std::vector<double> u(polygonSize);
+		std::vector<double> v(polygonSize);
+
+		for (long i = 0; i < polygonSize; ++i)
+		{
+			remaining[i] = i;
+			u[i] = controlPoints[polygonCorners[i]][uAxis];
+			v[i] = controlPoints[polygonCorners[i]][vAxis];
+		}
+
+		auto cross = [&](long a, long b, long c)
+		{
+			return orientation * ((u[b] - u[a]) * (v[c] - v[a]) - (v[b] - v[a]) * (u[c] - u[a]));
+		};
+
+		bool clipped = true;
+
+		while ((remaining.size() > 3) && clipped)
+		{
+			const long count = static_cast<long>(remaining.size());
+
+			clipped = false;
+
+			for (long i = 0; (i < count) && !clipped; ++i)
+			{
+				const long prev = remaining[(i + count - 1) % count];
+				const long ear = remaining[i];
+				const long next = remaining[(i + 1) % count];
+
+				if (cross(prev, ear, next) <= 0.0)
+				{
+					// Reflex or degenerate corner.
+					continue;
+				}
+
+				bool isEar = true;
+
+				for (long j = 0; (j < count) && isEar; ++j)
+				{
+					const long other = remaining[j];
+
+					if ((other == prev) || (other == ear) || (other == next))
+					{
+						continue;
+					}
+
+					isEar = (cross(prev, ear, other) < 0.0)
+						|| (cross(ear, next, other) < 0.0)
+						|| (cross(next, prev, other) < 0.0);
+				}
+
+				if (isEar)
+				{
+					triangleCorners[triangleIndex++] = static_cast<std::uint32_t>(prev);
+					triangleCorners[triangleIndex++] = static_cast<std::uint32_t>(ear);
+					triangleCorners[triangleIndex++] = static_cast<std::uint32_t>(next);
+
+					remaining.erase(remaining.begin() + i);
+					clipped = true;
+				}
+			}
+		}
+
+		for (size_t i = 1; i + 1 < remaining.size(); ++i)
+		{
+			triangleCorners[triangleIndex++] = static_cast<std::uint32_t>(remaining[0]);
+			triangleCorners[triangleIndex++] = static_cast<std::uint32_t>(remaining[i]);
+			triangleCorners[triangleIndex++] = static_cast<std::uint32_t>(remaining[i + 1]);
+		}
+
+		return;
+	}
+
+	triangleCorners[triangleIndex++] = 0;
+	triangleCorners[triangleIndex++] = 1;
+	triangleCorners[triangleIndex++] = 2;
+}
+
+// Raw view of a layer element's arrays. They are locked for reading once,
+// so extraction tasks can index them without going through the SDK.
+template<class T>
+class tLayerElementReader
+{
+public:
+	tLayerElementReader(
+		FbxLayerElementTemplate<T>* elementPtr)
+		:_elementPtr(elementPtr)
+		, _mappingMode(elementPtr->GetMappingMode())
+		, _directArrayPtr(elementPtr->GetDirectArray().GetLocked(FbxLayerElementArray::eReadLock))
+		, _indexArrayPtr(nullptr)
+	{
+		if (elementPtr->GetReferenceMode() != FbxLayerElement::eDirect)
+		{
+			_indexArrayPtr = elementPtr->GetIndexArray().GetLocked(FbxLayerElementArray::eReadLock);
+		}
+
+		assert(nullptr != _directArrayPtr);
+	}
+
+	~tLayerElementReader()
+	{
+		_elementPtr->GetDirectArray().Release(&_directArrayPtr);
+
+		if (nullptr != _indexArrayPtr)
+		{
+			_elementPtr->GetIndexArray().Release(&_indexArrayPtr);
+		}
+	}
+
+	tLayerElementReader(const tLayerElementReader& rhs) = delete;
+	tLayerElementReader& operator=(const tLayerElementReader& rhs) = delete;
+
+	const T& get(
+		long controlPointIndex,
+		long polygonVertexIndex,
+		long polygonIndex) const
+	{
+		long index = 0;
+
+		switch (_mappingMode)
+		{
+		case FbxLayerElement::eByControlPoint:
+			index = controlPointIndex;
+			break;
+		case FbxLayerElement::eByPolygonVertex:
+			index = polygonVertexIndex;
+			break;
+		case FbxLayerElement::eByPolygon:
+			index = polygonIndex;
+			break;
+		default: // eAllSame
+			break;
+		}
+
+		if (nullptr != _indexArrayPtr)
+		{
+			index = _indexArrayPtr[index];
+		}
+
+		return _directArrayPtr[index];
+	}
+
+private:
+	FbxLayerElementTemplate<T>* _elementPtr;
+	FbxLayerElement::EMappingMode _mappingMode;
+	T* _directArrayPtr;
+	int* _indexArrayPtr;
+};
+
 ModelLoader::ModelLoader()
 	:m_sdkManagerPtr(nullptr)
 	, m_devicePtr(nullptr)
@@ -36,11 +325,33 @@ ModelLoader::ModelLoader()
 	, m_revisionFileVersion(0)
 	, m_modelVector()
 	, m_textureName()
+	, m_loadSettings()
+	, m_axisConversion(MathHelper::Identity4x4())
+	, m_unitScale(1.0f)
 	, m_boneVector()
-	, m_allByControlPoint(true)
+	, m_boneIndexMap()
+	, m_skeleton()
+	, m_loadArena()
+	, m_loadArenaPeakBytes(0)
+	, m_prunedBoneCount(0)
+	, m_loadTaskGroup()
+	, m_loadComplete(false)
+	, m_loadPending(false)
+	, m_positionsOnly(false)
+	, m_pendingModelVector()
 	, m_boneMatrixVectorSize(0)
 	, m_boneMatrixVector()
 	, m_initialAnimationDurationInMs(0)
+	, m_animationStartTime(0)
+	, m_sourceHash(0)
+	, m_modelCacheLoaded(false)
+	, m_clipNameVector()
+	, m_poseKeyVector()
+	, m_clipDecodeNanoseconds(0.0)
+	, m_clipDecodedBoneCount(0)
+	, m_animatedBoneVector()
+	, m_staticBonesPosed(false)
+	, m_skippedBoneCount(0)
 	, maxVertex(INT_MIN, INT_MIN, INT_MIN)
 	, minVertex(INT_MAX, INT_MAX, INT_MAX)
 {
@@ -63,6 +374,8 @@ ModelLoader::ModelLoader()
 
 ModelLoader::~ModelLoader()
 {
+	// A progressive load still reads the scene.
+	m_loadTaskGroup.wait();
 
 	if (nullptr != m_sdkManagerPtr)
 	{
@@ -71,6 +384,23 @@ ModelLoader::~ModelLoader()
 	}
 }
 
+void ModelLoader::setLoadSettings(
+	const tLoadSettings& loadSettings)
+{
+	assert(loadSettings.weldEpsilon >= 0.0f);
+	assert(!m_loadPending.load());
+
+	m_loadSettings = loadSettings;
+
+	const bool importAll = !m_loadSettings.minimalImport;
+
+	m_sdkManagerPtr->GetIOSettings()->SetBoolProp(IMP_FBX_MATERIAL, importAll);
+	m_sdkManagerPtr->GetIOSettings()->SetBoolProp(IMP_FBX_TEXTURE, importAll);
+	m_sdkManagerPtr->GetIOSettings()->SetBoolProp(IMP_FBX_SHAPE, importAll);
+	m_sdkManagerPtr->GetIOSettings()->SetBoolProp(IMP_FBX_CHARACTER, importAll);
+	m_sdkManagerPtr->GetIOSettings()->SetBoolProp(IMP_FBX_EXTRACT_EMBEDDED_DATA, importAll);
+}
+
 void ModelLoader::load(Microsoft::WRL::ComPtr<ID3D12Device> devicePtr, const char* meshName,unsigned long boneMatrixVectorSize)
 {
 	assert(boneMatrixVectorSize >= kTriangleVertexCount * kBoneInfluencesPerVertice);
@@ -79,19 +409,154 @@ void ModelLoader::load(Microsoft::WRL::ComPtr<ID3D12Device> devicePtr, const cha
 	m_devicePtr = devicePtr;
 	m_filename = meshName;
 	m_boneMatrixVectorSize = boneMatrixVectorSize;
+	m_loadComplete.store(false);
+	m_loadPending.store(true);
+	m_positionsOnly = false;
 
 	_loadModel();
+	_packModels();
+
+	if (!m_loadSettings.progressive)
+	{
+		finishLoad();
+	}
+}
+
+// True once a progressive load has finished in the background,
+// finishLoad() will then not block.
+bool ModelLoader::isLoadComplete()
+{
+	return m_loadComplete.load();
+}
+
+// Waits for the second phase of the load, and swaps its complete meshes
+// in. Skinning and animation are only available after this.
+void ModelLoader::finishLoad()
+{
+	if (!m_loadPending.load())
+	{
+		return;
+	}
 
-	// We just need the duration of the first animation track.
-	m_initialAnimationDurationInMs = _getAnimationDuration();
+	m_loadTaskGroup.wait();
+
+	assert(isLoadComplete());
+
+	m_loadPending.store(false);
+
+	if (!m_pendingModelVector.empty())
+	{
+		m_modelVector.swap(m_pendingModelVector);
+		m_pendingModelVector.clear();
+
+		m_positionsOnly = false;
+
+		_packModels();
+	}
+
+	// Every load temporary is gone by now, release them in one go.
+	m_loadArenaPeakBytes = m_loadArena.usedBytes();
+	m_loadArena.reset();
+
+	// A cached load without a scene has all of this already.
+	if (nullptr != m_scenePtr)
+	{
+		_selectFirstTake();
+	}
+
+	// The curves are needed, before the clips release the scene.
+	_findStaticBones();
+	_buildSkeleton();
+
+	if (m_loadSettings.bakeClips && (nullptr != m_scenePtr))
+	{
+		_bakeClips();
+
+		if (m_loadSettings.compressClips)
+		{
+			_compressClips();
+		}
+	}
+
+	// Written last, so the clips and the bone flags are in. The meshes
+	// may be packed already, packing them again gives the same result.
+	if (m_loadSettings.useModelCache && !m_modelCacheLoaded)
+	{
+		_saveModelCache(m_modelVector, m_sourceHash);
+	}
+
+	if (m_loadSettings.bakeClips)
+	{
+		_releaseScene();
+	}
+}
+
+size_t ModelLoader::getLoadArenaPeakBytes()
+{
+	return m_loadArenaPeakBytes;
+}
+
+bool ModelLoader::isModelCacheLoaded()
+{
+	return m_modelCacheLoaded;
+}
+
+size_t ModelLoader::getPrunedBoneCount()
+{
+	// Still counted by the background phase.
+	if (m_loadPending.load())
+	{
+		return 0;
+	}
+
+	return m_prunedBoneCount;
+}
+
+float ModelLoader::getClipCompressionRatio()
+{
+	size_t uncompressedSize = 0;
+	size_t compressedSize = 0;
+
+	for (const auto& clipPtr : m_compressedClipVector)
+	{
+		uncompressedSize += clipPtr->uncompressedSize();
+		compressedSize += clipPtr->size();
+	}
+
+	return (compressedSize > 0) ? float(uncompressedSize) / float(compressedSize) : 0.0f;
+}
+
+float ModelLoader::getClipDecodeNanosecondsPerBone()
+{
+	return (m_clipDecodedBoneCount > 0) ? float(m_clipDecodeNanoseconds / m_clipDecodedBoneCount) : 0.0f;
+}
+
+size_t ModelLoader::getSkippedBoneCount()
+{
+	return m_skippedBoneCount;
 }
 
 void ModelLoader::advanceTime()
 {
+	if (m_loadPending.load())
+	{
+		return;
+	}
+
+	setAnimationTime(GetTickCount64() % m_initialAnimationDurationInMs);
+}
+
+void ModelLoader::setAnimationTime(
+	unsigned long long timeInMs)
+{
+	if (m_loadPending.load())
+	{
+		return;
+	}
+
 	fbxsdk::FbxTime fbxFrameTime;
-	unsigned long long localAnimationTime = GetTickCount64() % m_initialAnimationDurationInMs;
 
-	fbxFrameTime.SetMilliSeconds(localAnimationTime);
+	fbxFrameTime.SetMilliSeconds(timeInMs);
 
 	_buildMatrices(fbxFrameTime);
 }
@@ -105,26 +570,60 @@ void ModelLoader::_buildMatrices(
 	}
 
 	// Set the matrices that change by time and animation keys.
-	_loadNodeLocalTransformMatrices(fbxFrameTime);
+	if (!m_compressedClipVector.empty())
+	{
+		_sampleCompressedClip(*m_compressedClipVector[0], static_cast<float>(fbxFrameTime.GetSecondDouble()));
+	}
+	else if (!m_clipVector.empty())
+	{
+		_sampleClip(m_clipVector[0], static_cast<float>(fbxFrameTime.GetSecondDouble()));
+	}
+	else
+	{
+		// The scene keeps the take on its own time line.
+		_loadNodeLocalTransformMatrices(m_animationStartTime + fbxFrameTime);
+	}
 
 	// Propagate the local transform matrices from parent to child.
 	_calculateCombinedTransforms();
 
 	// This is the final pass that prepends the offset matrix.
 	_calculatePaletteMatrices();
+
+	m_skippedBoneCount = 0;
+
+	if (m_staticBonesPosed)
+	{
+		for (size_t level = 0; level < m_skeleton.posedEndVector.size(); ++level)
+		{
+			m_skippedBoneCount += m_skeleton.levelStartVector[level + 1] - m_skeleton.posedEndVector[level];
+		}
+	}
+
+	m_staticBonesPosed = true;
 }
 
 void ModelLoader::_loadModel()
 {
-	std::ifstream file(m_filename.c_str(), std::ios::binary | std::ios::ate);
-	size_t fileSize = (size_t)file.tellg();
-	file.seekg(0, std::ios::beg);
+	// The cached meshes, skeleton and clips replace the import below, if
+	// they were built from this version of the file.
+	m_sourceHash = _getSourceHash();
+	m_modelCacheLoaded = m_loadSettings.useModelCache && _loadModelCache(m_sourceHash);
 
-	std::vector<unsigned char> buffer;
+	if (m_modelCacheLoaded && m_loadSettings.bakeClips)
+	{
+		// The clips drive the bones, nothing is left to read from the scene.
+		m_loadComplete.store(true);
+		return;
+	}
 
-	buffer.resize(size_t(fileSize), 0);
+	// Mapped rather than read into the load arena, which a progressive
+	// load keeps until finishLoad(). The scene holds everything once the
+	// import returns, so the file goes right after it.
+	tMappedFile sourceFile;
+	const bool sourceOpened = sourceFile.open(m_filename.c_str());
 
-	assert(file.read((char*)buffer.data(), fileSize));
+	assert(sourceOpened);
 
 	//Create an FBX scene. This object holds the object imported from a file.
 	m_scenePtr = FbxScene::Create(m_sdkManagerPtr, m_filename.c_str());
@@ -132,7 +631,7 @@ void ModelLoader::_loadModel()
 	assert(nullptr != m_scenePtr);
 
 	FbxIOPluginRegistry* fbxIoPluginRegistry = m_sdkManagerPtr->GetIOPluginRegistry();
-	tAutodeskMemoryStream stream = tAutodeskMemoryStream((char*)buffer.data(), fileSize, fbxIoPluginRegistry->FindReaderIDByExtension("fbx"));
+	tAutodeskMemoryStream stream = tAutodeskMemoryStream((char*)sourceFile.data(), static_cast<long>(sourceFile.size()), fbxIoPluginRegistry->FindReaderIDByExtension("fbx"));
 	fbxsdk::FbxImporter* importerPtr = FbxImporter::Create(m_sdkManagerPtr, "");
 
 	assert(nullptr != importerPtr);
@@ -140,6 +639,9 @@ void ModelLoader::_loadModel()
 	assert(importerPtr->Import(m_scenePtr));
 
 	importerPtr->GetFileVersion(m_majorFileVersion, m_minorFileVersion, m_revisionFileVersion);
+	importerPtr->Destroy();
+	importerPtr = nullptr;
+	sourceFile.close();
 
 	assert(m_scenePtr->GetSrcObjectCount<FbxConstraint>() == 0);
 
@@ -147,805 +649,4297 @@ void ModelLoader::_loadModel()
 
 	assert(nullptr != rootNodePtr);
 
-	FbxAxisSystem SceneAxisSystem = m_scenePtr->GetGlobalSettings().GetAxisSystem();
-	FbxAxisSystem OurAxisSystem(FbxAxisSystem::eYAxis, FbxAxisSystem::eParityOdd, FbxAxisSystem::eRightHanded);
-	if (SceneAxisSystem != OurAxisSystem)
-	{
-		OurAxisSystem.ConvertScene(m_scenePtr);
-	}
+	_loadSceneConversion();
+	_loadTextureNames();
 
-	FbxSystemUnit SceneSystemUnit = m_scenePtr->GetGlobalSettings().GetSystemUnit();
-	if (SceneSystemUnit.GetScaleFactor() != 1.0)
+	if (m_modelCacheLoaded)
 	{
-		// VERY IMPORTANT: NEED TO SCALE 
-		FbxSystemUnit OurSystemUnit(100);
-		OurSystemUnit.ConvertScene(m_scenePtr);
-	}
+		unsigned long boneIndex = 0;
 
-	// Convert mesh, NURBS and patch into triangle mesh
-	// DirectX desires triangles.
-	{
-		FbxGeometryConverter geometryConverter(m_sdkManagerPtr);
+		_bindCachedBones(m_scenePtr->GetRootNode(), boneIndex);
 
-		assert(geometryConverter.Triangulate(
-			m_scenePtr,
-			true,
-			false));
+		assert(boneIndex == m_boneVector.size());
 	}
+	else
+	{
+		// Convert mesh, NURBS and patch into triangle mesh
+		// DirectX desires triangles. The positions are read from the
+		// triangles too, so this stays in the first phase.
+		if (!m_loadSettings.nativeConversion)
+		{
+			FbxGeometryConverter geometryConverter(m_sdkManagerPtr);
 
-	_loadTextureNames();
-
-	_loadBones(m_scenePtr->GetRootNode(), kInvalidBoneIndex);
-	_loadMeshes(m_scenePtr->GetRootNode());
-
-	importerPtr->Destroy();
-	importerPtr = nullptr;
-}
+			assert(geometryConverter.Triangulate(
+				m_scenePtr,
+				true,
+				false));
+		}
 
-void ModelLoader::_loadTextureNames()
-{
-	const long lTextureCount = m_scenePtr->GetTextureCount();
-	for (long lTextureIndex = 0; lTextureIndex < lTextureCount; ++lTextureIndex)
-	{
-		FbxTexture* lTexture = m_scenePtr->GetTexture(lTextureIndex);
-		FbxFileTexture* lFileTexture = FbxCast<FbxFileTexture>(lTexture);
-		if (lFileTexture && !lFileTexture->GetUserDataPtr())
+		if (m_loadSettings.progressive)
 		{
-			std::string fileName = lFileTexture->GetFileName();
+			// Enough to place and cull the model, the rest is loaded in
+			// the background. The bones are only read back after
+			// finishLoad(), see getBoneIndex().
+			_loadMeshes(m_scenePtr->GetRootNode(), m_modelVector, true);
+			_mergeModelBounds();
+			m_positionsOnly = true;
+
+			m_loadTaskGroup.run([this]()
+			{
+				_loadBones(m_scenePtr->GetRootNode(), kInvalidBoneIndex);
+				_loadMeshes(m_scenePtr->GetRootNode(), m_pendingModelVector, false);
+				m_loadComplete.store(true);
+			});
+
+			return;
 		}
+
+		_loadBones(m_scenePtr->GetRootNode(), kInvalidBoneIndex);
+		_loadMeshes(m_scenePtr->GetRootNode(), m_modelVector, false);
+		_mergeModelBounds();
 	}
+
+	m_loadComplete.store(true);
 }
 
+std::string ModelLoader::_getModelCacheFilename()
+{
+	return m_filename + ".cache";
+}
 
-void ModelLoader::_loadBones(
-	FbxNode* nodePtr,
-	long parentBoneIndex)
+// The contents of the .fbx, a copy or a checkout that keeps the bytes keeps
+// the cache, an edit of the same size within the same second does not.
+// FNV-1a over 64 bit words, the multiply latency then comes once every
+// eight bytes, which keeps this well under the time of the import.
+unsigned long long ModelLoader::_getSourceHash()
 {
-	FbxNodeAttribute* pNodeAttribute = nodePtr->GetNodeAttribute();
-	long childCount = nodePtr->GetChildCount();
+	tMappedFile mappedFile;
 
-	if ((nullptr != pNodeAttribute)
-		&& (pNodeAttribute->GetAttributeType() == FbxNodeAttribute::eSkeleton))
+	if (!mappedFile.open(m_filename.c_str()))
 	{
-		_loadBone(
-			nodePtr,
-			parentBoneIndex);
-
-		parentBoneIndex = static_cast<long>(m_boneVector.size()) - 1;
+		return 0;
 	}
 
-	for (long lChildIndex = 0; lChildIndex < childCount; ++lChildIndex)
+	const unsigned char* data = mappedFile.data();
+	const size_t size = mappedFile.size();
+	const size_t wordCount = size / sizeof(std::uint64_t);
+	unsigned long long hash = hashBytes(&size, sizeof(size));
+
+	for (size_t i = 0; i < wordCount; ++i)
+	{
+		std::uint64_t word;
+
+		memcpy(&word, data + i * sizeof(word), sizeof(word));
+		hash ^= word;
+		hash *= 1099511628211ULL;
+	}
+
+	return hashBytes(data + wordCount * sizeof(std::uint64_t), size - wordCount * sizeof(std::uint64_t), hash);
+}
+
+unsigned long long ModelLoader::_getLoadSettingsHash()
+{
+	// Only the settings that change the cached data belong here.
+	unsigned long long hash = hashBytes(&m_loadSettings.weldEpsilon, sizeof(m_loadSettings.weldEpsilon));
+
+	hash = hashBytes(&m_loadSettings.nativeConversion, sizeof(m_loadSettings.nativeConversion), hash);
+	hash = hashBytes(&m_loadSettings.minimalImport, sizeof(m_loadSettings.minimalImport), hash);
+	hash = hashBytes(&m_loadSettings.optimizeVertexOrder, sizeof(m_loadSettings.optimizeVertexOrder), hash);
+	hash = hashBytes(&m_loadSettings.optimizeOverdraw, sizeof(m_loadSettings.optimizeOverdraw), hash);
+	hash = hashBytes(m_loadSettings.lodTriangleRatios, sizeof(m_loadSettings.lodTriangleRatios), hash);
+	hash = hashBytes(&m_loadSettings.partitionSkin, sizeof(m_loadSettings.partitionSkin), hash);
+	hash = hashBytes(&m_loadSettings.bucketInfluences, sizeof(m_loadSettings.bucketInfluences), hash);
+	hash = hashBytes(&m_loadSettings.pruneBones, sizeof(m_loadSettings.pruneBones), hash);
+	hash = hashBytes(&m_loadSettings.bakeClips, sizeof(m_loadSettings.bakeClips), hash);
+	hash = hashBytes(&m_loadSettings.compressClips, sizeof(m_loadSettings.compressClips), hash);
+	hash = hashBytes(&m_loadSettings.skipStaticBones, sizeof(m_loadSettings.skipStaticBones), hash);
+
+	if (m_loadSettings.partitionSkin)
+	{
+		hash = hashBytes(&m_boneMatrixVectorSize, sizeof(m_boneMatrixVectorSize), hash);
+	}
+
+	return hash;
+}
+
+void ModelLoader::_loadSceneConversion()
+{
+	FbxAxisSystem SceneAxisSystem = m_scenePtr->GetGlobalSettings().GetAxisSystem();
+	FbxAxisSystem OurAxisSystem(FbxAxisSystem::eYAxis, FbxAxisSystem::eParityOdd, FbxAxisSystem::eRightHanded);
+	FbxSystemUnit SceneSystemUnit = m_scenePtr->GetGlobalSettings().GetSystemUnit();
+	FbxSystemUnit OurSystemUnit(100);
+
+	m_axisConversion = MathHelper::Identity4x4();
+	m_unitScale = 1.0f;
+
+	if (!m_loadSettings.nativeConversion)
+	{
+		// The animation is still evaluated from the scene, so it has to be
+		// converted even when the meshes come from the cache.
+		if (SceneAxisSystem != OurAxisSystem)
+		{
+			OurAxisSystem.ConvertScene(m_scenePtr);
+		}
+
+		if (SceneSystemUnit.GetScaleFactor() != 1.0)
+		{
+			// VERY IMPORTANT: NEED TO SCALE 
+			OurSystemUnit.ConvertScene(m_scenePtr);
+		}
+
+		return;
+	}
+
+	// The same conversion as one matrix. The vertices and bind poses are
+	// converted while they are extracted, and the skeleton roots every frame.
+	if (SceneAxisSystem != OurAxisSystem)
+	{
+		FbxAMatrix sceneAxisMatrix;
+		FbxAMatrix ourAxisMatrix;
+
+		SceneAxisSystem.GetMatrix(sceneAxisMatrix);
+		OurAxisSystem.GetMatrix(ourAxisMatrix);
+
+		_fbxToMatrix(ourAxisMatrix.Inverse() * sceneAxisMatrix, m_axisConversion);
+	}
+
+	if (SceneSystemUnit.GetScaleFactor() != 1.0)
+	{
+		m_unitScale = static_cast<float>(SceneSystemUnit.GetConversionFactorTo(OurSystemUnit));
+	}
+}
+
+XMMATRIX ModelLoader::_getSceneConversion()
+{
+	return XMMatrixMultiply(
+		XMLoadFloat4x4(&m_axisConversion),
+		XMMatrixScaling(m_unitScale, m_unitScale, m_unitScale));
+}
+
+bool ModelLoader::_loadModelCache(
+	unsigned long long sourceHash)
+{
+	tMappedFile mappedFile;
+
+	if (!mappedFile.open(_getModelCacheFilename().c_str()))
+	{
+		return false;
+	}
+
+	tModelCacheReader reader(mappedFile.data(), mappedFile.size());
+	tModelCacheHeader header;
+
+	if ((!reader.read(&header, sizeof(header)))
+		|| (header.magic != kModelCacheMagic)
+		|| (header.version != kModelCacheVersion)
+		|| (header.sourceHash != sourceHash)
+		|| (header.settingsHash != _getLoadSettingsHash())
+		|| (header.verticeStride != sizeof(tSkinnedVertice))
+		|| (header.indexStride != sizeof(tVertexIndexVector::value_type)))
+	{
+		return false;
+	}
+
+	tModelVector modelVector(header.modelCount);
+	tBoneVector boneVector(header.boneCount);
+	tBoneIndexMap boneIndexMap;
+	std::vector<bool> animatedBoneVector(header.boneCount);
+	tAnimationClipVector clipVector(header.clipCount);
+	std::vector<std::string> clipNameVector;
+
+	for (auto& modelRec : modelVector)
+	{
+		tModelCacheMesh cacheMesh;
+
+		if (!reader.read(&cacheMesh, sizeof(cacheMesh)))
+		{
+			return false;
+		}
+
+		const char* meshName = static_cast<const char*>(reader.take(cacheMesh.meshNameLength));
+
+		if (nullptr == meshName)
+		{
+			return false;
+		}
+
+		modelRec.meshName.assign(meshName, cacheMesh.meshNameLength);
+		modelRec.materialNameVector.resize(cacheMesh.materialCount);
+
+		for (auto& materialName : modelRec.materialNameVector)
+		{
+			std::uint32_t materialNameLength;
+
+			if (!reader.read(&materialNameLength, sizeof(materialNameLength)))
+			{
+				return false;
+			}
+
+			const char* name = static_cast<const char*>(reader.take(materialNameLength));
+
+			if (nullptr == name)
+			{
+				return false;
+			}
+
+			materialName.assign(name, materialNameLength);
+		}
+
+		const size_t verticeByteSize = cacheMesh.verticeCount * sizeof(tSkinnedVertice);
+		const size_t indexByteSize = cacheMesh.indexCount * sizeof(tVertexIndexVector::value_type);
+		const size_t submeshByteSize = cacheMesh.submeshCount * sizeof(tModelCacheSubmesh);
+		const tSkinnedVertice* vertices = static_cast<const tSkinnedVertice*>(reader.take(verticeByteSize));
+		const tVertexIndexVector::value_type* indices = static_cast<const tVertexIndexVector::value_type*>(reader.take(indexByteSize));
+		const tModelCacheSubmesh* cacheSubmeshes = static_cast<const tModelCacheSubmesh*>(reader.take(submeshByteSize));
+
+		if ((nullptr == vertices)
+			|| (nullptr == indices)
+			|| (nullptr == cacheSubmeshes))
+		{
+			return false;
+		}
+
+		// Copied, one memcpy each. Packing rewrites and extends these
+		// vectors after the load, and the mapping closes on return.
+		modelRec.verticeVector.assign(vertices, vertices + cacheMesh.verticeCount);
+		modelRec.indexVector.assign(indices, indices + cacheMesh.indexCount);
+		modelRec.maxVertex = cacheMesh.maxVertex;
+		modelRec.minVertex = cacheMesh.minVertex;
+		modelRec.allByControlPoint = false;
+		modelRec.submeshVector.resize(cacheMesh.submeshCount);
+
+		for (std::uint32_t submeshIndex = 0; submeshIndex < cacheMesh.submeshCount; ++submeshIndex)
+		{
+			const tModelCacheSubmesh& cacheSubmesh = cacheSubmeshes[submeshIndex];
+			tSubmeshRec& submeshRec = modelRec.submeshVector[submeshIndex];
+			const std::uint32_t* palette = static_cast<const std::uint32_t*>(reader.take(cacheSubmesh.boneCount * sizeof(std::uint32_t)));
+
+			// In this order, the sum could wrap.
+			if ((cacheSubmesh.materialIndex >= cacheMesh.materialCount)
+				|| (cacheSubmesh.startIndex > cacheMesh.indexCount)
+				|| (cacheSubmesh.indexCount > cacheMesh.indexCount - cacheSubmesh.startIndex)
+				|| (nullptr == palette))
+			{
+				return false;
+			}
+
+			submeshRec.materialIndex = cacheSubmesh.materialIndex;
+			submeshRec.startIndex = cacheSubmesh.startIndex;
+			submeshRec.indexCount = cacheSubmesh.indexCount;
+			submeshRec.boneIndexVector.assign(palette, palette + cacheSubmesh.boneCount);
+		}
+
+		if (cacheMesh.lodCount > kMaxLodCount)
+		{
+			return false;
+		}
+
+		modelRec.lodVector.resize(cacheMesh.lodCount);
+
+		for (auto& lodRec : modelRec.lodVector)
+		{
+			tModelCacheLod cacheLod;
+
+			if (!reader.read(&cacheLod, sizeof(cacheLod)))
+			{
+				return false;
+			}
+
+			const tVertexIndexVector::value_type* lodIndices = static_cast<const tVertexIndexVector::value_type*>(
+				reader.take(cacheLod.indexCount * sizeof(tVertexIndexVector::value_type)));
+			const std::uint32_t* submeshStarts = static_cast<const std::uint32_t*>(
+				reader.take((size_t(cacheMesh.submeshCount) + 1) * sizeof(std::uint32_t)));
+
+			if ((nullptr == lodIndices)
+				|| (nullptr == submeshStarts))
+			{
+				return false;
+			}
+
+			lodRec.indexVector.assign(lodIndices, lodIndices + cacheLod.indexCount);
+			lodRec.submeshStartVector.assign(submeshStarts, submeshStarts + size_t(cacheMesh.submeshCount) + 1);
+			lodRec.error = cacheLod.error;
+		}
+	}
+
+	for (unsigned long boneIndex = 0; boneIndex < boneVector.size(); ++boneIndex)
+	{
+		tBone& bone = boneVector[boneIndex];
+		tModelCacheBone cacheBone;
+
+		if (!reader.read(&cacheBone, sizeof(cacheBone)))
+		{
+			return false;
+		}
+
+		const char* name = static_cast<const char*>(reader.take(cacheBone.nameLength));
+
+		if ((nullptr == name)
+			|| (cacheBone.parentIndex < kInvalidBoneIndex)
+			|| (cacheBone.parentIndex >= static_cast<std::int32_t>(boneIndex)))
+		{
+			return false;
+		}
+
+		bone.namePtr = _internBoneName(boneIndexMap, std::string(name, cacheBone.nameLength).c_str(), boneIndex);
+		bone.parentIndex = cacheBone.parentIndex;
+		bone.offset = cacheBone.offset;
+		bone.nodeLocalTransform = cacheBone.nodeLocalTransform;
+		bone.collapsedTransform = cacheBone.collapsedTransform;
+		bone.boneNodePtr = nullptr;
+		bone.fbxSkeletonPtr = nullptr;
+		bone.fbxClusterPtr = nullptr;
+		animatedBoneVector[boneIndex] = (0 != cacheBone.animated);
+	}
+
+	for (std::uint32_t aliasIndex = 0; aliasIndex < header.boneAliasCount; ++aliasIndex)
+	{
+		tModelCacheBoneAlias cacheAlias;
+
+		if (!reader.read(&cacheAlias, sizeof(cacheAlias)))
+		{
+			return false;
+		}
+
+		const char* name = static_cast<const char*>(reader.take(cacheAlias.nameLength));
+
+		if ((nullptr == name)
+			|| (cacheAlias.boneIndex >= header.boneCount))
+		{
+			return false;
+		}
+
+		boneIndexMap.emplace(std::string(name, cacheAlias.nameLength), static_cast<long>(cacheAlias.boneIndex));
+	}
+
+	for (auto& clipRec : clipVector)
+	{
+		tModelCacheClip cacheClip;
+
+		if (!reader.read(&cacheClip, sizeof(cacheClip)))
+		{
+			return false;
+		}
+
+		const char* name = static_cast<const char*>(reader.take(cacheClip.nameLength));
+		const tBoneKey* keys = static_cast<const tBoneKey*>(reader.take(cacheClip.keyCount * sizeof(tBoneKey)));
+
+		if ((nullptr == name)
+			|| (nullptr == keys)
+			|| (cacheClip.keyCount != (m_loadSettings.compressClips ? 0 : cacheClip.frameCount * header.boneCount)))
+		{
+			return false;
+		}
+
+		clipRec.name.assign(name, cacheClip.nameLength);
+		clipNameVector.push_back(clipRec.name);
+		clipRec.frameRate = cacheClip.frameRate;
+		clipRec.duration = cacheClip.duration;
+		clipRec.frameCount = cacheClip.frameCount;
+		clipRec.keyVector.assign(keys, keys + cacheClip.keyCount);
+	}
+
+	if (!reader.atEnd())
+	{
+		return false;
+	}
+
+	// The compressed keys are in the clip files, a load without them
+	// has to bake the clips again.
+	if (m_loadSettings.bakeClips
+		&& m_loadSettings.compressClips
+		&& !_loadCompressedClips(clipNameVector, boneVector.size()))
+	{
+		return false;
+	}
+
+	m_modelVector.swap(modelVector);
+	m_boneVector.swap(boneVector);
+	m_boneIndexMap.swap(boneIndexMap);
+	m_animatedBoneVector.swap(animatedBoneVector);
+	maxVertex = header.maxVertex;
+	minVertex = header.minVertex;
+	m_axisConversion = header.axisConversion;
+	m_unitScale = header.unitScale;
+	m_initialAnimationDurationInMs = header.animationDurationInMs;
+	m_clipNameVector.swap(clipNameVector);
+
+	if (!m_loadSettings.compressClips)
+	{
+		m_clipVector.swap(clipVector);
+	}
+
+	return true;
+}
+
+void ModelLoader::_saveModelCache(
+	const ModelLoader::tModelVector& modelVector,
+	unsigned long long sourceHash)
+{
+	std::ofstream file(_getModelCacheFilename().c_str(), std::ios::binary | std::ios::trunc);
+
+	if (!file)
+	{
+		return;
+	}
+
+	tModelCacheHeader header = {};
+
+	header.magic = kModelCacheMagic;
+	header.version = kModelCacheVersion;
+	header.sourceHash = sourceHash;
+	header.settingsHash = _getLoadSettingsHash();
+	header.verticeStride = sizeof(tSkinnedVertice);
+	header.indexStride = sizeof(tVertexIndexVector::value_type);
+	header.modelCount = static_cast<std::uint32_t>(modelVector.size());
+	header.boneCount = static_cast<std::uint32_t>(m_boneVector.size());
+
+	// Names in the map that no bone owns belong to pruned bones, sorted
+	// so the same load writes the same cache.
+	std::vector<const tBoneIndexMap::value_type*> aliasVector;
+
+	for (const auto& entry : m_boneIndexMap)
+	{
+		if (m_boneVector[entry.second].namePtr != &entry.first)
+		{
+			aliasVector.push_back(&entry);
+		}
+	}
+
+	std::sort(aliasVector.begin(), aliasVector.end(), [](const tBoneIndexMap::value_type* a, const tBoneIndexMap::value_type* b)
+	{
+		return a->first < b->first;
+	});
+
+	header.boneAliasCount = static_cast<std::uint32_t>(aliasVector.size());
+	header.clipCount = static_cast<std::uint32_t>(m_loadSettings.compressClips ? m_compressedClipVector.size() : m_clipVector.size());
+	header.maxVertex = maxVertex;
+	header.minVertex = minVertex;
+	header.axisConversion = m_axisConversion;
+	header.unitScale = m_unitScale;
+	header.animationDurationInMs = m_initialAnimationDurationInMs;
+
+	writeModelCacheBlock(file, &header, sizeof(header));
+
+	for (const auto& modelRec : modelVector)
+	{
+		tModelCacheMesh cacheMesh = {};
+
+		cacheMesh.materialCount = static_cast<std::uint32_t>(modelRec.materialNameVector.size());
+		cacheMesh.meshNameLength = static_cast<std::uint32_t>(modelRec.meshName.size());
+		cacheMesh.verticeCount = static_cast<std::uint32_t>(modelRec.verticeVector.size());
+		cacheMesh.indexCount = static_cast<std::uint32_t>(modelRec.indexVector.size());
+		cacheMesh.submeshCount = static_cast<std::uint32_t>(modelRec.submeshVector.size());
+		cacheMesh.lodCount = static_cast<std::uint32_t>(modelRec.lodVector.size());
+		cacheMesh.maxVertex = modelRec.maxVertex;
+		cacheMesh.minVertex = modelRec.minVertex;
+
+		writeModelCacheBlock(file, &cacheMesh, sizeof(cacheMesh));
+		writeModelCacheBlock(file, modelRec.meshName.data(), modelRec.meshName.size());
+
+		for (const auto& materialName : modelRec.materialNameVector)
+		{
+			const std::uint32_t materialNameLength = static_cast<std::uint32_t>(materialName.size());
+
+			writeModelCacheBlock(file, &materialNameLength, sizeof(materialNameLength));
+			writeModelCacheBlock(file, materialName.data(), materialName.size());
+		}
+
+		std::vector<tModelCacheSubmesh> cacheSubmeshes(modelRec.submeshVector.size());
+
+		for (size_t submeshIndex = 0; submeshIndex < cacheSubmeshes.size(); ++submeshIndex)
+		{
+			cacheSubmeshes[submeshIndex].materialIndex = modelRec.submeshVector[submeshIndex].materialIndex;
+			cacheSubmeshes[submeshIndex].startIndex = modelRec.submeshVector[submeshIndex].startIndex;
+			cacheSubmeshes[submeshIndex].indexCount = modelRec.submeshVector[submeshIndex].indexCount;
+			cacheSubmeshes[submeshIndex].boneCount = m_loadSettings.partitionSkin
+				? static_cast<std::uint32_t>(modelRec.submeshVector[submeshIndex].boneIndexVector.size())
+				: 0;
+		}
+
+		writeModelCacheBlock(file, modelRec.verticeVector.data(), modelRec.verticeVector.size() * sizeof(tSkinnedVertice));
+		writeModelCacheBlock(file, modelRec.indexVector.data(), modelRec.indexVector.size() * sizeof(tVertexIndexVector::value_type));
+		writeModelCacheBlock(file, cacheSubmeshes.data(), cacheSubmeshes.size() * sizeof(tModelCacheSubmesh));
+
+		for (size_t submeshIndex = 0; submeshIndex < cacheSubmeshes.size(); ++submeshIndex)
+		{
+			writeModelCacheBlock(
+				file,
+				modelRec.submeshVector[submeshIndex].boneIndexVector.data(),
+				cacheSubmeshes[submeshIndex].boneCount * sizeof(std::uint32_t));
+		}
+
+		for (const auto& lodRec : modelRec.lodVector)
+		{
+			tModelCacheLod cacheLod = {};
+
+			cacheLod.indexCount = static_cast<std::uint32_t>(lodRec.indexVector.size());
+			cacheLod.error = lodRec.error;
+
+			writeModelCacheBlock(file, &cacheLod, sizeof(cacheLod));
+			writeModelCacheBlock(file, lodRec.indexVector.data(), lodRec.indexVector.size() * sizeof(tVertexIndexVector::value_type));
+			writeModelCacheBlock(file, lodRec.submeshStartVector.data(), lodRec.submeshStartVector.size() * sizeof(std::uint32_t));
+		}
+	}
+
+	for (size_t boneIndex = 0; boneIndex < m_boneVector.size(); ++boneIndex)
+	{
+		const tBone& bone = m_boneVector[boneIndex];
+		tModelCacheBone cacheBone = {};
+
+		cacheBone.parentIndex = bone.parentIndex;
+		cacheBone.nameLength = static_cast<std::uint32_t>(bone.namePtr->size());
+		cacheBone.animated = m_animatedBoneVector[boneIndex] ? 1 : 0;
+		cacheBone.offset = bone.offset;
+		cacheBone.nodeLocalTransform = bone.nodeLocalTransform;
+		cacheBone.collapsedTransform = bone.collapsedTransform;
+
+		writeModelCacheBlock(file, &cacheBone, sizeof(cacheBone));
+		writeModelCacheBlock(file, bone.namePtr->data(), bone.namePtr->size());
+	}
+
+	for (const auto* alias : aliasVector)
+	{
+		tModelCacheBoneAlias cacheAlias = {};
+
+		cacheAlias.boneIndex = static_cast<std::uint32_t>(alias->second);
+		cacheAlias.nameLength = static_cast<std::uint32_t>(alias->first.size());
+
+		writeModelCacheBlock(file, &cacheAlias, sizeof(cacheAlias));
+		writeModelCacheBlock(file, alias->first.data(), alias->first.size());
+	}
+
+	for (std::uint32_t clipIndex = 0; clipIndex < header.clipCount; ++clipIndex)
+	{
+		tModelCacheClip cacheClip = {};
+		const std::string& name = m_clipNameVector[clipIndex];
+
+		if (m_loadSettings.compressClips)
+		{
+			cacheClip.frameCount = static_cast<std::uint32_t>(m_compressedClipVector[clipIndex]->frameCount());
+			cacheClip.frameRate = m_compressedClipVector[clipIndex]->frameRate();
+			cacheClip.duration = m_compressedClipVector[clipIndex]->duration();
+		}
+		else
+		{
+			const tAnimationClipRec& clipRec = m_clipVector[clipIndex];
+
+			cacheClip.frameCount = clipRec.frameCount;
+			cacheClip.keyCount = static_cast<std::uint32_t>(clipRec.keyVector.size());
+			cacheClip.frameRate = clipRec.frameRate;
+			cacheClip.duration = clipRec.duration;
+		}
+
+		cacheClip.nameLength = static_cast<std::uint32_t>(name.size());
+
+		writeModelCacheBlock(file, &cacheClip, sizeof(cacheClip));
+		writeModelCacheBlock(file, name.data(), name.size());
+
+		if (!m_loadSettings.compressClips)
+		{
+			writeModelCacheBlock(file, m_clipVector[clipIndex].keyVector.data(), m_clipVector[clipIndex].keyVector.size() * sizeof(tBoneKey));
+		}
+	}
+
+	if (!file)
+	{
+		// Never leave a partial cache behind.
+		file.close();
+		remove(_getModelCacheFilename().c_str());
+	}
+}
+
+// The cached bones were saved in the same depth first order _loadBones uses,
+// so walking the scene again hands out their nodes in order. Pruned bones
+// are missing from the cache, a node only binds when it has the name of
+// the next cached bone.
+void ModelLoader::_bindCachedBones(
+	FbxNode* nodePtr,
+	unsigned long& boneIndex)
+{
+	FbxNodeAttribute* pNodeAttribute = nodePtr->GetNodeAttribute();
+	long childCount = nodePtr->GetChildCount();
+
+	if ((nullptr != pNodeAttribute)
+		&& (pNodeAttribute->GetAttributeType() == FbxNodeAttribute::eSkeleton)
+		&& (boneIndex < m_boneVector.size()))
+	{
+		tBone& bone = m_boneVector[boneIndex];
+
+		if (*bone.namePtr == pNodeAttribute->GetName())
+		{
+			bone.boneNodePtr = nodePtr;
+			bone.fbxSkeletonPtr = (FbxSkeleton*)pNodeAttribute;
+
+			++boneIndex;
+		}
+		else
+		{
+			assert(m_loadSettings.pruneBones);
+		}
+	}
+
+	for (long lChildIndex = 0; lChildIndex < childCount; ++lChildIndex)
+	{
+		_bindCachedBones(nodePtr->GetChild(lChildIndex), boneIndex);
+	}
+}
+
+void ModelLoader::_loadTextureNames()
+{
+	const long lTextureCount = m_scenePtr->GetTextureCount();
+	for (long lTextureIndex = 0; lTextureIndex < lTextureCount; ++lTextureIndex)
+	{
+		FbxTexture* lTexture = m_scenePtr->GetTexture(lTextureIndex);
+		FbxFileTexture* lFileTexture = FbxCast<FbxFileTexture>(lTexture);
+		if (lFileTexture && !lFileTexture->GetUserDataPtr())
+		{
+			std::string fileName = lFileTexture->GetFileName();
+		}
+	}
+}
+
+
+void ModelLoader::_loadBones(
+	FbxNode* nodePtr,
+	long parentBoneIndex)
+{
+	FbxNodeAttribute* pNodeAttribute = nodePtr->GetNodeAttribute();
+	long childCount = nodePtr->GetChildCount();
+
+	if ((nullptr != pNodeAttribute)
+		&& (pNodeAttribute->GetAttributeType() == FbxNodeAttribute::eSkeleton))
+	{
+		_loadBone(
+			nodePtr,
+			parentBoneIndex);
+
+		parentBoneIndex = static_cast<long>(m_boneVector.size()) - 1;
+	}
+
+	for (long lChildIndex = 0; lChildIndex < childCount; ++lChildIndex)
+	{
+		_loadBones(nodePtr->GetChild(lChildIndex), parentBoneIndex);
+	}
+}
+
+void ModelLoader::_loadBone(
+	FbxNode* nodePtr,
+	long parentBoneIndex)
+{
+	tBone dummy;
+
+	m_boneVector.push_back(dummy);
+
+	tBone& back = m_boneVector.back();
+
+	back.boneNodePtr = nodePtr;
+	back.fbxSkeletonPtr = (FbxSkeleton*)nodePtr->GetNodeAttribute();
+	back.fbxClusterPtr = nullptr;
+	back.namePtr = _internBoneName(m_boneIndexMap, back.fbxSkeletonPtr->GetName(), static_cast<long>(m_boneVector.size() - 1));
+	back.parentIndex = parentBoneIndex;
+
+	back.offset = MathHelper::Identity4x4();
+	back.collapsedTransform = MathHelper::Identity4x4();
+
+	// Get our local transform at time 0.
+	_getNodeLocalTransform(nodePtr, back.nodeLocalTransform);
+}
+
+void ModelLoader::_getNodeLocalTransform(
+	FbxNode* nodePtr,
+	DirectX::XMFLOAT4X4& matrix)
+{
+	FbxAMatrix fbxMatrix = m_scenePtr->GetAnimationEvaluator()->GetNodeLocalTransform(nodePtr);
+
+	_fbxToMatrix(fbxMatrix, matrix);
+}
+
+void ModelLoader::_getNodeLocalTransform(
+	FbxNode* nodePtr,
+	const FbxTime& fbxTime,
+	DirectX::XMFLOAT4X4& matrix)
+{
+	FbxAMatrix fbxMatrix = m_scenePtr->GetAnimationEvaluator()->GetNodeLocalTransform(nodePtr, fbxTime);
+
+	_fbxToMatrix(fbxMatrix, matrix);
+}
+
+void ModelLoader::_fbxToMatrix(
+	const FbxAMatrix& fbxMatrix,
+	DirectX::XMFLOAT4X4& matrix)
+{
+	for (unsigned long i = 0; i < 4; ++i)
+	{
+		matrix(i, 0) = (float)fbxMatrix.Get(i, 0);
+		matrix(i, 1) = (float)fbxMatrix.Get(i, 1);
+		matrix(i, 2) = (float)fbxMatrix.Get(i, 2);
+		matrix(i, 3) = (float)fbxMatrix.Get(i, 3);
+	}
+}
+
+
+// True when a layer of any animation stack has a curve on the local
+// translation, rotation or scaling of the node.
+bool ModelLoader::_isNodeAnimated(
+	FbxNode* nodePtr)
+{
+	const int animStackCount = m_scenePtr->GetSrcObjectCount<FbxAnimStack>();
+
+	for (int animStackIndex = 0; animStackIndex < animStackCount; ++animStackIndex)
+	{
+		FbxAnimStack* animStackPtr = m_scenePtr->GetSrcObject<FbxAnimStack>(animStackIndex);
+		const int animLayerCount = animStackPtr->GetMemberCount<FbxAnimLayer>();
+
+		for (int animLayerIndex = 0; animLayerIndex < animLayerCount; ++animLayerIndex)
+		{
+			FbxAnimLayer* animLayerPtr = animStackPtr->GetMember<FbxAnimLayer>(animLayerIndex);
+
+			if ((nullptr != nodePtr->LclTranslation.GetCurveNode(animLayerPtr))
+				|| (nullptr != nodePtr->LclRotation.GetCurveNode(animLayerPtr))
+				|| (nullptr != nodePtr->LclScaling.GetCurveNode(animLayerPtr)))
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+// True when no curve of the stack moves the local translation, rotation
+// or scaling of the node. Keys have to share their value, and cubic ones
+// must have flat tangents so nothing overshoots in between.
+bool ModelLoader::_isNodeConstant(
+	FbxNode* nodePtr,
+	FbxAnimStack* animStackPtr)
+{
+	FbxPropertyT<FbxDouble3>* properties[] = { &nodePtr->LclTranslation, &nodePtr->LclRotation, &nodePtr->LclScaling };
+	const int animLayerCount = animStackPtr->GetMemberCount<FbxAnimLayer>();
+
+	for (int animLayerIndex = 0; animLayerIndex < animLayerCount; ++animLayerIndex)
+	{
+		FbxAnimLayer* animLayerPtr = animStackPtr->GetMember<FbxAnimLayer>(animLayerIndex);
+
+		for (auto propertyPtr : properties)
+		{
+			FbxAnimCurveNode* curveNodePtr = propertyPtr->GetCurveNode(animLayerPtr);
+
+			if (nullptr == curveNodePtr)
+			{
+				continue;
+			}
+
+			for (unsigned int channel = 0; channel < curveNodePtr->GetChannelsCount(); ++channel)
+			{
+				for (int curveIndex = 0; curveIndex < curveNodePtr->GetCurveCount(channel); ++curveIndex)
+				{
+					FbxAnimCurve* curvePtr = curveNodePtr->GetCurve(channel, curveIndex);
+					const int keyCount = curvePtr->KeyGetCount();
+
+					for (int keyIndex = 0; keyIndex < keyCount; ++keyIndex)
+					{
+						if ((curvePtr->KeyGetValue(keyIndex) != curvePtr->KeyGetValue(0))
+							|| ((curvePtr->KeyGetInterpolation(keyIndex) == FbxAnimCurveDef::eInterpolationCubic)
+								&& ((curvePtr->KeyGetLeftDerivative(keyIndex) != 0.0f)
+									|| (curvePtr->KeyGetRightDerivative(keyIndex) != 0.0f))))
+						{
+							return false;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+// Flags the bones the played take moves, see _findFirstTake().
+void ModelLoader::_findStaticBones()
+{
+	const size_t boneCount = m_boneVector.size();
+
+	m_staticBonesPosed = false;
+	m_skippedBoneCount = 0;
+
+	if (nullptr == m_scenePtr)
+	{
+		// Read from the model cache.
+		assert(m_animatedBoneVector.size() == boneCount);
+		return;
+	}
+
+	m_animatedBoneVector.assign(boneCount, true);
+
+	if (!m_loadSettings.skipStaticBones)
+	{
+		return;
+	}
+
+	FbxAnimStack* animStackPtr = nullptr;
+	FbxTakeInfo* takeInfoPtr = nullptr;
+
+	if (!_findFirstTake(animStackPtr, takeInfoPtr))
+	{
+		return;
+	}
+
+	for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+	{
+		m_animatedBoneVector[boneIndex] = !_isNodeConstant(m_boneVector[boneIndex].boneNodePtr, animStackPtr);
+	}
+}
+
+// The first frame builds every bone, the static ones keep that pose.
+bool ModelLoader::_isBoneAnimated(
+	size_t boneIndex)
+{
+	return !m_staticBonesPosed || m_animatedBoneVector[boneIndex];
+}
+
+size_t ModelLoader::_getPosedSlotEnd(
+	size_t level)
+{
+	return m_staticBonesPosed ? m_skeleton.posedEndVector[level] : m_skeleton.levelStartVector[level + 1];
+}
+
+// A bone stays when a vertex is weighted to it, or when it animates and a
+// descendant stays. Static bones above a kept one fold their local
+// transform into its collapsedTransform, everything else is dropped.
+// The kept bones stay in depth first order.
+void ModelLoader::_pruneBones(
+	ModelLoader::tLoadVerticeVectorList& loadVerticeVectorList)
+{
+	m_prunedBoneCount = 0;
+
+	if (!m_loadSettings.pruneBones || m_boneVector.empty())
+	{
+		return;
+	}
+
+	const size_t boneCount = m_boneVector.size();
+	std::vector<bool> deformVector(boneCount, false);
+
+	for (const auto& loadVerticeVector : loadVerticeVectorList)
+	{
+		for (const auto& vertice : loadVerticeVector)
+		{
+			tPackedInt boneWeights;
+
+			boneWeights.number = vertice.boneWeights;
+
+			for (unsigned long i = 0; i < kBoneInfluencesPerVertice; ++i)
+			{
+				if (boneWeights.bytes[i] != 0)
+				{
+					deformVector[vertice.boneIndices[i]] = true;
+				}
+			}
+		}
+	}
+
+	// Children come after their parent, walking backwards sees every
+	// descendant of a bone before the bone itself.
+	std::vector<bool> neededVector(deformVector);
+
+	for (size_t boneIndex = boneCount; boneIndex-- > 0;)
+	{
+		const int parentIndex = m_boneVector[boneIndex].parentIndex;
+
+		if (neededVector[boneIndex] && (parentIndex != kInvalidBoneIndex))
+		{
+			neededVector[parentIndex] = true;
+		}
+	}
+
+	std::vector<long> newBoneForOldBone(boneCount, kInvalidBoneIndex);
+	tMatrixVector collapsedTransformVector(boneCount, MathHelper::Identity4x4());
+	tBoneVector newBoneVector;
+	tBoneIndexMap newBoneIndexMap;
+
+	for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+	{
+		const tBone& bone = m_boneVector[boneIndex];
+
+		// Every parent is either kept or points at its closest kept
+		// ancestor.
+		const long parentIndex = bone.parentIndex;
+		const long newParentIndex = (parentIndex != kInvalidBoneIndex)
+			? newBoneForOldBone[parentIndex]
+			: static_cast<long>(kInvalidBoneIndex);
+
+		if (!neededVector[boneIndex])
+		{
+			newBoneForOldBone[boneIndex] = newParentIndex;
+
+			continue;
+		}
+
+		// Stays identity for kept bones.
+		const XMFLOAT4X4 parentCollapsedTransform = (parentIndex != kInvalidBoneIndex)
+			? collapsedTransformVector[parentIndex]
+			: MathHelper::Identity4x4();
+
+		if (!deformVector[boneIndex] && !_isNodeAnimated(bone.boneNodePtr))
+		{
+			XMMATRIX collapsedTransform = XMMatrixMultiply(
+				XMLoadFloat4x4(&bone.nodeLocalTransform),
+				XMLoadFloat4x4(&parentCollapsedTransform));
+
+			XMStoreFloat4x4(&collapsedTransformVector[boneIndex], collapsedTransform);
+			newBoneForOldBone[boneIndex] = newParentIndex;
+
+			continue;
+		}
+
+		const long newBoneIndex = static_cast<long>(newBoneVector.size());
+
+		newBoneVector.push_back(bone);
+
+		tBone& newBone = newBoneVector.back();
+
+		newBone.namePtr = _internBoneName(newBoneIndexMap, bone.namePtr->c_str(), newBoneIndex);
+		newBone.parentIndex = newParentIndex;
+		newBone.collapsedTransform = parentCollapsedTransform;
+		newBoneForOldBone[boneIndex] = newBoneIndex;
+	}
+
+	for (auto& loadVerticeVector : loadVerticeVectorList)
+	{
+		for (auto& vertice : loadVerticeVector)
+		{
+			tPackedInt boneWeights;
+
+			boneWeights.number = vertice.boneWeights;
+
+			for (unsigned long i = 0; i < kBoneInfluencesPerVertice; ++i)
+			{
+				vertice.boneIndices[i] = (boneWeights.bytes[i] != 0)
+					? static_cast<std::uint16_t>(newBoneForOldBone[vertice.boneIndices[i]])
+					: 0;
+			}
+		}
+	}
+
+	// Callers still look up the pruned bones by name, they resolve to the
+	// closest kept ancestor. The kept bones already hold their names, so
+	// this only adds the pruned ones.
+	for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+	{
+		if (newBoneForOldBone[boneIndex] != kInvalidBoneIndex)
+		{
+			newBoneIndexMap.emplace(*m_boneVector[boneIndex].namePtr, newBoneForOldBone[boneIndex]);
+		}
+	}
+
+	m_prunedBoneCount = boneCount - newBoneVector.size();
+	m_boneVector.swap(newBoneVector);
+	m_boneIndexMap.swap(newBoneIndexMap);
+}
+
+void ModelLoader::_collectMeshNodes(
+	FbxNode* nodePtr,
+	std::vector<FbxNode*>& meshNodes)
+{
+	FbxNodeAttribute* pNodeAttribute = nodePtr->GetNodeAttribute();
+	long childCount = nodePtr->GetChildCount();
+
+	if ((nullptr != pNodeAttribute)
+		&& (pNodeAttribute->GetAttributeType() == FbxNodeAttribute::eMesh))
+	{
+		meshNodes.push_back(nodePtr);
+	}
+
+	for (long lChildIndex = 0; lChildIndex < childCount; ++lChildIndex)
+	{
+		_collectMeshNodes(nodePtr->GetChild(lChildIndex), meshNodes);
+	}
+}
+
+void ModelLoader::_loadMeshes(
+	FbxNode* nodePtr,
+	ModelLoader::tModelVector& modelVector,
+	bool positionsOnly)
+{
+	std::vector<FbxNode*> meshNodes;
+
+	_collectMeshNodes(nodePtr, meshNodes);
+
+	// Every mesh gets its slot up front, so the output keeps scene order
+	// no matter which task finishes first.
+	const size_t firstModelIndex = modelVector.size();
+
+	modelVector.resize(firstModelIndex + meshNodes.size());
+
+	tLoadVerticeVectorList loadVerticeVectorList(
+		meshNodes.size(),
+		tLoadVerticeVector(m_loadArena),
+		m_loadArena);
+
+	// Geometry extraction only reads the scene.
+	concurrency::parallel_for(size_t(0), meshNodes.size(), [&](size_t meshIndex)
+	{
+		_loadMesh(
+			meshNodes[meshIndex],
+			modelVector[firstModelIndex + meshIndex],
+			loadVerticeVectorList[meshIndex],
+			positionsOnly);
+	});
+
+	if (positionsOnly)
+	{
+		// Nothing to weld on yet, the vertices are used as extracted.
+		concurrency::parallel_for(size_t(0), meshNodes.size(), [&](size_t meshIndex)
+		{
+			const tLoadVerticeVector& loadVerticeVector = loadVerticeVectorList[meshIndex];
+
+			modelVector[firstModelIndex + meshIndex].verticeVector.assign(loadVerticeVector.begin(), loadVerticeVector.end());
+		});
+
+		return;
+	}
+
+	// Skinning writes the offsets of the shared bones, keep it serial.
+	for (size_t meshIndex = 0; meshIndex < meshNodes.size(); ++meshIndex)
+	{
+		_loadMeshBoneWeightsAndIndices(
+			meshNodes[meshIndex],
+			modelVector[firstModelIndex + meshIndex],
+			loadVerticeVectorList[meshIndex]);
+	}
+
+	// Needs the weights of every mesh, and has to run before welding and
+	// partitioning read the bone indices.
+	_pruneBones(loadVerticeVectorList);
+
+	concurrency::parallel_for(size_t(0), meshNodes.size(), [&](size_t meshIndex)
+	{
+		_compressSkinnedVertices(modelVector[firstModelIndex + meshIndex], loadVerticeVectorList[meshIndex]);
+		_optimizeMesh(modelVector[firstModelIndex + meshIndex]);
+		_partitionSkin(modelVector[firstModelIndex + meshIndex]);
+		_generateLods(modelVector[firstModelIndex + meshIndex]);
+	});
+}
+
+void ModelLoader::_mergeModelBounds()
+{
+	XMVECTOR currMax = XMLoadFloat3(&maxVertex);
+	XMVECTOR currMin = XMLoadFloat3(&minVertex);
+
+	for (const auto& modelRec : m_modelVector)
+	{
+		currMax = XMVectorMax(currMax, XMLoadFloat3(&modelRec.maxVertex));
+		currMin = XMVectorMin(currMin, XMLoadFloat3(&modelRec.minVertex));
+	}
+
+	XMStoreFloat3(&maxVertex, currMax);
+	XMStoreFloat3(&minVertex, currMin);
+}
+
+void ModelLoader::_loadMesh(
+	FbxNode* nodePtr,
+	tModelRec& modelRec,
+	tLoadVerticeVector& loadVerticeVector,
+	bool positionsOnly)
+{
+	const long materialCount = nodePtr->GetMaterialCount();
+	FbxNodeAttribute* nodeAttributePtr = nodePtr->GetNodeAttribute();
+
+	modelRec.indexBufferPtr = nullptr;
+	modelRec.vertexBufferPtr = nullptr;
+
+	// Every polygon refers to one of these, a mesh without materials
+	// still gets one unnamed material.
+	modelRec.materialNameVector.assign(MathHelper::Max(materialCount, 1L), std::string());
+
+	for (long lMaterialIndex = 0; lMaterialIndex < materialCount; ++lMaterialIndex)
+	{
+		FbxSurfaceMaterial* lMaterial = nodePtr->GetMaterial(lMaterialIndex);
+		if (lMaterial)
+		{
+			modelRec.materialNameVector[lMaterialIndex] = lMaterial->GetName();
+		}
+	}
+
+	if (nullptr != nodeAttributePtr)
+	{
+		// Bake mesh as VBO(vertex buffer object) into GPU.
+		if (nodeAttributePtr->GetAttributeType() == FbxNodeAttribute::eMesh)
+		{
+			FbxMesh* meshPtr = nodePtr->GetMesh();
+			if (nullptr != meshPtr)
+			{
+				long boneCount = _getBoneCount(meshPtr);
+
+				modelRec.meshName = meshPtr->GetName();
+
+				_loadMeshPositionNormalUV(nodePtr, modelRec, loadVerticeVector, positionsOnly);
+
+				assert(_isMeshSkinned(meshPtr));
+
+				// Ensure our bone matrix vector size is large enough,
+				// partitions are made to fit it.
+				assert(m_loadSettings.partitionSkin || (m_boneMatrixVectorSize >= (unsigned int)boneCount));
+			}
+		}
+	}
+}
+
+long ModelLoader::_getBoneCount(
+	FbxMesh* meshPtr)
+{
+	if (meshPtr->GetDeformerCount(FbxDeformer::eSkin) == 0)
+	{
+		return 0;
+	}
+
+	return ((FbxSkin*)(meshPtr->GetDeformer(0, FbxDeformer::eSkin)))->GetClusterCount();
+}
+
+// Positions only leaves the normals and uvs zeroed, for the first phase
+// of a progressive load.
+void ModelLoader::_loadMeshPositionNormalUV(
+	FbxNode* nodePtr,
+	tModelRec& modelRec,
+	tLoadVerticeVector& loadVerticeVector,
+	bool positionsOnly)
+{
+	FbxMesh* meshPtr = nodePtr->GetMesh();
+
+	assert(m_loadSettings.minimalImport || (nullptr != meshPtr->GetElementMaterial()));
+	assert(meshPtr->GetElementNormalCount() > 0);
+	assert(meshPtr->GetElementUVCount() > 0);
+	assert(0 == meshPtr->GetDeformerCount(FbxDeformer::eBlendShape));
+	assert(0 == meshPtr->GetDeformerCount(FbxDeformer::eVertexCache));
+	assert(1 <= meshPtr->GetDeformerCount(FbxDeformer::eSkin));
+
+	FbxGeometryElementNormal* normalElementPtr = meshPtr->GetElementNormal(0);
+	FbxGeometryElementUV* uvElementPtr = meshPtr->GetElementUV(0);
+
+	assert(normalElementPtr->GetMappingMode() != FbxGeometryElement::eNone);
+	assert(uvElementPtr->GetMappingMode() != FbxGeometryElement::eNone);
+
+	const long polygonCount = meshPtr->GetPolygonCount();
+	const long controlPointCount = meshPtr->GetControlPointsCount();
+	const long cornerCount = meshPtr->GetPolygonVertexCount();
+
+	// The scene was triangulated before the meshes are loaded,
+	// unless the polygons are triangulated here.
+	assert(m_loadSettings.nativeConversion || (cornerCount == polygonCount * kTriangleVertexCount));
+
+	modelRec.allByControlPoint =
+		(normalElementPtr->GetMappingMode() == FbxGeometryElement::eByControlPoint)
+		&& (uvElementPtr->GetMappingMode() == FbxGeometryElement::eByControlPoint);
+
+	long polygonVertexCount = controlPointCount;
+
+	if (!modelRec.allByControlPoint)
+	{
+		polygonVertexCount = cornerCount;
+	}
+
+	// A polygon of n corners becomes n - 2 triangles. The triangles are
+	// grouped by material, and keep the polygon order inside a material.
+	const long materialCount = static_cast<long>(modelRec.materialNameVector.size());
+	FbxGeometryElementMaterial* materialElementPtr = meshPtr->GetElementMaterial(0);
+	tControlPointIndexes triangleOffsetVector(polygonCount, 0, m_loadArena);
+	tControlPointIndexes materialOffsetVector(materialCount + 1, 0, m_loadArena);
+
+	for (long polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+	{
+		const long polygonSize = meshPtr->GetPolygonSize(polygonIndex);
+		long materialIndex = 0;
+
+		assert(polygonSize >= kTriangleVertexCount);
+
+		if (nullptr != materialElementPtr)
+		{
+			const bool byPolygon = (materialElementPtr->GetMappingMode() == FbxGeometryElement::eByPolygon);
+
+			materialIndex = materialElementPtr->GetIndexArray().GetAt(byPolygon ? polygonIndex : 0);
+		}
+
+		if ((materialIndex < 0) || (materialIndex >= materialCount))
+		{
+			materialIndex = 0;
+		}
+
+		// Only the material for now, it becomes the offset below.
+		triangleOffsetVector[polygonIndex] = materialIndex;
+		materialOffsetVector[materialIndex + 1] += polygonSize - 2;
+	}
+
+	std::partial_sum(materialOffsetVector.begin(), materialOffsetVector.end(), materialOffsetVector.begin());
+
+	modelRec.submeshVector.clear();
+
+	for (long materialIndex = 0; materialIndex < materialCount; ++materialIndex)
+	{
+		if (materialOffsetVector[materialIndex + 1] == materialOffsetVector[materialIndex])
+		{
+			continue;
+		}
+
+		tSubmeshRec submeshRec;
+
+		submeshRec.materialIndex = static_cast<std::uint32_t>(materialIndex);
+		submeshRec.startIndex = static_cast<std::uint32_t>(materialOffsetVector[materialIndex] * kTriangleVertexCount);
+		submeshRec.indexCount = static_cast<std::uint32_t>((materialOffsetVector[materialIndex + 1] - materialOffsetVector[materialIndex]) * kTriangleVertexCount);
+		modelRec.submeshVector.push_back(submeshRec);
+	}
+
+	for (long polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+	{
+		const long materialIndex = triangleOffsetVector[polygonIndex];
+
+		triangleOffsetVector[polygonIndex] = materialOffsetVector[materialIndex];
+		materialOffsetVector[materialIndex] += meshPtr->GetPolygonSize(polygonIndex) - 2;
+	}
+
+	tSkinnedVertice emptyVertice;
+
+	ZeroMemory(&emptyVertice, sizeof(emptyVertice));
+
+	modelRec.indexVector.resize(materialOffsetVector[materialCount] * kTriangleVertexCount);
+	loadVerticeVector.resize(polygonVertexCount, emptyVertice);
+
+	const FbxVector4* controlPoints = meshPtr->GetControlPoints();
+	const int* polygonVertices = meshPtr->GetPolygonVertices();
+	const tLayerElementReader<FbxVector4> normalReader(normalElementPtr);
+	const tLayerElementReader<FbxVector2> uvReader(uvElementPtr);
+	const XMMATRIX pointConversion = _getSceneConversion();
+	const XMMATRIX normalConversion = XMLoadFloat4x4(&m_axisConversion);
+
+	// Vertices are split in chunks that each write their own range,
+	// and keep their own bounds until the chunks are combined.
+	const long chunkItemCount = modelRec.allByControlPoint ? controlPointCount : polygonCount;
+	const long chunkCount = (chunkItemCount + kPolygonChunkSize - 1) / kPolygonChunkSize;
+	std::vector<XMFLOAT3> chunkMaxVector(chunkCount);
+	std::vector<XMFLOAT3> chunkMinVector(chunkCount);
+
+	auto loadVertice = [&](
+		tSkinnedVertice& vertice,
+		long controlPointIndex,
+		long polygonVertexIndex,
+		long polygonIndex,
+		XMVECTOR& currMax,
+		XMVECTOR& currMin)
+	{
+		const FbxVector4& currentVertex = controlPoints[controlPointIndex];
+		XMVECTOR point = XMVectorSet(
+			static_cast<float>(currentVertex[0]),
+			static_cast<float>(currentVertex[1]),
+			static_cast<float>(currentVertex[2]),
+			1.0f);
+
+		if (m_loadSettings.nativeConversion)
+		{
+			point = XMVector3TransformCoord(point, pointConversion);
+		}
+
+		XMStoreFloat3(&(vertice.point), point);
+
+		currMax = XMVectorMax(currMax, point);
+		currMin = XMVectorMin(currMin, point);
+
+		if (positionsOnly)
+		{
+			return;
+		}
+
+		const FbxVector4& currentNormal = normalReader.get(controlPointIndex, polygonVertexIndex, polygonIndex);
+		XMVECTOR normal = XMVectorSet(
+			static_cast<float>(currentNormal[0]),
+			static_cast<float>(currentNormal[1]),
+			static_cast<float>(currentNormal[2]),
+			0.0f);
+
+		if (m_loadSettings.nativeConversion)
+		{
+			normal = XMVector3TransformNormal(normal, normalConversion);
+		}
+
+		XMStoreFloat3(&(vertice.normal), normal);
+
+		const FbxVector2& currentUV = uvReader.get(controlPointIndex, polygonVertexIndex, polygonIndex);
+
+		vertice.tex.x = static_cast<float>(currentUV[0]);
+
+		if (modelRec.allByControlPoint)
+		{
+			vertice.tex.y = static_cast<float>(currentUV[1]);
+		}
+		else
+		{
+			vertice.tex.y = 1.0f - static_cast<float>(currentUV[1]);
+		}
+	};
+
+	if (modelRec.allByControlPoint)
+	{
+		concurrency::parallel_for(0L, chunkCount, [&](long chunkIndex)
+		{
+			const long first = chunkIndex * kPolygonChunkSize;
+			const long last = MathHelper::Min(first + static_cast<long>(kPolygonChunkSize), controlPointCount);
+			XMVECTOR currMax = XMVectorReplicate(-MathHelper::Infinity);
+			XMVECTOR currMin = XMVectorReplicate(MathHelper::Infinity);
+
+			for (long controlPointIndex = first; controlPointIndex < last; ++controlPointIndex)
+			{
+				loadVertice(
+					loadVerticeVector[controlPointIndex],
+					controlPointIndex,
+					0,
+					0,
+					currMax,
+					currMin);
+			}
+
+			XMStoreFloat3(&chunkMaxVector[chunkIndex], currMax);
+			XMStoreFloat3(&chunkMinVector[chunkIndex], currMin);
+		});
+	}
+
+	// Polygons are triangulated in the same chunks, their corner vertices
+	// are loaded here too when they are not shared by control point.
+	concurrency::parallel_for(0L, (polygonCount + kPolygonChunkSize - 1) / kPolygonChunkSize, [&](long chunkIndex)
+	{
+		const long first = chunkIndex * kPolygonChunkSize;
+		const long last = MathHelper::Min(first + static_cast<long>(kPolygonChunkSize), polygonCount);
+		XMVECTOR currMax = XMVectorReplicate(-MathHelper::Infinity);
+		XMVECTOR currMin = XMVectorReplicate(MathHelper::Infinity);
+
+		for (long polygonIndex = first; polygonIndex < last; ++polygonIndex)
+		{
+			const long firstCorner = meshPtr->GetPolygonVertexIndex(polygonIndex);
+			const long polygonSize = meshPtr->GetPolygonSize(polygonIndex);
+			const long firstIndex = triangleOffsetVector[polygonIndex] * kTriangleVertexCount;
+			const long lastIndex = firstIndex + (polygonSize - 2) * kTriangleVertexCount;
+
+			triangulatePolygon(
+				controlPoints,
+				polygonVertices + firstCorner,
+				polygonSize,
+				modelRec.indexVector.data() + firstIndex);
+
+			// Change the polygon corner numbers, to vertex indexes.
+			for (long index = firstIndex; index < lastIndex; ++index)
+			{
+				const long polygonVertexIndex = firstCorner + static_cast<long>(modelRec.indexVector[index]);
+
+				if (modelRec.allByControlPoint)
+				{
+					modelRec.indexVector[index] = static_cast<tVertexIndex>(polygonVertices[polygonVertexIndex]);
+				}
+				else
+				{
+					modelRec.indexVector[index] = static_cast<tVertexIndex>(polygonVertexIndex);
+				}
+			}
+
+			if (modelRec.allByControlPoint)
+			{
+				continue;
+			}
+
+			for (long polygonVertexIndex = firstCorner; polygonVertexIndex < firstCorner + polygonSize; ++polygonVertexIndex)
+			{
+				loadVertice(
+					loadVerticeVector[polygonVertexIndex],
+					polygonVertices[polygonVertexIndex],
+					polygonVertexIndex,
+					polygonIndex,
+					currMax,
+					currMin);
+			}
+		}
+
+		if (!modelRec.allByControlPoint)
+		{
+			XMStoreFloat3(&chunkMaxVector[chunkIndex], currMax);
+			XMStoreFloat3(&chunkMinVector[chunkIndex], currMin);
+		}
+	});
+
+	XMVECTOR currMax = XMVectorReplicate(-MathHelper::Infinity);
+	XMVECTOR currMin = XMVectorReplicate(MathHelper::Infinity);
+
+	for (long chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex)
+	{
+		currMax = XMVectorMax(currMax, XMLoadFloat3(&chunkMaxVector[chunkIndex]));
+		currMin = XMVectorMin(currMin, XMLoadFloat3(&chunkMinVector[chunkIndex]));
+	}
+
+	XMStoreFloat3(&modelRec.maxVertex, currMax);
+	XMStoreFloat3(&modelRec.minVertex, currMin);
+}
+
+void ModelLoader::_getGeometryTransformMatrix(
+	FbxNode* nodePtr,
+	DirectX::XMFLOAT4X4& geometryOffsetMatrix)
+{
+	// Get the geometry offset to a node. It is never inherited by the children.
+	const FbxVector4 lT = nodePtr->GetGeometricTranslation(FbxNode::eSourcePivot);
+	const FbxVector4 lR = nodePtr->GetGeometricRotation(FbxNode::eSourcePivot);
+	const FbxVector4 lS = nodePtr->GetGeometricScaling(FbxNode::eSourcePivot);
+
+	FbxAMatrix fbxMatrix = FbxAMatrix(lT, lR, lS);
+
+	_fbxToMatrix(fbxMatrix, geometryOffsetMatrix);
+}
+
+bool ModelLoader::_isMeshSkinned(
+	FbxMesh* meshPtr)
+{
+	long boneCount = _getBoneCount(meshPtr);
+
+	return boneCount > 0;
+}
+
+void ModelLoader::_loadMeshBoneWeightsAndIndices(
+	FbxNode* nodePtr,
+	const tModelRec& modelRec,
+	tLoadVerticeVector& loadVerticeVector)
+{
+	FbxMesh* meshPtr = nodePtr->GetMesh();
+	DirectX::XMFLOAT4X4 geometryTransform;
+	tControlPointRemap controlPointRemap = { tControlPointIndexes(m_loadArena), tControlPointIndexes(m_loadArena) };
+
+	// maps control points to vertex indexes
+	_loadControlPointRemap(meshPtr, controlPointRemap);
+
+	// takes into account an offsetted model.
+	_getGeometryTransformMatrix(nodePtr, geometryTransform);
+
+	tBoneInfluences emptyInfluences;
+
+	ZeroMemory(&emptyInfluences, sizeof(emptyInfluences));
+
+	tBoneInfluencesVector boneInfluencesVector(
+		meshPtr->GetControlPointsCount(),
+		emptyInfluences,
+		m_loadArena);
+
+	// A deformer is a FBX thing, which contains some clusters
+	// A cluster contains a link, which is basically a joint
+	// Normally, there is only one deformer in a mesh
+	// We are using only skins, so we see if this is a skin
+	FbxSkin* currSkin = (FbxSkin*)(meshPtr->GetDeformer(0, FbxDeformer::eSkin));
+
+	long numberOfClusters = currSkin->GetClusterCount();
+	for (long clusterIndex = 0; clusterIndex < numberOfClusters; ++clusterIndex)
+	{
+		FbxCluster* clusterPtr = currSkin->GetCluster(clusterIndex);
+		long numOfIndices = clusterPtr->GetControlPointIndicesCount();
+		double* weightPtr = clusterPtr->GetControlPointWeights();
+		int* indicePtr = clusterPtr->GetControlPointIndices();
+
+		if (nullptr == clusterPtr->GetLink())
+		{
+			continue;
+		}
+
+		unsigned long boneIndex = _boneNameToindex(clusterPtr->GetLink()->GetName());
+		FbxAMatrix transformMatrix;
+		FbxAMatrix transformLinkMatrix;
+		FbxAMatrix globalBindposeInverseMatrix;
+
+		// Now that we have the clusterPtr, let's calculate the inverse bind pose matrix.
+		clusterPtr->GetTransformLinkMatrix(transformLinkMatrix);
+		clusterPtr->GetTransformMatrix(transformMatrix);
+		globalBindposeInverseMatrix = transformLinkMatrix.Inverse() * transformMatrix;
+		_fbxToMatrix(globalBindposeInverseMatrix, m_boneVector[boneIndex].offset);
+
+		if (m_loadSettings.nativeConversion)
+		{
+			// The vertices are already converted, take them back to the
+			// scene space before they are bound.
+			XMMATRIX offset = XMLoadFloat4x4(&m_boneVector[boneIndex].offset);
+			XMMATRIX inverseConversion = XMMatrixInverse(nullptr, _getSceneConversion());
+
+			XMStoreFloat4x4(&m_boneVector[boneIndex].offset, XMMatrixMultiply(inverseConversion, offset));
+		}
+
+		// Update the information in mSkeleton 
+		m_boneVector[boneIndex].fbxClusterPtr = clusterPtr;
+
+		// Associate each joint with the control points it affects
+		for (long i = 0; i < numOfIndices; ++i)
+		{
+			double weight = weightPtr[i];
+
+			if (weight == 0.0)
+			{
+				continue;
+			}
+
+			// Gathered per control point, every corner gets the same influences.
+			const int controlPointIndex = indicePtr[i];
+
+			assert(controlPointIndex < static_cast<int>(boneInfluencesVector.size()));
+
+			_addBoneInfluence(boneInfluencesVector[controlPointIndex], boneIndex, static_cast<float>(weight));
+		}
+	}
+
+	_packBoneInfluences(controlPointRemap, modelRec, boneInfluencesVector, loadVerticeVector);
+}
+
+// Level after level, a level only reads the model matrices of the one
+// before, so its slots are independent. Wide levels run in parallel.
+void ModelLoader::_calculateCombinedTransforms()
+{
+	if (m_skeleton.boneIndexVector.empty())
+	{
+		return;
+	}
+
+	// The scene was not converted with nativeConversion, the roots carry
+	// the conversion then.
+	XMFLOAT4X4A rootTransform;
+
+	XMStoreFloat4x4A(&rootTransform, m_loadSettings.nativeConversion ? _getSceneConversion() : XMMatrixIdentity());
+
+	auto calculateSlots = [&](size_t firstSlot, size_t lastSlot)
+	{
+		const XMFLOAT4X4A* localPtr = m_skeleton.localVector.data();
+
+		if (m_loadSettings.pruneBones)
+		{
+			MathHelper::MultiplyMatrices(
+				localPtr + firstSlot,
+				m_skeleton.collapsedVector.data() + firstSlot,
+				m_skeleton.modelVector.data() + firstSlot,
+				lastSlot - firstSlot);
+
+			localPtr = m_skeleton.modelVector.data();
+		}
+
+		MathHelper::MultiplyParentMatrices(
+			localPtr,
+			m_skeleton.parentSlotVector.data(),
+			rootTransform,
+			m_skeleton.modelVector.data(),
+			firstSlot,
+			lastSlot);
+	};
+
+	for (size_t level = 0; level + 1 < m_skeleton.levelStartVector.size(); ++level)
+	{
+		const int firstSlot = static_cast<int>(m_skeleton.levelStartVector[level]);
+		const int lastSlot = static_cast<int>(_getPosedSlotEnd(level));
+
+		if (lastSlot - firstSlot > kSkeletonChunkSize)
+		{
+			concurrency::parallel_for(firstSlot, lastSlot, static_cast<int>(kSkeletonChunkSize), [&](int first)
+			{
+				calculateSlots(first, MathHelper::Min(first + static_cast<int>(kSkeletonChunkSize), lastSlot));
+			});
+		}
+		else
+		{
+			calculateSlots(firstSlot, lastSlot);
+		}
+	}
+}
+
+// The first bone with a name owns it, like the lookup always returned
+// the first match.
+const std::string* ModelLoader::_internBoneName(
+	tBoneIndexMap& boneIndexMap,
+	const char* name,
+	long boneIndex)
+{
+	auto found = boneIndexMap.emplace(name, boneIndex);
+
+	return &(found.first->first);
+}
+
+long ModelLoader::_boneNameToindex(
+	const char* boneName)
+{
+	// Called by the load itself, so it cannot wait for the load to finish
+	// like getBoneIndex() does.
+	auto found = m_boneIndexMap.find(boneName);
+
+	assert(found != m_boneIndexMap.end());
+	return (found != m_boneIndexMap.end()) ? found->second : kInvalidBoneIndex;
+}
+
+long ModelLoader::getBoneIndex(
+	const char* boneName)
+{
+	// The background phase of a progressive load still builds and prunes
+	// the bones.
+	if (m_loadPending.load())
+	{
+		return kInvalidBoneIndex;
+	}
+
+	auto found = m_boneIndexMap.find(boneName);
+
+	if (found == m_boneIndexMap.end())
+	{
+		return kInvalidBoneIndex;
+	}
+
+	return found->second;
+}
+
+// Keeps the strongest influences of a control point. Ties are broken on
+// the bone index, so the result never depends on the cluster order.
+void ModelLoader::_addBoneInfluence(
+	ModelLoader::tBoneInfluences& boneInfluences,
+	long boneIndex,
+	float boneWeight)
+{
+	if (boneWeight <= 0.0f)
+	{
+		return;
+	}
+
+	unsigned long weakestIndex = 0;
+
+	for (unsigned long i = 0; i < boneInfluences.count; ++i)
+	{
+		if (boneInfluences.boneIndices[i] == boneIndex)
+		{
+			// Several clusters can drive the same bone.
+			boneInfluences.weights[i] += boneWeight;
+			return;
+		}
+
+		if ((boneInfluences.weights[i] < boneInfluences.weights[weakestIndex])
+			|| ((boneInfluences.weights[i] == boneInfluences.weights[weakestIndex])
+				&& (boneInfluences.boneIndices[i] > boneInfluences.boneIndices[weakestIndex])))
+		{
+			weakestIndex = i;
+		}
+	}
+
+	if (boneInfluences.count < kMaxGatheredInfluences)
+	{
+		weakestIndex = boneInfluences.count++;
+	}
+	else if ((boneWeight < boneInfluences.weights[weakestIndex])
+		|| ((boneWeight == boneInfluences.weights[weakestIndex])
+			&& (boneIndex > boneInfluences.boneIndices[weakestIndex])))
+	{
+		// We had more influences than we gather, and this is the weakest.
+		return;
+	}
+
+	boneInfluences.weights[weakestIndex] = boneWeight;
+	boneInfluences.boneIndices[weakestIndex] = static_cast<unsigned short>(boneIndex);
+}
+
+// One pass over the control points: select the strongest influences,
+// renormalize and quantize them, then store them in every corner.
+void ModelLoader::_packBoneInfluences(
+	const ModelLoader::tControlPointRemap& controlPointRemap,
+	const ModelLoader::tModelRec& modelRec,
+	const ModelLoader::tBoneInfluencesVector& boneInfluencesVector,
+	ModelLoader::tLoadVerticeVector& loadVerticeVector)
+{
+	const int controlPointCount = static_cast<int>(boneInfluencesVector.size());
+
+	concurrency::parallel_for(0, controlPointCount, static_cast<int>(kPolygonChunkSize), [&](int first)
+	{
+		const int last = MathHelper::Min(first + static_cast<int>(kPolygonChunkSize), controlPointCount);
+
+		for (int controlPointIndex = first; controlPointIndex < last; ++controlPointIndex)
+		{
+			const int firstCorner = controlPointRemap.offsetVector[controlPointIndex];
+			const int lastCorner = controlPointRemap.offsetVector[controlPointIndex + 1];
+
+			if (firstCorner == lastCorner)
+			{
+				// Not used by any polygon.
+				continue;
+			}
+
+			tBoneInfluences influences = boneInfluencesVector[controlPointIndex];
+
+			assert(influences.count != 0);
+
+			// Partial selection sort, the strongest end up in front.
+			for (unsigned long i = 0; i < kBoneInfluencesPerVertice; ++i)
+			{
+				for (unsigned long j = i + 1; j < influences.count; ++j)
+				{
+					if ((influences.weights[j] > influences.weights[i])
+						|| ((influences.weights[j] == influences.weights[i])
+							&& (influences.boneIndices[j] < influences.boneIndices[i])))
+					{
+						std::swap(influences.weights[i], influences.weights[j]);
+						std::swap(influences.boneIndices[i], influences.boneIndices[j]);
+					}
+				}
+			}
+
+			for (unsigned long i = influences.count; i < kBoneInfluencesPerVertice; ++i)
+			{
+				influences.weights[i] = 0.0f;
+				influences.boneIndices[i] = 0;
+			}
+
+			XMVECTOR weights = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(influences.weights));
+			XMVECTOR totalWeight = XMVectorSum(weights);
+
+			weights = XMVectorRound(XMVectorScale(XMVectorDivide(weights, totalWeight), static_cast<float>(kMaxPackedWeight)));
+
+			XMFLOAT4 quantizedWeights;
+
+			XMStoreFloat4(&quantizedWeights, weights);
+
+			tPackedInt packedWeights;
+			long packedTotal =
+				static_cast<long>(quantizedWeights.x)
+				+ static_cast<long>(quantizedWeights.y)
+				+ static_cast<long>(quantizedWeights.z)
+				+ static_cast<long>(quantizedWeights.w);
+
+			// Each of the four weights rounds by up to half a step, so the
+			// total can be off by up to two either way. The strongest weight
+			// absorbs it, it is at least a quarter of the total and cannot
+			// underflow.
+			const long strongestWeight = static_cast<long>(quantizedWeights.x) + kMaxPackedWeight - packedTotal;
+
+			assert((strongestWeight >= 0) && (strongestWeight <= kMaxPackedWeight));
+			packedWeights.bytes[0] = static_cast<unsigned char>(strongestWeight);
+			packedWeights.bytes[1] = static_cast<unsigned char>(quantizedWeights.y);
+			packedWeights.bytes[2] = static_cast<unsigned char>(quantizedWeights.z);
+			packedWeights.bytes[3] = static_cast<unsigned char>(quantizedWeights.w);
+
+			if (modelRec.allByControlPoint)
+			{
+				tSkinnedVertice& vertice = loadVerticeVector[controlPointIndex];
+
+				memcpy(vertice.boneIndices, influences.boneIndices, sizeof(vertice.boneIndices));
+				vertice.boneWeights = packedWeights.number;
+				continue;
+			}
+
+			for (int corner = firstCorner; corner < lastCorner; ++corner)
+			{
+				// Every polygon corner has its own vertex.
+				tSkinnedVertice& vertice = loadVerticeVector[controlPointRemap.cornerVector[corner]];
+
+				memcpy(vertice.boneIndices, influences.boneIndices, sizeof(vertice.boneIndices));
+				vertice.boneWeights = packedWeights.number;
+			}
+		}
+	});
+}
+
+// Every slot is independent, only the posed ones of each level change.
+void ModelLoader::_calculatePaletteMatrices()
+{
+	auto calculateSlots = [&](size_t firstSlot, size_t lastSlot)
+	{
+		MathHelper::TransposedPaletteMatrices(
+			m_skeleton.offsetVector.data(),
+			m_skeleton.modelVector.data(),
+			m_skeleton.boneIndexVector.data(),
+			m_skeleton.paletteVector.data(),
+			firstSlot,
+			lastSlot);
+	};
+
+	for (size_t level = 0; level + 1 < m_skeleton.levelStartVector.size(); ++level)
+	{
+		const int firstSlot = static_cast<int>(m_skeleton.levelStartVector[level]);
+		const int lastSlot = static_cast<int>(_getPosedSlotEnd(level));
+
+		if (lastSlot - firstSlot > kSkeletonChunkSize)
+		{
+			concurrency::parallel_for(firstSlot, lastSlot, static_cast<int>(kSkeletonChunkSize), [&](int first)
+			{
+				calculateSlots(first, MathHelper::Min(first + static_cast<int>(kSkeletonChunkSize), lastSlot));
+			});
+		}
+		else
+		{
+			calculateSlots(firstSlot, lastSlot);
+		}
+	}
+}
+
+// A stable counting sort on depth, the posed bones before the others of
+// their level, so siblings keep their order. It only relies on the parent
+// indices, not on the bones being depth first.
+void ModelLoader::sortBonesByDepth(
+	const std::int32_t* parentIndices,
+	const std::vector<bool>& animatedBoneVector,
+	std::vector<std::uint32_t>& boneIndexVector,
+	std::vector<std::uint32_t>& slotIndexVector,
+	std::vector<std::uint32_t>& levelStartVector,
+	std::vector<std::uint32_t>& posedEndVector)
+{
+	const size_t boneCount = animatedBoneVector.size();
+	std::vector<std::uint32_t> keyVector(boneCount, 0);
+	std::uint32_t maxDepth = 0;
+
+	for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+	{
+		std::uint32_t depth = 0;
+		bool posed = animatedBoneVector[boneIndex];
+
+		for (std::int32_t parentIndex = parentIndices[boneIndex]; parentIndex != kInvalidBoneIndex; parentIndex = parentIndices[parentIndex])
+		{
+			posed = posed || animatedBoneVector[parentIndex];
+			++depth;
+
+			assert(depth <= boneCount);
+		}
+
+		// Even keys for the posed bones of a level, odd ones for the rest.
+		keyVector[boneIndex] = 2 * depth + (posed ? 0 : 1);
+		maxDepth = MathHelper::Max(maxDepth, depth);
+	}
+
+	const size_t levelCount = (boneCount > 0) ? maxDepth + 1 : 0;
+	std::vector<std::uint32_t> keyStartVector(2 * levelCount + 1, 0);
+
+	for (auto key : keyVector)
+	{
+		++keyStartVector[key + 1];
+	}
+
+	std::partial_sum(keyStartVector.begin(), keyStartVector.end(), keyStartVector.begin());
+
+	levelStartVector.resize(levelCount + 1);
+	posedEndVector.resize(levelCount);
+
+	for (size_t level = 0; level <= levelCount; ++level)
+	{
+		levelStartVector[level] = keyStartVector[2 * level];
+	}
+
+	for (size_t level = 0; level < levelCount; ++level)
+	{
+		posedEndVector[level] = keyStartVector[2 * level + 1];
+	}
+
+	boneIndexVector.resize(boneCount);
+	slotIndexVector.resize(boneCount);
+
+	for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+	{
+		const std::uint32_t slot = keyStartVector[keyVector[boneIndex]]++;
+
+		boneIndexVector[slot] = static_cast<std::uint32_t>(boneIndex);
+		slotIndexVector[boneIndex] = slot;
+	}
+}
+
+// Sorts the bones by depth into m_skeleton, see sortBonesByDepth(), and
+// copies their constant matrices into the slots.
+void ModelLoader::_buildSkeleton()
+{
+	const size_t boneCount = m_boneVector.size();
+	std::vector<std::int32_t> parentIndexVector(boneCount);
+
+	for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+	{
+		parentIndexVector[boneIndex] = m_boneVector[boneIndex].parentIndex;
+	}
+
+	sortBonesByDepth(
+		parentIndexVector.data(),
+		m_animatedBoneVector,
+		m_skeleton.boneIndexVector,
+		m_skeleton.slotIndexVector,
+		m_skeleton.levelStartVector,
+		m_skeleton.posedEndVector);
+
+	m_skeleton.parentSlotVector.resize(boneCount);
+	m_skeleton.localVector.resize(boneCount);
+	m_skeleton.collapsedVector.resize(boneCount);
+	m_skeleton.offsetVector.resize(boneCount);
+	XMFLOAT4X4A identity;
+
+	XMStoreFloat4x4A(&identity, XMMatrixIdentity());
+
+	m_skeleton.modelVector.assign(boneCount, identity);
+	m_skeleton.paletteVector.assign(boneCount, identity);
+
+	for (size_t slot = 0; slot < boneCount; ++slot)
+	{
+		const tBone& bone = m_boneVector[m_skeleton.boneIndexVector[slot]];
+
+		m_skeleton.parentSlotVector[slot] = (bone.parentIndex != kInvalidBoneIndex)
+			? static_cast<std::int32_t>(m_skeleton.slotIndexVector[bone.parentIndex])
+			: kInvalidBoneIndex;
+		XMStoreFloat4x4A(&m_skeleton.localVector[slot], XMLoadFloat4x4(&bone.nodeLocalTransform));
+		XMStoreFloat4x4A(&m_skeleton.collapsedVector[slot], XMLoadFloat4x4(&bone.collapsedTransform));
+		XMStoreFloat4x4A(&m_skeleton.offsetVector[slot], XMLoadFloat4x4(&bone.offset));
+	}
+}
+
+DirectX::XMFLOAT4X4A& ModelLoader::_getLocalTransform(
+	size_t boneIndex)
+{
+	return m_skeleton.localVector[m_skeleton.slotIndexVector[boneIndex]];
+}
+
+void ModelLoader::_loadNodeLocalTransformMatrices(
+	const FbxTime& fbxTime)
+{
+	for (unsigned long i = 0; i < m_boneVector.size(); ++i)
+	{
+		if (_isBoneAnimated(i))
+		{
+			_getNodeLocalTransform(m_boneVector[i].boneNodePtr, fbxTime, _getLocalTransform(i));
+		}
+	}
+}
+
+// This function re-indexes the vertex buffer and makes it smaller.
+void ModelLoader::_compressSkinnedVertices(
+	ModelLoader::tModelRec& modelRec,
+	const ModelLoader::tLoadVerticeVector& loadVerticeVector)
+{
+	weldVertices(
+		loadVerticeVector.data(),
+		modelRec.indexVector.data(),
+		modelRec.indexVector.size(),
+		m_loadSettings.weldEpsilon,
+		m_loadArena,
+		modelRec.verticeVector);
+}
+
+// Welded vertices are found through a hash of their contents, so the
+// first occurrence of every vertice keeps its order like before. With an
+// epsilon, matches can sit on either side of a cell border: the welded
+// vertices are chained per cell of their point, and every new vertice is
+// compared to the chains of the 27 cells around its own.
+void ModelLoader::weldVertices(
+	const ModelLoader::tSkinnedVertice* vertices,
+	std::uint32_t* indices,
+	size_t indexCount,
+	float weldEpsilon,
+	LinearArena& arena,
+	std::vector<ModelLoader::tSkinnedVertice>& weldedVector)
+{
+	tLoadVerticeVector newVertices(arena);
+	tWeldMap weldMap(
+		indexCount,
+		tWeldKeyHasher(),
+		tWeldKeyEqual(),
+		arena);
+	tWeldKey weldKey;
+
+	// At most one vertice per index, and the map has a bucket per index,
+	// so neither regrows in the arena.
+	newVertices.reserve(indexCount);
+
+	if (weldEpsilon <= 0.0f)
+	{
+		for (size_t i = 0; i < indexCount; ++i)
+		{
+			const tSkinnedVertice& currentSkinnedVertice = vertices[indices[i]];
+
+			_makeWeldKey(currentSkinnedVertice, weldKey);
+
+			auto found = weldMap.emplace(weldKey, static_cast<tVertexIndex>(newVertices.size()));
+
+			if (found.second) // not found
+			{
+				newVertices.push_back(currentSkinnedVertice);
+			}
+
+			indices[i] = found.first->second;
+		}
+
+		// Only the welded vertices leave the arena.
+		weldedVector.assign(newVertices.begin(), newVertices.end());
+		return;
+	}
+
+	// Cells can be wider than the epsilon, never narrower, or a match
+	// could be two cells away. Far from the origin they grow, so the cell
+	// coordinates stay well inside 64 bits.
+	float maxCoordinate = 0.0f;
+
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		const DirectX::XMFLOAT3& point = vertices[indices[i]].point;
+
+		maxCoordinate = MathHelper::Max(maxCoordinate, MathHelper::Max(fabsf(point.x), MathHelper::Max(fabsf(point.y), fabsf(point.z))));
+	}
+
+	const double cellSize = MathHelper::Max(static_cast<double>(weldEpsilon), ldexp(static_cast<double>(maxCoordinate), -40)) * (1.0 + 1.0e-6);
+	std::vector<tVertexIndex, ArenaAllocator<tVertexIndex>> nextVector(arena);
+
+	nextVector.reserve(indexCount);
+
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		const tSkinnedVertice& currentSkinnedVertice = vertices[indices[i]];
+		const std::int64_t cell[3] =
+		{
+			static_cast<std::int64_t>(floor(currentSkinnedVertice.point.x / cellSize)),
+			static_cast<std::int64_t>(floor(currentSkinnedVertice.point.y / cellSize)),
+			static_cast<std::int64_t>(floor(currentSkinnedVertice.point.z / cellSize)),
+		};
+		tVertexIndex weldedIndex = kInvalidVertexIndex;
+
+		for (int neighbour = 0; (neighbour < 27) && (kInvalidVertexIndex == weldedIndex); ++neighbour)
+		{
+			const std::int64_t neighbourCell[3] =
+			{
+				cell[0] + neighbour % 3 - 1,
+				cell[1] + (neighbour / 3) % 3 - 1,
+				cell[2] + neighbour / 9 - 1,
+			};
+
+			_makeWeldCellKey(currentSkinnedVertice, neighbourCell, weldKey);
+
+			auto found = weldMap.find(weldKey);
+
+			for (tVertexIndex candidate = (found != weldMap.end()) ? found->second : kInvalidVertexIndex;
+				candidate != kInvalidVertexIndex;
+				candidate = nextVector[candidate])
+			{
+				if (_isWeldMatch(currentSkinnedVertice, newVertices[candidate], weldEpsilon))
+				{
+					weldedIndex = candidate;
+					break;
+				}
+			}
+		}
+
+		if (kInvalidVertexIndex == weldedIndex)
+		{
+			weldedIndex = static_cast<tVertexIndex>(newVertices.size());
+
+			_makeWeldCellKey(currentSkinnedVertice, cell, weldKey);
+
+			auto found = weldMap.emplace(weldKey, weldedIndex);
+
+			// Chained in front of the vertices already in the cell.
+			nextVector.push_back(found.second ? kInvalidVertexIndex : found.first->second);
+			found.first->second = weldedIndex;
+			newVertices.push_back(currentSkinnedVertice);
+		}
+
+		indices[i] = weldedIndex;
+	}
+
+	weldedVector.assign(newVertices.begin(), newVertices.end());
+}
+
+// Packs every mesh for upload, or only the merged model.
+void ModelLoader::_packModels()
+{
+	m_mergedModel = tModelRec();
+
+	if (m_loadSettings.mergeMeshes)
+	{
+		_mergeModels(m_mergedModel);
+		_packModel(m_mergedModel);
+		return;
+	}
+
+	for (auto& modelRec : m_modelVector)
+	{
+		_packModel(modelRec);
+	}
+}
+
+void ModelLoader::_packModel(
+	ModelLoader::tModelRec& modelRec)
+{
+	_bucketInfluences(modelRec);
+	_packIndices(modelRec);
+	_packVertices(modelRec);
+
+	if (!m_positionsOnly)
+	{
+		if (!m_loadSettings.partitionSkin)
+		{
+			_loadSubmeshBones(modelRec);
+		}
+
+		_buildClusters(modelRec);
+		_generateTangents(modelRec);
+	}
+}
+
+// Appends every mesh to one vertex and index buffer. The submeshes of one
+// material are appended back to back and become a single submesh, so the
+// merged model needs one draw per material.
+void ModelLoader::_mergeModels(
+	ModelLoader::tModelRec& mergedModelRec)
+{
+	size_t verticeCount = 0;
+	size_t indexCount = 0;
+	size_t lodCount = m_modelVector.empty() ? 0 : kMaxLodCount;
+
+	for (const auto& modelRec : m_modelVector)
+	{
+		verticeCount += modelRec.verticeVector.size();
+		indexCount += modelRec.indexVector.size();
+		lodCount = MathHelper::Min(lodCount, modelRec.lodVector.size());
+	}
+
+	mergedModelRec.meshName = m_filename;
+	mergedModelRec.maxVertex = maxVertex;
+	mergedModelRec.minVertex = minVertex;
+	mergedModelRec.allByControlPoint = false;
+	mergedModelRec.verticeVector.reserve(verticeCount);
+	mergedModelRec.indexVector.reserve(indexCount);
+	mergedModelRec.lodVector.resize(lodCount);
+
+	for (auto& lodRec : mergedModelRec.lodVector)
+	{
+		lodRec.submeshStartVector.assign(1, 0);
+		lodRec.error = 0.0f;
+	}
+
+	std::vector<tVertexIndex> baseVertexVector;
+	std::unordered_map<std::string, std::uint32_t> materialIndexMap;
+
+	for (const auto& modelRec : m_modelVector)
+	{
+		baseVertexVector.push_back(static_cast<tVertexIndex>(mergedModelRec.verticeVector.size()));
+		mergedModelRec.verticeVector.insert(
+			mergedModelRec.verticeVector.end(),
+			modelRec.verticeVector.begin(),
+			modelRec.verticeVector.end());
+
+		for (const auto& materialName : modelRec.materialNameVector)
+		{
+			if (materialIndexMap.emplace(materialName, static_cast<std::uint32_t>(mergedModelRec.materialNameVector.size())).second)
+			{
+				mergedModelRec.materialNameVector.push_back(materialName);
+			}
+		}
+	}
+
+	auto appendIndices = [](
+		tVertexIndexVector& indexVector,
+		const tVertexIndex* indices,
+		size_t count,
+		tVertexIndex baseVertex)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			indexVector.push_back(indices[i] + baseVertex);
+		}
+	};
+
+	tSubmeshRec mergedSubmeshRec;
+
+	// Ends the merged submesh at the current end of the indices.
+	auto closeSubmesh = [&]()
+	{
+		mergedSubmeshRec.indexCount = static_cast<std::uint32_t>(mergedModelRec.indexVector.size()) - mergedSubmeshRec.startIndex;
+
+		if (mergedSubmeshRec.indexCount == 0)
+		{
+			return;
+		}
+
+		mergedModelRec.submeshVector.push_back(mergedSubmeshRec);
+
+		for (auto& lodRec : mergedModelRec.lodVector)
+		{
+			lodRec.submeshStartVector.push_back(static_cast<std::uint32_t>(lodRec.indexVector.size()));
+		}
+	};
+
+	for (std::uint32_t materialIndex = 0; materialIndex < mergedModelRec.materialNameVector.size(); ++materialIndex)
+	{
+		const std::string& materialName = mergedModelRec.materialNameVector[materialIndex];
+
+		mergedSubmeshRec.materialIndex = materialIndex;
+		mergedSubmeshRec.startIndex = static_cast<std::uint32_t>(mergedModelRec.indexVector.size());
+
+		for (size_t modelIndex = 0; modelIndex < m_modelVector.size(); ++modelIndex)
+		{
+			const tModelRec& modelRec = m_modelVector[modelIndex];
+
+			for (size_t submeshIndex = 0; submeshIndex < modelRec.submeshVector.size(); ++submeshIndex)
+			{
+				const tSubmeshRec& submeshRec = modelRec.submeshVector[submeshIndex];
+
+				if (modelRec.materialNameVector[submeshRec.materialIndex] != materialName)
+				{
+					continue;
+				}
+
+				appendIndices(
+					mergedModelRec.indexVector,
+					modelRec.indexVector.data() + submeshRec.startIndex,
+					submeshRec.indexCount,
+					baseVertexVector[modelIndex]);
+
+				for (size_t lodIndex = 0; lodIndex < lodCount; ++lodIndex)
+				{
+					const tLodRec& lodRec = modelRec.lodVector[lodIndex];
+					tLodRec& mergedLodRec = mergedModelRec.lodVector[lodIndex];
+
+					appendIndices(
+						mergedLodRec.indexVector,
+						lodRec.indexVector.data() + lodRec.submeshStartVector[submeshIndex],
+						lodRec.submeshStartVector[submeshIndex + 1] - lodRec.submeshStartVector[submeshIndex],
+						baseVertexVector[modelIndex]);
+					mergedLodRec.error = MathHelper::Max(mergedLodRec.error, lodRec.error);
+				}
+
+				if (m_loadSettings.partitionSkin)
+				{
+					// Each partition keeps its own palette, they can not fuse.
+					mergedSubmeshRec.boneIndexVector = submeshRec.boneIndexVector;
+					closeSubmesh();
+					mergedSubmeshRec.startIndex = static_cast<std::uint32_t>(mergedModelRec.indexVector.size());
+				}
+			}
+		}
+
+		closeSubmesh();
+	}
+}
+
+// The bones a submesh needs in its palette, any weight counts.
+void ModelLoader::_loadSubmeshBones(
+	ModelLoader::tModelRec& modelRec)
+{
+	concurrency::parallel_for(size_t(0), modelRec.submeshVector.size(), [&](size_t submeshIndex)
+	{
+		tSubmeshRec& submeshRec = modelRec.submeshVector[submeshIndex];
+		std::vector<bool> boneUsedVector(m_boneVector.size(), false);
+
+		for (std::uint32_t i = submeshRec.startIndex; i < submeshRec.startIndex + submeshRec.indexCount; ++i)
+		{
+			const tSkinnedVertice& vertice = modelRec.verticeVector[modelRec.indexVector[i]];
+			tPackedInt packedWeights;
+
+			packedWeights.number = vertice.boneWeights;
+
+			for (unsigned long influence = 0; influence < kBoneInfluencesPerVertice; ++influence)
+			{
+				if ((packedWeights.bytes[influence] != 0) && (vertice.boneIndices[influence] < boneUsedVector.size()))
+				{
+					boneUsedVector[vertice.boneIndices[influence]] = true;
+				}
+			}
+		}
+
+		submeshRec.boneIndexVector.clear();
+
+		for (std::uint32_t boneIndex = 0; boneIndex < boneUsedVector.size(); ++boneIndex)
+		{
+			if (boneUsedVector[boneIndex])
+			{
+				submeshRec.boneIndexVector.push_back(boneIndex);
+			}
+		}
+	});
+}
+
+// Finds the vertex range of every palette, and with bucketInfluences sorts
+// it by influence count, so skinning runs one kernel per count without
+// branching on the weights. The sort is stable, inside a bucket the
+// vertices keep the fetch order _optimizeMesh gave them. A partitioned
+// submesh owns a contiguous range of vertices, but a merged model lists
+// the submeshes by material, not in vertex order.
+void ModelLoader::_bucketInfluences(
+	ModelLoader::tModelRec& modelRec)
+{
+	modelRec.influenceBucketVector.clear();
+
+	const size_t verticeCount = modelRec.verticeVector.size();
+
+	if (verticeCount == 0)
+	{
+		return;
+	}
+
+	if (!m_loadSettings.partitionSkin || m_positionsOnly)
+	{
+		tInfluenceBucketRec bucketRec = {};
+
+		bucketRec.submeshIndex = kInvalidSubmeshIndex;
+		bucketRec.influenceStarts[kBoneInfluencesPerVertice + 1] = static_cast<std::uint32_t>(verticeCount);
+		modelRec.influenceBucketVector.push_back(bucketRec);
+	}
+	else
+	{
+		for (size_t submeshIndex = 0; submeshIndex < modelRec.submeshVector.size(); ++submeshIndex)
+		{
+			const tSubmeshRec& submeshRec = modelRec.submeshVector[submeshIndex];
+
+			if (submeshRec.indexCount == 0)
+			{
+				continue;
+			}
+
+			const auto first = modelRec.indexVector.begin() + submeshRec.startIndex;
+			const auto range = std::minmax_element(first, first + submeshRec.indexCount);
+			tInfluenceBucketRec bucketRec = {};
+
+			bucketRec.submeshIndex = static_cast<std::uint32_t>(submeshIndex);
+			bucketRec.influenceStarts[0] = *range.first;
+			bucketRec.influenceStarts[kBoneInfluencesPerVertice + 1] = *range.second + 1;
+			modelRec.influenceBucketVector.push_back(bucketRec);
+		}
+
+		std::sort(
+			modelRec.influenceBucketVector.begin(),
+			modelRec.influenceBucketVector.end(),
+			[](const tInfluenceBucketRec& a, const tInfluenceBucketRec& b)
+		{
+			return a.influenceStarts[0] < b.influenceStarts[0];
+		});
+	}
+
+	if (!m_loadSettings.bucketInfluences)
+	{
+		for (auto& bucketRec : modelRec.influenceBucketVector)
+		{
+			std::fill(
+				bucketRec.influenceStarts + 1,
+				bucketRec.influenceStarts + kBoneInfluencesPerVertice + 1,
+				bucketRec.influenceStarts[0]);
+		}
+
+		return;
+	}
+
+	// The weights are sorted strongest first, the non zero ones lead.
+	auto influenceCount = [](const tSkinnedVertice& vertice)
+	{
+		tPackedInt boneWeights;
+		unsigned long count = 0;
+
+		boneWeights.number = vertice.boneWeights;
+
+		while ((count < kBoneInfluencesPerVertice) && (boneWeights.bytes[count] != 0))
+		{
+			++count;
+		}
+
+		return count;
+	};
+
+	std::vector<tVertexIndex> newVerticeForOldVertice(verticeCount);
+	std::uint32_t previousEnd = 0;
+
+	std::iota(newVerticeForOldVertice.begin(), newVerticeForOldVertice.end(), tVertexIndex(0));
+
+	for (auto& bucketRec : modelRec.influenceBucketVector)
+	{
+		const std::uint32_t first = bucketRec.influenceStarts[0];
+		const std::uint32_t end = bucketRec.influenceStarts[kBoneInfluencesPerVertice + 1];
+		std::uint32_t counts[kBoneInfluencesPerVertice + 1] = {};
+
+		assert(first >= previousEnd);
+		previousEnd = end;
+		bucketRec.sorted = true;
+
+		for (std::uint32_t vertice = first; vertice < end; ++vertice)
+		{
+			++counts[influenceCount(modelRec.verticeVector[vertice])];
+		}
+
+		std::uint32_t cursors[kBoneInfluencesPerVertice + 1];
+
+		for (unsigned long count = 0; count <= kBoneInfluencesPerVertice; ++count)
+		{
+			cursors[count] = bucketRec.influenceStarts[count];
+			bucketRec.influenceStarts[count + 1] = bucketRec.influenceStarts[count] + counts[count];
+		}
+
+		for (std::uint32_t vertice = first; vertice < end; ++vertice)
+		{
+			newVerticeForOldVertice[vertice] = cursors[influenceCount(modelRec.verticeVector[vertice])]++;
+		}
+	}
+
+	tSkinnedVerticeVector newVerticeVector(verticeCount);
+
+	for (size_t vertice = 0; vertice < verticeCount; ++vertice)
+	{
+		newVerticeVector[newVerticeForOldVertice[vertice]] = modelRec.verticeVector[vertice];
+	}
+
+	modelRec.verticeVector.swap(newVerticeVector);
+
+	for (auto& index : modelRec.indexVector)
+	{
+		index = newVerticeForOldVertice[index];
+	}
+
+	for (auto& lodRec : modelRec.lodVector)
+	{
+		for (auto& index : lodRec.indexVector)
+		{
+			index = newVerticeForOldVertice[index];
+		}
+	}
+
+	// Measured again on the final indices, when _optimizeMesh measured.
+	if (modelRec.cacheStatisticsAfter.Acmr > 0.0f)
+	{
+		modelRec.cacheStatisticsAfter = MeshOptimizer::AnalyzeVertexCache(
+			modelRec.indexVector.data(),
+			modelRec.indexVector.size(),
+			verticeCount);
+	}
+}
+
+// Cuts every submesh into runs of clusterTriangleCount triangles. The
+// vertex cache order keeps neighbors together, so a run stays compact.
+// The cone holds the face normals, the winding is counter clockwise
+// facing them, so it bounds what the rasterizer sees. Degenerate
+// triangles face nowhere and are left out.
+template <class tVertice>
+void ModelLoader::_buildClusters(
+	ModelLoader::tModelRec& modelRec,
+	const tVertice* vertices)
+{
+	const size_t clusterIndexCount = m_loadSettings.clusterTriangleCount * kTriangleVertexCount;
+
+	std::vector<std::int32_t> boneVoteVector;
+	std::vector<std::int32_t> boneVector;
+	std::vector<XMFLOAT3> faceNormalVector;
+
+	for (size_t submeshIndex = 0; submeshIndex < modelRec.submeshVector.size(); ++submeshIndex)
+	{
+		const tSubmeshRec& submeshRec = modelRec.submeshVector[submeshIndex];
+		const size_t lastIndex = submeshRec.startIndex + submeshRec.indexCount;
+
+		for (size_t startIndex = submeshRec.startIndex; startIndex < lastIndex; startIndex += clusterIndexCount)
+		{
+			const size_t endIndex = MathHelper::Min(startIndex + clusterIndexCount, lastIndex);
+			XMVECTOR minPoint = XMVectorReplicate(MathHelper::Infinity);
+			XMVECTOR maxPoint = XMVectorReplicate(-MathHelper::Infinity);
+			XMVECTOR normalSum = XMVectorZero();
+
+			boneVoteVector.clear();
+			boneVector.clear();
+			faceNormalVector.clear();
+
+			for (size_t i = startIndex; i < endIndex; ++i)
+			{
+				const tVertice& vertice = vertices[modelRec.indexVector[i]];
+				XMVECTOR point = XMLoadFloat3(&vertice.point);
+				tPackedInt boneWeights;
+
+				minPoint = XMVectorMin(minPoint, point);
+				maxPoint = XMVectorMax(maxPoint, point);
+				boneWeights.number = vertice.boneWeights;
+
+				for (size_t influence = 0; influence < kBoneInfluencesPerVertice; ++influence)
+				{
+					if (boneWeights.bytes[influence] != 0)
+					{
+						// Partitioned vertices index their palette.
+						const std::int32_t boneIndex = m_loadSettings.partitionSkin
+							? static_cast<std::int32_t>(submeshRec.boneIndexVector[vertice.boneIndices[influence]])
+							: static_cast<std::int32_t>(vertice.boneIndices[influence]);
+
+						boneVector.push_back(boneIndex);
+
+						if (influence == 0)
+						{
+							boneVoteVector.push_back(boneIndex);
+						}
+					}
+				}
+			}
+
+			for (size_t i = startIndex; i + 2 < endIndex; i += kTriangleVertexCount)
+			{
+				XMVECTOR a = XMLoadFloat3(&vertices[modelRec.indexVector[i]].point);
+				XMVECTOR b = XMLoadFloat3(&vertices[modelRec.indexVector[i + 1]].point);
+				XMVECTOR c = XMLoadFloat3(&vertices[modelRec.indexVector[i + 2]].point);
+				XMVECTOR faceNormal = XMVector3Cross(b - a, c - a);
+
+				if (XMVectorGetX(XMVector3LengthSq(faceNormal)) > 0.0f)
+				{
+					faceNormal = XMVector3Normalize(faceNormal);
+					normalSum += faceNormal;
+					faceNormalVector.emplace_back();
+					XMStoreFloat3(&faceNormalVector.back(), faceNormal);
+				}
+			}
+
+			XMVECTOR center = 0.5f * (minPoint + maxPoint);
+			XMVECTOR coneAxis = XMVector3Normalize(normalSum);
+			float radius = 0.0f;
+			float minConeDot = XMVector3Equal(normalSum, XMVectorZero()) ? -1.0f : 1.0f;
+
+			for (size_t i = startIndex; i < endIndex; ++i)
+			{
+				radius = MathHelper::Max(radius, XMVectorGetX(XMVector3Length(XMLoadFloat3(&vertices[modelRec.indexVector[i]].point) - center)));
+			}
+
+			for (const auto& faceNormal : faceNormalVector)
+			{
+				minConeDot = MathHelper::Min(minConeDot, XMVectorGetX(XMVector3Dot(coneAxis, XMLoadFloat3(&faceNormal))));
+			}
+
+			tClusterRec clusterRec;
+
+			XMStoreFloat3(&clusterRec.center, center);
+			XMStoreFloat3(&clusterRec.coneAxis, coneAxis);
+			clusterRec.radius = radius;
+			clusterRec.coneCutoff = (minConeDot <= 0.0f) ? 1.0f : sqrtf(1.0f - minConeDot * minConeDot);
+			clusterRec.startIndex = static_cast<std::uint32_t>(startIndex);
+			clusterRec.indexCount = static_cast<std::uint32_t>(endIndex - startIndex);
+			clusterRec.submeshIndex = static_cast<std::uint32_t>(submeshIndex);
+
+			// The most common strongest bone first, it turns the cone.
+			std::sort(boneVoteVector.begin(), boneVoteVector.end());
+
+			std::int32_t mainBoneIndex = kInvalidBoneIndex;
+			size_t bestVoteCount = 0;
+
+			for (size_t first = 0, last = 0; first < boneVoteVector.size(); first = last)
+			{
+				while ((last < boneVoteVector.size()) && (boneVoteVector[last] == boneVoteVector[first]))
+				{
+					++last;
+				}
+
+				if (last - first > bestVoteCount)
+				{
+					bestVoteCount = last - first;
+					mainBoneIndex = boneVoteVector[first];
+				}
+			}
+
+			std::sort(boneVector.begin(), boneVector.end());
+			boneVector.erase(std::unique(boneVector.begin(), boneVector.end()), boneVector.end());
+			clusterRec.firstBone = static_cast<std::uint32_t>(modelRec.clusterBoneVector.size());
+			clusterRec.boneCount = static_cast<std::uint32_t>(boneVector.size());
+
+			if (mainBoneIndex != kInvalidBoneIndex)
+			{
+				modelRec.clusterBoneVector.push_back(mainBoneIndex);
+			}
+
+			for (std::int32_t boneIndex : boneVector)
+			{
+				if (boneIndex != mainBoneIndex)
+				{
+					modelRec.clusterBoneVector.push_back(boneIndex);
+				}
+			}
+
+			modelRec.clusterVector.push_back(clusterRec);
+		}
+	}
+}
+
+// Points and bones come from the position stream when there is one, so the
+// pass does not pull the shading data through the cache.
+void ModelLoader::_buildClusters(
+	ModelLoader::tModelRec& modelRec)
+{
+	modelRec.clusterVector.clear();
+	modelRec.clusterBoneVector.clear();
+
+	if (m_loadSettings.clusterTriangleCount == 0)
+	{
+		return;
+	}
+
+	if (!modelRec.positionStreamVector.empty())
+	{
+		_buildClusters(modelRec, modelRec.positionStreamVector.data());
+	}
+	else
+	{
+		_buildClusters(modelRec, modelRec.verticeVector.data());
+	}
+}
+
+// Splits the 3x3 part of a palette matrix into its rotation rows and the
+// most it stretches a vector. False when it scales unevenly or shears,
+// normals then turn by more than the rotation.
+bool getRotationAndScale(
+	FXMMATRIX matrice,
+	XMVECTOR rotationRows[3],
+	float& scale)
+{
+	const float tolerance = 1.0e-3f;
+	float lengths[3];
+
+	for (int row = 0; row < 3; ++row)
+	{
+		lengths[row] = XMVectorGetX(XMVector3Length(matrice.r[row]));
+
+		if (lengths[row] <= 0.0f)
+		{
+			return false;
+		}
+
+		rotationRows[row] = matrice.r[row] / lengths[row];
+	}
+
+	const float minLength = MathHelper::Min(lengths[0], MathHelper::Min(lengths[1], lengths[2]));
+	const float maxLength = MathHelper::Max(lengths[0], MathHelper::Max(lengths[1], lengths[2]));
+
+	if ((maxLength > (1.0f + tolerance) * minLength)
+		|| (fabsf(XMVectorGetX(XMVector3Dot(rotationRows[0], rotationRows[1]))) > tolerance)
+		|| (fabsf(XMVectorGetX(XMVector3Dot(rotationRows[0], rotationRows[2]))) > tolerance)
+		|| (fabsf(XMVectorGetX(XMVector3Dot(rotationRows[1], rotationRows[2]))) > tolerance))
+	{
+		return false;
+	}
+
+	// Gershgorin on the rows, what is left of the shear stretches a little.
+	scale = maxLength * sqrtf(1.0f + 2.0f * tolerance);
+
+	return true;
+}
+
+// A cluster is skipped when every normal in its cone points away from the
+// eye, seen from anywhere in its sphere. Every bone a vertex weighs moves
+// the bind sphere to its own sphere, the posed sphere holds all of them,
+// so it holds every blend of them too. The cone turns with the first
+// bone and widens by the largest rotation of any other bone against it.
+// Bones that scale unevenly or shear leave the cluster visible. The eye
+// goes to model space once, and so does the shell offset, through the
+// smallest scale of world.
+void ModelLoader::cullClusters(
+	const ModelLoader::tModelRec& modelRec,
+	const XMFLOAT4X4& world,
+	const XMFLOAT3& eyePosW,
+	float shellOffset,
+	std::vector<std::uint32_t>& visibleClusterVector)
+{
+	XMMATRIX worldMatrix = XMLoadFloat4x4(&world);
+	XMVECTOR determinant;
+	XMMATRIX inverseWorld = XMMatrixInverse(&determinant, worldMatrix);
+	XMVECTOR eye = XMVector3TransformCoord(XMLoadFloat3(&eyePosW), inverseWorld);
+	const float minScale = MathHelper::Min(
+		XMVectorGetX(XMVector3Length(worldMatrix.r[0])),
+		MathHelper::Min(XMVectorGetX(XMVector3Length(worldMatrix.r[1])), XMVectorGetX(XMVector3Length(worldMatrix.r[2]))));
+	const float modelShellOffset = (minScale > 0.0f) ? shellOffset / minScale : MathHelper::Infinity;
+	std::vector<XMFLOAT4> posedSphereVector;
+
+	for (size_t clusterIndex = 0; clusterIndex < modelRec.clusterVector.size(); ++clusterIndex)
+	{
+		const tClusterRec& clusterRec = modelRec.clusterVector[clusterIndex];
+
+		if (clusterRec.coneCutoff < 1.0f)
+		{
+			XMVECTOR center = XMLoadFloat3(&clusterRec.center);
+			XMVECTOR coneAxis = XMLoadFloat3(&clusterRec.coneAxis);
+			float radius = clusterRec.radius;
+			float coneCutoff = clusterRec.coneCutoff;
+			bool bounded = true;
+
+			// Nothing is posed before the first loadBoneMatriceVector().
+			if ((clusterRec.boneCount > 0) && !m_boneMatrixVector.empty())
+			{
+				const XMVECTOR bindCenter = center;
+				const float bindConeAngle = asinf(coneCutoff);
+				XMVECTOR mainRotationRows[3];
+				float coneAngle = bindConeAngle;
+
+				posedSphereVector.clear();
+
+				for (std::uint32_t i = 0; i < clusterRec.boneCount; ++i)
+				{
+					const std::int32_t boneIndex = modelRec.clusterBoneVector[clusterRec.firstBone + i];
+					XMVECTOR rotationRows[3];
+					float scale;
+
+					if (boneIndex >= static_cast<std::int32_t>(m_boneMatrixVector.size()))
+					{
+						bounded = false;
+						break;
+					}
+
+					// The palette is transposed for the shaders.
+					XMMATRIX boneMatrice = XMMatrixTranspose(XMLoadFloat4x4(&m_boneMatrixVector[boneIndex]));
+
+					if (!getRotationAndScale(boneMatrice, rotationRows, scale))
+					{
+						bounded = false;
+						break;
+					}
+
+					posedSphereVector.emplace_back();
+					XMStoreFloat4(&posedSphereVector.back(), XMVectorSetW(XMVector3TransformCoord(bindCenter, boneMatrice), scale * clusterRec.radius));
+
+					if (i == 0)
+					{
+						mainRotationRows[0] = rotationRows[0];
+						mainRotationRows[1] = rotationRows[1];
+						mainRotationRows[2] = rotationRows[2];
+						coneAxis = XMVector3Normalize(XMVector3TransformNormal(coneAxis, boneMatrice));
+					}
+					else
+					{
+						// The angle of the rotation between both bones, from
+						// the trace of one times the other transposed.
+						const float trace = XMVectorGetX(XMVector3Dot(mainRotationRows[0], rotationRows[0])
+							+ XMVector3Dot(mainRotationRows[1], rotationRows[1])
+							+ XMVector3Dot(mainRotationRows[2], rotationRows[2]));
+
+						coneAngle = MathHelper::Max(coneAngle, bindConeAngle + acosf(MathHelper::Clamp(0.5f * (trace - 1.0f), -1.0f, 1.0f)));
+					}
+				}
+
+				if (bounded)
+				{
+					center = XMVectorZero();
+					radius = 0.0f;
+
+					for (const auto& posedSphere : posedSphereVector)
+					{
+						center += XMLoadFloat4(&posedSphere);
+					}
+
+					center = XMVectorSetW(center / static_cast<float>(posedSphereVector.size()), 0.0f);
+
+					for (const auto& posedSphere : posedSphereVector)
+					{
+						radius = MathHelper::Max(radius, XMVectorGetX(XMVector3Length(XMLoadFloat4(&posedSphere) - center)) + posedSphere.w);
+					}
+
+					// The tolerance of getRotationAndScale() turns normals
+					// by a few thousandths of a radian.
+					coneAngle += 0.005f;
+					bounded = (coneAngle < 0.5f * MathHelper::Pi);
+					coneCutoff = sinf(coneAngle);
+				}
+			}
+
+			XMVECTOR toCenter = center - eye;
+
+			if (bounded
+				&& (XMVectorGetX(XMVector3Dot(toCenter, coneAxis))
+					>= coneCutoff * XMVectorGetX(XMVector3Length(toCenter)) + radius + modelShellOffset))
+			{
+				continue;
+			}
+		}
+
+		visibleClusterVector.push_back(static_cast<std::uint32_t>(clusterIndex));
+	}
+}
+
+// Only the interleaved vertices carry a normal, the position stream skins
+// points alone.
+void storeSkinnedNormal(
+	const ModelLoader::tSkinnedVertice& vertice,
+	FXMMATRIX matrice,
+	XMFLOAT3* normal)
+{
+	if (nullptr != normal)
+	{
+		XMStoreFloat3(normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&vertice.normal), matrice)));
+	}
+}
+
+void storeSkinnedNormal(
+	const ModelLoader::tPositionStreamVertice&,
+	FXMMATRIX,
+	XMFLOAT3*)
+{
+}
+
+// Blends the palette matrices and transforms once. The trip count is known
+// at compile time, so the loop unrolls for every bucket. A single influence
+// carries the full weight, and unweighted vertices stay where they are.
+template <unsigned long influenceCount, class tVertice>
+void ModelLoader::_skinInfluences(
+	const tVertice* vertices,
+	size_t verticeCount,
+	const XMFLOAT4X4* boneMatrices,
+	XMFLOAT3* points,
+	XMFLOAT3* normals)
+{
+	const float weightScale = 1.0f / kMaxPackedWeight;
+
+	for (size_t i = 0; i < verticeCount; ++i)
+	{
+		const tVertice& vertice = vertices[i];
+		XMMATRIX blendedMatrice = XMMatrixIdentity();
+
+		if (influenceCount == 1)
+		{
+			blendedMatrice = XMLoadFloat4x4(&boneMatrices[vertice.boneIndices[0]]);
+		}
+		else if (influenceCount > 1)
+		{
+			tPackedInt boneWeights;
+
+			boneWeights.number = vertice.boneWeights;
+			blendedMatrice = XMLoadFloat4x4(&boneMatrices[vertice.boneIndices[0]]) * (boneWeights.bytes[0] * weightScale);
+
+			for (unsigned long influence = 1; influence < influenceCount; ++influence)
+			{
+				blendedMatrice += XMLoadFloat4x4(&boneMatrices[vertice.boneIndices[influence]]) * (boneWeights.bytes[influence] * weightScale);
+			}
+		}
+
+		// The palette is transposed for the shaders.
+		blendedMatrice = XMMatrixTranspose(blendedMatrice);
+
+		XMStoreFloat3(&points[i], XMVector3Transform(XMLoadFloat3(&vertice.point), blendedMatrice));
+		storeSkinnedNormal(vertice, blendedMatrice, (nullptr != normals) ? normals + i : nullptr);
+	}
+}
+
+// The kernel for vertices in any order, it stops at the first zero weight.
+template <class tVertice>
+void ModelLoader::_skinAnyInfluences(
+	const tVertice* vertices,
+	size_t verticeCount,
+	const XMFLOAT4X4* boneMatrices,
+	XMFLOAT3* points,
+	XMFLOAT3* normals)
+{
+	const float weightScale = 1.0f / kMaxPackedWeight;
+
+	for (size_t i = 0; i < verticeCount; ++i)
+	{
+		const tVertice& vertice = vertices[i];
+		tPackedInt boneWeights;
+		XMMATRIX blendedMatrice = XMMatrixIdentity();
+
+		boneWeights.number = vertice.boneWeights;
+
+		if (boneWeights.bytes[0] != 0)
+		{
+			blendedMatrice = XMLoadFloat4x4(&boneMatrices[vertice.boneIndices[0]]) * (boneWeights.bytes[0] * weightScale);
+
+			for (unsigned long influence = 1; (influence < kBoneInfluencesPerVertice) && (boneWeights.bytes[influence] != 0); ++influence)
+			{
+				blendedMatrice += XMLoadFloat4x4(&boneMatrices[vertice.boneIndices[influence]]) * (boneWeights.bytes[influence] * weightScale);
+			}
+		}
+
+		// The palette is transposed for the shaders.
+		blendedMatrice = XMMatrixTranspose(blendedMatrice);
+
+		XMStoreFloat3(&points[i], XMVector3Transform(XMLoadFloat3(&vertice.point), blendedMatrice));
+		storeSkinnedNormal(vertice, blendedMatrice, (nullptr != normals) ? normals + i : nullptr);
+	}
+}
+
+// Runs the kernel of every influence count over one bucket, or the generic
+// one over the whole range when it is not sorted.
+template <class tVertice>
+void ModelLoader::_skinBucket(
+	const tVertice* vertices,
+	const ModelLoader::tInfluenceBucketRec& bucketRec,
+	const XMFLOAT4X4* boneMatrices,
+	XMFLOAT3* points,
+	XMFLOAT3* normals)
+{
+	const std::uint32_t* influenceStarts = bucketRec.influenceStarts;
+
+	if (!bucketRec.sorted)
+	{
+		const std::uint32_t first = influenceStarts[0];
+
+		_skinAnyInfluences(
+			vertices + first,
+			influenceStarts[kBoneInfluencesPerVertice + 1] - first,
+			boneMatrices,
+			points + first,
+			(nullptr != normals) ? normals + first : nullptr);
+		return;
+	}
+
+	for (unsigned long influenceCount = 0; influenceCount <= kBoneInfluencesPerVertice; ++influenceCount)
+	{
+		const std::uint32_t first = influenceStarts[influenceCount];
+		const size_t count = influenceStarts[influenceCount + 1] - first;
+		XMFLOAT3* bucketNormals = (nullptr != normals) ? normals + first : nullptr;
+
+		switch (influenceCount)
+		{
+		case 0:
+			_skinInfluences<0>(vertices + first, count, boneMatrices, points + first, bucketNormals);
+			break;
+		case 1:
+			_skinInfluences<1>(vertices + first, count, boneMatrices, points + first, bucketNormals);
+			break;
+		case 2:
+			_skinInfluences<2>(vertices + first, count, boneMatrices, points + first, bucketNormals);
+			break;
+		case 3:
+			_skinInfluences<3>(vertices + first, count, boneMatrices, points + first, bucketNormals);
+			break;
+		default:
+			_skinInfluences<kBoneInfluencesPerVertice>(vertices + first, count, boneMatrices, points + first, bucketNormals);
+			break;
+		}
+	}
+}
+
+void ModelLoader::skinVertices(
+	const ModelLoader::tModelRec& modelRec,
+	XMFLOAT3* points,
+	XMFLOAT3* normals)
+{
+	tMatrixVector paletteVector;
+
+	for (const auto& bucketRec : modelRec.influenceBucketVector)
+	{
+		if (bucketRec.submeshIndex == kInvalidSubmeshIndex)
+		{
+			// Nothing is posed before the first loadBoneMatriceVector().
+			paletteVector.assign(m_boneMatrixVector.begin(), m_boneMatrixVector.end());
+			paletteVector.resize(m_boneVector.size(), MathHelper::Identity4x4());
+		}
+		else
+		{
+			const tSubmeshRec& submeshRec = modelRec.submeshVector[bucketRec.submeshIndex];
+
+			paletteVector.resize(submeshRec.boneIndexVector.size());
+			loadPaletteMatrices(submeshRec, paletteVector.data());
+		}
+
+		// Points alone only need the position stream, when it was built.
+		if ((nullptr == normals) && !modelRec.positionStreamVector.empty())
+		{
+			_skinBucket(modelRec.positionStreamVector.data(), bucketRec, paletteVector.data(), points, normals);
+		}
+		else
+		{
+			_skinBucket(modelRec.verticeVector.data(), bucketRec, paletteVector.data(), points, normals);
+		}
+	}
+}
+
+// Picks the smallest index format for the mesh. Every shell pass reads the
+// index buffer again, so 16 bit is kept wherever the vertices fit.
+void ModelLoader::_packIndices(
+	ModelLoader::tModelRec& modelRec)
+{
+	modelRec.indexVector16.clear();
+
+	for (auto& lodRec : modelRec.lodVector)
 	{
-		_loadBones(nodePtr->GetChild(lChildIndex), parentBoneIndex);
+		lodRec.indexVector16.clear();
+	}
+
+	if (modelRec.verticeVector.size() > kMaxVertexCount16)
+	{
+		modelRec.indexFormat = DXGI_FORMAT_R32_UINT;
+		return;
+	}
+
+	modelRec.indexFormat = DXGI_FORMAT_R16_UINT;
+	modelRec.indexVector16.assign(modelRec.indexVector.begin(), modelRec.indexVector.end());
+
+	// The levels index the same vertices, so they always fit too.
+	for (auto& lodRec : modelRec.lodVector)
+	{
+		lodRec.indexVector16.assign(lodRec.indexVector.begin(), lodRec.indexVector.end());
 	}
 }
 
-void ModelLoader::_loadBone(
-	FbxNode* nodePtr,
-	long parentBoneIndex)
+// Builds the one GPU layout the settings ask for, interleaved or split, full
+// width or compact. The full width position stream is built with every
+// split layout, the CPU passes walk it instead of the interleaved vertices.
+// Every layout but the interleaved full width one has 8 bit bone indices.
+void ModelLoader::_packVertices(
+	ModelLoader::tModelRec& modelRec)
 {
-	tBone dummy;
+	modelRec.compactVerticeVector.clear();
+	modelRec.positionStreamVector.clear();
+	modelRec.shadingStreamVector.clear();
+	modelRec.compactPositionStreamVector.clear();
+	modelRec.compactShadingStreamVector.clear();
 
-	m_boneVector.push_back(dummy);
+	const long verticeCount = static_cast<long>(modelRec.verticeVector.size());
 
-	tBone& back = m_boneVector.back();
+	// 8 bit bone indices would wrap, so such a mesh keeps the interleaved
+	// full width vertices.
+	const bool byteBoneIndices = _hasByteBoneIndices(modelRec);
 
-	back.boneNodePtr = nodePtr;
-	back.fbxSkeletonPtr = (FbxSkeleton*)nodePtr->GetNodeAttribute();
-	back.fbxClusterPtr = nullptr;
-	back.name = back.fbxSkeletonPtr->GetName();
-	back.parentIndex = parentBoneIndex;
+	modelRec.compactVertices = m_loadSettings.compactVertices && byteBoneIndices;
+	modelRec.splitVertexStreams = m_loadSettings.splitVertexStreams && byteBoneIndices;
 
-	back.offset = MathHelper::Identity4x4();
-	back.boneMatrice = MathHelper::Identity4x4();
-	back.combinedTransform = MathHelper::Identity4x4();
+	if (!modelRec.splitVertexStreams)
+	{
+		if (!modelRec.compactVertices)
+		{
+			return;
+		}
 
-	// Get our local transform at time 0.
-	_getNodeLocalTransform(nodePtr, back.nodeLocalTransform);
+		modelRec.compactVerticeVector.resize(verticeCount);
+
+		concurrency::parallel_for(0L, verticeCount, static_cast<long>(kPolygonChunkSize), [&](long first)
+		{
+			const long last = MathHelper::Min(first + static_cast<long>(kPolygonChunkSize), verticeCount);
+
+			encodeCompactVertices(
+				modelRec.verticeVector.data() + first,
+				last - first,
+				modelRec.minVertex,
+				modelRec.maxVertex,
+				modelRec.compactVerticeVector.data() + first);
+		});
 
-	if (parentBoneIndex != kInvalidBoneIndex)
+		return;
+	}
+
+	modelRec.positionStreamVector.resize(verticeCount);
+
+	if (modelRec.compactVertices)
 	{
-		m_boneVector[parentBoneIndex].childIndexes.push_back(static_cast<long>(m_boneVector.size() - 1));
+		modelRec.compactPositionStreamVector.resize(verticeCount);
+		modelRec.compactShadingStreamVector.resize(verticeCount);
+	}
+	else
+	{
+		modelRec.shadingStreamVector.resize(verticeCount);
 	}
-}
 
-void ModelLoader::_getNodeLocalTransform(
-	FbxNode* nodePtr,
-	DirectX::XMFLOAT4X4& matrix)
-{
-	FbxAMatrix fbxMatrix = m_scenePtr->GetAnimationEvaluator()->GetNodeLocalTransform(nodePtr);
+	concurrency::parallel_for(0L, verticeCount, static_cast<long>(kPolygonChunkSize), [&](long first)
+	{
+		const long last = MathHelper::Min(first + static_cast<long>(kPolygonChunkSize), verticeCount);
 
-	_fbxToMatrix(fbxMatrix, matrix);
-}
+		for (long i = first; i < last; ++i)
+		{
+			const tSkinnedVertice& vertice = modelRec.verticeVector[i];
+			tPositionStreamVertice& positionVertice = modelRec.positionStreamVector[i];
 
-void ModelLoader::_getNodeLocalTransform(
-	FbxNode* nodePtr,
-	const FbxTime& fbxTime,
-	DirectX::XMFLOAT4X4& matrix)
-{
-	FbxAMatrix fbxMatrix = m_scenePtr->GetAnimationEvaluator()->GetNodeLocalTransform(nodePtr, fbxTime);
+			positionVertice.point = vertice.point;
+			positionVertice.boneWeights = vertice.boneWeights;
 
-	_fbxToMatrix(fbxMatrix, matrix);
+			for (unsigned long influence = 0; influence < kBoneInfluencesPerVertice; ++influence)
+			{
+				positionVertice.boneIndices[influence] = static_cast<std::uint8_t>(vertice.boneIndices[influence]);
+			}
+		}
+
+		if (!modelRec.compactVertices)
+		{
+			for (long i = first; i < last; ++i)
+			{
+				const tSkinnedVertice& vertice = modelRec.verticeVector[i];
+				tShadingStreamVertice& shadingVertice = modelRec.shadingStreamVector[i];
+
+				shadingVertice.normal = vertice.normal;
+				shadingVertice.tex = vertice.tex;
+			}
+
+			return;
+		}
+
+		// Encoded a block at a time and split right away, the interleaved
+		// compact vertices are never kept.
+		tCompactSkinnedVertice compactVertices[256];
+
+		for (long block = first; block < last; block += _countof(compactVertices))
+		{
+			const long blockCount = MathHelper::Min(static_cast<long>(_countof(compactVertices)), last - block);
+
+			encodeCompactVertices(
+				modelRec.verticeVector.data() + block,
+				blockCount,
+				modelRec.minVertex,
+				modelRec.maxVertex,
+				compactVertices);
+
+			for (long i = 0; i < blockCount; ++i)
+			{
+				const tCompactSkinnedVertice& compactVertice = compactVertices[i];
+				tCompactPositionStreamVertice& positionVertice = modelRec.compactPositionStreamVector[block + i];
+				tCompactShadingStreamVertice& shadingVertice = modelRec.compactShadingStreamVector[block + i];
+
+				memcpy(positionVertice.point, compactVertice.point, sizeof(positionVertice.point));
+				positionVertice.boneWeights = compactVertice.boneWeights;
+				positionVertice.boneIndices = compactVertice.boneIndices;
+				memcpy(shadingVertice.normal, compactVertice.normal, sizeof(shadingVertice.normal));
+				memcpy(shadingVertice.tex, compactVertice.tex, sizeof(shadingVertice.tex));
+			}
+		}
+	});
 }
 
-void ModelLoader::_fbxToMatrix(
-	const FbxAMatrix& fbxMatrix,
-	DirectX::XMFLOAT4X4& matrix)
+// Every bone index, palette local with tLoadSettings::partitionSkin, has to
+// fit the 8 bits of the compact layout and the split streams.
+bool ModelLoader::_hasByteBoneIndices(
+	const ModelLoader::tModelRec& modelRec)
 {
-	for (unsigned long i = 0; i < 4; ++i)
+	for (const auto& vertice : modelRec.verticeVector)
 	{
-		matrix(i, 0) = (float)fbxMatrix.Get(i, 0);
-		matrix(i, 1) = (float)fbxMatrix.Get(i, 1);
-		matrix(i, 2) = (float)fbxMatrix.Get(i, 2);
-		matrix(i, 3) = (float)fbxMatrix.Get(i, 3);
+		for (unsigned long influence = 0; influence < kBoneInfluencesPerVertice; ++influence)
+		{
+			if (vertice.boneIndices[influence] > kMaxCompactBoneIndex)
+			{
+				return false;
+			}
+		}
 	}
-}
 
+	return true;
+}
 
-void ModelLoader::_loadMeshes(
-	FbxNode* nodePtr)
+// Tangents follow the uv directions. Every vertice sums the tangents of
+// its triangles, weighted by their area, and the sum is orthonormalized
+// against the vertice normal before it is packed.
+void ModelLoader::_generateTangents(
+	ModelLoader::tModelRec& modelRec)
 {
-	FbxNodeAttribute* pNodeAttribute = nodePtr->GetNodeAttribute();
-	long childCount = nodePtr->GetChildCount();
+	modelRec.qTangentVector.clear();
 
-	if ((nullptr != pNodeAttribute)
-		&& (pNodeAttribute->GetAttributeType() == FbxNodeAttribute::eMesh))
+	if (!m_loadSettings.generateTangents)
 	{
-		_loadMesh(nodePtr);
+		return;
 	}
 
-	for (long lChildIndex = 0; lChildIndex < childCount; ++lChildIndex)
+	const tSkinnedVerticeVector& vertices = modelRec.verticeVector;
+	const tVertexIndexVector& indices = modelRec.indexVector;
+	const long verticeCount = static_cast<long>(vertices.size());
+	const long triangleCount = static_cast<long>(indices.size() / kTriangleVertexCount);
+	std::vector<XMFLOAT3> triangleTangents(triangleCount);
+	std::vector<XMFLOAT3> triangleBitangents(triangleCount);
+
+	concurrency::parallel_for(0L, triangleCount, static_cast<long>(kPolygonChunkSize), [&](long first)
 	{
-		_loadMeshes(nodePtr->GetChild(lChildIndex));
-	}
-}
+		const long last = MathHelper::Min(first + static_cast<long>(kPolygonChunkSize), triangleCount);
 
-void ModelLoader::_loadMesh(
-	FbxNode* nodePtr)
-{
-	const long materialCount = nodePtr->GetMaterialCount();
-	FbxNodeAttribute* nodeAttributePtr = nodePtr->GetNodeAttribute();
+		for (long triangle = first; triangle < last; ++triangle)
+		{
+			const tSkinnedVertice& v0 = vertices[indices[triangle * kTriangleVertexCount + 0]];
+			const tSkinnedVertice& v1 = vertices[indices[triangle * kTriangleVertexCount + 1]];
+			const tSkinnedVertice& v2 = vertices[indices[triangle * kTriangleVertexCount + 2]];
+			XMVECTOR edge1 = XMVectorSubtract(XMLoadFloat3(&v1.point), XMLoadFloat3(&v0.point));
+			XMVECTOR edge2 = XMVectorSubtract(XMLoadFloat3(&v2.point), XMLoadFloat3(&v0.point));
+			const float du1 = v1.tex.x - v0.tex.x;
+			const float dv1 = v1.tex.y - v0.tex.y;
+			const float du2 = v2.tex.x - v0.tex.x;
+			const float dv2 = v2.tex.y - v0.tex.y;
+			const float uvArea = du1 * dv2 - du2 * dv1;
+
+			// Only the sign of the uv area is used, so the tangent keeps the
+			// magnitude of the triangle area. Flat uvs add nothing.
+			const float uvSign = (uvArea > 0.0f) ? 1.0f : ((uvArea < 0.0f) ? -1.0f : 0.0f);
+			XMVECTOR tangent = XMVectorScale(XMVectorSubtract(XMVectorScale(edge1, dv2), XMVectorScale(edge2, dv1)), uvSign);
+			XMVECTOR bitangent = XMVectorScale(XMVectorSubtract(XMVectorScale(edge2, du1), XMVectorScale(edge1, du2)), uvSign);
+
+			XMStoreFloat3(&triangleTangents[triangle], tangent);
+			XMStoreFloat3(&triangleBitangents[triangle], bitangent);
+		}
+	});
+
+	// Triangles of every vertice, as compressed rows.
+	std::vector<std::uint32_t> triangleOffsets(verticeCount + 1, 0);
+	std::vector<std::uint32_t> verticeTriangles(indices.size());
 
+	for (auto index : indices)
 	{
-		tModelRec emptyModelRec;
-		m_modelVector.push_back(emptyModelRec);
+		++triangleOffsets[index + 1];
 	}
-	tModelRec& modelRec = m_modelVector.back();
 
-	modelRec.indexBufferPtr = nullptr;
-	modelRec.vertexBufferPtr = nullptr;
+	for (long vertice = 0; vertice < verticeCount; ++vertice)
+	{
+		triangleOffsets[vertice + 1] += triangleOffsets[vertice];
+	}
 
-	for (long lMaterialIndex = 0; lMaterialIndex < materialCount; ++lMaterialIndex)
 	{
-		FbxSurfaceMaterial* lMaterial = nodePtr->GetMaterial(lMaterialIndex);
-		if (lMaterial && !lMaterial->GetUserDataPtr())
+		std::vector<std::uint32_t> cursors(triangleOffsets.begin(), triangleOffsets.end() - 1);
+
+		for (size_t i = 0; i < indices.size(); ++i)
 		{
-			modelRec.materialName = lMaterial->GetName();
+			verticeTriangles[cursors[indices[i]]++] = static_cast<std::uint32_t>(i / kTriangleVertexCount);
 		}
 	}
 
-	if (nullptr != nodeAttributePtr)
+	modelRec.qTangentVector.resize(verticeCount);
+
+	concurrency::parallel_for(0L, verticeCount, static_cast<long>(kPolygonChunkSize), [&](long first)
 	{
-		// Bake mesh as VBO(vertex buffer object) into GPU.
-		if (nodeAttributePtr->GetAttributeType() == FbxNodeAttribute::eMesh)
+		const long last = MathHelper::Min(first + static_cast<long>(kPolygonChunkSize), verticeCount);
+
+		for (long vertice = first; vertice < last; ++vertice)
 		{
-			FbxMesh* meshPtr = nodePtr->GetMesh();
-			if (nullptr != meshPtr)
-			{
-				long boneCount = _getBoneCount(meshPtr);
+			XMVECTOR tangent = XMVectorZero();
+			XMVECTOR bitangent = XMVectorZero();
 
-				modelRec.meshName = meshPtr->GetName();
+			for (std::uint32_t i = triangleOffsets[vertice]; i < triangleOffsets[vertice + 1]; ++i)
+			{
+				tangent = XMVectorAdd(tangent, XMLoadFloat3(&triangleTangents[verticeTriangles[i]]));
+				bitangent = XMVectorAdd(bitangent, XMLoadFloat3(&triangleBitangents[verticeTriangles[i]]));
+			}
 
-				_loadMeshPositionNormalUV(nodePtr, modelRec);
+			XMFLOAT3 tangentSum;
+			XMFLOAT3 bitangentSum;
 
-				assert(_isMeshSkinned(meshPtr));
+			XMStoreFloat3(&tangentSum, tangent);
+			XMStoreFloat3(&bitangentSum, bitangent);
 
-				// Ensure our bone matrix vector size is large enough.
-				assert(m_boneMatrixVectorSize >= (unsigned int)boneCount);
+			encodeQTangent(tangentSum, bitangentSum, vertices[vertice].normal, modelRec.qTangentVector[vertice]);
 
-				_loadMeshBoneWeightsAndIndices(nodePtr, modelRec);
-				_normalizeBoneWeights(modelRec);
-				_compressSkinnedVertices(modelRec);
-			}
+			assert(isValidQTangent(modelRec.qTangentVector[vertice], vertices[vertice].normal));
 		}
-	}
+	});
 }
 
-long ModelLoader::_getBoneCount(
-	FbxMesh* meshPtr)
+// The frame is orthonormalized around the normal. The quaternion keeps w
+// positive and at least one snorm step away from zero, so negating it can
+// carry a mirrored bitangent.
+void ModelLoader::encodeQTangent(
+	const XMFLOAT3& tangent,
+	const XMFLOAT3& bitangent,
+	const XMFLOAT3& normal,
+	ModelLoader::tQTangent& qTangent)
 {
-	if (meshPtr->GetDeformerCount(FbxDeformer::eSkin) == 0)
+	const float bias = 1.0f / 32767.0f;
+	XMVECTOR n = XMLoadFloat3(&normal);
+
+	// A zero or broken normal packs the z axis.
+	if (XMVector3Equal(n, XMVectorZero()) || XMVector3IsNaN(n) || XMVector3IsInfinite(n))
 	{
-		return 0;
+		n = g_XMIdentityR2;
 	}
 
-	return ((FbxSkin*)(meshPtr->GetDeformer(0, FbxDeformer::eSkin)))->GetClusterCount();
-}
+	n = XMVector3Normalize(n);
 
-void ModelLoader::_loadMeshPositionNormalUV(
-	FbxNode* nodePtr,
-	tModelRec& modelRec)
-{
-	FbxMesh* meshPtr = nodePtr->GetMesh();
+	XMVECTOR t = XMLoadFloat3(&tangent);
 
-	assert(nullptr != meshPtr->GetElementMaterial());
-	assert(meshPtr->GetElementNormalCount() > 0);
-	assert(meshPtr->GetElementUVCount() > 0);
-	assert(0 == meshPtr->GetDeformerCount(FbxDeformer::eBlendShape));
-	assert(0 == meshPtr->GetDeformerCount(FbxDeformer::eVertexCache));
-	assert(1 <= meshPtr->GetDeformerCount(FbxDeformer::eSkin));
+	if (XMVector3IsNaN(t) || XMVector3IsInfinite(t))
+	{
+		t = XMVectorZero();
+	}
 
-	FbxGeometryElement::EMappingMode normalMappingMode = meshPtr->GetElementNormal(0)->GetMappingMode();
-	FbxGeometryElement::EMappingMode uvMappingMode = meshPtr->GetElementUV(0)->GetMappingMode();
-	FbxLayerElementArrayTemplate<int>* materialIndice = &meshPtr->GetElementMaterial()->GetIndexArray();
+	t = XMVectorSubtract(t, XMVectorMultiply(n, XMVector3Dot(n, t)));
 
-	assert(normalMappingMode != FbxGeometryElement::eNone);
-	assert(uvMappingMode != FbxGeometryElement::eNone);
-	assert(nullptr != materialIndice);
+	if (XMVector3LessOrEqual(XMVector3LengthSq(t), XMVectorReplicate(1.0e-12f)))
+	{
+		// No uv direction, any tangent in the plane will do.
+		XMVECTOR axis = (fabsf(XMVectorGetX(n)) < 0.9f) ? g_XMIdentityR0 : g_XMIdentityR1;
 
-	const long polygonCount = meshPtr->GetPolygonCount();
-	FbxGeometryElement::EMappingMode lMaterialMappingMode = meshPtr->GetElementMaterial()->GetMappingMode();
-	tSkinnedVertice emptyVertice;
+		t = XMVector3Cross(axis, n);
+	}
 
-	ZeroMemory(&emptyVertice, sizeof(emptyVertice));
+	t = XMVector3Normalize(t);
+
+	XMVECTOR b = XMVector3Cross(n, t);
+	const bool mirrored = XMVectorGetX(XMVector3Dot(b, XMLoadFloat3(&bitangent))) < 0.0f;
+	XMVECTOR q = XMQuaternionNormalize(XMQuaternionRotationMatrix(XMMATRIX(t, b, n, g_XMIdentityR3)));
+
+	if (XMVectorGetW(q) < 0.0f)
+	{
+		q = XMVectorNegate(q);
+	}
+
+	if (XMVectorGetW(q) < bias)
+	{
+		const float w = XMVectorGetW(q);
+
+		q = XMVectorSetW(XMVectorScale(q, sqrtf(1.0f - bias * bias) / sqrtf(1.0f - w * w)), bias);
+	}
+
+	if (mirrored)
+	{
+		q = XMVectorNegate(q);
+	}
+
+	XMStoreShortN4(reinterpret_cast<XMSHORTN4*>(qTangent.rotation), q);
+}
+
+void ModelLoader::decodeQTangent(
+	const ModelLoader::tQTangent& qTangent,
+	XMFLOAT3& tangent,
+	XMFLOAT3& bitangent,
+	XMFLOAT3& normal)
+{
+	XMVECTOR q = XMLoadShortN4(reinterpret_cast<const XMSHORTN4*>(qTangent.rotation));
+	const float handedness = (XMVectorGetW(q) < 0.0f) ? -1.0f : 1.0f;
+	XMMATRIX frame = XMMatrixRotationQuaternion(XMQuaternionNormalize(q));
 
-	if (normalMappingMode != FbxGeometryElement::eByControlPoint)
+	XMStoreFloat3(&tangent, frame.r[0]);
+	XMStoreFloat3(&bitangent, XMVectorScale(frame.r[1], handedness));
+	XMStoreFloat3(&normal, frame.r[2]);
+}
+
+// A frame is rejected when it is not a unit quaternion within the snorm
+// rounding, when w is zero so the handedness is lost, or when it does not
+// give normal back within the documented 0.004 degrees. A zero or broken
+// normal is not compared, encodeQTangent packs the z axis for those.
+bool ModelLoader::isValidQTangent(
+	const ModelLoader::tQTangent& qTangent,
+	const XMFLOAT3& normal)
+{
+	const float maxLengthError = 1.0e-3f;
+	const float maxSine = 6.9813e-5f;
+	XMVECTOR q = XMLoadShortN4(reinterpret_cast<const XMSHORTN4*>(qTangent.rotation));
+
+	if ((fabsf(XMVectorGetX(XMVector4LengthSq(q)) - 1.0f) > maxLengthError)
+		|| (qTangent.rotation[3] == 0))
 	{
-		m_allByControlPoint = false;
+		return false;
 	}
 
-	if (uvMappingMode != FbxGeometryElement::eByControlPoint)
+	XMVECTOR n = XMLoadFloat3(&normal);
+
+	if (XMVector3Equal(n, XMVectorZero()) || XMVector3IsNaN(n) || XMVector3IsInfinite(n))
 	{
-		m_allByControlPoint = false;
+		return true;
 	}
 
-	long polygonVertexCount = meshPtr->GetControlPointsCount();
+	XMFLOAT3 decodedTangent;
+	XMFLOAT3 decodedBitangent;
+	XMFLOAT3 decodedNormal;
+
+	decodeQTangent(qTangent, decodedTangent, decodedBitangent, decodedNormal);
+
+	n = XMVector3Normalize(n);
+
+	XMVECTOR decoded = XMLoadFloat3(&decodedNormal);
 
-	if (!m_allByControlPoint)
+	return (XMVectorGetX(XMVector3Dot(n, decoded)) > 0.0f)
+		&& (XMVectorGetX(XMVector3Length(XMVector3Cross(n, decoded))) <= maxSine);
+}
+
+// Points are stored as (point - min) / (max - min) in 16 bit unorm, so the
+// error is at most half a step of the extent over 65535 on each axis.
+// Normals are folded on the octahedron |x| + |y| + |z| = 1 and stored in
+// 16 bit snorm, that keeps the direction within 0.004 degrees.
+// Uvs are halves, good to one part in 2048.
+void ModelLoader::encodeCompactVertices(
+	const ModelLoader::tSkinnedVertice* vertices,
+	size_t verticeCount,
+	const XMFLOAT3& boundsMin,
+	const XMFLOAT3& boundsMax,
+	ModelLoader::tCompactSkinnedVertice* compactVertices)
+{
+	const XMVECTOR zero = XMVectorZero();
+	const XMVECTOR one = XMVectorSplatOne();
+	const XMVECTOR pointMin = XMLoadFloat3(&boundsMin);
+	const XMVECTOR extent = XMVectorSubtract(XMLoadFloat3(&boundsMax), pointMin);
+
+	// A flat axis has no extent, all its points quantize to zero.
+	const XMVECTOR inverseExtent = XMVectorSelect(
+		XMVectorReciprocal(extent),
+		zero,
+		XMVectorLessOrEqual(extent, zero));
+
+	for (size_t i = 0; i < verticeCount; ++i)
 	{
-		polygonVertexCount = polygonCount * kTriangleVertexCount;
+		const tSkinnedVertice& vertice = vertices[i];
+		tCompactSkinnedVertice& compactVertice = compactVertices[i];
+
+		XMVECTOR point = XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&vertice.point), pointMin), inverseExtent);
+
+		point = XMVectorSetW(point, 1.0f);
+		XMStoreUShortN4(reinterpret_cast<XMUSHORTN4*>(compactVertice.point), point);
+
+		XMVECTOR normal = XMLoadFloat3(&vertice.normal);
+		XMVECTOR manhattanLength = XMVector3Dot(XMVectorAbs(normal), one);
+
+		normal = XMVectorSelect(
+			XMVectorDivide(normal, manhattanLength),
+			g_XMIdentityR2,
+			XMVectorLessOrEqual(manhattanLength, zero));
+
+		// The lower half folds over the diagonals onto the upper half.
+		XMVECTOR signNotZero = XMVectorSelect(g_XMNegativeOne, one, XMVectorGreaterOrEqual(normal, zero));
+		XMVECTOR folded = XMVectorMultiply(
+			XMVectorSubtract(one, XMVectorAbs(XMVectorSwizzle<XM_SWIZZLE_Y, XM_SWIZZLE_X, XM_SWIZZLE_Z, XM_SWIZZLE_W>(normal))),
+			signNotZero);
+
+		normal = XMVectorSelect(normal, folded, XMVectorLess(XMVectorSplatZ(normal), zero));
+		XMStoreShortN2(reinterpret_cast<XMSHORTN2*>(compactVertice.normal), normal);
+
+		XMStoreHalf2(reinterpret_cast<XMHALF2*>(compactVertice.tex), XMLoadFloat2(&vertice.tex));
+
+		tPackedInt packedIndices;
+
+		for (unsigned long influence = 0; influence < kBoneInfluencesPerVertice; ++influence)
+		{
+			// The loader falls back to the full width before it gets here.
+			assert(vertice.boneIndices[influence] <= kMaxCompactBoneIndex);
+
+			packedIndices.bytes[influence] = static_cast<unsigned char>(vertice.boneIndices[influence]);
+		}
+
+		compactVertice.boneWeights = vertice.boneWeights;
+		compactVertice.boneIndices = packedIndices.number;
 	}
+}
+
+void ModelLoader::decodeCompactVertices(
+	const ModelLoader::tCompactSkinnedVertice* compactVertices,
+	size_t verticeCount,
+	const XMFLOAT3& boundsMin,
+	const XMFLOAT3& boundsMax,
+	ModelLoader::tSkinnedVertice* vertices)
+{
+	const XMVECTOR zero = XMVectorZero();
+	const XMVECTOR one = XMVectorSplatOne();
+	const XMVECTOR pointMin = XMLoadFloat3(&boundsMin);
+	const XMVECTOR extent = XMVectorSubtract(XMLoadFloat3(&boundsMax), pointMin);
+
+	for (size_t i = 0; i < verticeCount; ++i)
+	{
+		const tCompactSkinnedVertice& compactVertice = compactVertices[i];
+		tSkinnedVertice& vertice = vertices[i];
+
+		XMVECTOR point = XMLoadUShortN4(reinterpret_cast<const XMUSHORTN4*>(compactVertice.point));
+
+		XMStoreFloat3(&vertice.point, XMVectorMultiplyAdd(point, extent, pointMin));
+
+		// z is what is left of the octahedron, a negative z means the
+		// point was folded and has to be unfolded first.
+		XMVECTOR normal = XMLoadShortN2(reinterpret_cast<const XMSHORTN2*>(compactVertice.normal));
+		XMVECTOR z = XMVectorSubtract(XMVectorSubtract(one, XMVectorAbs(XMVectorSplatX(normal))), XMVectorAbs(XMVectorSplatY(normal)));
+		XMVECTOR fold = XMVectorMax(XMVectorNegate(z), zero);
 
-	modelRec.indexVector.resize(polygonCount * kTriangleVertexCount);
-	modelRec.verticeVector.resize(polygonVertexCount, emptyVertice);
+		normal = XMVectorAdd(normal, XMVectorSelect(fold, XMVectorNegate(fold), XMVectorGreaterOrEqual(normal, zero)));
+		normal = XMVectorSelect(z, normal, g_XMSelect1100);
+		XMStoreFloat3(&vertice.normal, XMVector3Normalize(normal));
 
-	FbxStringList uvNames;
-	meshPtr->GetUVSetNames(uvNames);
-	const char* uvName = NULL;
+		XMStoreFloat2(&vertice.tex, XMLoadHalf2(reinterpret_cast<const XMHALF2*>(compactVertice.tex)));
 
-	if (uvNames.GetCount() != 0)
+		tPackedInt packedIndices;
+
+		packedIndices.number = compactVertice.boneIndices;
+
+		for (unsigned long influence = 0; influence < kBoneInfluencesPerVertice; ++influence)
+		{
+			vertice.boneIndices[influence] = packedIndices.bytes[influence];
+		}
+
+		vertice.boneWeights = compactVertice.boneWeights;
+	}
+}
+
+// Triangles first go in cache order, then optionally in overdraw order,
+// and the vertices follow the order the triangles first use them. The
+// triangles never leave their submesh.
+void ModelLoader::_optimizeMesh(
+	ModelLoader::tModelRec& modelRec)
+{
+	ZeroMemory(&modelRec.cacheStatisticsBefore, sizeof(modelRec.cacheStatisticsBefore));
+	ZeroMemory(&modelRec.cacheStatisticsAfter, sizeof(modelRec.cacheStatisticsAfter));
+
+	if ((!m_loadSettings.optimizeVertexOrder && !m_loadSettings.optimizeOverdraw)
+		|| modelRec.indexVector.empty())
 	{
-		uvName = uvNames[0];
+		return;
 	}
 
-	const FbxVector4* controlPoints = meshPtr->GetControlPoints();
-	FbxVector4 currentVertex;
-	FbxVector4 currentNormal;
-	FbxVector2 currentUV;
-	DirectX::XMFLOAT4X4 geometryTransformMatrix;
+	tVertexIndex* indices = modelRec.indexVector.data();
+	const size_t indexCount = modelRec.indexVector.size();
+	const size_t verticeCount = modelRec.verticeVector.size();
+
+	modelRec.cacheStatisticsBefore = MeshOptimizer::AnalyzeVertexCache(indices, indexCount, verticeCount);
 
-	_getGeometryTransformMatrix(nodePtr, geometryTransformMatrix);
+	for (const auto& submeshRec : modelRec.submeshVector)
+	{
+		if (m_loadSettings.optimizeVertexOrder)
+		{
+			MeshOptimizer::OptimizeVertexCache(indices + submeshRec.startIndex, submeshRec.indexCount, verticeCount);
+		}
 
-	DirectX::XMMATRIX geometryTransformMatrix_formated = DirectX::XMLoadFloat4x4(&geometryTransformMatrix);
+		if (m_loadSettings.optimizeOverdraw)
+		{
+			MeshOptimizer::OptimizeOverdraw(
+				indices + submeshRec.startIndex,
+				submeshRec.indexCount,
+				&modelRec.verticeVector[0].point.x,
+				sizeof(tSkinnedVertice),
+				verticeCount);
+		}
+	}
 
-	if (m_allByControlPoint)
+	if (m_loadSettings.optimizeVertexOrder)
 	{
-		const FbxGeometryElementNormal* lNormalElement = meshPtr->GetElementNormal(0);;
-		const FbxGeometryElementUV* lUVElement = meshPtr->GetElementUV(0);
+		std::vector<tVertexIndex> newVerticeForOldVertice;
+		tSkinnedVerticeVector newVertices(verticeCount);
 
-		for (long index = 0; index < polygonVertexCount; ++index)
+		MeshOptimizer::OptimizeVertexFetch(indices, indexCount, verticeCount, newVerticeForOldVertice);
+
+		for (size_t i = 0; i < verticeCount; ++i)
 		{
-			{
-				currentVertex = controlPoints[index];
-				XMVECTOR pointPreProcessed = DirectX::XMVectorSet(
-					static_cast<float>(currentVertex[0]),
-					static_cast<float>(currentVertex[1]),
-					static_cast<float>(currentVertex[2]),
-					1.0f);
-				XMVector3TransformCoord(pointPreProcessed, geometryTransformMatrix_formated);
+			newVertices[newVerticeForOldVertice[i]] = modelRec.verticeVector[i];
+		}
+
+		modelRec.verticeVector.swap(newVertices);
+	}
+
+	modelRec.cacheStatisticsAfter = MeshOptimizer::AnalyzeVertexCache(indices, indexCount, verticeCount);
+}
+
+// Splits every submesh into ranges of at most m_boneMatrixVectorSize bones.
+// The triangles are taken in their cache order, and a range ends when the
+// next triangle does not fit its palette anymore. Each range gets its own
+// copy of its vertices, with bone indices into its palette.
+void ModelLoader::_partitionSkin(
+	ModelLoader::tModelRec& modelRec)
+{
+	if (!m_loadSettings.partitionSkin || modelRec.indexVector.empty())
+	{
+		return;
+	}
 
-				XMStoreFloat3(&(modelRec.verticeVector[index].point), pointPreProcessed);
+	const tVertexIndex kNoVertice = ~tVertexIndex(0);
+	const size_t paletteSize = m_boneMatrixVectorSize;
+	std::vector<bool> bonePaletteVector(m_boneVector.size(), false);
+	std::vector<std::uint16_t> localBoneIndexVector(m_boneVector.size(), 0);
+	std::vector<tVertexIndex> newVerticeForOldVertice(modelRec.verticeVector.size(), kNoVertice);
+	std::vector<std::uint32_t> paletteVector;
+	tSkinnedVerticeVector newVerticeVector;
+	tSubmeshVector newSubmeshVector;
 
-				XMVECTOR currMax = DirectX::XMVectorSet(
-					maxVertex.x,
-					maxVertex.y,
-					maxVertex.z,
-					1.0f
-				);
+	newVerticeVector.reserve(modelRec.verticeVector.size());
 
-				XMVECTOR currMin = DirectX::XMVectorSet(
-					minVertex.x,
-					minVertex.y,
-					minVertex.z,
-					1.0f
-				);
+	for (const auto& submeshRec : modelRec.submeshVector)
+	{
+		const size_t lastIndex = submeshRec.startIndex + submeshRec.indexCount;
+		size_t partitionStart = submeshRec.startIndex;
 
-				currMax = XMVectorMax(currMax, pointPreProcessed);
-				currMin = XMVectorMin(currMin, pointPreProcessed);
+		auto closePartition = [&](size_t partitionEnd)
+		{
+			if (partitionEnd == partitionStart)
+			{
+				return;
+			}
 
-				XMStoreFloat3(&maxVertex, currMax);
-				XMStoreFloat3(&minVertex, currMin);
+			std::sort(paletteVector.begin(), paletteVector.end());
 
+			for (size_t i = 0; i < paletteVector.size(); ++i)
+			{
+				localBoneIndexVector[paletteVector[i]] = static_cast<std::uint16_t>(i);
+				bonePaletteVector[paletteVector[i]] = false;
 			}
 
+			// Vertices mapped before this partition belong to another one.
+			const tVertexIndex firstNewVertice = static_cast<tVertexIndex>(newVerticeVector.size());
+
+			for (size_t i = partitionStart; i < partitionEnd; ++i)
 			{
-				long lNormalIndex = index;
+				tVertexIndex& newVertice = newVerticeForOldVertice[modelRec.indexVector[i]];
 
-				if (lNormalElement->GetReferenceMode() == FbxLayerElement::eIndexToDirect)
+				if ((newVertice == kNoVertice) || (newVertice < firstNewVertice))
 				{
-					lNormalIndex = lNormalElement->GetIndexArray().GetAt(index);
+					tSkinnedVertice vertice = modelRec.verticeVector[modelRec.indexVector[i]];
+					tPackedInt packedWeights;
+
+					packedWeights.number = vertice.boneWeights;
+
+					for (unsigned long influence = 0; influence < kBoneInfluencesPerVertice; ++influence)
+					{
+						vertice.boneIndices[influence] = (packedWeights.bytes[influence] != 0)
+							? localBoneIndexVector[vertice.boneIndices[influence]]
+							: 0;
+					}
+
+					newVertice = static_cast<tVertexIndex>(newVerticeVector.size());
+					newVerticeVector.push_back(vertice);
 				}
 
-				currentNormal = lNormalElement->GetDirectArray().GetAt(lNormalIndex);
-				XMVECTOR normalPreProcessed = DirectX::XMVectorSet(
-					static_cast<float>(currentNormal[0]),
-					static_cast<float>(currentNormal[1]),
-					static_cast<float>(currentNormal[2]),
-					1.0f);
-				XMVector3TransformCoord(normalPreProcessed, geometryTransformMatrix_formated);
-				XMStoreFloat3(&(modelRec.verticeVector[index].normal), normalPreProcessed);;
+				modelRec.indexVector[i] = newVertice;
 			}
 
+			tSubmeshRec partitionRec;
+
+			partitionRec.materialIndex = submeshRec.materialIndex;
+			partitionRec.startIndex = static_cast<std::uint32_t>(partitionStart);
+			partitionRec.indexCount = static_cast<std::uint32_t>(partitionEnd - partitionStart);
+			partitionRec.boneIndexVector.swap(paletteVector);
+			newSubmeshVector.push_back(partitionRec);
+
+			paletteVector.clear();
+			partitionStart = partitionEnd;
+		};
+
+		std::uint32_t newBones[kTriangleVertexCount * kBoneInfluencesPerVertice];
+		size_t newBoneCount = 0;
+
+		// Bones of the triangle that are not in the palette yet.
+		auto gatherNewBones = [&](size_t triangleStart)
+		{
+			newBoneCount = 0;
+
+			for (size_t corner = 0; corner < kTriangleVertexCount; ++corner)
 			{
-				long uvIndex = index;
+				const tSkinnedVertice& vertice = modelRec.verticeVector[modelRec.indexVector[triangleStart + corner]];
+				tPackedInt packedWeights;
 
-				if (lUVElement->GetReferenceMode() == FbxLayerElement::eIndexToDirect)
+				packedWeights.number = vertice.boneWeights;
+
+				for (unsigned long influence = 0; influence < kBoneInfluencesPerVertice; ++influence)
 				{
-					uvIndex = lUVElement->GetIndexArray().GetAt(index);
+					const std::uint32_t boneIndex = vertice.boneIndices[influence];
+
+					if ((packedWeights.bytes[influence] != 0)
+						&& !bonePaletteVector[boneIndex]
+						&& (std::find(newBones, newBones + newBoneCount, boneIndex) == newBones + newBoneCount))
+					{
+						newBones[newBoneCount++] = boneIndex;
+					}
 				}
+			}
+		};
+
+		for (size_t triangleStart = submeshRec.startIndex; triangleStart < lastIndex; triangleStart += kTriangleVertexCount)
+		{
+			gatherNewBones(triangleStart);
 
-				currentUV = lUVElement->GetDirectArray().GetAt(uvIndex);
+			if (paletteVector.size() + newBoneCount > paletteSize)
+			{
+				closePartition(triangleStart);
+				gatherNewBones(triangleStart);
+			}
 
-				modelRec.verticeVector[index].tex.x = static_cast<float>(currentUV[0]);
-				modelRec.verticeVector[index].tex.y = static_cast<float>(currentUV[1]);
+			for (size_t i = 0; i < newBoneCount; ++i)
+			{
+				bonePaletteVector[newBones[i]] = true;
+				paletteVector.push_back(newBones[i]);
 			}
 		}
+
+		closePartition(lastIndex);
 	}
 
-	long lVertexCount = 0;
-	long numberOfTriangles = 0;
+	modelRec.verticeVector.swap(newVerticeVector);
+	modelRec.submeshVector.swap(newSubmeshVector);
+}
 
-	for (long lPolygonIndex = 0; lPolygonIndex < polygonCount; ++lPolygonIndex)
-	{
-		long materialIndex = 0;
-		if (materialIndice && lMaterialMappingMode == FbxGeometryElement::eByPolygon)
-		{
-			materialIndex = materialIndice->GetAt(lPolygonIndex);
-		}
+// Every level is simplified from the full mesh, so each one only carries its
+// own error. Vertices only fold onto neighbors with the same strongest bone,
+// which keeps the skin weight boundaries where they were. Each submesh is
+// simplified on its own, the vertices between materials are borders then.
+void ModelLoader::_generateLods(
+	ModelLoader::tModelRec& modelRec)
+{
+	modelRec.lodVector.clear();
 
-		const long indexOffset = numberOfTriangles * 3;
+	size_t lodCount = 0;
 
-		for (long verticeIndex = 0; verticeIndex < kTriangleVertexCount; ++verticeIndex)
-		{
-			const long controlPointIndex = meshPtr->GetPolygonVertex(lPolygonIndex, verticeIndex);
+	while ((lodCount < kMaxLodCount) && (m_loadSettings.lodTriangleRatios[lodCount] > 0.0f))
+	{
+		++lodCount;
+	}
 
-			if (m_allByControlPoint)
-			{
-				modelRec.indexVector[indexOffset + verticeIndex] = static_cast<unsigned short>(controlPointIndex);
-			}
-			else
-			{
-				modelRec.indexVector[indexOffset + verticeIndex] = static_cast<unsigned short>(lVertexCount);
+	if ((lodCount == 0) || modelRec.indexVector.empty())
+	{
+		return;
+	}
 
-				currentVertex = controlPoints[controlPointIndex];
-				XMVECTOR pointPreProcessed = DirectX::XMVectorSet(
-					static_cast<float>(currentVertex[0]),
-					static_cast<float>(currentVertex[1]),
-					static_cast<float>(currentVertex[2]),
-					1.0f);
-				XMVector3TransformCoord(pointPreProcessed, geometryTransformMatrix_formated);
-				XMStoreFloat3(&(modelRec.verticeVector[lVertexCount].point), pointPreProcessed);
+	const size_t verticeCount = modelRec.verticeVector.size();
+	std::vector<std::uint32_t> vertexGroups(verticeCount);
 
-				XMVECTOR currMax = DirectX::XMVectorSet(
-					maxVertex.x,
-					maxVertex.y,
-					maxVertex.z,
-					1.0f
-				);
+	for (size_t i = 0; i < verticeCount; ++i)
+	{
+		vertexGroups[i] = modelRec.verticeVector[i].boneIndices[0];
+	}
 
-				XMVECTOR currMin = DirectX::XMVectorSet(
-					minVertex.x,
-					minVertex.y,
-					minVertex.z,
-					1.0f
-				);
+	const size_t submeshCount = modelRec.submeshVector.size();
+	std::vector<std::vector<std::uint32_t>> submeshIndicesVector(lodCount * submeshCount);
+	std::vector<float> submeshErrorVector(lodCount * submeshCount);
 
-				currMax = XMVectorMax(currMax, pointPreProcessed);
-				currMin = XMVectorMin(currMin, pointPreProcessed);
+	// Every submesh of every level is its own task. A handful of levels
+	// alone leaves most cores idle, and the finest level takes the longest.
+	concurrency::parallel_for(size_t(0), lodCount * submeshCount, [&](size_t taskIndex)
+	{
+		const size_t lodIndex = taskIndex / submeshCount;
+		const tSubmeshRec& submeshRec = modelRec.submeshVector[taskIndex % submeshCount];
+		const float triangleRatio = MathHelper::Min(m_loadSettings.lodTriangleRatios[lodIndex], 1.0f);
+		const size_t targetTriangleCount = static_cast<size_t>(submeshRec.indexCount / kTriangleVertexCount * triangleRatio);
+		std::vector<std::uint32_t>& submeshIndices = submeshIndicesVector[taskIndex];
+
+		submeshErrorVector[taskIndex] = MeshOptimizer::SimplifyMesh(
+			modelRec.indexVector.data() + submeshRec.startIndex,
+			submeshRec.indexCount,
+			&modelRec.verticeVector[0].point.x,
+			sizeof(tSkinnedVertice),
+			verticeCount,
+			nullptr,
+			vertexGroups.data(),
+			targetTriangleCount * kTriangleVertexCount,
+			submeshIndices);
+
+		if (m_loadSettings.optimizeVertexOrder && !submeshIndices.empty())
+		{
+			MeshOptimizer::OptimizeVertexCache(submeshIndices.data(), submeshIndices.size(), verticeCount);
+		}
+	});
 
-				XMStoreFloat3(&maxVertex, currMax);
-				XMStoreFloat3(&minVertex, currMin);
+	modelRec.lodVector.resize(lodCount);
 
-				meshPtr->GetPolygonVertexNormal(lPolygonIndex, verticeIndex, currentNormal);
-				XMVECTOR normalPreProcessed = DirectX::XMVectorSet(
-					static_cast<float>(currentNormal[0]),
-					static_cast<float>(currentNormal[1]),
-					static_cast<float>(currentNormal[2]),
-					1.0f);
-				XMVector3TransformCoord(normalPreProcessed, geometryTransformMatrix_formated);
-				XMStoreFloat3(&(modelRec.verticeVector[lVertexCount].normal), normalPreProcessed);
+	for (size_t lodIndex = 0; lodIndex < lodCount; ++lodIndex)
+	{
+		tLodRec& lodRec = modelRec.lodVector[lodIndex];
 
-				{
-					bool unmappedUV;
+		lodRec.error = 0.0f;
+		lodRec.indexVector.clear();
+		lodRec.submeshStartVector.assign(1, 0);
 
-					meshPtr->GetPolygonVertexUV(lPolygonIndex, verticeIndex, uvName, currentUV, unmappedUV);
-					modelRec.verticeVector[lVertexCount].tex.x = static_cast<float>(currentUV[0]);
-					modelRec.verticeVector[lVertexCount].tex.y = 1.0f - static_cast<float>(currentUV[1]);
-				}
-			}
+		for (size_t submeshIndex = 0; submeshIndex < submeshCount; ++submeshIndex)
+		{
+			const std::vector<std::uint32_t>& submeshIndices = submeshIndicesVector[lodIndex * submeshCount + submeshIndex];
 
-			++lVertexCount;
+			lodRec.error = MathHelper::Max(lodRec.error, submeshErrorVector[lodIndex * submeshCount + submeshIndex]);
+			lodRec.indexVector.insert(lodRec.indexVector.end(), submeshIndices.begin(), submeshIndices.end());
+			lodRec.submeshStartVector.push_back(static_cast<std::uint32_t>(lodRec.indexVector.size()));
 		}
+	}
 
-		numberOfTriangles += 1;
+	// A coarser level can land on a smaller error, or the ratios may not
+	// shrink. selectLod stops at the first level over its budget, so the
+	// error of a level is at least the one of the level before.
+	for (size_t lodIndex = 1; lodIndex < lodCount; ++lodIndex)
+	{
+		modelRec.lodVector[lodIndex].error = MathHelper::Max(modelRec.lodVector[lodIndex].error, modelRec.lodVector[lodIndex - 1].error);
 	}
 }
 
-void ModelLoader::_getGeometryTransformMatrix(
-	FbxNode* nodePtr,
-	DirectX::XMFLOAT4X4& geometryOffsetMatrix)
+size_t ModelLoader::selectLod(
+	size_t modelIndex,
+	float maxError)
 {
-	// Get the geometry offset to a node. It is never inherited by the children.
-	const FbxVector4 lT = nodePtr->GetGeometricTranslation(FbxNode::eSourcePivot);
-	const FbxVector4 lR = nodePtr->GetGeometricRotation(FbxNode::eSourcePivot);
-	const FbxVector4 lS = nodePtr->GetGeometricScaling(FbxNode::eSourcePivot);
+	assert(modelIndex < m_modelVector.size());
 
-	FbxAMatrix fbxMatrix = FbxAMatrix(lT, lR, lS);
+	const tModelRec& modelRec = m_modelVector[modelIndex];
+	size_t lodIndex = 0;
 
-	_fbxToMatrix(fbxMatrix, geometryOffsetMatrix);
+	while ((lodIndex < modelRec.lodVector.size()) && (modelRec.lodVector[lodIndex].error <= maxError))
+	{
+		++lodIndex;
+	}
+
+	return lodIndex;
 }
 
-bool ModelLoader::_isMeshSkinned(
-	FbxMesh* meshPtr)
+void ModelLoader::_makeWeldKey(
+	const ModelLoader::tSkinnedVertice& skinnedVertice,
+	ModelLoader::tWeldKey& weldKey)
 {
-	long boneCount = _getBoneCount(meshPtr);
+	const float components[] =
+	{
+		skinnedVertice.point.x,
+		skinnedVertice.point.y,
+		skinnedVertice.point.z,
+		skinnedVertice.normal.x,
+		skinnedVertice.normal.y,
+		skinnedVertice.normal.z,
+		skinnedVertice.tex.x,
+		skinnedVertice.tex.y,
+	};
+	const unsigned long componentCount = _countof(components);
+
+	static_assert(_countof(components) + 3 == kWeldKeyValueCount, "weld key size mismatch");
+
+	for (unsigned long i = 0; i < componentCount; ++i)
+	{
+		// -0.0 and 0.0 compare equal, so they must hash the same.
+		float component = (components[i] == 0.0f) ? 0.0f : components[i];
 
-	return boneCount > 0;
+		memcpy(&weldKey.values[i], &component, sizeof(component));
+	}
+
+	weldKey.values[componentCount] = skinnedVertice.boneWeights;
+	weldKey.values[componentCount + 1] = skinnedVertice.boneIndices[0] | (skinnedVertice.boneIndices[1] << 16);
+	weldKey.values[componentCount + 2] = skinnedVertice.boneIndices[2] | (skinnedVertice.boneIndices[3] << 16);
 }
 
-void ModelLoader::_loadMeshBoneWeightsAndIndices(
-	FbxNode* nodePtr,
-	tModelRec& modelRec)
+// The cell takes the place of the point, normal and uv. Vertices with a
+// different skin never weld, so it still narrows the chains.
+void ModelLoader::_makeWeldCellKey(
+	const ModelLoader::tSkinnedVertice& skinnedVertice,
+	const std::int64_t cell[3],
+	ModelLoader::tWeldKey& weldKey)
 {
-	FbxMesh* meshPtr = nodePtr->GetMesh();
-	DirectX::XMFLOAT4X4 geometryTransform;
-	tControlPointRemap controlPointRemap;
+	static_assert(sizeof(std::int64_t) * 3 <= sizeof(std::uint32_t) * (kWeldKeyValueCount - 3), "weld key size mismatch");
 
-	// maps control points to vertex indexes
-	_loadControlPointRemap(meshPtr, controlPointRemap);
+	memset(weldKey.values, 0, sizeof(weldKey.values));
+	memcpy(weldKey.values, cell, sizeof(std::int64_t) * 3);
 
-	// takes into account an offsetted model.
-	_getGeometryTransformMatrix(nodePtr, geometryTransform);
+	weldKey.values[kWeldKeyValueCount - 3] = skinnedVertice.boneWeights;
+	weldKey.values[kWeldKeyValueCount - 2] = skinnedVertice.boneIndices[0] | (skinnedVertice.boneIndices[1] << 16);
+	weldKey.values[kWeldKeyValueCount - 1] = skinnedVertice.boneIndices[2] | (skinnedVertice.boneIndices[3] << 16);
+}
 
-	// A deformer is a FBX thing, which contains some clusters
-	// A cluster contains a link, which is basically a joint
-	// Normally, there is only one deformer in a mesh
-	// We are using only skins, so we see if this is a skin
-	FbxSkin* currSkin = (FbxSkin*)(meshPtr->GetDeformer(0, FbxDeformer::eSkin));
+bool ModelLoader::_isWeldMatch(
+	const ModelLoader::tSkinnedVertice& left,
+	const ModelLoader::tSkinnedVertice& right,
+	float weldEpsilon)
+{
+	return (fabsf(left.point.x - right.point.x) <= weldEpsilon)
+		&& (fabsf(left.point.y - right.point.y) <= weldEpsilon)
+		&& (fabsf(left.point.z - right.point.z) <= weldEpsilon)
+		&& (fabsf(left.normal.x - right.normal.x) <= weldEpsilon)
+		&& (fabsf(left.normal.y - right.normal.y) <= weldEpsilon)
+		&& (fabsf(left.normal.z - right.normal.z) <= weldEpsilon)
+		&& (fabsf(left.tex.x - right.tex.x) <= weldEpsilon)
+		&& (fabsf(left.tex.y - right.tex.y) <= weldEpsilon)
+		&& (left.boneWeights == right.boneWeights)
+		&& (0 == memcmp(left.boneIndices, right.boneIndices, sizeof(left.boneIndices)));
+}
 
-	long numberOfClusters = currSkin->GetClusterCount();
-	for (long clusterIndex = 0; clusterIndex < numberOfClusters; ++clusterIndex)
+size_t ModelLoader::tWeldKeyHasher::operator()(
+	const ModelLoader::tWeldKey& weldKey) const
+{
+	// FNV-1a over the key values.
+	unsigned long long hash = 14695981039346656037ULL;
+
+	for (unsigned long i = 0; i < kWeldKeyValueCount; ++i)
 	{
-		FbxCluster* clusterPtr = currSkin->GetCluster(clusterIndex);
-		long numOfIndices = clusterPtr->GetControlPointIndicesCount();
-		double* weightPtr = clusterPtr->GetControlPointWeights();
-		int* indicePtr = clusterPtr->GetControlPointIndices();
-		std::string currJointName = clusterPtr->GetLink()->GetName();
-		std::string secondName = clusterPtr->GetName();
-		unsigned long boneIndex = _boneNameToindex(currJointName);
-		FbxAMatrix transformMatrix;
-		FbxAMatrix transformLinkMatrix;
-		FbxAMatrix globalBindposeInverseMatrix;
+		hash ^= weldKey.values[i];
+		hash *= 1099511628211ULL;
+	}
 
-		// Now that we have the clusterPtr, let's calculate the inverse bind pose matrix.
-		clusterPtr->GetTransformLinkMatrix(transformLinkMatrix);
-		clusterPtr->GetTransformMatrix(transformMatrix);
-		globalBindposeInverseMatrix = transformLinkMatrix.Inverse() * transformMatrix;
-		_fbxToMatrix(globalBindposeInverseMatrix, m_boneVector[boneIndex].offset);
+	return static_cast<size_t>(hash);
+}
 
-		// Update the information in mSkeleton 
-		m_boneVector[boneIndex].fbxClusterPtr = clusterPtr;
+bool ModelLoader::tWeldKeyEqual::operator()(
+	const ModelLoader::tWeldKey& left,
+	const ModelLoader::tWeldKey& right) const
+{
+	return 0 == memcmp(left.values, right.values, sizeof(left.values));
+}
 
-		if (nullptr == clusterPtr->GetLink())
-		{
-			continue;
-		}
+// Built in two passes over the polygon corners. The first counts the
+// corners of every control point, the second scatters them into place.
+void ModelLoader::_loadControlPointRemap(
+	FbxMesh* meshPtr,
+	ModelLoader::tControlPointRemap& controlPointRemap)
+{
+	buildControlPointRemap(
+		meshPtr->GetPolygonVertices(),
+		meshPtr->GetPolygonVertexCount(),
+		meshPtr->GetControlPointsCount(),
+		m_loadArena,
+		controlPointRemap);
+}
 
-		// Associate each joint with the control points it affects
-		for (long i = 0; i < numOfIndices; ++i)
-		{
-			double weight = weightPtr[i];
+void ModelLoader::buildControlPointRemap(
+	const int* polygonVertices,
+	int cornerCount,
+	int controlPointCount,
+	LinearArena& arena,
+	ModelLoader::tControlPointRemap& controlPointRemap)
+{
+	typedef std::vector<std::atomic<int>, ArenaAllocator<std::atomic<int>>> tAtomicIndexVector;
 
-			if (weight == 0.0)
-			{
-				continue;
-			}
+	tAtomicIndexVector cursorVector(controlPointCount, arena);
 
-			// all the points the control word is mapped to
-			tControlPointIndexes& controlPointIndexes = controlPointRemap[indicePtr[i]];
+	for (auto& cursor : cursorVector)
+	{
+		cursor.store(0, std::memory_order_relaxed);
+	}
 
-			for (auto const& i : controlPointIndexes)
-			{
-				// Change the index vector offset, to a vertex offset.
-				long vertexIndex = modelRec.indexVector[i];
+	concurrency::parallel_for(0, cornerCount, static_cast<int>(kPolygonChunkSize), [&](int first)
+	{
+		const int last = MathHelper::Min(first + static_cast<int>(kPolygonChunkSize), cornerCount);
 
-				_addBoneInfluence(modelRec.verticeVector, vertexIndex, boneIndex, weight);
-			}
+		for (int corner = first; corner < last; ++corner)
+		{
+			cursorVector[polygonVertices[corner]].fetch_add(1, std::memory_order_relaxed);
 		}
-	}
-}
+	});
 
-void ModelLoader::_calculateCombinedTransforms()
-{
-	if (m_boneVector.empty())
-	{
-		return;
-	}
+	controlPointRemap.offsetVector.resize(controlPointCount + 1);
+	controlPointRemap.cornerVector.resize(cornerCount);
+	controlPointRemap.offsetVector[0] = 0;
 
-	if (m_boneVector.size() == 1)
+	for (int controlPointIndex = 0; controlPointIndex < controlPointCount; ++controlPointIndex)
 	{
-		return;
+		const int offset = controlPointRemap.offsetVector[controlPointIndex];
+
+		controlPointRemap.offsetVector[controlPointIndex + 1] = offset + cursorVector[controlPointIndex].load(std::memory_order_relaxed);
+		cursorVector[controlPointIndex].store(offset, std::memory_order_relaxed);
 	}
 
-	for (auto& bone : m_boneVector)
+	concurrency::parallel_for(0, cornerCount, static_cast<int>(kPolygonChunkSize), [&](int first)
 	{
-		if (bone.parentIndex != kInvalidBoneIndex)
+		const int last = MathHelper::Min(first + static_cast<int>(kPolygonChunkSize), cornerCount);
+
+		for (int corner = first; corner < last; ++corner)
 		{
-			XMMATRIX nodeLocalTransform = XMLoadFloat4x4(&bone.nodeLocalTransform);
-			XMMATRIX combinedTransformLocal = XMLoadFloat4x4(&m_boneVector[bone.parentIndex].combinedTransform);
-			XMMATRIX combinedTransformFinal = XMMatrixMultiply(nodeLocalTransform, combinedTransformLocal);
-			XMStoreFloat4x4(&(bone.combinedTransform), combinedTransformFinal);
+			int slot = cursorVector[polygonVertices[corner]].fetch_add(1, std::memory_order_relaxed);
+
+			controlPointRemap.cornerVector[slot] = corner;
 		}
-		else
+	});
+
+	// The scatter order depends on the scheduling, sort the rows so the
+	// remap is the same on every load.
+	concurrency::parallel_for(0, controlPointCount, static_cast<int>(kPolygonChunkSize), [&](int first)
+	{
+		const int last = MathHelper::Min(first + static_cast<int>(kPolygonChunkSize), controlPointCount);
+
+		for (int controlPointIndex = first; controlPointIndex < last; ++controlPointIndex)
 		{
-			bone.combinedTransform = bone.nodeLocalTransform;
+			std::sort(
+				controlPointRemap.cornerVector.begin() + controlPointRemap.offsetVector[controlPointIndex],
+				controlPointRemap.cornerVector.begin() + controlPointRemap.offsetVector[controlPointIndex + 1]);
 		}
+	});
+}
+
+void ModelLoader::loadBoneMatriceVector()
+{
+	if (m_loadPending.load())
+	{
+		return;
 	}
+
+	m_boneMatrixVector.assign(m_skeleton.paletteVector.begin(), m_skeleton.paletteVector.end());
 }
 
-long ModelLoader::_boneNameToindex(
-	const std::string& boneName)
+void ModelLoader::loadPaletteMatrices(
+	const ModelLoader::tSubmeshRec& submeshRec,
+	XMFLOAT4X4* paletteMatrices)
 {
-	long index = 0;
+	assert(m_loadSettings.partitionSkin);
+	assert(submeshRec.boneIndexVector.size() <= m_boneMatrixVectorSize);
 
-	for (auto const& i : m_boneVector)
+	for (size_t i = 0; i < submeshRec.boneIndexVector.size(); ++i)
 	{
-		if (i.name == boneName)
-		{
-			return index;
-		}
+		const std::uint32_t boneIndex = submeshRec.boneIndexVector[i];
 
-		++index;
+		// Nothing is posed before the load finished.
+		paletteMatrices[i] = (boneIndex < m_boneMatrixVector.size())
+			? m_boneMatrixVector[boneIndex]
+			: MathHelper::Identity4x4();
 	}
-
-	assert(false);
-	return kInvalidBoneIndex;
 }
 
-void ModelLoader::_addBoneInfluence(
-	ModelLoader::tSkinnedVerticeVector& skinnedVerticeVector,
-	long vertexIndex,
-	long boneIndex,
-	double boneWeight)
+// Runs every take through the SDK evaluator once, at the scene frame rate.
+// Rotations are kept on the hemisphere of the previous frame, so sampling
+// can blend neighbors without checking the sign. Takes are skipped like
+// _findFirstTake() skips them, so clip 0 is the played take.
+void ModelLoader::_bakeClips()
 {
-	unsigned long integerWeight = clamp(static_cast<unsigned long>(boneWeight * 255.0 + 0.5), unsigned long(0), unsigned long(255));
+	m_clipVector.clear();
+	m_clipNameVector.clear();
+
+	FbxArray<FbxString*> animStackNameArray;
+
+	m_scenePtr->FillAnimStackNameArray(animStackNameArray);
+
+	FbxGlobalSettings& globalSettings = m_scenePtr->GetGlobalSettings();
+	double frameRate = (globalSettings.GetTimeMode() == FbxTime::eCustom)
+		? globalSettings.GetCustomFrameRate()
+		: FbxTime::GetFrameRate(globalSettings.GetTimeMode());
 
-	if (0 == integerWeight)
+	if (frameRate <= 0.0)
 	{
-		return;
+		// The default mode has no rate of its own.
+		frameRate = 30.0;
 	}
 
-	tPackedInt packedIndices;
-	tPackedInt packedWeights;
-	unsigned long smallestWeightIndex = 0xFFFFFFFF;
-	unsigned long smallestWeight = 0xFFFFFFFF;
-
-	packedIndices.number = skinnedVerticeVector[vertexIndex].boneIndices;
-	packedWeights.number = skinnedVerticeVector[vertexIndex].boneWeights;
+	const size_t boneCount = m_boneVector.size();
+	FbxAnimStack* initialAnimStackPtr = m_scenePtr->GetCurrentAnimationStack();
 
-	for (unsigned long i = 0; i < 4; ++i)
+	for (int takeIndex = 0; takeIndex < animStackNameArray.GetCount(); ++takeIndex)
 	{
-		unsigned long packedWeight = packedWeights.bytes[i];
+		FbxAnimStack* animStackPtr = m_scenePtr->FindMember<FbxAnimStack>(animStackNameArray[takeIndex]->Buffer());
+		FbxTakeInfo* takeInfoPtr = m_scenePtr->GetTakeInfo(*animStackNameArray[takeIndex]);
 
-		if (packedWeight == 0)
-		{
-			smallestWeightIndex = i;
-			smallestWeight = 0;
-		}
-		else if ((packedWeight < boneWeight)
-			&& (packedWeight < smallestWeight))
+		if ((nullptr == animStackPtr) || (nullptr == takeInfoPtr))
 		{
-			smallestWeightIndex = i;
-			smallestWeight = packedWeight;
+			continue;
 		}
 
-		if (packedIndices.bytes[i] == boneIndex)
+		m_scenePtr->SetCurrentAnimationStack(animStackPtr);
+
+		const double startTime = takeInfoPtr->mLocalTimeSpan.GetStart().GetSecondDouble();
+		const double duration = MathHelper::Max(takeInfoPtr->mLocalTimeSpan.GetDuration().GetSecondDouble(), 0.0);
+
+		m_clipVector.emplace_back();
+
+		tAnimationClipRec& clipRec = m_clipVector.back();
+
+		clipRec.name = animStackNameArray[takeIndex]->Buffer();
+		m_clipNameVector.push_back(clipRec.name);
+		clipRec.frameRate = static_cast<float>(frameRate);
+		clipRec.duration = static_cast<float>(duration);
+		clipRec.frameCount = static_cast<std::uint32_t>(ceil(duration * frameRate)) + 1;
+		clipRec.keyVector.resize(clipRec.frameCount * boneCount);
+
+		for (std::uint32_t frame = 0; frame < clipRec.frameCount; ++frame)
 		{
-			return;
+			tBoneKey* keys = &clipRec.keyVector[frame * boneCount];
+			const tBoneKey* previousKeys = (frame > 0) ? keys - boneCount : nullptr;
+			FbxTime fbxTime;
+
+			fbxTime.SetSecondDouble(startTime + MathHelper::Min(frame / frameRate, duration));
+
+			for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+			{
+				XMFLOAT4X4 nodeLocalTransform;
+				XMVECTOR scale;
+				XMVECTOR rotation;
+				XMVECTOR translation;
+
+				_getNodeLocalTransform(m_boneVector[boneIndex].boneNodePtr, fbxTime, nodeLocalTransform);
+
+				if (!XMMatrixDecompose(&scale, &rotation, &translation, XMLoadFloat4x4(&nodeLocalTransform)))
+				{
+					// Collapsed to a point, the rotation is lost anyway.
+					rotation = XMQuaternionIdentity();
+				}
+
+				if ((nullptr != previousKeys)
+					&& (XMVectorGetX(XMVector4Dot(rotation, XMLoadFloat4(&previousKeys[boneIndex].rotation))) < 0.0f))
+				{
+					rotation = XMVectorNegate(rotation);
+				}
+
+				XMStoreFloat3(&keys[boneIndex].translation, translation);
+				XMStoreFloat4(&keys[boneIndex].rotation, rotation);
+				XMStoreFloat3(&keys[boneIndex].scale, scale);
+			}
 		}
 	}
 
-	if (smallestWeightIndex == 0xFFFFFFFF)
-	{
-		// We had more than four weights, and this weight is the smallest.
-		return;
-	}
+	m_scenePtr->SetCurrentAnimationStack(initialAnimStackPtr);
 
-	packedIndices.bytes[smallestWeightIndex] = static_cast<unsigned char>(boneIndex);
-	packedWeights.bytes[smallestWeightIndex] = static_cast<unsigned char>(integerWeight);
-	skinnedVerticeVector[vertexIndex].boneIndices = packedIndices.number;
-	skinnedVerticeVector[vertexIndex].boneWeights = packedWeights.number;
+	FbxArrayDelete(animStackNameArray);
 }
 
-void ModelLoader::_calculatePaletteMatrices()
+// Lerps translation and scale and normalizes the lerped rotation between
+// the two keys around time, in seconds from the start of the take.
+void ModelLoader::_sampleClip(
+	const ModelLoader::tAnimationClipRec& clipRec,
+	float time)
 {
-	for (auto& bone : m_boneVector)
+	const size_t boneCount = m_boneVector.size();
+	const float frame = MathHelper::Clamp(time * clipRec.frameRate, 0.0f, static_cast<float>(clipRec.frameCount - 1));
+	const std::uint32_t frame0 = static_cast<std::uint32_t>(frame);
+	const std::uint32_t frame1 = MathHelper::Min(frame0 + 1, clipRec.frameCount - 1);
+	const XMVECTOR alpha = XMVectorReplicate(frame - frame0);
+	const tBoneKey* keys0 = &clipRec.keyVector[frame0 * boneCount];
+	const tBoneKey* keys1 = &clipRec.keyVector[frame1 * boneCount];
+
+	for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
 	{
-		XMMATRIX offset = XMLoadFloat4x4(&bone.offset);
-		XMMATRIX combinedTransform = XMLoadFloat4x4(&bone.combinedTransform);
-		XMMATRIX boneMatrice = XMMatrixMultiply(offset, combinedTransform);
-		XMStoreFloat4x4(&(bone.boneMatrice), XMMatrixTranspose(boneMatrice));
+		if (!_isBoneAnimated(boneIndex))
+		{
+			continue;
+		}
+
+		XMVECTOR translation = XMVectorLerpV(XMLoadFloat3(&keys0[boneIndex].translation), XMLoadFloat3(&keys1[boneIndex].translation), alpha);
+		XMVECTOR rotation = XMVectorLerpV(XMLoadFloat4(&keys0[boneIndex].rotation), XMLoadFloat4(&keys1[boneIndex].rotation), alpha);
+		XMVECTOR scale = XMVectorLerpV(XMLoadFloat3(&keys0[boneIndex].scale), XMLoadFloat3(&keys1[boneIndex].scale), alpha);
+
+		XMStoreFloat4x4A(
+			&_getLocalTransform(boneIndex),
+			XMMatrixAffineTransformation(scale, XMVectorZero(), XMQuaternionNormalize(rotation), translation));
 	}
 }
 
-void ModelLoader::_loadNodeLocalTransformMatrices(
-	const FbxTime& fbxTime)
+// Nothing points into the scene after this, the clips drive the bones.
+void ModelLoader::_releaseScene()
 {
-	for (unsigned long i = 0; i < m_boneVector.size(); ++i)
+	if ((m_clipVector.empty() && m_compressedClipVector.empty())
+		|| (nullptr == m_scenePtr))
+	{
+		return;
+	}
+
+	for (auto& bone : m_boneVector)
 	{
-		_getNodeLocalTransform(m_boneVector[i].boneNodePtr, fbxTime, m_boneVector[i].nodeLocalTransform);
+		bone.boneNodePtr = nullptr;
+		bone.fbxSkeletonPtr = nullptr;
+		bone.fbxClusterPtr = nullptr;
 	}
+
+	m_scenePtr->Destroy();
+	m_scenePtr = nullptr;
 }
 
-void ModelLoader::_normalizeBoneWeights(
-	tModelRec& modelRec)
+// <model>.<take>.clip, every character of the take name but letters,
+// digits, '-' and '_' replaced by '_'. A take that ends up with the name of
+// an earlier one gets its index as well.
+std::string ModelLoader::_getClipFilename(
+	const std::vector<std::string>& clipNameVector,
+	size_t clipIndex)
 {
-	for (auto& vertice : modelRec.verticeVector)
+	auto getFileName = [](const std::string& clipName)
 	{
-		tPackedInt packedWeights;
-
-		packedWeights.number = vertice.boneWeights;
+		std::string fileName = clipName;
 
+		for (auto& c : fileName)
 		{
-			unsigned long totalWeight =
-				packedWeights.bytes[0]
-				+ packedWeights.bytes[1]
-				+ packedWeights.bytes[2]
-				+ packedWeights.bytes[3];
-
-			assert(totalWeight != 0);
-
-			if ((totalWeight >= 254)
-				&& (totalWeight <= 256))
-			{ // no need to normalize
-				continue;
+			if (!isalnum(static_cast<unsigned char>(c)) && (c != '-') && (c != '_'))
+			{
+				c = '_';
 			}
 		}
 
-		float weights[4];
-		float calculation[4];
+		return fileName;
+	};
 
-		weights[0] = static_cast<float>(packedWeights.bytes[0]);
-		weights[1] = static_cast<float>(packedWeights.bytes[1]);
-		weights[2] = static_cast<float>(packedWeights.bytes[2]);
-		weights[3] = static_cast<float>(packedWeights.bytes[3]);
+	const std::string fileName = getFileName(clipNameVector[clipIndex]);
 
-		float totalWeight = weights[0] + weights[1] + weights[2] + weights[3];
+	for (size_t i = 0; i < clipIndex; ++i)
+	{
+		if (getFileName(clipNameVector[i]) == fileName)
+		{
+			return m_filename + "." + fileName + "." + std::to_string(clipIndex) + ".clip";
+		}
+	}
 
-		calculation[0] = 255.0f * (weights[0] / totalWeight) + 0.5f;
-		calculation[1] = 255.0f * (weights[1] / totalWeight) + 0.5f;
-		calculation[2] = 255.0f * (weights[2] / totalWeight) + 0.5f;
-		calculation[3] = 255.0f * (weights[3] / totalWeight) + 0.5f;
+	return m_filename + "." + fileName + ".clip";
+}
 
-		packedWeights.bytes[0] = static_cast<unsigned char>(calculation[0]);
-		packedWeights.bytes[1] = static_cast<unsigned char>(calculation[1]);
-		packedWeights.bytes[2] = static_cast<unsigned char>(calculation[2]);
-		packedWeights.bytes[3] = static_cast<unsigned char>(calculation[3]);
+// Clips depend on the file, the bones the settings leave and the
+// tolerances.
+unsigned long long ModelLoader::_getClipHash()
+{
+	unsigned long long hash = hashBytes(&m_sourceHash, sizeof(m_sourceHash), _getLoadSettingsHash());
 
-		vertice.boneWeights = packedWeights.number;
-	}
+	return hashBytes(&m_loadSettings.clipTolerances, sizeof(m_loadSettings.clipTolerances), hash);
 }
 
-
-// This function re-indexes the vertex buffer and makes it smaller.
-void ModelLoader::_compressSkinnedVertices(
-	ModelLoader::tModelRec& modelRec)
+// Maps the clips an earlier load saved, all of them or none.
+bool ModelLoader::_loadCompressedClips(
+	const std::vector<std::string>& clipNameVector,
+	size_t boneCount)
 {
-	tSkinnedVerticeVector newVertices;
-	unsigned short foundIndice;
+	m_compressedClipVector.clear();
 
-	for (auto& i : modelRec.indexVector)
+	for (size_t clipIndex = 0; clipIndex < clipNameVector.size(); ++clipIndex)
 	{
-		tSkinnedVertice currentSkinnedVertice = modelRec.verticeVector[i];
-
-		foundIndice = _findSkinnedVertice(newVertices, currentSkinnedVertice);
+		auto clipPtr = std::make_unique<tCompressedClip>();
 
-		if (foundIndice == 0xFFFF) // not found
-		{
-			i = static_cast<unsigned short>(newVertices.size());
-			newVertices.push_back(currentSkinnedVertice);
-		}
-		else
+		if (!clipPtr->open(_getClipFilename(clipNameVector, clipIndex).c_str(), _getClipHash())
+			|| (clipPtr->boneCount() != boneCount))
 		{
-			i = foundIndice;
+			m_compressedClipVector.clear();
+			return false;
 		}
+
+		m_compressedClipVector.push_back(std::move(clipPtr));
 	}
 
-	modelRec.verticeVector.swap(newVertices);
+	return true;
 }
 
-void ModelLoader::_loadControlPointRemap(
-	FbxMesh* meshPtr,
-	ModelLoader::tControlPointRemap& controlPointRemap)
+// The compressed clips replace the baked keys.
+void ModelLoader::_compressClips()
 {
-	const long lPolygonCount = meshPtr->GetPolygonCount();
+	m_compressedClipVector.clear();
 
-	controlPointRemap.resize(lPolygonCount);
-
-	for (long lPolygonIndex = 0; lPolygonIndex < lPolygonCount; lPolygonIndex++)
+	for (size_t clipIndex = 0; clipIndex < m_clipVector.size(); ++clipIndex)
 	{
-		long lPolygonSize = meshPtr->GetPolygonSize(lPolygonIndex);
-
-		for (long lVertexIndex = 0; lVertexIndex < lPolygonSize; lVertexIndex++)
+		const tAnimationClipRec& clipRec = m_clipVector[clipIndex];
+		auto clipPtr = std::make_unique<tCompressedClip>();
+
+		clipPtr->compress(
+			clipRec.keyVector.data(),
+			m_boneVector.size(),
+			clipRec.frameCount,
+			clipRec.frameRate,
+			m_loadSettings.clipTolerances,
+			_getClipHash());
+
+		if (m_loadSettings.useModelCache)
 		{
-			long lControlPointIndex = meshPtr->GetPolygonVertex(lPolygonIndex, lVertexIndex);
-
-			controlPointRemap[lControlPointIndex].push_back(lPolygonIndex * kTriangleVertexCount + lVertexIndex);
+			clipPtr->save(_getClipFilename(m_clipNameVector, clipIndex).c_str());
 		}
+
+		m_compressedClipVector.push_back(std::move(clipPtr));
 	}
+
+	m_clipVector.clear();
 }
 
-unsigned short  ModelLoader::_findSkinnedVertice(
-	const  ModelLoader::tSkinnedVerticeVector& skinnedVerticeVector,
-	const  ModelLoader::tSkinnedVertice& skinnedVertice)
+void ModelLoader::_sampleCompressedClip(
+	const tCompressedClip& clip,
+	float time)
 {
-	for (size_t i = 0; i < skinnedVerticeVector.size(); ++i)
-	{
-		XMVECTOR chosenPoint = XMLoadFloat3(&(skinnedVertice.point));
-		XMVECTOR pointInVector = XMLoadFloat3(&(skinnedVerticeVector[i].point));
-		XMVECTOR chosenNormal = XMLoadFloat3(&(skinnedVertice.normal));
-		XMVECTOR normalInVector = XMLoadFloat3(&(skinnedVerticeVector[i].normal));
+	const size_t boneCount = m_boneVector.size();
 
-		if ((XMVector3Equal(chosenPoint, pointInVector))
-			&& (XMVector3Equal(chosenNormal, normalInVector))
-			&& (skinnedVertice.tex.x == skinnedVerticeVector[i].tex.x)
-			&& (skinnedVertice.tex.y == skinnedVerticeVector[i].tex.y))
+	size_t decodedBoneCount = 0;
+
+	m_poseKeyVector.resize(boneCount);
+
+	auto decodeStart = std::chrono::high_resolution_clock::now();
+
+	for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+	{
+		if (_isBoneAnimated(boneIndex))
 		{
-			return static_cast<unsigned short>(i);
+			clip.decodeBone(time, boneIndex, m_poseKeyVector[boneIndex]);
+			++decodedBoneCount;
 		}
 	}
 
-	return 0xFFFF;
-}
-
-void ModelLoader::loadBoneMatriceVector()
-{
-	m_boneMatrixVector.clear();
+	m_clipDecodeNanoseconds += std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - decodeStart).count();
+	m_clipDecodedBoneCount += decodedBoneCount;
 
-	for (const auto& bone : m_boneVector)
+	for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
 	{
-		m_boneMatrixVector.push_back(bone.boneMatrice);
-	}
+		if (!_isBoneAnimated(boneIndex))
+		{
+			continue;
+		}
 
+		const tBoneKey& key = m_poseKeyVector[boneIndex];
+
+		XMStoreFloat4x4A(
+			&_getLocalTransform(boneIndex),
+			XMMatrixAffineTransformation(
+				XMLoadFloat3(&key.scale),
+				XMVectorZero(),
+				XMLoadFloat4(&key.rotation),
+				XMLoadFloat3(&key.translation)));
+	}
 }
 
-unsigned long long ModelLoader::_getAnimationDuration()
+// The first take with a stack and take info. Every path plays this one:
+// the SDK evaluation, clip 0 and the static bone scan.
+bool ModelLoader::_findFirstTake(
+	FbxAnimStack*& animStackPtr,
+	FbxTakeInfo*& takeInfoPtr)
 {
 	FbxArray<FbxString*> animStackNameArray;
-	FbxAnimStack* fbxAnimStackPtr = m_scenePtr->GetSrcObject<FbxAnimStack>(0);
-
-	assert(nullptr != fbxAnimStackPtr);
 
 	m_scenePtr->FillAnimStackNameArray(animStackNameArray);
 
-	int animStackNameArraySize = animStackNameArray.GetCount();
+	animStackPtr = nullptr;
+	takeInfoPtr = nullptr;
+
+	for (int takeIndex = 0; takeIndex < animStackNameArray.GetCount(); ++takeIndex)
+	{
+		animStackPtr = m_scenePtr->FindMember<FbxAnimStack>(animStackNameArray[takeIndex]->Buffer());
+		takeInfoPtr = m_scenePtr->GetTakeInfo(*animStackNameArray[takeIndex]);
+
+		if ((nullptr != animStackPtr) && (nullptr != takeInfoPtr))
+		{
+			break;
+		}
+	}
+
+	FbxArrayDelete(animStackNameArray);
+
+	return (nullptr != animStackPtr) && (nullptr != takeInfoPtr);
+}
 
-	assert(animStackNameArraySize >= 1);
+// Makes the first take current, and keeps its duration and start. Times
+// handed to _buildMatrices() count from that start on every path.
+void ModelLoader::_selectFirstTake()
+{
+	FbxAnimStack* animStackPtr = nullptr;
+	FbxTakeInfo* takeInfoPtr = nullptr;
+	const bool found = _findFirstTake(animStackPtr, takeInfoPtr);
 
-	FbxTakeInfo* currentTakeInfoPtr = m_scenePtr->GetTakeInfo(*animStackNameArray[0]);
+	assert(found);
 
-	assert(nullptr != currentTakeInfoPtr);
+	if (!found)
+	{
+		return;
+	}
 
-	return currentTakeInfoPtr->mLocalTimeSpan.GetStop().GetMilliSeconds()
-		- currentTakeInfoPtr->mLocalTimeSpan.GetStart().GetMilliSeconds();
+	m_scenePtr->SetCurrentAnimationStack(animStackPtr);
+	m_animationStartTime = takeInfoPtr->mLocalTimeSpan.GetStart();
+	m_initialAnimationDurationInMs = takeInfoPtr->mLocalTimeSpan.GetStop().GetMilliSeconds()
+		- takeInfoPtr->mLocalTimeSpan.GetStart().GetMilliSeconds();
 }
@@ -1,9 +1,18 @@
 #pragma once
 #include "../Utilities/d3dUtil.h"
+#include "../Utilities/LinearArena.h"
 #include "../Utilities/MathHelper.h"
+#include "../Utilities/MeshOptimizer.h"
 #include "../Utilities/tAutodeskMemoryStream.h"
+#include "../Utilities/tCompressedClip.h"
+#include "../Utilities/tMappedFile.h"
+#include <atomic>
+#include <cstdint>
 #include <fbxsdk.h>
+#include <memory>
+#include <ppl.h>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class ModelLoader
@@ -16,10 +25,180 @@ public:
 		DirectX::XMFLOAT3 point;
 		DirectX::XMFLOAT3 normal;
 		DirectX::XMFLOAT2 tex;
-		unsigned long boneWeights;
-		unsigned long boneIndices;
+		std::uint32_t boneWeights;
+
+		// 16 bit, rigs can have more than 256 bones. Palette local
+		// indices with tLoadSettings::partitionSkin. The split streams
+		// and the compact layout upload 8 bit ones, this layout only
+		// goes to the GPU without splitVertexStreams, or when an index
+		// does not fit 8 bits.
+		std::uint16_t boneIndices[4];
 	} tSkinnedVertice;
 
+	// Opt-in 24 byte layout for the GPU. The point is quantized to the mesh
+	// bounds, the normal is octahedral encoded and the uv is a half.
+	typedef struct
+	{
+		std::uint16_t point[4];    // R16G16B16A16_UNORM, w is 1
+		std::int16_t normal[2];    // R16G16_SNORM
+		std::uint16_t tex[2];      // R16G16_FLOAT
+		std::uint32_t boneWeights; // R8G8B8A8_UINT
+		std::uint32_t boneIndices; // R8G8B8A8_UINT, bones 0 to 255
+	} tCompactSkinnedVertice;
+	typedef std::vector<tCompactSkinnedVertice> tCompactSkinnedVerticeVector;
+
+	// The same vertices split in two streams. Passes that only place the
+	// mesh, like depth or skinning, read the position stream alone.
+	typedef struct
+	{
+		DirectX::XMFLOAT3 point;
+		std::uint32_t boneWeights;  // R8G8B8A8_UINT
+		std::uint8_t boneIndices[4]; // R8G8B8A8_UINT, bones 0 to 255
+	} tPositionStreamVertice;
+	typedef std::vector<tPositionStreamVertice> tPositionStreamVerticeVector;
+
+	typedef struct
+	{
+		DirectX::XMFLOAT3 normal;
+		DirectX::XMFLOAT2 tex;
+	} tShadingStreamVertice;
+	typedef std::vector<tShadingStreamVertice> tShadingStreamVerticeVector;
+
+	typedef struct
+	{
+		std::uint16_t point[4];
+		std::uint32_t boneWeights;
+		std::uint32_t boneIndices;
+	} tCompactPositionStreamVertice;
+	typedef std::vector<tCompactPositionStreamVertice> tCompactPositionStreamVerticeVector;
+
+	typedef struct
+	{
+		std::int16_t normal[2];
+		std::uint16_t tex[2];
+	} tCompactShadingStreamVertice;
+	typedef std::vector<tCompactShadingStreamVertice> tCompactShadingStreamVerticeVector;
+
+	enum
+	{
+		kMaxLodCount = 4,
+	};
+
+	// Options that control how a model is imported.
+	// Value initialized settings give the default behavior.
+	typedef struct
+	{
+		// Vertices are welded when their point, normal and uv are all within
+		// this distance of each other, per component. Zero only welds
+		// identical vertices. Either way the skin has to match exactly, so
+		// welding never changes how the mesh deforms.
+		float weldEpsilon;
+
+		// Keep a binary copy of the loaded meshes, skeleton and clips next
+		// to the .fbx, and use it instead of rebuilding them on the next
+		// load. With bakeClips a cached load never imports the .fbx,
+		// without it the scene is still imported to evaluate the takes.
+		bool useModelCache;
+
+		// Triangulate polygons and convert the axis system and unit while
+		// the mesh arrays are extracted, instead of converting and
+		// triangulating the whole FBX scene through the SDK first.
+		bool nativeConversion;
+
+		// load() returns once the positions, indices and bounds are in,
+		// normals, uvs, bones and skinning follow on a background task.
+		// See isLoadComplete() and finishLoad(). The SDK imports the whole
+		// file in the first phase either way, without nativeConversion it
+		// also converts and triangulates the scene there.
+		bool progressive;
+
+		// Skip the FBX content the loader never reads, like materials,
+		// textures and blend shapes. The skin links are still imported.
+		bool minimalImport;
+
+		// Reorder the triangles for the post transform cache and the
+		// vertices by first use. Every fur shell pays for each miss.
+		bool optimizeVertexOrder;
+
+		// Also order clusters of triangles to reduce overdraw, as long as
+		// the cache misses do not grow by more than a few percent.
+		bool optimizeOverdraw;
+
+		// Pack the GPU vertices in the compact layout. Fills
+		// compactVerticeVector, or the compact streams with
+		// splitVertexStreams. A mesh with a bone index over 255 keeps the
+		// full width layout, see tModelRec::compactVertices.
+		bool compactVertices;
+
+		// Fill qTangentVector in every mesh.
+		bool generateTangents;
+
+		// Pack the GPU vertices in a position and a shading stream, full
+		// width or compact. The full width position stream is always
+		// filled, the CPU passes read it. The streams have 8 bit bone
+		// indices, a mesh with a bone index over 255 keeps the
+		// interleaved vertices, see tModelRec::splitVertexStreams.
+		bool splitVertexStreams;
+
+		// Combine every mesh into m_mergedModel, one buffer for the whole
+		// character. Only the merged model is packed for upload then.
+		bool mergeMeshes;
+
+		// Split the submeshes so none uses more bones than the bone matrix
+		// vector size given to load(). Every submesh then has its own
+		// palette, see loadPaletteMatrices().
+		bool partitionSkin;
+
+		// Sort the vertices of every palette by influence count, so
+		// skinVertices() runs one kernel per count. This moves vertices
+		// out of the fetch order optimizeVertexOrder gave them, only the
+		// CPU skinning gains from it.
+		bool bucketInfluences;
+
+		// Drop the bones no vertex is weighted to, unless they animate a
+		// bone that is. Static ones in between fold into their children.
+		bool pruneBones;
+
+		// Triangles per culling cluster of the full mesh, see
+		// cullClusters(). Zero builds no clusters.
+		unsigned long clusterTriangleCount;
+
+		// Sample every take into m_clipVector when the load finishes and
+		// release the scene, animation then never calls the SDK.
+		bool bakeClips;
+
+		// Replace the baked clips with compressed ones, saved next to the
+		// model cache with useModelCache and mapped again by later loads.
+		bool compressClips;
+		tCompressedClip::tTolerances clipTolerances;
+
+		// Only update the bones the take moves, or that sit below one.
+		// The others keep the pose of the first frame.
+		bool skipStaticBones;
+
+		// Triangle count of every generated level of detail, as a ratio of
+		// the full mesh, like 0.5, 0.25 and 0.1. The first zero ends the chain.
+		float lodTriangleRatios[kMaxLodCount];
+	} tLoadSettings;
+
+	// Tangent frame as a 16 bit snorm quaternion, the sign of w is the
+	// handedness of the bitangent. Every axis stays within 0.004 degrees.
+	typedef struct
+	{
+		std::int16_t rotation[4];
+	} tQTangent;
+	typedef std::vector<tQTangent> tQTangentVector;
+
+	// Used to do a reverse lookup, stored as compressed sparse rows.
+	// The polygon corners of control point i are
+	// cornerVector[offsetVector[i]] up to cornerVector[offsetVector[i + 1]].
+	typedef std::vector<int, ArenaAllocator<int>> tControlPointIndexes;
+	typedef struct
+	{
+		tControlPointIndexes offsetVector;
+		tControlPointIndexes cornerVector;
+	} tControlPointRemap;
+
 private:
 	fbxsdk::FbxManager* m_sdkManagerPtr;
 	Microsoft::WRL::ComPtr<ID3D12Device> m_devicePtr;
@@ -31,28 +210,189 @@ private:
 		kInvalidBoneIndex = -1,
 		kTriangleVertexCount = 3,
 		kBoneInfluencesPerVertice = 4,
+		kMaxGatheredInfluences = 8,
+		kMaxPackedWeight = 255,
+		kWeldKeyValueCount = 11,
+		kModelCacheMagic = 0x4344464D, // "MFDC"
+		kModelCacheVersion = 11,
+		kMaxVertexCount16 = 0xFFFF,
+		kMaxCompactBoneIndex = 0xFF,
+		kPolygonChunkSize = 16384,
+		kSkeletonChunkSize = 256,
 	};
 
+	static const std::uint32_t kInvalidSubmeshIndex = 0xFFFFFFFF;
+	static const std::uint32_t kInvalidVertexIndex = 0xFFFFFFFF;
+
 	typedef union
 	{
 		unsigned char bytes[4];
-		unsigned long number;
+		std::uint32_t number;
 	} tPackedInt;
 
 	typedef std::vector<tSkinnedVertice> tSkinnedVerticeVector;
 	typedef tSkinnedVerticeVector::iterator tSkinnedVerticeIterator;
 	typedef tSkinnedVerticeVector::const_iterator tSkinnedVerticeConstIterator;
 
-	typedef std::vector<unsigned short> tVertexIndexVector;
+	// Unwelded vertices of a mesh, they only live while loading.
+	typedef std::vector<tSkinnedVertice, ArenaAllocator<tSkinnedVertice>> tLoadVerticeVector;
+	typedef std::vector<tLoadVerticeVector, ArenaAllocator<tLoadVerticeVector>> tLoadVerticeVectorList;
+
+	// Indices are 32 bit while loading, meshes that fit are packed
+	// to 16 bit at the end of load().
+	typedef std::uint32_t tVertexIndex;
+	typedef std::vector<tVertexIndex> tVertexIndexVector;
 	typedef tVertexIndexVector::iterator tVertexIndexIterator;
 	typedef tVertexIndexVector::const_iterator tVertexIndexConstIterator;
 
+	typedef std::vector<std::uint16_t> tVertexIndex16Vector;
+
+	// Point, normal, uv and skin of a vertice as raw bits, equal keys are
+	// welded into one vertice. With a weld epsilon the key is the grid
+	// cell of the point and the skin instead, see weldVertices().
+	typedef struct
+	{
+		std::uint32_t values[kWeldKeyValueCount];
+	} tWeldKey;
+
+	struct tWeldKeyHasher
+	{
+		size_t operator()(const tWeldKey& weldKey) const;
+	};
+
+	struct tWeldKeyEqual
+	{
+		bool operator()(const tWeldKey& left, const tWeldKey& right) const;
+	};
+
+	typedef std::unordered_map<
+		tWeldKey,
+		tVertexIndex,
+		tWeldKeyHasher,
+		tWeldKeyEqual,
+		ArenaAllocator<std::pair<const tWeldKey, tVertexIndex>>> tWeldMap;
+
+	// Triangles of one material. The triangles of a mesh are sorted by
+	// material, so each material is one range and one draw.
+	typedef struct
+	{
+		// Into tModelRec::materialNameVector.
+		std::uint32_t materialIndex;
+		std::uint32_t startIndex;
+		std::uint32_t indexCount;
+
+		// Every bone with a weight on the range, in ascending order. With
+		// tLoadSettings::partitionSkin this is the palette of the range,
+		// and the vertices hold indices into it.
+		std::vector<std::uint32_t> boneIndexVector;
+	} tSubmeshRec;
+	typedef std::vector<tSubmeshRec> tSubmeshVector;
+
+	// A coarser triangle list over the vertices of the full mesh. error is
+	// how far the simplified surface can be from the full one, in model
+	// units, so it can be projected to pixels at run time. It never drops
+	// from one level to the next.
+	typedef struct
+	{
+		tVertexIndexVector indexVector;
+		tVertexIndex16Vector indexVector16;
+
+		// Submesh n is simplified on its own, its triangles are in
+		// [submeshStartVector[n], submeshStartVector[n + 1]).
+		std::vector<std::uint32_t> submeshStartVector;
+		float error;
+	} tLodRec;
+	typedef std::vector<tLodRec> tLodVector;
+
+	// Vertices that share one palette. When sorted, by their count of non
+	// zero weights, the ones with n influences are in
+	// [influenceStarts[n], influenceStarts[n + 1]). Otherwise they keep
+	// their order and the whole range is in the last count.
+	typedef struct
+	{
+		// Palette of the range, kInvalidSubmeshIndex for the whole bone
+		// vector when the skin is not partitioned.
+		std::uint32_t submeshIndex;
+		std::uint32_t influenceStarts[kBoneInfluencesPerVertice + 2];
+
+		// See tLoadSettings::bucketInfluences.
+		bool sorted;
+	} tInfluenceBucketRec;
+	typedef std::vector<tInfluenceBucketRec> tInfluenceBucketVector;
+
+	// A run of triangles inside one submesh, with the sphere around its
+	// vertices and the cone around its face normals, both in bind space.
+	// coneCutoff is the sine of the cone half angle, 1 never culls.
+	typedef struct
+	{
+		DirectX::XMFLOAT3 center;
+		float radius;
+		DirectX::XMFLOAT3 coneAxis;
+		float coneCutoff;
+		std::uint32_t startIndex;
+		std::uint32_t indexCount;
+		std::uint32_t submeshIndex;
+
+		// Every bone a vertex of the cluster weighs, boneCount of them in
+		// tModelRec::clusterBoneVector from firstBone. The one most of the
+		// vertices weigh strongest comes first. None when unskinned.
+		std::uint32_t firstBone;
+		std::uint32_t boneCount;
+	} tClusterRec;
+	typedef std::vector<tClusterRec> tClusterVector;
+
 	typedef struct
 	{
-		std::string materialName;
+		std::vector<std::string> materialNameVector;
 		std::string meshName;
 		tSkinnedVerticeVector verticeVector;
 		tVertexIndexVector indexVector;
+		tSubmeshVector submeshVector;
+
+		// Same vertices in the compact layout, relative to maxVertex and
+		// minVertex. Only filled with compactVertices and without
+		// tLoadSettings::splitVertexStreams.
+		tCompactSkinnedVerticeVector compactVerticeVector;
+
+		// Split copies of the vertices, in the same order. Only the layout
+		// compactVertices picks is filled, and positionStreamVector with
+		// both.
+		tPositionStreamVerticeVector positionStreamVector;
+		tShadingStreamVerticeVector shadingStreamVector;
+		tCompactPositionStreamVerticeVector compactPositionStreamVector;
+		tCompactShadingStreamVerticeVector compactShadingStreamVector;
+
+		// One per vertice, only filled with tLoadSettings::generateTangents.
+		tQTangentVector qTangentVector;
+
+		// DXGI_FORMAT_R16_UINT when every vertex fits a 16 bit index,
+		// indexVector16 then holds the indices to upload.
+		DXGI_FORMAT indexFormat;
+
+		// The vertices were packed in the compact layout, or in split
+		// streams. False without the matching tLoadSettings, and when a
+		// bone index does not fit 8 bits, which partitionSkin avoids.
+		bool compactVertices;
+		bool splitVertexStreams;
+		tVertexIndex16Vector indexVector16;
+
+		// Coarsest last, each one packed like indexVector.
+		tLodVector lodVector;
+
+		// Covers every vertice once, see skinVertices().
+		tInfluenceBucketVector influenceBucketVector;
+
+		// In index order, only filled with tLoadSettings::clusterTriangleCount.
+		tClusterVector clusterVector;
+		std::vector<std::int32_t> clusterBoneVector;
+		DirectX::XMFLOAT3 maxVertex;
+		DirectX::XMFLOAT3 minVertex;
+		bool allByControlPoint;
+
+		// Simulated post transform cache, before and after the mesh was
+		// optimized. Left zeroed when it was not optimized in this load.
+		MeshOptimizer::VertexCacheStatistics cacheStatisticsBefore;
+		MeshOptimizer::VertexCacheStatistics cacheStatisticsAfter;
 		Microsoft::WRL::ComPtr<ID3D12Resource> indexBufferPtr;
 		Microsoft::WRL::ComPtr<ID3D12Resource> vertexBufferPtr;
 	} tModelRec;
@@ -60,15 +400,13 @@ private:
 	typedef tModelVector::iterator tModelIterator;
 	typedef tModelVector::const_iterator tModelConstIterator;
 
+	// Load time data of a bone. The per frame matrices live in m_skeleton.
 	typedef struct
 	{
-		std::string name;
+		// Interned in m_boneIndexMap, shared by every lookup of this bone.
+		const std::string* namePtr;
 
-		// calculates the locals together depth first
-		// equals localTransform * parentMatrix
-		DirectX::XMFLOAT4X4 combinedTransform;
-
-		// updated for animation
+		// Local transform at time 0, the first pose of m_skeleton.
 		DirectX::XMFLOAT4X4 nodeLocalTransform;
 
 		// This is an inverse of the parent to child matrix,
@@ -76,20 +414,158 @@ private:
 		// It's set at mesh load time and doesn't change.
 		DirectX::XMFLOAT4X4 offset;
 
-		// Ready for a skinned mesh shader as the bone matrice.
-		// equals offset * combinedTransform
-		DirectX::XMFLOAT4X4 boneMatrice;
+		// Local transforms of the pruned static bones between this bone
+		// and its parent, applied after nodeLocalTransform.
+		DirectX::XMFLOAT4X4 collapsedTransform;
 		fbxsdk::FbxNode* boneNodePtr;
 		fbxsdk::FbxSkeleton* fbxSkeletonPtr;
 		fbxsdk::FbxCluster* fbxClusterPtr;
 
-		std::vector<int> childIndexes;
 		int parentIndex;
 	} tBone;
 
-	// Used to do a reverse lookup.
-	typedef std::vector<int> tControlPointIndexes;
-	typedef std::vector<tControlPointIndexes> tControlPointRemap;
+	// Runtime pose of the bones, built from m_boneVector when the load
+	// finishes. Slots sort the bones by depth: the slots of level d are
+	// levelStartVector[d] up to levelStartVector[d + 1], so every parent
+	// is done before the level of its children starts. Inside a level the
+	// posed bones, animated or below an animated one, come first and end
+	// at posedEndVector[d]. Matrices are kept per slot, except the palette
+	// which is per bone for the shaders.
+	typedef struct
+	{
+		std::vector<std::uint32_t> boneIndexVector;
+		std::vector<std::uint32_t> slotIndexVector;
+		std::vector<std::int32_t> parentSlotVector;
+		std::vector<std::uint32_t> levelStartVector;
+		std::vector<std::uint32_t> posedEndVector;
+
+		// Updated for animation.
+		std::vector<DirectX::XMFLOAT4X4A> localVector;
+
+		// Constant, see tBone.
+		std::vector<DirectX::XMFLOAT4X4A> collapsedVector;
+		std::vector<DirectX::XMFLOAT4X4A> offsetVector;
+
+		// local * parent model, then transposed offset * model per bone.
+		std::vector<DirectX::XMFLOAT4X4A> modelVector;
+		std::vector<DirectX::XMFLOAT4X4A> paletteVector;
+	} tSkeleton;
+
+	// Local transform of a bone at one key, rotation is a quaternion.
+	typedef tCompressedClip::tTransformKey tBoneKey;
+
+	// One take sampled at the scene frame rate, the keys of frame f are
+	// keyVector[f * boneCount] up to keyVector[(f + 1) * boneCount].
+	typedef struct
+	{
+		std::string name;
+		float frameRate;
+		float duration;
+		std::uint32_t frameCount;
+		std::vector<tBoneKey> keyVector;
+	} tAnimationClipRec;
+	typedef std::vector<tAnimationClipRec> tAnimationClipVector;
+
+	// Binary model cache layout. The header is followed by every mesh
+	// (tModelCacheMesh, mesh name, length and name of every material,
+	// vertices, indices, tModelCacheSubmesh table, every palette, then
+	// tModelCacheLod, indices and submesh starts for every level), every
+	// bone (tModelCacheBone, name), every pruned bone name
+	// (tModelCacheBoneAlias, name) and every clip (tModelCacheClip, name,
+	// keys). Each block is padded to 4 bytes.
+	typedef struct
+	{
+		std::uint32_t magic;
+		std::uint32_t version;
+
+		// Contents of the .fbx, see _getSourceHash().
+		std::uint64_t sourceHash;
+		std::uint64_t settingsHash;
+		std::uint32_t verticeStride;
+		std::uint32_t indexStride;
+		std::uint32_t modelCount;
+		std::uint32_t boneCount;
+		std::uint32_t boneAliasCount;
+		std::uint32_t clipCount;
+		DirectX::XMFLOAT3 maxVertex;
+		DirectX::XMFLOAT3 minVertex;
+
+		// What the scene gave, for loads that do not import it.
+		DirectX::XMFLOAT4X4 axisConversion;
+		float unitScale;
+		std::uint64_t animationDurationInMs;
+	} tModelCacheHeader;
+
+	typedef struct
+	{
+		std::uint32_t materialCount;
+		std::uint32_t meshNameLength;
+		std::uint32_t verticeCount;
+		std::uint32_t indexCount;
+		std::uint32_t submeshCount;
+		std::uint32_t lodCount;
+		DirectX::XMFLOAT3 maxVertex;
+		DirectX::XMFLOAT3 minVertex;
+	} tModelCacheMesh;
+
+	typedef struct
+	{
+		std::uint32_t materialIndex;
+		std::uint32_t startIndex;
+		std::uint32_t indexCount;
+
+		// Palette size, zero unless the skin was partitioned.
+		std::uint32_t boneCount;
+	} tModelCacheSubmesh;
+
+	typedef struct
+	{
+		std::uint32_t indexCount;
+		float error;
+	} tModelCacheLod;
+
+	typedef struct
+	{
+		std::int32_t parentIndex;
+		std::uint32_t nameLength;
+
+		// See m_animatedBoneVector.
+		std::uint32_t animated;
+		DirectX::XMFLOAT4X4 offset;
+		DirectX::XMFLOAT4X4 nodeLocalTransform;
+		DirectX::XMFLOAT4X4 collapsedTransform;
+	} tModelCacheBone;
+
+	// A pruned bone name and the kept bone it resolves to.
+	typedef struct
+	{
+		std::uint32_t boneIndex;
+		std::uint32_t nameLength;
+	} tModelCacheBoneAlias;
+
+	// Compressed clips live in their own files, their keys are not cached.
+	typedef struct
+	{
+		std::uint32_t nameLength;
+		std::uint32_t frameCount;
+		std::uint32_t keyCount;
+		float frameRate;
+		float duration;
+	} tModelCacheClip;
+
+	// Full precision influences of one control point, gathered from the
+	// clusters before the strongest are packed into the vertices.
+	typedef struct
+	{
+		float weights[kMaxGatheredInfluences];
+		unsigned short boneIndices[kMaxGatheredInfluences];
+		unsigned long count;
+	} tBoneInfluences;
+	typedef std::vector<tBoneInfluences, ArenaAllocator<tBoneInfluences>> tBoneInfluencesVector;
+
+	// Interns the bone names and maps each one to its bone index.
+	// Its nodes never move, so bones can point at their key.
+	typedef std::unordered_map<std::string, long> tBoneIndexMap;
 
 	typedef std::vector<tBone> tBoneVector;
 	typedef tBoneVector::iterator tBoneIterator;
@@ -105,38 +581,190 @@ private:
 	int m_minorFileVersion;
 	int m_revisionFileVersion;
 	std::string m_textureName;
+	tLoadSettings m_loadSettings;
+
+	// Scene to our axis system rotation and unit scale, applied on the
+	// extracted data when the scene itself is not converted.
+	DirectX::XMFLOAT4X4 m_axisConversion;
+	float m_unitScale;
 	tBoneVector m_boneVector;
-	bool m_allByControlPoint;
+	tBoneIndexMap m_boneIndexMap;
+	tSkeleton m_skeleton;
+
+	// Backs every temporary of a load, released when load() returns.
+	LinearArena m_loadArena;
+	size_t m_loadArenaPeakBytes;
+	size_t m_prunedBoneCount;
+
+	// Second phase of a progressive load, its meshes replace m_modelVector
+	// in finishLoad().
+	concurrency::task_group m_loadTaskGroup;
+	std::atomic<bool> m_loadComplete;
+
+	// Set from load() until finishLoad(), the accessors may run on other
+	// threads meanwhile.
+	std::atomic<bool> m_loadPending;
+
+	// m_modelVector only has the first phase positions yet.
+	bool m_positionsOnly;
+	tModelVector m_pendingModelVector;
 	unsigned int m_boneMatrixVectorSize;
 	unsigned long long m_initialAnimationDurationInMs;
 
+	// Where the played take starts on the scene time line.
+	fbxsdk::FbxTime m_animationStartTime;
+
+	// Identifies the .fbx file version, also keys the saved clips.
+	unsigned long long m_sourceHash;
+
+	// The last load came from the model cache.
+	bool m_modelCacheLoaded;
+
+	// Take of every clip, in m_clipVector or m_compressedClipVector order.
+	std::vector<std::string> m_clipNameVector;
+
+	// Keys decoded from a compressed clip this frame, and the time every
+	// decode took so far.
+	std::vector<tBoneKey> m_poseKeyVector;
+	double m_clipDecodeNanoseconds;
+	unsigned long long m_clipDecodedBoneCount;
+
+	// Per bone, whether the take changes its local transform. Every bone
+	// is updated until the first frame was built.
+	std::vector<bool> m_animatedBoneVector;
+	bool m_staticBonesPosed;
+	size_t m_skippedBoneCount;
+
+	// time counts from the start of the played take.
 	void _buildMatrices(
 		const fbxsdk::FbxTime& time);
 
 	void _loadModel();
+	std::string _getModelCacheFilename();
+	unsigned long long _getSourceHash();
+	unsigned long long _getLoadSettingsHash();
+	bool _loadModelCache(
+		unsigned long long sourceHash);
+	void _saveModelCache(
+		const tModelVector& modelVector,
+		unsigned long long sourceHash);
+	void _loadSceneConversion();
+	DirectX::XMMATRIX _getSceneConversion();
+	void _bindCachedBones(
+		fbxsdk::FbxNode* nodePtr,
+		unsigned long& boneIndex);
 	void _loadBones(
 		fbxsdk::FbxNode* nodePtr,
 		long parentBoneIndex);
 	void _loadBone(
 		fbxsdk::FbxNode* nodePtr,
 		long parentBoneIndex);
-	void _loadMeshes(
+	bool _isNodeAnimated(
 		fbxsdk::FbxNode* nodePtr);
+	bool _isNodeConstant(
+		fbxsdk::FbxNode* nodePtr,
+		fbxsdk::FbxAnimStack* animStackPtr);
+	void _findStaticBones();
+	void _buildSkeleton();
+	DirectX::XMFLOAT4X4A& _getLocalTransform(
+		size_t boneIndex);
+	bool _isBoneAnimated(
+		size_t boneIndex);
+	size_t _getPosedSlotEnd(
+		size_t level);
+	void _pruneBones(
+		tLoadVerticeVectorList& loadVerticeVectorList);
+	void _collectMeshNodes(
+		fbxsdk::FbxNode* nodePtr,
+		std::vector<fbxsdk::FbxNode*>& meshNodes);
+	void _loadMeshes(
+		fbxsdk::FbxNode* nodePtr,
+		tModelVector& modelVector,
+		bool positionsOnly);
 	void _loadMesh(
-		fbxsdk::FbxNode* nodePtr);
+		fbxsdk::FbxNode* nodePtr,
+		tModelRec& modelRec,
+		tLoadVerticeVector& loadVerticeVector,
+		bool positionsOnly);
 	void _loadMeshPositionNormalUV(
 		fbxsdk::FbxNode* nodePtr,
-		tModelRec& meshRec);
-	void _compressSkinnedVertices(
+		tModelRec& modelRec,
+		tLoadVerticeVector& loadVerticeVector,
+		bool positionsOnly);
+	void _mergeModelBounds();
+	void _packIndices(
 		tModelRec& modelRec);
-	unsigned short _findSkinnedVertice(
-		const tSkinnedVerticeVector& skinnedVerticeVector,
-		const tSkinnedVertice& skinnedVertice);
-	void _loadMeshBoneWeightsAndIndices(
-		fbxsdk::FbxNode* nodePtr,
+	void _optimizeMesh(
+		tModelRec& modelRec);
+	void _generateLods(
+		tModelRec& modelRec);
+	void _partitionSkin(
+		tModelRec& modelRec);
+	void _packModels();
+	void _bucketInfluences(
+		tModelRec& modelRec);
+	void _buildClusters(
+		tModelRec& modelRec);
+	template <class tVertice>
+	void _buildClusters(
+		tModelRec& modelRec,
+		const tVertice* vertices);
+	template <unsigned long influenceCount, class tVertice>
+	static void _skinInfluences(
+		const tVertice* vertices,
+		size_t verticeCount,
+		const DirectX::XMFLOAT4X4* boneMatrices,
+		DirectX::XMFLOAT3* points,
+		DirectX::XMFLOAT3* normals);
+	template <class tVertice>
+	static void _skinAnyInfluences(
+		const tVertice* vertices,
+		size_t verticeCount,
+		const DirectX::XMFLOAT4X4* boneMatrices,
+		DirectX::XMFLOAT3* points,
+		DirectX::XMFLOAT3* normals);
+	template <class tVertice>
+	static void _skinBucket(
+		const tVertice* vertices,
+		const tInfluenceBucketRec& bucketRec,
+		const DirectX::XMFLOAT4X4* boneMatrices,
+		DirectX::XMFLOAT3* points,
+		DirectX::XMFLOAT3* normals);
+	void _packModel(
+		tModelRec& modelRec);
+	void _mergeModels(
+		tModelRec& mergedModelRec);
+	void _loadSubmeshBones(
+		tModelRec& modelRec);
+	void _packVertices(
 		tModelRec& modelRec);
-	void _normalizeBoneWeights(
+	bool _hasByteBoneIndices(
+		const tModelRec& modelRec);
+	void _generateTangents(
 		tModelRec& modelRec);
+	void _compressSkinnedVertices(
+		tModelRec& modelRec,
+		const tLoadVerticeVector& loadVerticeVector);
+	static void _makeWeldKey(
+		const tSkinnedVertice& skinnedVertice,
+		tWeldKey& weldKey);
+	static void _makeWeldCellKey(
+		const tSkinnedVertice& skinnedVertice,
+		const std::int64_t cell[3],
+		tWeldKey& weldKey);
+	static bool _isWeldMatch(
+		const tSkinnedVertice& left,
+		const tSkinnedVertice& right,
+		float weldEpsilon);
+	void _loadMeshBoneWeightsAndIndices(
+		fbxsdk::FbxNode* nodePtr,
+		const tModelRec& modelRec,
+		tLoadVerticeVector& loadVerticeVector);
+	void _packBoneInfluences(
+		const tControlPointRemap& controlPointRemap,
+		const tModelRec& modelRec,
+		const tBoneInfluencesVector& boneInfluencesVector,
+		tLoadVerticeVector& loadVerticeVector);
 	void _loadTextureNames();
 
 	bool _isMeshSkinned(
@@ -157,35 +785,198 @@ private:
 		const fbxsdk::FbxAMatrix& fbxMatrix,
 		DirectX::XMFLOAT4X4& matrix);
 	void _calculateCombinedTransforms();
+	const std::string* _internBoneName(
+		tBoneIndexMap& boneIndexMap,
+		const char* name,
+		long boneIndex);
 	long _boneNameToindex(
-		const std::string& name);
+		const char* name);
 	void _loadControlPointRemap(
 		fbxsdk::FbxMesh* meshPtr,
 		tControlPointRemap& controlPointRemap);
 	void _addBoneInfluence(
-		tSkinnedVerticeVector& skinnedVerticeVector,
-		long vertexIndex,
+		tBoneInfluences& boneInfluences,
 		long boneIndex,
-		double boneWeight);
+		float boneWeight);
 
 	void _calculatePaletteMatrices();
 	void _loadNodeLocalTransformMatrices(
 		const fbxsdk::FbxTime& fbxTime);
+	void _bakeClips();
+	void _sampleClip(
+		const tAnimationClipRec& clipRec,
+		float time);
+	void _releaseScene();
+	std::string _getClipFilename(
+		const std::vector<std::string>& clipNameVector,
+		size_t clipIndex);
+	unsigned long long _getClipHash();
+	bool _loadCompressedClips(
+		const std::vector<std::string>& clipNameVector,
+		size_t boneCount);
+	void _compressClips();
+	void _sampleCompressedClip(
+		const tCompressedClip& clip,
+		float time);
 
-	unsigned long long _getAnimationDuration();
+	bool _findFirstTake(
+		fbxsdk::FbxAnimStack*& animStackPtr,
+		fbxsdk::FbxTakeInfo*& takeInfoPtr);
+	void _selectFirstTake();
 
 public:
 	ModelLoader();
 	~ModelLoader();
 
+	void setLoadSettings(
+		const tLoadSettings& loadSettings);
 	void load(
 		Microsoft::WRL::ComPtr<ID3D12Device> devicePtr,
 		const char* meshName,
 		unsigned long boneMatrixVectorSize = 50);
+	bool isLoadComplete();
+	void finishLoad();
+	size_t getLoadArenaPeakBytes();
+
+	// The last load came from the model cache, see
+	// tLoadSettings::useModelCache.
+	bool isModelCacheLoaded();
+
+	// Bones dropped by tLoadSettings::pruneBones in the last load, zero
+	// until the load finished.
+	size_t getPrunedBoneCount();
+
+	// Baked key bytes over compressed bytes of every compressed clip.
+	float getClipCompressionRatio();
+
+	// Average decode time of one bone from a compressed clip.
+	float getClipDecodeNanosecondsPerBone();
+
+	// Bones the last frame left untouched, see
+	// tLoadSettings::skipStaticBones.
+	size_t getSkippedBoneCount();
+
+	// Coarsest level of m_modelVector[modelIndex] whose error stays within
+	// maxError, 0 is the full mesh and level n is lodVector[n - 1].
+	size_t selectLod(
+		size_t modelIndex,
+		float maxError);
+
+	// Fills controlPointRemap from the control point of every polygon
+	// corner. The rows are counted and scattered in parallel, then sorted,
+	// so they do not depend on the scheduling. The temporaries live in
+	// arena.
+	static void buildControlPointRemap(
+		const int* polygonVertices,
+		int cornerCount,
+		int controlPointCount,
+		LinearArena& arena,
+		tControlPointRemap& controlPointRemap);
+
+	// Sorts the bones into slots by depth, so every parent comes in a
+	// level before its children, see tSkeleton. parentIndices holds the
+	// parent of every bone, -1 for a root, in any order. A bone is posed
+	// when it or an ancestor is flagged in animatedBoneVector.
+	static void sortBonesByDepth(
+		const std::int32_t* parentIndices,
+		const std::vector<bool>& animatedBoneVector,
+		std::vector<std::uint32_t>& boneIndexVector,
+		std::vector<std::uint32_t>& slotIndexVector,
+		std::vector<std::uint32_t>& levelStartVector,
+		std::vector<std::uint32_t>& posedEndVector);
+
+	// Replaces every index with the one of its welded vertice, appended to
+	// weldedVector in order of first use. See tLoadSettings::weldEpsilon.
+	// The temporaries live in arena.
+	static void weldVertices(
+		const tSkinnedVertice* vertices,
+		std::uint32_t* indices,
+		size_t indexCount,
+		float weldEpsilon,
+		LinearArena& arena,
+		std::vector<tSkinnedVertice>& weldedVector);
+
+	// Both directions work on any count, boundsMin and boundsMax have to
+	// enclose the points and every bone index has to fit 8 bits.
+	static void encodeCompactVertices(
+		const tSkinnedVertice* vertices,
+		size_t verticeCount,
+		const DirectX::XMFLOAT3& boundsMin,
+		const DirectX::XMFLOAT3& boundsMax,
+		tCompactSkinnedVertice* compactVertices);
+	static void decodeCompactVertices(
+		const tCompactSkinnedVertice* compactVertices,
+		size_t verticeCount,
+		const DirectX::XMFLOAT3& boundsMin,
+		const DirectX::XMFLOAT3& boundsMax,
+		tSkinnedVertice* vertices);
+	static void encodeQTangent(
+		const DirectX::XMFLOAT3& tangent,
+		const DirectX::XMFLOAT3& bitangent,
+		const DirectX::XMFLOAT3& normal,
+		tQTangent& qTangent);
+	static void decodeQTangent(
+		const tQTangent& qTangent,
+		DirectX::XMFLOAT3& tangent,
+		DirectX::XMFLOAT3& bitangent,
+		DirectX::XMFLOAT3& normal);
+
+	// False for a frame that is not a unit quaternion, lost its
+	// handedness or does not match normal.
+	static bool isValidQTangent(
+		const tQTangent& qTangent,
+		const DirectX::XMFLOAT3& normal);
+	// -1 for an unknown bone, and for every bone until the load finished.
+	// A bone tLoadSettings::pruneBones removed gives its closest kept
+	// ancestor.
+	long getBoneIndex(
+		const char* boneName);
 	void advanceTime();
+
+	// Poses the bones timeInMs into the first take, like advanceTime()
+	// does with the clock.
+	void setAnimationTime(
+		unsigned long long timeInMs);
 	void loadBoneMatriceVector();
+
+	// Skins the points and normals of a packed model on the CPU with the
+	// current pose. With tLoadSettings::bucketInfluences every influence
+	// bucket runs the kernel built for its count, otherwise one kernel
+	// checks the weights of every vertice. points and normals need room
+	// for every vertice. A null normals skins the points alone, from the
+	// position stream when tLoadSettings::splitVertexStreams built one.
+	void skinVertices(
+		const tModelRec& modelRec,
+		DirectX::XMFLOAT3* points,
+		DirectX::XMFLOAT3* normals);
+
+	// Appends the clusters of modelRec that can face eyePosW in the current
+	// pose, in index order. world places the model like its render items.
+	// shellOffset is how far, in world units, the outermost fur shell is
+	// pushed out from the skin.
+	void cullClusters(
+		const tModelRec& modelRec,
+		const DirectX::XMFLOAT4X4& world,
+		const DirectX::XMFLOAT3& eyePosW,
+		float shellOffset,
+		std::vector<std::uint32_t>& visibleClusterVector);
+
+	// Bone matrices of a partitioned submesh, in palette order.
+	void loadPaletteMatrices(
+		const tSubmeshRec& submeshRec,
+		DirectX::XMFLOAT4X4* paletteMatrices);
 	tMatrixVector m_boneMatrixVector;
 	tModelVector m_modelVector;
+
+	// Every take of the scene, only filled with tLoadSettings::bakeClips.
+	tAnimationClipVector m_clipVector;
+
+	// Replaces m_clipVector with tLoadSettings::compressClips.
+	std::vector<std::unique_ptr<tCompressedClip>> m_compressedClipVector;
+
+	// Every mesh in one buffer, with a submesh per mesh and material.
+	// Only filled with tLoadSettings::mergeMeshes.
+	tModelRec m_mergedModel;
 	DirectX::XMFLOAT3 maxVertex;
 	DirectX::XMFLOAT3 minVertex;
 };
\ No newline at end of file
@@ -0,0 +1,204 @@
+#include "tBenchmark.h"
+#include "tTestHarness.h"
+#include "../Utilities/tCompressedClip.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	typedef tCompressedClip::tTransformKey tTransformKey;
+
+	const float kFrameRate = 30.0f;
+
+	// Every bone swings and bobs on its own phase, the scale stays put.
+	void makeSwingingKeys(
+		size_t boneCount,
+		size_t frameCount,
+		std::vector<tTransformKey>& keyVector)
+	{
+		keyVector.resize(boneCount * frameCount);
+
+		for (size_t frame = 0; frame < frameCount; ++frame)
+		{
+			const float time = frame / kFrameRate;
+
+			for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+			{
+				const float phase = 0.37f * boneIndex;
+				tTransformKey& key = keyVector[frame * boneCount + boneIndex];
+
+				key.translation = XMFLOAT3(0.1f * boneIndex + 0.05f * sinf(1.3f * time + phase), 0.02f * cosf(0.7f * time + phase), 0.0f);
+				XMStoreFloat4(&key.rotation, XMQuaternionRotationRollPitchYaw(0.3f * sinf(0.5f * time), 0.0f, 0.8f * sinf(2.0f * time + phase)));
+				key.scale = XMFLOAT3(1.0f, 1.0f, 1.0f);
+			}
+		}
+	}
+
+	// In double and from the chord, acos loses too much close to 1.
+	double getRotationError(
+		const XMFLOAT4& rotation0,
+		const XMFLOAT4& rotation1)
+	{
+		const double a[4] = { rotation0.x, rotation0.y, rotation0.z, rotation0.w };
+		const double b[4] = { rotation1.x, rotation1.y, rotation1.z, rotation1.w };
+		double dot = 0.0;
+		double difference = 0.0;
+		double sum = 0.0;
+
+		for (int i = 0; i < 4; ++i)
+		{
+			dot += a[i] * b[i];
+			difference += (a[i] - b[i]) * (a[i] - b[i]);
+			sum += (a[i] + b[i]) * (a[i] + b[i]);
+		}
+
+		const double chord = sqrt((dot < 0.0) ? sum : difference);
+
+		return 4.0 * asin(std::min(chord * 0.5, 1.0));
+	}
+
+	double getDistance(
+		const XMFLOAT3& value0,
+		const XMFLOAT3& value1)
+	{
+		const double x = double(value0.x) - value1.x;
+		const double y = double(value0.y) - value1.y;
+		const double z = double(value0.z) - value1.z;
+
+		return sqrt(x * x + y * y + z * z);
+	}
+}
+
+// Every frame, dropped or kept, decodes within the tolerances.
+TEST_CASE(CompressedClip_DecodesWithinTolerances)
+{
+	const size_t boneCount = 8;
+	const size_t frameCount = 300;
+	const tCompressedClip::tTolerances tolerances = { 0.0005f, 0.002f, 0.0005f };
+	std::vector<tTransformKey> keyVector;
+	std::vector<tTransformKey> decodedVector(boneCount);
+	tCompressedClip clip;
+
+	makeSwingingKeys(boneCount, frameCount, keyVector);
+	clip.compress(keyVector.data(), boneCount, frameCount, kFrameRate, tolerances, 1);
+
+	CHECK(clip.boneCount() == boneCount);
+	CHECK(clip.frameCount() == frameCount);
+
+	double translationError = 0.0;
+	double rotationError = 0.0;
+	double scaleError = 0.0;
+
+	for (size_t frame = 0; frame < frameCount; ++frame)
+	{
+		clip.decode(frame / kFrameRate, decodedVector.data());
+
+		for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+		{
+			const tTransformKey& key = keyVector[frame * boneCount + boneIndex];
+
+			translationError = std::max(translationError, getDistance(decodedVector[boneIndex].translation, key.translation));
+			rotationError = std::max(rotationError, getRotationError(decodedVector[boneIndex].rotation, key.rotation));
+			scaleError = std::max(scaleError, getDistance(decodedVector[boneIndex].scale, key.scale));
+		}
+	}
+
+	printf("  %.1f to 1, largest errors %.6f, %.6f rad, %.6f\n",
+		double(clip.uncompressedSize()) / clip.size(), translationError, rotationError, scaleError);
+
+	CHECK(translationError <= tolerances.translation + 1.0e-5);
+	CHECK(rotationError <= tolerances.rotation + 1.0e-5);
+	CHECK(scaleError <= tolerances.scale + 1.0e-5);
+	CHECK(clip.size() < clip.uncompressedSize() / 4);
+}
+
+// A bone that moves at a constant speed needs its two end keys and nothing
+// in between, however long the take.
+TEST_CASE(CompressedClip_LinearMotionKeepsEndKeys)
+{
+	const size_t boneCount = 4;
+	const size_t frameCount = 3000;
+	const tCompressedClip::tTolerances tolerances = { 0.0005f, 0.001f, 0.001f };
+	std::vector<tTransformKey> keyVector(boneCount * frameCount);
+	tCompressedClip shortClip;
+	tCompressedClip longClip;
+
+	for (size_t frame = 0; frame < frameCount; ++frame)
+	{
+		for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+		{
+			tTransformKey& key = keyVector[frame * boneCount + boneIndex];
+
+			key.translation = XMFLOAT3(0.001f * frame, float(boneIndex), 0.0f);
+			key.rotation = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+			key.scale = XMFLOAT3(1.0f, 1.0f, 1.0f);
+		}
+	}
+
+	shortClip.compress(keyVector.data(), boneCount, 2, kFrameRate, tolerances, 1);
+	longClip.compress(keyVector.data(), boneCount, frameCount, kFrameRate, tolerances, 1);
+
+	CHECK(longClip.size() == shortClip.size());
+
+	tTransformKey key;
+
+	longClip.decodeBone(1500 / kFrameRate, 1, key);
+
+	CHECK(fabsf(key.translation.x - 1.5f) < 1.0e-3f);
+	CHECK(fabsf(key.translation.y - 1.0f) < 1.0e-3f);
+}
+
+// The time per key should only grow with the log of the take length, a
+// key search that is quadratic in the frames grows with the length itself.
+BENCHMARK_CASE(CompressedClip_Compress)
+{
+	const size_t boneCount = 32;
+	const size_t frameCounts[] = { 1000, 8000, 64000 };
+	const tCompressedClip::tTolerances tolerances = { 0.0001f, 0.0005f, 0.0001f };
+	std::vector<tTransformKey> keyVector;
+	tCompressedClip clip;
+
+	for (size_t frameCount : frameCounts)
+	{
+		makeSwingingKeys(boneCount, frameCount, keyVector);
+
+		tBenchmark("compress " + std::to_string(frameCount) + " frames, per key", boneCount * frameCount, 3).run([&]()
+		{
+			clip.compress(keyVector.data(), boneCount, frameCount, kFrameRate, tolerances, 1);
+		});
+
+		printf("  %.1f to 1\n", double(clip.uncompressedSize()) / clip.size());
+	}
+}
+
+BENCHMARK_CASE(CompressedClip_Decode)
+{
+	const size_t boneCounts[] = { 50, 500, 5000 };
+	const size_t frameCount = 300;
+	const size_t sampleCount = 1000;
+	const tCompressedClip::tTolerances tolerances = { 0.0001f, 0.0005f, 0.0001f };
+	std::vector<tTransformKey> keyVector;
+	std::vector<tTransformKey> decodedVector;
+	tCompressedClip clip;
+
+	for (size_t boneCount : boneCounts)
+	{
+		makeSwingingKeys(boneCount, frameCount, keyVector);
+		clip.compress(keyVector.data(), boneCount, frameCount, kFrameRate, tolerances, 1);
+		decodedVector.resize(boneCount);
+
+		// Off the frames, so every channel interpolates.
+		tBenchmark("decode " + std::to_string(boneCount) + " bones, per bone", boneCount * sampleCount).run([&]()
+		{
+			for (size_t sample = 0; sample < sampleCount; ++sample)
+			{
+				clip.decode(clip.duration() * (sample + 0.5f) / sampleCount, decodedVector.data());
+			}
+		});
+	}
+}
@@ -0,0 +1,286 @@
+#include "tBenchmark.h"
+#include "tTestHarness.h"
+#include "../Utilities/MathHelper.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	const char* const kInstructionSetNames[] = { "sse", "avx2", "avx-512" };
+
+	void makeRandomMatrices(
+		size_t count,
+		std::mt19937& random,
+		std::vector<XMFLOAT4X4A>& matrixVector)
+	{
+		std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+		matrixVector.resize(count);
+
+		for (auto& matrix : matrixVector)
+		{
+			for (int row = 0; row < 4; ++row)
+			{
+				for (int column = 0; column < 4; ++column)
+				{
+					matrix.m[row][column] = distribution(random);
+				}
+			}
+		}
+	}
+
+	// Plain row vector product, the reference for every instruction set.
+	XMFLOAT4X4A multiply(
+		const XMFLOAT4X4A& a,
+		const XMFLOAT4X4A& b)
+	{
+		XMFLOAT4X4A out;
+
+		for (int row = 0; row < 4; ++row)
+		{
+			for (int column = 0; column < 4; ++column)
+			{
+				double sum = 0.0;
+
+				for (int i = 0; i < 4; ++i)
+				{
+					sum += double(a.m[row][i]) * b.m[i][column];
+				}
+
+				out.m[row][column] = float(sum);
+			}
+		}
+
+		return out;
+	}
+
+	XMFLOAT4X4A transpose(
+		const XMFLOAT4X4A& m)
+	{
+		XMFLOAT4X4A out;
+
+		for (int row = 0; row < 4; ++row)
+		{
+			for (int column = 0; column < 4; ++column)
+			{
+				out.m[row][column] = m.m[column][row];
+			}
+		}
+
+		return out;
+	}
+
+	// Relative to the larger references, the products grow level by level.
+	float getLargestError(
+		const std::vector<XMFLOAT4X4A>& matrixVector,
+		const std::vector<XMFLOAT4X4A>& referenceVector)
+	{
+		float error = 0.0f;
+
+		for (size_t i = 0; i < matrixVector.size(); ++i)
+		{
+			for (int row = 0; row < 4; ++row)
+			{
+				for (int column = 0; column < 4; ++column)
+				{
+					const float reference = referenceVector[i].m[row][column];
+
+					error = MathHelper::Max(error, fabsf(matrixVector[i].m[row][column] - reference) / (1.0f + fabsf(reference)));
+				}
+			}
+		}
+
+		return error;
+	}
+
+	// Slots sorted by depth like the loader's skeleton: rootCount roots,
+	// then every level levelWidth slots whose parents are in the level
+	// before. levelStartVector gets the first slot of every level and the
+	// end.
+	void makeSkeleton(
+		size_t rootCount,
+		size_t levelWidth,
+		size_t levelCount,
+		std::mt19937& random,
+		std::vector<std::int32_t>& parentVector,
+		std::vector<size_t>& levelStartVector)
+	{
+		parentVector.assign(rootCount, -1);
+		levelStartVector.assign(1, 0);
+		levelStartVector.push_back(rootCount);
+
+		for (size_t level = 1; level < levelCount; ++level)
+		{
+			const size_t parentStart = levelStartVector[level - 1];
+			const size_t parentCount = levelStartVector[level] - parentStart;
+
+			for (size_t i = 0; i < levelWidth; ++i)
+			{
+				parentVector.push_back(static_cast<std::int32_t>(parentStart + random() % parentCount));
+			}
+
+			levelStartVector.push_back(parentVector.size());
+		}
+	}
+}
+
+// Every instruction set this CPU has gives the plain product, within the
+// rounding of fused multiply adds.
+TEST_CASE(MathHelper_MatrixKernelsMatchScalar)
+{
+	const MathHelper::InstructionSet supportedInstructionSet = MathHelper::GetInstructionSet();
+	const float tolerance = 1.0e-5f;
+	std::mt19937 random(11);
+	std::vector<XMFLOAT4X4A> aVector;
+	std::vector<XMFLOAT4X4A> bVector;
+	std::vector<XMFLOAT4X4A> rootVector;
+	std::vector<std::int32_t> parentVector;
+	std::vector<size_t> levelStartVector;
+
+	makeRandomMatrices(37, random, aVector);
+	makeRandomMatrices(37, random, bVector);
+	makeRandomMatrices(1, random, rootVector);
+	makeSkeleton(3, 20, 4, random, parentVector, levelStartVector);
+
+	const size_t slotCount = parentVector.size();
+	std::vector<XMFLOAT4X4A> localVector;
+	std::vector<XMFLOAT4X4A> offsetVector;
+	std::vector<std::uint32_t> paletteIndexVector(slotCount);
+
+	makeRandomMatrices(slotCount, random, localVector);
+	makeRandomMatrices(slotCount, random, offsetVector);
+
+	for (size_t slot = 0; slot < slotCount; ++slot)
+	{
+		paletteIndexVector[slot] = static_cast<std::uint32_t>(slot);
+	}
+
+	std::shuffle(paletteIndexVector.begin(), paletteIndexVector.end(), random);
+
+	// The references.
+	std::vector<XMFLOAT4X4A> productVector(aVector.size());
+	std::vector<XMFLOAT4X4A> modelVector(slotCount);
+	std::vector<XMFLOAT4X4A> paletteVector(slotCount);
+
+	for (size_t i = 0; i < aVector.size(); ++i)
+	{
+		productVector[i] = multiply(aVector[i], bVector[i]);
+	}
+
+	for (size_t slot = 0; slot < slotCount; ++slot)
+	{
+		modelVector[slot] = multiply(localVector[slot], (parentVector[slot] < 0) ? rootVector[0] : modelVector[parentVector[slot]]);
+		paletteVector[paletteIndexVector[slot]] = transpose(multiply(offsetVector[slot], modelVector[slot]));
+	}
+
+	std::string checkedNames;
+
+	for (int instructionSet = MathHelper::InstructionSetSse; instructionSet <= supportedInstructionSet; ++instructionSet)
+	{
+		MathHelper::SetInstructionSet(static_cast<MathHelper::InstructionSet>(instructionSet));
+		CHECK(MathHelper::GetInstructionSet() == instructionSet);
+
+		std::vector<XMFLOAT4X4A> outVector(aVector.size());
+
+		MathHelper::MultiplyMatrices(aVector.data(), bVector.data(), outVector.data(), aVector.size());
+		CHECK(getLargestError(outVector, productVector) < tolerance);
+
+		// In place, out is a.
+		outVector = aVector;
+		MathHelper::MultiplyMatrices(outVector.data(), bVector.data(), outVector.data(), outVector.size());
+		CHECK(getLargestError(outVector, productVector) < tolerance);
+
+		// Level by level, once into its own vector and once in place.
+		std::vector<XMFLOAT4X4A> models(slotCount);
+		std::vector<XMFLOAT4X4A> inPlaceModels = localVector;
+		std::vector<XMFLOAT4X4A> palettes(slotCount);
+
+		for (size_t level = 0; level + 1 < levelStartVector.size(); ++level)
+		{
+			MathHelper::MultiplyParentMatrices(localVector.data(), parentVector.data(), rootVector[0], models.data(),
+				levelStartVector[level], levelStartVector[level + 1]);
+			MathHelper::MultiplyParentMatrices(inPlaceModels.data(), parentVector.data(), rootVector[0], inPlaceModels.data(),
+				levelStartVector[level], levelStartVector[level + 1]);
+		}
+
+		MathHelper::TransposedPaletteMatrices(offsetVector.data(), models.data(), paletteIndexVector.data(), palettes.data(), 0, slotCount);
+
+		CHECK(getLargestError(models, modelVector) < tolerance);
+		CHECK(getLargestError(inPlaceModels, modelVector) < tolerance);
+		CHECK(getLargestError(palettes, paletteVector) < tolerance);
+
+		checkedNames += std::string(checkedNames.empty() ? "" : ", ") + kInstructionSetNames[instructionSet];
+	}
+
+	MathHelper::SetInstructionSet(supportedInstructionSet);
+
+	// A CPU without AVX-512 cannot check that path, say so.
+	printf("  checked %s\n", checkedNames.c_str());
+}
+
+// The skeleton passes of the loader: the combined transforms, one level
+// after the other, then the palette.
+BENCHMARK_CASE(MathHelper_SkeletonKernels)
+{
+	const MathHelper::InstructionSet supportedInstructionSet = MathHelper::GetInstructionSet();
+	const size_t boneCounts[] = { 50, 500, 1000, 10000 };
+	const size_t levelCount = 10;
+	std::mt19937 random(13);
+	std::vector<XMFLOAT4X4A> rootVector;
+
+	makeRandomMatrices(1, random, rootVector);
+
+	for (size_t boneCount : boneCounts)
+	{
+		std::vector<std::int32_t> parentVector;
+		std::vector<size_t> levelStartVector;
+		std::vector<XMFLOAT4X4A> localVector;
+		std::vector<XMFLOAT4X4A> offsetVector;
+
+		makeSkeleton(1, (boneCount - 1) / (levelCount - 1), levelCount, random, parentVector, levelStartVector);
+
+		const size_t slotCount = parentVector.size();
+		std::vector<XMFLOAT4X4A> modelVector(slotCount);
+		std::vector<XMFLOAT4X4A> paletteVector(slotCount);
+		std::vector<std::uint32_t> paletteIndexVector(slotCount);
+
+		makeRandomMatrices(slotCount, random, localVector);
+		makeRandomMatrices(slotCount, random, offsetVector);
+
+		for (size_t slot = 0; slot < slotCount; ++slot)
+		{
+			paletteIndexVector[slot] = static_cast<std::uint32_t>(slot);
+		}
+
+		for (int instructionSet = MathHelper::InstructionSetSse; instructionSet <= supportedInstructionSet; ++instructionSet)
+		{
+			MathHelper::SetInstructionSet(static_cast<MathHelper::InstructionSet>(instructionSet));
+
+			// Enough repeats that the small skeletons measure above the timer.
+			const size_t repeatCount = MathHelper::Max<size_t>(1, 100000 / slotCount);
+			const std::string name = std::string(kInstructionSetNames[instructionSet]) + ", " + std::to_string(slotCount) + " bones, per bone";
+
+			tBenchmark(name, slotCount * repeatCount).run([&]()
+			{
+				for (size_t repeat = 0; repeat < repeatCount; ++repeat)
+				{
+					for (size_t level = 0; level + 1 < levelStartVector.size(); ++level)
+					{
+						MathHelper::MultiplyParentMatrices(localVector.data(), parentVector.data(), rootVector[0], modelVector.data(),
+							levelStartVector[level], levelStartVector[level + 1]);
+					}
+
+					MathHelper::TransposedPaletteMatrices(offsetVector.data(), modelVector.data(), paletteIndexVector.data(), paletteVector.data(), 0, slotCount);
+				}
+			});
+		}
+	}
+
+	MathHelper::SetInstructionSet(supportedInstructionSet);
+}
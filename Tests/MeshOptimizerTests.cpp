@@ -0,0 +1,319 @@
+#include "tBenchmark.h"
+#include "tTestHarness.h"
+#include "../Utilities/MeshOptimizer.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+	typedef std::array<std::uint32_t, 3> tTriangle;
+
+	// Quads of a columnCount by rowCount grid, two triangles each, in a
+	// shuffled order so the cache starts out cold.
+	void makeShuffledGrid(
+		std::uint32_t columnCount,
+		std::uint32_t rowCount,
+		std::vector<std::uint32_t>& indexVector)
+	{
+		std::vector<tTriangle> triangleVector;
+
+		for (std::uint32_t row = 0; row < rowCount; ++row)
+		{
+			for (std::uint32_t column = 0; column < columnCount; ++column)
+			{
+				const std::uint32_t a = row * (columnCount + 1) + column;
+				const std::uint32_t b = a + 1;
+				const std::uint32_t c = a + columnCount + 1;
+				const std::uint32_t d = c + 1;
+
+				triangleVector.push_back({ { a, c, d } });
+				triangleVector.push_back({ { a, d, b } });
+			}
+		}
+
+		std::mt19937 random(7);
+
+		std::shuffle(triangleVector.begin(), triangleVector.end(), random);
+
+		indexVector.clear();
+
+		for (const auto& triangle : triangleVector)
+		{
+			indexVector.insert(indexVector.end(), triangle.begin(), triangle.end());
+		}
+	}
+
+	// Every triangle rotated to start at its smallest index, which keeps
+	// the winding, then sorted.
+	std::vector<tTriangle> getTriangleSet(
+		const std::vector<std::uint32_t>& indexVector)
+	{
+		std::vector<tTriangle> triangleVector;
+
+		for (size_t i = 0; i + 2 < indexVector.size(); i += 3)
+		{
+			tTriangle triangle = { { indexVector[i], indexVector[i + 1], indexVector[i + 2] } };
+
+			std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+			triangleVector.push_back(triangle);
+		}
+
+		std::sort(triangleVector.begin(), triangleVector.end());
+
+		return triangleVector;
+	}
+
+	// A torus with uv seams where it closes in both directions: column
+	// columnCount and row rowCount repeat the positions of column and row
+	// 0 with their own vertices. uvs holds u and v of every vertex.
+	void makeSeamedTorus(
+		std::uint32_t columnCount,
+		std::uint32_t rowCount,
+		std::vector<float>& positions,
+		std::vector<float>& uvs,
+		std::vector<std::uint32_t>& indexVector)
+	{
+		const float pi = 3.14159265f;
+
+		positions.clear();
+		uvs.clear();
+		indexVector.clear();
+
+		for (std::uint32_t row = 0; row <= rowCount; ++row)
+		{
+			for (std::uint32_t column = 0; column <= columnCount; ++column)
+			{
+				const float u = 2.0f * pi * (column % columnCount) / columnCount;
+				const float v = 2.0f * pi * (row % rowCount) / rowCount;
+				const float radius = 1.0f + 0.3f * cosf(v);
+
+				positions.push_back(radius * cosf(u));
+				positions.push_back(0.3f * sinf(v));
+				positions.push_back(radius * sinf(u));
+				uvs.push_back(static_cast<float>(column) / columnCount);
+				uvs.push_back(static_cast<float>(row) / rowCount);
+			}
+		}
+
+		for (std::uint32_t row = 0; row < rowCount; ++row)
+		{
+			for (std::uint32_t column = 0; column < columnCount; ++column)
+			{
+				const std::uint32_t a = row * (columnCount + 1) + column;
+				const std::uint32_t b = a + 1;
+				const std::uint32_t c = a + columnCount + 1;
+				const std::uint32_t d = c + 1;
+
+				indexVector.insert(indexVector.end(), { a, c, d, a, d, b });
+			}
+		}
+	}
+}
+
+// Counted by hand. With 3 entries the fourth triangle misses vertex 0
+// again, a FIFO does not refresh it on the hit in the second triangle.
+TEST_CASE(MeshOptimizer_AnalyzeVertexCacheIsExact)
+{
+	const std::uint32_t indices[] = { 0, 1, 2, 0, 3, 4, 0, 4, 5 };
+	const MeshOptimizer::VertexCacheStatistics smallCache = MeshOptimizer::AnalyzeVertexCache(indices, 9, 6, 3);
+	const MeshOptimizer::VertexCacheStatistics largeCache = MeshOptimizer::AnalyzeVertexCache(indices, 9, 6, 16);
+
+	CHECK(fabsf(smallCache.Acmr - 7.0f / 3.0f) < 1.0e-6f);
+	CHECK(fabsf(smallCache.Atvr - 7.0f / 6.0f) < 1.0e-6f);
+	CHECK(fabsf(largeCache.Acmr - 2.0f) < 1.0e-6f);
+	CHECK(fabsf(largeCache.Atvr - 1.0f) < 1.0e-6f);
+}
+
+TEST_CASE(MeshOptimizer_VertexCacheOrderLowersAcmr)
+{
+	const std::uint32_t columnCount = 64;
+	const std::uint32_t rowCount = 64;
+	const size_t vertexCount = (columnCount + 1) * (rowCount + 1);
+	std::vector<std::uint32_t> indexVector;
+
+	makeShuffledGrid(columnCount, rowCount, indexVector);
+
+	const std::vector<tTriangle> triangleSet = getTriangleSet(indexVector);
+	const MeshOptimizer::VertexCacheStatistics before = MeshOptimizer::AnalyzeVertexCache(indexVector.data(), indexVector.size(), vertexCount);
+
+	MeshOptimizer::OptimizeVertexCache(indexVector.data(), indexVector.size(), vertexCount);
+
+	const MeshOptimizer::VertexCacheStatistics after = MeshOptimizer::AnalyzeVertexCache(indexVector.data(), indexVector.size(), vertexCount);
+
+	printf("  ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", before.Acmr, after.Acmr, before.Atvr, after.Atvr);
+
+	// A grid cannot go below 0.5, every vertex is shared by 6 triangles.
+	CHECK(before.Acmr > 2.0f);
+	CHECK(after.Acmr < 0.8f);
+	CHECK(after.Acmr >= 0.5f);
+	CHECK(getTriangleSet(indexVector) == triangleSet);
+}
+
+TEST_CASE(MeshOptimizer_VertexFetchRemapIsPermutation)
+{
+	const size_t vertexCount = 8;
+
+	// Vertices 1 and 6 are never used.
+	std::vector<std::uint32_t> indexVector = { 5, 2, 7, 7, 2, 0, 3, 4, 0 };
+	const std::vector<std::uint32_t> originalIndexVector = indexVector;
+	std::vector<std::uint32_t> newVertexForOldVertex;
+
+	MeshOptimizer::OptimizeVertexFetch(indexVector.data(), indexVector.size(), vertexCount, newVertexForOldVertex);
+
+	CHECK(newVertexForOldVertex.size() == vertexCount);
+
+	std::vector<std::uint32_t> sortedRemap = newVertexForOldVertex;
+
+	std::sort(sortedRemap.begin(), sortedRemap.end());
+
+	for (std::uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		CHECK(sortedRemap[vertex] == vertex);
+	}
+
+	// New vertices appear in order of first use, the unused ones last.
+	std::uint32_t nextVertex = 0;
+
+	for (size_t i = 0; i < indexVector.size(); ++i)
+	{
+		CHECK(indexVector[i] == newVertexForOldVertex[originalIndexVector[i]]);
+		CHECK(indexVector[i] <= nextVertex);
+
+		nextVertex = std::max(nextVertex, indexVector[i] + 1);
+	}
+
+	CHECK(newVertexForOldVertex[1] >= 6);
+	CHECK(newVertexForOldVertex[6] >= 6);
+}
+
+// The seams have to shorten with the rest of the surface, without cracks
+// and without a triangle that reaches across to the other side of a seam.
+TEST_CASE(MeshOptimizer_SimplifyCollapsesSeams)
+{
+	const std::uint32_t columnCount = 64;
+	const std::uint32_t rowCount = 32;
+	std::vector<float> positions;
+	std::vector<float> uvs;
+	std::vector<std::uint32_t> indexVector;
+	std::vector<std::uint32_t> simplifiedIndices;
+
+	makeSeamedTorus(columnCount, rowCount, positions, uvs, indexVector);
+
+	const size_t vertexCount = positions.size() / 3;
+	const size_t targetIndexCount = indexVector.size() / 10;
+
+	MeshOptimizer::SimplifyMesh(
+		indexVector.data(),
+		indexVector.size(),
+		positions.data(),
+		3 * sizeof(float),
+		vertexCount,
+		nullptr,
+		nullptr,
+		targetIndexCount,
+		simplifiedIndices);
+
+	CHECK(simplifiedIndices.size() <= targetIndexCount);
+
+	// Points are the vertices without the seam copies.
+	auto point = [&](std::uint32_t vertex)
+	{
+		return (vertex / (columnCount + 1)) % rowCount * columnCount + vertex % (columnCount + 1) % columnCount;
+	};
+
+	std::vector<std::uint64_t> edges;
+	std::vector<bool> seamPointUsed(rowCount * columnCount, false);
+	size_t seamPointCount = 0;
+	bool uvsContinuous = true;
+
+	for (size_t i = 0; i < simplifiedIndices.size(); i += 3)
+	{
+		float minUv[2] = { 1.0f, 1.0f };
+		float maxUv[2] = { 0.0f, 0.0f };
+
+		for (size_t corner = 0; corner < 3; ++corner)
+		{
+			const std::uint32_t vertex = simplifiedIndices[i + corner];
+			const std::uint64_t a = point(vertex);
+			const std::uint64_t b = point(simplifiedIndices[i + (corner + 1) % 3]);
+
+			edges.push_back((std::min(a, b) << 32) | std::max(a, b));
+
+			for (size_t axis = 0; axis < 2; ++axis)
+			{
+				minUv[axis] = std::min(minUv[axis], uvs[vertex * 2 + axis]);
+				maxUv[axis] = std::max(maxUv[axis], uvs[vertex * 2 + axis]);
+			}
+
+			if (((vertex % (columnCount + 1)) % columnCount == 0) || ((vertex / (columnCount + 1)) % rowCount == 0))
+			{
+				seamPointCount += seamPointUsed[a] ? 0 : 1;
+				seamPointUsed[a] = true;
+			}
+		}
+
+		uvsContinuous = uvsContinuous && (maxUv[0] - minUv[0] < 0.5f) && (maxUv[1] - minUv[1] < 0.5f);
+	}
+
+	std::sort(edges.begin(), edges.end());
+
+	bool closed = true;
+
+	for (size_t first = 0; first < edges.size();)
+	{
+		size_t last = first + 1;
+
+		while ((last < edges.size()) && (edges[last] == edges[first]))
+		{
+			++last;
+		}
+
+		closed = closed && (last - first == 2);
+		first = last;
+	}
+
+	printf("  %zu of %u seam points left\n", seamPointCount, columnCount + rowCount - 1);
+
+	CHECK(closed);
+	CHECK(uvsContinuous);
+	CHECK(seamPointCount < (columnCount + rowCount - 1) / 2);
+}
+
+BENCHMARK_CASE(MeshOptimizer_SimplifyMesh)
+{
+	const std::uint32_t columnCounts[] = { 128, 512, 1024 };
+	std::vector<float> positions;
+	std::vector<float> uvs;
+	std::vector<std::uint32_t> indexVector;
+	std::vector<std::uint32_t> simplifiedIndices;
+
+	for (std::uint32_t columnCount : columnCounts)
+	{
+		const std::uint32_t rowCount = columnCount / 2;
+
+		makeSeamedTorus(columnCount, rowCount, positions, uvs, indexVector);
+
+		const size_t triangleCount = indexVector.size() / 3;
+
+		tBenchmark("simplify to 10%, " + std::to_string(triangleCount) + " triangles, per triangle", triangleCount, 3).run([&]()
+		{
+			MeshOptimizer::SimplifyMesh(
+				indexVector.data(),
+				indexVector.size(),
+				positions.data(),
+				3 * sizeof(float),
+				positions.size() / 3,
+				nullptr,
+				nullptr,
+				indexVector.size() / 10,
+				simplifiedIndices);
+		});
+
+		CHECK(simplifiedIndices.size() <= indexVector.size() / 10);
+	}
+}
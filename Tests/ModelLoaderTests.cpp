@@ -0,0 +1,2021 @@
+#include "tBenchmark.h"
+#include "tTestHarness.h"
+#include "tTestScene.h"
+#include "../Source/ModelLoader.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const unsigned long kBoneMatrixVectorSize = 50;
+
+	ModelLoader::tLoadSettings getLoadSettings()
+	{
+		ModelLoader::tLoadSettings loadSettings = {};
+
+		loadSettings.minimalImport = true;
+
+		return loadSettings;
+	}
+
+	void load(
+		ModelLoader& modelLoader,
+		const std::string& filename,
+		const ModelLoader::tLoadSettings& loadSettings)
+	{
+		modelLoader.setLoadSettings(loadSettings);
+		modelLoader.load(tTestScene::createDevice(), filename.c_str(), kBoneMatrixVectorSize);
+		modelLoader.finishLoad();
+	}
+
+	ModelLoader::tSkinnedVertice makeVertice(
+		float x,
+		float y,
+		float z)
+	{
+		ModelLoader::tSkinnedVertice vertice = {};
+
+		vertice.point = DirectX::XMFLOAT3(x, y, z);
+		vertice.normal = DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f);
+		vertice.boneWeights = 0xFF;
+
+		return vertice;
+	}
+
+	// Welds the vertices in order, returns the welded count.
+	size_t weld(
+		const std::vector<ModelLoader::tSkinnedVertice>& verticeVector,
+		float weldEpsilon,
+		std::vector<std::uint32_t>& indexVector)
+	{
+		LinearArena arena;
+		std::vector<ModelLoader::tSkinnedVertice> weldedVector;
+
+		indexVector.resize(verticeVector.size());
+
+		for (size_t i = 0; i < indexVector.size(); ++i)
+		{
+			indexVector[i] = static_cast<std::uint32_t>(i);
+		}
+
+		ModelLoader::weldVertices(verticeVector.data(), indexVector.data(), indexVector.size(), weldEpsilon, arena, weldedVector);
+
+		return weldedVector.size();
+	}
+
+	// A grid of quads, every corner repeated per triangle and moved by up
+	// to a tenth of weldEpsilon.
+	void makeTriangleSoup(
+		size_t triangleCount,
+		float weldEpsilon,
+		std::vector<ModelLoader::tSkinnedVertice>& verticeVector)
+	{
+		const size_t columnCount = static_cast<size_t>(sqrt(triangleCount / 2.0)) + 1;
+		unsigned long seed = 1;
+
+		verticeVector.clear();
+
+		for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+		{
+			const size_t quad = triangle / 2;
+			const size_t column = quad % columnCount;
+			const size_t row = quad / columnCount;
+			const size_t corners[2][3][2] =
+			{
+				{ { 0, 0 }, { 0, 1 }, { 1, 1 } },
+				{ { 0, 0 }, { 1, 1 }, { 1, 0 } },
+			};
+
+			for (const auto& corner : corners[triangle % 2])
+			{
+				seed = seed * 1103515245 + 12345;
+
+				const float jitter = weldEpsilon * 0.1f * ((seed >> 16) & 0xFF) / 255.0f;
+
+				verticeVector.push_back(makeVertice(
+					static_cast<float>(column + corner[0]) + jitter,
+					0.0f,
+					static_cast<float>(row + corner[1]) - jitter));
+			}
+		}
+	}
+}
+
+TEST_CASE(ModelLoader_WeldsAcrossCellBorders)
+{
+	const float weldEpsilon = 0.01f;
+	std::vector<ModelLoader::tSkinnedVertice> verticeVector;
+	std::vector<std::uint32_t> indexVector;
+
+	// Closer than weldEpsilon, on both sides of a multiple of it.
+	verticeVector.push_back(makeVertice(0.0099f, 0.0f, -0.0001f));
+	verticeVector.push_back(makeVertice(0.0101f, 0.0f, 0.0001f));
+	verticeVector.push_back(makeVertice(-0.0101f, 0.0f, 0.0f));
+	verticeVector.push_back(makeVertice(-0.0099f, 0.0f, 0.0f));
+
+	CHECK(weld(verticeVector, weldEpsilon, indexVector) == 2);
+	CHECK(indexVector[0] == indexVector[1]);
+	CHECK(indexVector[2] == indexVector[3]);
+	CHECK(indexVector[0] != indexVector[2]);
+}
+
+TEST_CASE(ModelLoader_WeldKeepsDistinctVertices)
+{
+	const float weldEpsilon = 0.01f;
+	std::vector<ModelLoader::tSkinnedVertice> verticeVector;
+	std::vector<std::uint32_t> indexVector;
+
+	verticeVector.push_back(makeVertice(0.0f, 0.0f, 0.0f));
+	verticeVector.push_back(makeVertice(0.011f, 0.0f, 0.0f));
+
+	// Same point, the uv, normal or skin differ.
+	verticeVector.push_back(makeVertice(0.0f, 0.0f, 0.0f));
+	verticeVector.back().tex.x = 0.5f;
+	verticeVector.push_back(makeVertice(0.0f, 0.0f, 0.0f));
+	verticeVector.back().normal = DirectX::XMFLOAT3(0.0f, 0.0f, 1.0f);
+	verticeVector.push_back(makeVertice(0.0f, 0.0f, 0.0f));
+	verticeVector.back().boneIndices[0] = 1;
+
+	CHECK(weld(verticeVector, weldEpsilon, indexVector) == verticeVector.size());
+	CHECK(weld(verticeVector, 0.0f, indexVector) == verticeVector.size());
+}
+
+// Far from the origin the cells grow, their coordinates must not wrap.
+TEST_CASE(ModelLoader_WeldHandlesLargeCoordinates)
+{
+	std::vector<ModelLoader::tSkinnedVertice> verticeVector;
+	std::vector<std::uint32_t> indexVector;
+
+	verticeVector.push_back(makeVertice(1.0e30f, -1.0e30f, 0.0f));
+	verticeVector.push_back(makeVertice(1.0e30f, -1.0e30f, 0.0f));
+	verticeVector.push_back(makeVertice(-1.0e30f, 1.0e30f, 0.0f));
+	verticeVector.push_back(makeVertice(1.0f, 0.0f, 0.0f));
+
+	CHECK(weld(verticeVector, 1.0e-6f, indexVector) == 3);
+	CHECK(indexVector[0] == indexVector[1]);
+}
+
+TEST_CASE(ModelLoader_LoadsGeneratedTube)
+{
+	const std::string filename = tTestHarness::getTempFilename("tube.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+
+	settings.byPolygonVertex = true;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader modelLoader;
+
+	load(modelLoader, filename, getLoadSettings());
+
+	CHECK(modelLoader.m_modelVector.size() == 1);
+	CHECK(modelLoader.m_modelVector[0].verticeVector.size() == tTestScene::getVerticeCount(settings));
+	CHECK(modelLoader.m_modelVector[0].indexVector.size() == settings.columnCount * settings.rowCount * 6);
+
+	tTestScene::remove(filename);
+}
+
+// Both conversion paths must agree on the mesh, the native one converts
+// while extracting instead of running the SDK over the whole scene.
+TEST_CASE(ModelLoader_NativeConversionMatchesSdk)
+{
+	const std::string filename = tTestHarness::getTempFilename("converted.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+
+	settings.convertedAxis = true;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+	ModelLoader sdkLoader;
+	ModelLoader nativeLoader;
+
+	load(sdkLoader, filename, loadSettings);
+	loadSettings.nativeConversion = true;
+	load(nativeLoader, filename, loadSettings);
+
+	CHECK(sdkLoader.m_modelVector[0].verticeVector.size() == nativeLoader.m_modelVector[0].verticeVector.size());
+	CHECK(sdkLoader.m_modelVector[0].indexVector.size() == nativeLoader.m_modelVector[0].indexVector.size());
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		CHECK(fabs((&sdkLoader.maxVertex.x)[axis] - (&nativeLoader.maxVertex.x)[axis]) < 1.0e-3f);
+		CHECK(fabs((&sdkLoader.minVertex.x)[axis] - (&nativeLoader.minVertex.x)[axis]) < 1.0e-3f);
+	}
+
+	tTestScene::remove(filename);
+}
+
+// A second load comes from the cache and gives the same meshes and clips,
+// an edited .fbx is loaded again.
+TEST_CASE(ModelLoader_ModelCacheRoundTrip)
+{
+	const std::string filename = tTestHarness::getTempFilename("cached.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+
+	settings.takeCount = 2;
+	settings.staticBoneStride = 3;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+
+	loadSettings.useModelCache = true;
+	loadSettings.bakeClips = true;
+	loadSettings.skipStaticBones = true;
+
+	ModelLoader firstLoader;
+	ModelLoader cachedLoader;
+
+	load(firstLoader, filename, loadSettings);
+	load(cachedLoader, filename, loadSettings);
+
+	CHECK(!firstLoader.isModelCacheLoaded());
+	CHECK(cachedLoader.isModelCacheLoaded());
+	CHECK(firstLoader.m_modelVector.size() == cachedLoader.m_modelVector.size());
+	CHECK(firstLoader.m_modelVector[0].indexVector == cachedLoader.m_modelVector[0].indexVector);
+	CHECK(0 == memcmp(
+		firstLoader.m_modelVector[0].verticeVector.data(),
+		cachedLoader.m_modelVector[0].verticeVector.data(),
+		firstLoader.m_modelVector[0].verticeVector.size() * sizeof(ModelLoader::tSkinnedVertice)));
+	CHECK(firstLoader.m_clipVector.size() == settings.takeCount);
+	CHECK(cachedLoader.m_clipVector.size() == settings.takeCount);
+
+	for (size_t clipIndex = 0; clipIndex < firstLoader.m_clipVector.size(); ++clipIndex)
+	{
+		CHECK(firstLoader.m_clipVector[clipIndex].name == cachedLoader.m_clipVector[clipIndex].name);
+		CHECK(firstLoader.m_clipVector[clipIndex].keyVector.size() == cachedLoader.m_clipVector[clipIndex].keyVector.size());
+	}
+
+	// Compressed clips come back from their own files.
+	loadSettings.compressClips = true;
+
+	ModelLoader compressingLoader;
+	ModelLoader compressedLoader;
+
+	load(compressingLoader, filename, loadSettings);
+	load(compressedLoader, filename, loadSettings);
+
+	CHECK(compressedLoader.isModelCacheLoaded());
+	CHECK(compressedLoader.m_compressedClipVector.size() == settings.takeCount);
+	CHECK(compressedLoader.getClipCompressionRatio() > 1.0f);
+
+	for (unsigned long takeIndex = 0; takeIndex < settings.takeCount; ++takeIndex)
+	{
+		CHECK(std::ifstream(filename + ".take" + std::to_string(takeIndex) + ".clip").good());
+	}
+
+	settings.rowCount *= 2;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader editedLoader;
+
+	load(editedLoader, filename, loadSettings);
+
+	CHECK(!editedLoader.isModelCacheLoaded());
+	CHECK(editedLoader.m_modelVector[0].verticeVector.size() == tTestScene::getVerticeCount(settings));
+
+	tTestScene::remove(filename);
+}
+
+// A take that does not start at 0 has to play from its own start, baked,
+// compressed or evaluated by the SDK. The times hit frames, so the baked
+// keys match the curves exactly.
+TEST_CASE(ModelLoader_BakedClipsMatchSdkPoses)
+{
+	const std::string filename = tTestHarness::getTempFilename("takestart.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+	const unsigned long long timeVector[] = { 0, 100, 500, 900 };
+
+	settings.takeCount = 2;
+	settings.takeStart = 2.0;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+	ModelLoader sdkLoader;
+	ModelLoader bakedLoader;
+	ModelLoader compressedLoader;
+
+	load(sdkLoader, filename, loadSettings);
+	loadSettings.bakeClips = true;
+	load(bakedLoader, filename, loadSettings);
+	loadSettings.compressClips = true;
+	load(compressedLoader, filename, loadSettings);
+
+	for (unsigned long long time : timeVector)
+	{
+		std::vector<DirectX::XMFLOAT4X4> poseVectors[3];
+		ModelLoader* modelLoaders[] = { &sdkLoader, &bakedLoader, &compressedLoader };
+
+		for (size_t i = 0; i < _countof(modelLoaders); ++i)
+		{
+			modelLoaders[i]->setAnimationTime(time);
+			modelLoaders[i]->loadBoneMatriceVector();
+			poseVectors[i] = modelLoaders[i]->m_boneMatrixVector;
+		}
+
+		float bakedError = 0.0f;
+		float compressedError = 0.0f;
+
+		CHECK(poseVectors[0].size() == settings.boneCount);
+		CHECK(poseVectors[1].size() == poseVectors[0].size());
+		CHECK(poseVectors[2].size() == poseVectors[0].size());
+
+		for (size_t boneIndex = 0; boneIndex < poseVectors[0].size(); ++boneIndex)
+		{
+			for (int row = 0; row < 4; ++row)
+			{
+				for (int column = 0; column < 4; ++column)
+				{
+					const float sdkValue = poseVectors[0][boneIndex].m[row][column];
+
+					bakedError = MathHelper::Max(bakedError, fabsf(poseVectors[1][boneIndex].m[row][column] - sdkValue));
+					compressedError = MathHelper::Max(compressedError, fabsf(poseVectors[2][boneIndex].m[row][column] - sdkValue));
+				}
+			}
+		}
+
+		CHECK(bakedError < 1.0e-4f);
+		CHECK(compressedError < 1.0e-2f);
+	}
+
+	tTestScene::remove(filename);
+}
+
+// Skipped static bones keep the pose a full evaluation gives them at any
+// time, from the scene, baked or compressed clips. The palette is the
+// offset times the model matrix, both loaders share the offsets.
+TEST_CASE(ModelLoader_SkippedStaticBonesMatchFullPoses)
+{
+	const std::string filename = tTestHarness::getTempFilename("staticbones.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+	const unsigned long long timeVector[] = { 0, 100, 500, 900 };
+
+	// bone0 and bone0_helper sit above every animated bone, bone3 and
+	// bone6 are static too but below one.
+	settings.helperBones = true;
+	settings.staticBoneStride = 3;
+	CHECK(tTestScene::write(filename, settings));
+
+	for (int source = 0; source < 3; ++source)
+	{
+		ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+		ModelLoader fullLoader;
+		ModelLoader skippingLoader;
+
+		loadSettings.bakeClips = (source > 0);
+		loadSettings.compressClips = (source > 1);
+		load(fullLoader, filename, loadSettings);
+		loadSettings.skipStaticBones = true;
+		load(skippingLoader, filename, loadSettings);
+
+		ModelLoader* modelLoaders[] = { &fullLoader, &skippingLoader };
+
+		// The first frame poses every bone.
+		skippingLoader.setAnimationTime(0);
+		CHECK(skippingLoader.getSkippedBoneCount() == 0);
+
+		for (unsigned long long time : timeVector)
+		{
+			for (ModelLoader* modelLoader : modelLoaders)
+			{
+				modelLoader->setAnimationTime(time);
+				modelLoader->loadBoneMatriceVector();
+			}
+
+			const auto& fullVector = fullLoader.m_boneMatrixVector;
+			const auto& skippingVector = skippingLoader.m_boneMatrixVector;
+			float error = 0.0f;
+
+			CHECK(fullLoader.getSkippedBoneCount() == 0);
+			CHECK(skippingLoader.getSkippedBoneCount() == 2);
+			CHECK(fullVector.size() == settings.boneCount + 2);
+			CHECK(skippingVector.size() == fullVector.size());
+
+			for (size_t boneIndex = 0; boneIndex < MathHelper::Min(fullVector.size(), skippingVector.size()); ++boneIndex)
+			{
+				for (int row = 0; row < 4; ++row)
+				{
+					for (int column = 0; column < 4; ++column)
+					{
+						error = MathHelper::Max(error, fabsf(skippingVector[boneIndex].m[row][column] - fullVector[boneIndex].m[row][column]));
+					}
+				}
+			}
+
+			CHECK(error < 1.0e-5f);
+		}
+	}
+
+	tTestScene::remove(filename);
+}
+
+namespace
+{
+	// Runs the load under a scheduler of threadCount virtual processors,
+	// one runs every parallel_for of the load inline.
+	void loadWithThreads(
+		ModelLoader& modelLoader,
+		const std::string& filename,
+		const ModelLoader::tLoadSettings& loadSettings,
+		unsigned int threadCount)
+	{
+		concurrency::CurrentScheduler::Create(concurrency::SchedulerPolicy(2,
+			concurrency::MinConcurrency, threadCount,
+			concurrency::MaxConcurrency, threadCount));
+		load(modelLoader, filename, loadSettings);
+		concurrency::CurrentScheduler::Detach();
+	}
+}
+
+// The meshes load in parallel and every mesh in polygon chunks, each task
+// writes its own slots and the bounds are merged after. Whatever the
+// tasks run on, the arrays come out the same as a serial load.
+TEST_CASE(ModelLoader_ParallelExtractionMatchesSerial)
+{
+	const std::string filename = tTestHarness::getTempFilename("parallelextraction.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+
+	// Two polygon chunks of 16384 per mesh.
+	settings.columnCount = 256;
+	settings.rowCount = 80;
+	settings.meshCount = 3;
+
+	for (int byPolygonVertex = 0; byPolygonVertex < 2; ++byPolygonVertex)
+	{
+		settings.byPolygonVertex = (byPolygonVertex != 0);
+		CHECK(tTestScene::write(filename, settings));
+
+		ModelLoader serialLoader;
+		ModelLoader parallelLoader;
+
+		loadWithThreads(serialLoader, filename, getLoadSettings(), 1);
+		loadWithThreads(parallelLoader, filename, getLoadSettings(), 4);
+
+		CHECK(serialLoader.m_modelVector.size() == settings.meshCount);
+		CHECK(parallelLoader.m_modelVector.size() == settings.meshCount);
+
+		for (size_t modelIndex = 0; modelIndex < serialLoader.m_modelVector.size(); ++modelIndex)
+		{
+			const auto& serialModelRec = serialLoader.m_modelVector[modelIndex];
+			const auto& parallelModelRec = parallelLoader.m_modelVector[modelIndex];
+
+			CHECK(serialModelRec.meshName == parallelModelRec.meshName);
+			CHECK(serialModelRec.verticeVector.size() == parallelModelRec.verticeVector.size());
+			CHECK(0 == memcmp(serialModelRec.verticeVector.data(), parallelModelRec.verticeVector.data(),
+				serialModelRec.verticeVector.size() * sizeof(ModelLoader::tSkinnedVertice)));
+			CHECK(serialModelRec.indexVector == parallelModelRec.indexVector);
+			CHECK(0 == memcmp(&serialModelRec.minVertex, &parallelModelRec.minVertex, sizeof(serialModelRec.minVertex)));
+			CHECK(0 == memcmp(&serialModelRec.maxVertex, &parallelModelRec.maxVertex, sizeof(serialModelRec.maxVertex)));
+		}
+
+		// The tubes stand side by side, the merged bounds span all of them.
+		CHECK(0 == memcmp(&serialLoader.minVertex, &parallelLoader.minVertex, sizeof(serialLoader.minVertex)));
+		CHECK(0 == memcmp(&serialLoader.maxVertex, &parallelLoader.maxVertex, sizeof(serialLoader.maxVertex)));
+		CHECK(parallelLoader.maxVertex.x > parallelLoader.m_modelVector[0].maxVertex.x);
+		CHECK(parallelLoader.minVertex.x == parallelLoader.m_modelVector[0].minVertex.x);
+	}
+
+	tTestScene::remove(filename);
+}
+
+BENCHMARK_CASE(ModelLoader_ConversionPaths)
+{
+	const std::string filename = tTestHarness::getTempFilename("conversion.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+
+	settings.columnCount = 256;
+	settings.rowCount = 256;
+	settings.meshCount = 4;
+	settings.convertedAxis = true;
+	CHECK(tTestScene::write(filename, settings));
+
+	const size_t polygonCount = settings.columnCount * settings.rowCount * settings.meshCount;
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+
+	tBenchmark("sdk conversion, per polygon", polygonCount).run([&]()
+	{
+		ModelLoader modelLoader;
+
+		load(modelLoader, filename, loadSettings);
+	});
+
+	loadSettings.nativeConversion = true;
+	tBenchmark("native conversion, per polygon", polygonCount).run([&]()
+	{
+		ModelLoader modelLoader;
+
+		load(modelLoader, filename, loadSettings);
+	});
+
+	tTestScene::remove(filename);
+}
+
+BENCHMARK_CASE(ModelLoader_WeldVertices)
+{
+	const float weldEpsilon = 1.0e-3f;
+	const size_t triangleCounts[] = { 10000, 100000, 1000000 };
+	std::vector<ModelLoader::tSkinnedVertice> verticeVector;
+	std::vector<std::uint32_t> indexVector;
+
+	for (size_t triangleCount : triangleCounts)
+	{
+		makeTriangleSoup(triangleCount, weldEpsilon, verticeVector);
+
+		const size_t verticeCount = verticeVector.size();
+
+		tBenchmark("exact weld, " + std::to_string(triangleCount) + " triangles, per vertice", verticeCount).run([&]()
+		{
+			weld(verticeVector, 0.0f, indexVector);
+		});
+
+		size_t weldedCount = 0;
+
+		tBenchmark("epsilon weld, " + std::to_string(triangleCount) + " triangles, per vertice", verticeCount).run([&]()
+		{
+			weldedCount = weld(verticeVector, weldEpsilon, indexVector);
+		});
+
+		// The jitter stays within the epsilon, every grid corner is one vertice.
+		const size_t columnCount = static_cast<size_t>(sqrt(triangleCount / 2.0)) + 1;
+		const size_t rowCount = (triangleCount / 2 + columnCount - 1) / columnCount;
+
+		CHECK(weldedCount <= (columnCount + 1) * (rowCount + 1));
+	}
+}
+
+// The compressed rows hold the same corners, in the same order, as a
+// plain list per control point, also the empty rows of control points no
+// polygon uses. Enough corners for several parallel chunks.
+TEST_CASE(ModelLoader_ControlPointRemapMatchesLists)
+{
+	const int controlPointCount = 20000;
+	const int cornerCount = 100000;
+	std::mt19937 random(7);
+	std::vector<int> polygonVertexVector(cornerCount);
+	std::vector<std::vector<int>> cornerListVector(controlPointCount);
+
+	for (int corner = 0; corner < cornerCount; ++corner)
+	{
+		// Every fifth control point is left unused.
+		int controlPointIndex = static_cast<int>(random() % controlPointCount);
+
+		if (controlPointIndex % 5 == 0)
+		{
+			++controlPointIndex;
+		}
+
+		polygonVertexVector[corner] = controlPointIndex;
+		cornerListVector[controlPointIndex].push_back(corner);
+	}
+
+	LinearArena arena;
+	ModelLoader::tControlPointRemap controlPointRemap = { ModelLoader::tControlPointIndexes(arena), ModelLoader::tControlPointIndexes(arena) };
+
+	ModelLoader::buildControlPointRemap(polygonVertexVector.data(), cornerCount, controlPointCount, arena, controlPointRemap);
+
+	CHECK(controlPointRemap.offsetVector.size() == static_cast<size_t>(controlPointCount) + 1);
+	CHECK(controlPointRemap.cornerVector.size() == static_cast<size_t>(cornerCount));
+	CHECK(controlPointRemap.offsetVector[0] == 0);
+	CHECK(controlPointRemap.offsetVector[controlPointCount] == cornerCount);
+
+	size_t emptyRowCount = 0;
+
+	for (int controlPointIndex = 0; controlPointIndex < controlPointCount; ++controlPointIndex)
+	{
+		const std::vector<int>& cornerList = cornerListVector[controlPointIndex];
+		const int first = controlPointRemap.offsetVector[controlPointIndex];
+		const int last = controlPointRemap.offsetVector[controlPointIndex + 1];
+
+		CHECK(last - first == static_cast<int>(cornerList.size()));
+		CHECK(std::equal(cornerList.begin(), cornerList.end(), controlPointRemap.cornerVector.begin() + first));
+
+		emptyRowCount += (first == last) ? 1 : 0;
+	}
+
+	CHECK(emptyRowCount >= static_cast<size_t>(controlPointCount / 5));
+}
+
+namespace
+{
+	// A forest whose bones are shuffled after it was grown, so parents
+	// often come after their children. Roughly one bone in eight is
+	// animated.
+	void makeShuffledRig(
+		size_t boneCount,
+		size_t rootCount,
+		std::mt19937& random,
+		std::vector<std::int32_t>& parentIndexVector,
+		std::vector<bool>& animatedBoneVector)
+	{
+		std::vector<std::int32_t> grownParentVector(boneCount, -1);
+		std::vector<std::int32_t> shuffledIndexVector(boneCount);
+
+		for (size_t boneIndex = rootCount; boneIndex < boneCount; ++boneIndex)
+		{
+			grownParentVector[boneIndex] = static_cast<std::int32_t>(random() % boneIndex);
+		}
+
+		for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+		{
+			shuffledIndexVector[boneIndex] = static_cast<std::int32_t>(boneIndex);
+		}
+
+		std::shuffle(shuffledIndexVector.begin(), shuffledIndexVector.end(), random);
+
+		parentIndexVector.assign(boneCount, -1);
+		animatedBoneVector.assign(boneCount, false);
+
+		for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+		{
+			const std::int32_t grownParent = grownParentVector[boneIndex];
+
+			parentIndexVector[shuffledIndexVector[boneIndex]] = (grownParent < 0) ? -1 : shuffledIndexVector[grownParent];
+			animatedBoneVector[boneIndex] = (random() % 8 == 0);
+		}
+	}
+
+	// Transposed offset * model of every bone, the model matrices built
+	// depth first from the roots like the bones of an .fbx are read.
+	void getDepthFirstPalettes(
+		const std::vector<std::int32_t>& parentIndexVector,
+		const std::vector<DirectX::XMFLOAT4X4>& localVector,
+		const std::vector<DirectX::XMFLOAT4X4>& offsetVector,
+		std::vector<DirectX::XMFLOAT4X4>& paletteVector)
+	{
+		const size_t boneCount = parentIndexVector.size();
+		std::vector<std::vector<std::int32_t>> childListVector(boneCount);
+		std::vector<std::int32_t> stackVector;
+		std::vector<DirectX::XMFLOAT4X4> modelVector(boneCount);
+
+		for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+		{
+			if (parentIndexVector[boneIndex] < 0)
+			{
+				stackVector.push_back(static_cast<std::int32_t>(boneIndex));
+			}
+			else
+			{
+				childListVector[parentIndexVector[boneIndex]].push_back(static_cast<std::int32_t>(boneIndex));
+			}
+		}
+
+		paletteVector.resize(boneCount);
+
+		while (!stackVector.empty())
+		{
+			const std::int32_t boneIndex = stackVector.back();
+			const std::int32_t parentIndex = parentIndexVector[boneIndex];
+			DirectX::XMMATRIX model = DirectX::XMLoadFloat4x4(&localVector[boneIndex]);
+
+			stackVector.pop_back();
+
+			if (parentIndex >= 0)
+			{
+				model = DirectX::XMMatrixMultiply(model, DirectX::XMLoadFloat4x4(&modelVector[parentIndex]));
+			}
+
+			DirectX::XMStoreFloat4x4(&modelVector[boneIndex], model);
+			DirectX::XMStoreFloat4x4(&paletteVector[boneIndex],
+				DirectX::XMMatrixTranspose(DirectX::XMMatrixMultiply(DirectX::XMLoadFloat4x4(&offsetVector[boneIndex]), model)));
+			stackVector.insert(stackVector.end(), childListVector[boneIndex].begin(), childListVector[boneIndex].end());
+		}
+	}
+}
+
+// On a rig whose bone order is not topological, every parent lands in the
+// level before its children, the posed bones lead their level, siblings
+// keep their order, and posing level by level gives the depth first
+// palettes.
+TEST_CASE(ModelLoader_SkeletonSortsParentsFirst)
+{
+	const size_t boneCount = 5000;
+	std::mt19937 random(17);
+	std::vector<std::int32_t> parentIndexVector;
+	std::vector<bool> animatedBoneVector;
+
+	makeShuffledRig(boneCount, 3, random, parentIndexVector, animatedBoneVector);
+
+	size_t laterParentCount = 0;
+
+	for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+	{
+		laterParentCount += (parentIndexVector[boneIndex] > static_cast<std::int32_t>(boneIndex)) ? 1 : 0;
+	}
+
+	CHECK(laterParentCount > 0);
+
+	std::vector<std::uint32_t> boneIndexVector;
+	std::vector<std::uint32_t> slotIndexVector;
+	std::vector<std::uint32_t> levelStartVector;
+	std::vector<std::uint32_t> posedEndVector;
+
+	ModelLoader::sortBonesByDepth(parentIndexVector.data(), animatedBoneVector,
+		boneIndexVector, slotIndexVector, levelStartVector, posedEndVector);
+
+	CHECK(boneIndexVector.size() == boneCount);
+	CHECK(slotIndexVector.size() == boneCount);
+	CHECK(levelStartVector.size() == posedEndVector.size() + 1);
+	CHECK(levelStartVector.front() == 0);
+	CHECK(levelStartVector.back() == boneCount);
+
+	for (size_t slot = 0; slot < boneCount; ++slot)
+	{
+		CHECK(slotIndexVector[boneIndexVector[slot]] == slot);
+	}
+
+	std::vector<bool> posedVector(boneCount, false);
+
+	for (size_t level = 0; level < posedEndVector.size(); ++level)
+	{
+		const std::uint32_t levelStart = levelStartVector[level];
+		const std::uint32_t levelEnd = levelStartVector[level + 1];
+
+		CHECK((levelStart < levelEnd) && (levelStart <= posedEndVector[level]) && (posedEndVector[level] <= levelEnd));
+
+		for (std::uint32_t slot = levelStart; slot < levelEnd; ++slot)
+		{
+			const std::uint32_t boneIndex = boneIndexVector[slot];
+			const std::int32_t parentIndex = parentIndexVector[boneIndex];
+
+			if (level == 0)
+			{
+				CHECK(parentIndex == -1);
+				posedVector[boneIndex] = animatedBoneVector[boneIndex];
+			}
+			else
+			{
+				const std::uint32_t parentSlot = slotIndexVector[parentIndex];
+
+				CHECK((parentSlot >= levelStartVector[level - 1]) && (parentSlot < levelStart));
+				posedVector[boneIndex] = animatedBoneVector[boneIndex] || posedVector[parentIndex];
+			}
+
+			CHECK(posedVector[boneIndex] == (slot < posedEndVector[level]));
+
+			// Stable inside the posed and the static run of the level.
+			if ((slot > levelStart) && (slot != posedEndVector[level]))
+			{
+				CHECK(boneIndexVector[slot - 1] < boneIndex);
+			}
+		}
+	}
+
+	// Rotations and translations, so the deep chains stay in range.
+	std::vector<DirectX::XMFLOAT4X4> localVector(boneCount);
+	std::vector<DirectX::XMFLOAT4X4> offsetVector(boneCount);
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+	for (size_t boneIndex = 0; boneIndex < boneCount; ++boneIndex)
+	{
+		for (auto* matrix : { &localVector[boneIndex], &offsetVector[boneIndex] })
+		{
+			DirectX::XMStoreFloat4x4(matrix, DirectX::XMMatrixMultiply(
+				DirectX::XMMatrixRotationRollPitchYaw(distribution(random), distribution(random), distribution(random)),
+				DirectX::XMMatrixTranslation(distribution(random), distribution(random), distribution(random))));
+		}
+	}
+
+	std::vector<DirectX::XMFLOAT4X4> depthFirstVector;
+	std::vector<DirectX::XMFLOAT4X4> modelVector(boneCount);
+	std::vector<DirectX::XMFLOAT4X4> paletteVector(boneCount);
+
+	getDepthFirstPalettes(parentIndexVector, localVector, offsetVector, depthFirstVector);
+
+	for (size_t slot = 0; slot < boneCount; ++slot)
+	{
+		const std::uint32_t boneIndex = boneIndexVector[slot];
+		const std::int32_t parentIndex = parentIndexVector[boneIndex];
+		DirectX::XMMATRIX model = DirectX::XMLoadFloat4x4(&localVector[boneIndex]);
+
+		if (parentIndex >= 0)
+		{
+			model = DirectX::XMMatrixMultiply(model, DirectX::XMLoadFloat4x4(&modelVector[slotIndexVector[parentIndex]]));
+		}
+
+		DirectX::XMStoreFloat4x4(&modelVector[slot], model);
+		DirectX::XMStoreFloat4x4(&paletteVector[boneIndex],
+			DirectX::XMMatrixTranspose(DirectX::XMMatrixMultiply(DirectX::XMLoadFloat4x4(&offsetVector[boneIndex]), model)));
+	}
+
+	CHECK(0 == memcmp(paletteVector.data(), depthFirstVector.data(), boneCount * sizeof(DirectX::XMFLOAT4X4)));
+}
+
+namespace
+{
+	// Every packed index names a vertice, in the format the mesh says.
+	bool checkPackedIndices(
+		const decltype(ModelLoader::m_modelVector)::value_type& modelRec)
+	{
+		const size_t verticeCount = modelRec.verticeVector.size();
+
+		for (auto index : modelRec.indexVector)
+		{
+			if (index >= verticeCount)
+			{
+				return false;
+			}
+		}
+
+		if (modelRec.indexFormat == DXGI_FORMAT_R32_UINT)
+		{
+			return modelRec.indexVector16.empty();
+		}
+
+		return (modelRec.indexFormat == DXGI_FORMAT_R16_UINT)
+			&& std::equal(modelRec.indexVector.begin(), modelRec.indexVector.end(), modelRec.indexVector16.begin(), modelRec.indexVector16.end());
+	}
+}
+
+TEST_CASE(ModelLoader_SmallMeshUses16BitIndices)
+{
+	const std::string filename = tTestHarness::getTempFilename("small.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+
+	// One vertice short of the 16 bit limit.
+	settings.columnCount = 255;
+	settings.rowCount = 256;
+	CHECK(tTestScene::getVerticeCount(settings) == 0xFFFF);
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader modelLoader;
+
+	load(modelLoader, filename, getLoadSettings());
+
+	CHECK(modelLoader.m_modelVector[0].verticeVector.size() == 0xFFFF);
+	CHECK(modelLoader.m_modelVector[0].indexFormat == DXGI_FORMAT_R16_UINT);
+	CHECK(checkPackedIndices(modelLoader.m_modelVector[0]));
+
+	tTestScene::remove(filename);
+}
+
+// Two meshes of about a million vertices each, on their own and merged.
+TEST_CASE(ModelLoader_MultiMillionVerticeStress)
+{
+	const std::string filename = tTestHarness::getTempFilename("stress.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+
+	settings.columnCount = 1024;
+	settings.rowCount = 1023;
+	settings.meshCount = 2;
+	settings.byPolygonVertex = true;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+	const size_t verticeCount = tTestScene::getVerticeCount(settings);
+	const size_t indexCount = settings.columnCount * settings.rowCount * 6;
+
+	loadSettings.optimizeVertexOrder = true;
+
+	{
+		ModelLoader modelLoader;
+
+		load(modelLoader, filename, loadSettings);
+
+		CHECK(modelLoader.m_modelVector.size() == settings.meshCount);
+
+		for (const auto& modelRec : modelLoader.m_modelVector)
+		{
+			CHECK(modelRec.verticeVector.size() == verticeCount);
+			CHECK(modelRec.indexVector.size() == indexCount);
+			CHECK(modelRec.indexFormat == DXGI_FORMAT_R32_UINT);
+			CHECK(checkPackedIndices(modelRec));
+		}
+	}
+
+	loadSettings.mergeMeshes = true;
+
+	{
+		ModelLoader modelLoader;
+
+		load(modelLoader, filename, loadSettings);
+
+		CHECK(modelLoader.m_mergedModel.verticeVector.size() == settings.meshCount * verticeCount);
+		CHECK(modelLoader.m_mergedModel.indexVector.size() == settings.meshCount * indexCount);
+		CHECK(modelLoader.m_mergedModel.indexFormat == DXGI_FORMAT_R32_UINT);
+		CHECK(checkPackedIndices(modelLoader.m_mergedModel));
+	}
+
+	tTestScene::remove(filename);
+}
+
+// Nothing of the bones is visible before finishLoad(), the background
+// phase still prunes them.
+TEST_CASE(ModelLoader_ProgressiveLoadHidesBones)
+{
+	const std::string filename = tTestHarness::getTempFilename("progressive.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+
+	settings.helperBones = true;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+	ModelLoader modelLoader;
+
+	loadSettings.progressive = true;
+	loadSettings.nativeConversion = true;
+	loadSettings.pruneBones = true;
+	modelLoader.setLoadSettings(loadSettings);
+	modelLoader.load(tTestScene::createDevice(), filename.c_str(), kBoneMatrixVectorSize);
+
+	CHECK(modelLoader.m_modelVector[0].verticeVector.size() > 0);
+	CHECK(modelLoader.getBoneIndex("bone1") == -1);
+	CHECK(modelLoader.getPrunedBoneCount() == 0);
+
+	modelLoader.finishLoad();
+
+	CHECK(modelLoader.isLoadComplete());
+	CHECK(modelLoader.getBoneIndex("bone1") != -1);
+	CHECK(modelLoader.getPrunedBoneCount() > 0);
+	CHECK(modelLoader.m_modelVector[0].verticeVector.size() == tTestScene::getVerticeCount(settings));
+
+	tTestScene::remove(filename);
+}
+
+// Pruned helper bones still resolve, to the closest kept ancestor, also
+// when the bones come from the cache.
+TEST_CASE(ModelLoader_PrunedBonesResolveToAncestor)
+{
+	const std::string filename = tTestHarness::getTempFilename("pruned.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+
+	settings.helperBones = true;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+
+	loadSettings.pruneBones = true;
+	loadSettings.useModelCache = true;
+
+	ModelLoader firstLoader;
+	ModelLoader cachedLoader;
+
+	load(firstLoader, filename, loadSettings);
+	load(cachedLoader, filename, loadSettings);
+
+	const std::string lastBone = "bone" + std::to_string(settings.boneCount - 1);
+
+	CHECK(cachedLoader.isModelCacheLoaded());
+	CHECK(firstLoader.getPrunedBoneCount() == 2);
+
+	for (ModelLoader* modelLoader : { &firstLoader, &cachedLoader })
+	{
+		CHECK(modelLoader->getBoneIndex("bone0") != -1);
+		CHECK(modelLoader->getBoneIndex("bone0_helper") == modelLoader->getBoneIndex("bone0"));
+		CHECK(modelLoader->getBoneIndex((lastBone + "_end").c_str()) == modelLoader->getBoneIndex(lastBone.c_str()));
+		CHECK(modelLoader->getBoneIndex("bone1") != modelLoader->getBoneIndex("bone0"));
+		CHECK(modelLoader->m_boneVector.size() == settings.boneCount);
+	}
+
+	tTestScene::remove(filename);
+}
+
+// Every name of a large rig resolves to its own bone, also while the load
+// binds the skin clusters to the bones by their link names.
+TEST_CASE(ModelLoader_BoneNamesResolveOnLargeRigs)
+{
+	const std::string filename = tTestHarness::getTempFilename("bonenames.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+
+	settings.boneCount = 300;
+	settings.rowCount = 64;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+	ModelLoader modelLoader;
+
+	loadSettings.progressive = true;
+	modelLoader.setLoadSettings(loadSettings);
+	modelLoader.load(tTestScene::createDevice(), filename.c_str(), kBoneMatrixVectorSize);
+
+	CHECK(modelLoader.getBoneIndex("bone0") == -1);
+
+	modelLoader.finishLoad();
+
+	std::vector<bool> usedVector(modelLoader.m_boneVector.size(), false);
+
+	CHECK(modelLoader.m_boneVector.size() == settings.boneCount);
+
+	for (unsigned long i = 0; i < settings.boneCount; ++i)
+	{
+		const std::string name = "bone" + std::to_string(i);
+		const long boneIndex = modelLoader.getBoneIndex(name.c_str());
+
+		CHECK((boneIndex >= 0) && (boneIndex < static_cast<long>(usedVector.size())));
+
+		if ((boneIndex >= 0) && (boneIndex < static_cast<long>(usedVector.size())))
+		{
+			CHECK(!usedVector[boneIndex]);
+			CHECK(*modelLoader.m_boneVector[boneIndex].namePtr == name);
+			usedVector[boneIndex] = true;
+		}
+	}
+
+	CHECK(modelLoader.getBoneIndex("") == -1);
+	CHECK(modelLoader.getBoneIndex("missing_bone") == -1);
+	CHECK(modelLoader.getBoneIndex(("bone" + std::to_string(settings.boneCount)).c_str()) == -1);
+	CHECK(modelLoader.getBoneIndex("bone1_") == -1);
+
+	// The scene weighs every control point to the bones around its height,
+	// a cluster bound to the wrong name lands far from it.
+	const auto& modelRec = modelLoader.m_modelVector[0];
+	const float height = modelRec.maxVertex.y - modelRec.minVertex.y;
+	size_t farCount = 0;
+
+	CHECK(height > 0.0f);
+
+	for (const auto& vertice : modelRec.verticeVector)
+	{
+		const float bonePosition = (vertice.point.y - modelRec.minVertex.y) / height * (settings.boneCount - 1);
+
+		for (int influence = 0; influence < 4; ++influence)
+		{
+			if (((vertice.boneWeights >> (8 * influence)) & 0xFF) == 0)
+			{
+				continue;
+			}
+
+			const std::string& name = *modelLoader.m_boneVector[vertice.boneIndices[influence]].namePtr;
+			const float chainIndex = static_cast<float>(atoi(name.c_str() + 4));
+
+			if (fabsf(chainIndex - bonePosition) > static_cast<float>(settings.maxInfluenceCount))
+			{
+				++farCount;
+			}
+		}
+	}
+
+	CHECK(farCount == 0);
+
+	tTestScene::remove(filename);
+}
+
+TEST_CASE(ModelLoader_ReportsVertexCacheStatistics)
+{
+	const std::string filename = tTestHarness::getTempFilename("optimized.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+
+	settings.columnCount = 64;
+	settings.rowCount = 64;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+	ModelLoader modelLoader;
+
+	loadSettings.optimizeVertexOrder = true;
+	load(modelLoader, filename, loadSettings);
+
+	const auto& modelRec = modelLoader.m_modelVector[0];
+
+	CHECK(modelRec.cacheStatisticsBefore.Acmr > 0.0f);
+	CHECK(modelRec.cacheStatisticsAfter.Acmr <= modelRec.cacheStatisticsBefore.Acmr);
+
+	tTestScene::remove(filename);
+}
+
+namespace
+{
+	// In degrees, robust for tiny angles where the cosine rounds to 1.
+	double getAngle(
+		const DirectX::XMFLOAT3& a,
+		const DirectX::XMFLOAT3& b)
+	{
+		const double cross[3] =
+		{
+			(double)a.y * b.z - (double)a.z * b.y,
+			(double)a.z * b.x - (double)a.x * b.z,
+			(double)a.x * b.y - (double)a.y * b.x,
+		};
+		const double dot = (double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z;
+
+		return atan2(sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]), dot) * 180.0 / 3.14159265358979323846;
+	}
+
+	// Uniform on the sphere, then the axes, the diagonals and the equator
+	// where the octahedron folds.
+	std::vector<DirectX::XMFLOAT3> getTestDirections()
+	{
+		std::vector<DirectX::XMFLOAT3> directionVector;
+		std::mt19937 random(11);
+		std::normal_distribution<float> normal;
+
+		for (int i = 0; i < 1000000; ++i)
+		{
+			DirectX::XMFLOAT3 direction(normal(random), normal(random), normal(random));
+
+			DirectX::XMStoreFloat3(&direction, DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&direction)));
+			directionVector.push_back(direction);
+		}
+
+		for (int x = -1; x <= 1; ++x)
+		{
+			for (int y = -1; y <= 1; ++y)
+			{
+				for (int z = -1; z <= 1; ++z)
+				{
+					DirectX::XMFLOAT3 direction((float)x, (float)y, (float)z);
+
+					if ((x != 0) || (y != 0) || (z != 0))
+					{
+						DirectX::XMStoreFloat3(&direction, DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&direction)));
+						directionVector.push_back(direction);
+					}
+				}
+			}
+		}
+
+		for (int i = 0; i < 3600; ++i)
+		{
+			const float angle = i * 3.14159265f / 1800.0f;
+
+			directionVector.push_back(DirectX::XMFLOAT3(cosf(angle), sinf(angle), 0.0f));
+		}
+
+		return directionVector;
+	}
+}
+
+// The documented bound of the compact normals.
+TEST_CASE(ModelLoader_OctahedralNormalRoundTrip)
+{
+	const std::vector<DirectX::XMFLOAT3> directionVector = getTestDirections();
+	std::vector<ModelLoader::tSkinnedVertice> verticeVector(directionVector.size());
+	std::vector<ModelLoader::tCompactSkinnedVertice> compactVector(directionVector.size());
+	std::vector<ModelLoader::tSkinnedVertice> decodedVector(directionVector.size());
+	const DirectX::XMFLOAT3 boundsMin(-1.0f, -1.0f, -1.0f);
+	const DirectX::XMFLOAT3 boundsMax(1.0f, 1.0f, 1.0f);
+
+	for (size_t i = 0; i < directionVector.size(); ++i)
+	{
+		verticeVector[i] = makeVertice(directionVector[i].x, directionVector[i].y, directionVector[i].z);
+		verticeVector[i].normal = directionVector[i];
+	}
+
+	ModelLoader::encodeCompactVertices(verticeVector.data(), verticeVector.size(), boundsMin, boundsMax, compactVector.data());
+	ModelLoader::decodeCompactVertices(compactVector.data(), compactVector.size(), boundsMin, boundsMax, decodedVector.data());
+
+	double maxAngle = 0.0;
+	float maxPointError = 0.0f;
+
+	for (size_t i = 0; i < directionVector.size(); ++i)
+	{
+		maxAngle = MathHelper::Max(maxAngle, getAngle(directionVector[i], decodedVector[i].normal));
+		maxPointError = MathHelper::Max(maxPointError, fabsf(decodedVector[i].point.x - verticeVector[i].point.x));
+		maxPointError = MathHelper::Max(maxPointError, fabsf(decodedVector[i].point.y - verticeVector[i].point.y));
+		maxPointError = MathHelper::Max(maxPointError, fabsf(decodedVector[i].point.z - verticeVector[i].point.z));
+	}
+
+	printf("  max normal error %.5f degrees, max point error %g\n", maxAngle, maxPointError);
+
+	CHECK(maxAngle < 0.004);
+
+	// Half a step of the extent of 2, and a little for the float math.
+	CHECK(maxPointError <= 1.0f / 65535.0f * 1.01f);
+}
+
+TEST_CASE(ModelLoader_QTangentRoundTrip)
+{
+	const std::vector<DirectX::XMFLOAT3> directionVector = getTestDirections();
+	std::mt19937 random(13);
+	double maxAngle = 0.0;
+	bool handednessKept = true;
+
+	for (size_t i = 0; i < directionVector.size(); ++i)
+	{
+		// A random tangent in the plane of the normal, mirrored every
+		// other frame.
+		const DirectX::XMVECTOR n = DirectX::XMLoadFloat3(&directionVector[i]);
+		const DirectX::XMFLOAT3& other = directionVector[random() % directionVector.size()];
+		DirectX::XMVECTOR t = DirectX::XMVector3Cross(n, DirectX::XMLoadFloat3(&other));
+
+		if (DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(t)) < 1.0e-6f)
+		{
+			continue;
+		}
+
+		t = DirectX::XMVector3Normalize(t);
+
+		const float handedness = (i % 2 == 0) ? 1.0f : -1.0f;
+		DirectX::XMFLOAT3 tangent;
+		DirectX::XMFLOAT3 bitangent;
+		DirectX::XMFLOAT3 decodedTangent;
+		DirectX::XMFLOAT3 decodedBitangent;
+		DirectX::XMFLOAT3 decodedNormal;
+		ModelLoader::tQTangent qTangent;
+
+		DirectX::XMStoreFloat3(&tangent, t);
+		DirectX::XMStoreFloat3(&bitangent, DirectX::XMVectorScale(DirectX::XMVector3Cross(n, t), handedness));
+
+		ModelLoader::encodeQTangent(tangent, bitangent, directionVector[i], qTangent);
+		ModelLoader::decodeQTangent(qTangent, decodedTangent, decodedBitangent, decodedNormal);
+
+		maxAngle = MathHelper::Max(maxAngle, getAngle(tangent, decodedTangent));
+		maxAngle = MathHelper::Max(maxAngle, getAngle(bitangent, decodedBitangent));
+		maxAngle = MathHelper::Max(maxAngle, getAngle(directionVector[i], decodedNormal));
+		handednessKept = handednessKept && (getAngle(bitangent, decodedBitangent) < 90.0);
+	}
+
+	printf("  max tangent frame error %.5f degrees\n", maxAngle);
+
+	CHECK(handednessKept);
+	CHECK(maxAngle < 0.004);
+}
+
+// Degenerate input still has to pack a frame the validator accepts.
+TEST_CASE(ModelLoader_QTangentEncodesDegenerateInput)
+{
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	const float infinity = std::numeric_limits<float>::infinity();
+	const DirectX::XMFLOAT3 zero(0.0f, 0.0f, 0.0f);
+	const DirectX::XMFLOAT3 up(0.0f, 1.0f, 0.0f);
+	const DirectX::XMFLOAT3 right(1.0f, 0.0f, 0.0f);
+	const DirectX::XMFLOAT3 forward(0.0f, 0.0f, 1.0f);
+	const DirectX::XMFLOAT3 broken(nan, 0.0f, infinity);
+	const struct
+	{
+		DirectX::XMFLOAT3 tangent;
+		DirectX::XMFLOAT3 bitangent;
+		DirectX::XMFLOAT3 normal;
+	} frames[] =
+	{
+		// No uvs, so no tangent and no bitangent.
+		{ zero, zero, up },
+		// A tangent along the normal.
+		{ up, forward, up },
+		// Unnormalized normal.
+		{ right, forward, DirectX::XMFLOAT3(0.0f, 250.0f, 0.0f) },
+		// Zero and broken normals pack the z axis.
+		{ right, up, zero },
+		{ right, up, broken },
+		// Broken tangent and bitangent.
+		{ broken, broken, up },
+	};
+
+	for (const auto& frame : frames)
+	{
+		ModelLoader::tQTangent qTangent;
+
+		ModelLoader::encodeQTangent(frame.tangent, frame.bitangent, frame.normal, qTangent);
+
+		CHECK(ModelLoader::isValidQTangent(qTangent, frame.normal));
+	}
+
+	// The same frame mirrored only flips the sign of w.
+	ModelLoader::tQTangent qTangent;
+	ModelLoader::tQTangent mirroredQTangent;
+
+	ModelLoader::encodeQTangent(right, forward, up, qTangent);
+	ModelLoader::encodeQTangent(right, DirectX::XMFLOAT3(0.0f, 0.0f, -1.0f), up, mirroredQTangent);
+
+	CHECK(ModelLoader::isValidQTangent(mirroredQTangent, up));
+	CHECK((qTangent.rotation[3] > 0) != (mirroredQTangent.rotation[3] > 0));
+}
+
+TEST_CASE(ModelLoader_QTangentValidatorRejects)
+{
+	const DirectX::XMFLOAT3 up(0.0f, 1.0f, 0.0f);
+	ModelLoader::tQTangent qTangent;
+
+	ModelLoader::encodeQTangent(DirectX::XMFLOAT3(1.0f, 0.0f, 0.0f), DirectX::XMFLOAT3(0.0f, 0.0f, 1.0f), up, qTangent);
+
+	CHECK(ModelLoader::isValidQTangent(qTangent, up));
+
+	// The right frame against another normal, a few degrees off and
+	// opposite.
+	CHECK(!ModelLoader::isValidQTangent(qTangent, DirectX::XMFLOAT3(0.0f, 1.0f, 0.1f)));
+	CHECK(!ModelLoader::isValidQTangent(qTangent, DirectX::XMFLOAT3(0.0f, -1.0f, 0.0f)));
+
+	// Three snorm steps off on x and z tilt the normal by about 0.01
+	// degrees, over the documented 0.004.
+	ModelLoader::tQTangent badQTangent = qTangent;
+
+	badQTangent.rotation[0] += (badQTangent.rotation[0] < 0) ? 3 : -3;
+	badQTangent.rotation[2] += (badQTangent.rotation[2] < 0) ? 3 : -3;
+	CHECK(!ModelLoader::isValidQTangent(badQTangent, up));
+
+	// Zero quaternion.
+	const ModelLoader::tQTangent zeroQTangent = { { 0, 0, 0, 0 } };
+
+	CHECK(!ModelLoader::isValidQTangent(zeroQTangent, up));
+
+	// Not a unit quaternion.
+	const ModelLoader::tQTangent longQTangent = { { 32767, 0, 0, 32767 } };
+	const ModelLoader::tQTangent shortQTangent = { { 0, 0, 0, 16384 } };
+
+	CHECK(!ModelLoader::isValidQTangent(longQTangent, DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f)));
+	CHECK(!ModelLoader::isValidQTangent(shortQTangent, DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f)));
+
+	// A unit quaternion with w zero, the handedness is lost.
+	const ModelLoader::tQTangent lostQTangent = { { 32767, 0, 0, 0 } };
+
+	CHECK(!ModelLoader::isValidQTangent(lostQTangent, DirectX::XMFLOAT3(0.0f, 0.0f, -1.0f)));
+}
+
+// Every frame of a loaded mesh passes, including the seam vertices.
+TEST_CASE(ModelLoader_GeneratedTangentsAreValid)
+{
+	const std::string filename = tTestHarness::getTempFilename("tangents.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+
+	settings.byPolygonVertex = true;
+	loadSettings.generateTangents = true;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader modelLoader;
+
+	load(modelLoader, filename, loadSettings);
+
+	const auto& modelRec = modelLoader.m_modelVector[0];
+	size_t invalidCount = 0;
+
+	CHECK(modelRec.qTangentVector.size() == modelRec.verticeVector.size());
+
+	for (size_t i = 0; i < modelRec.qTangentVector.size(); ++i)
+	{
+		if (!ModelLoader::isValidQTangent(modelRec.qTangentVector[i], modelRec.verticeVector[i].normal))
+		{
+			++invalidCount;
+		}
+	}
+
+	CHECK(invalidCount == 0);
+
+	tTestScene::remove(filename);
+}
+
+// selectLod relies on errors that never drop from one level to the next,
+// even when the ratios do not shrink.
+TEST_CASE(ModelLoader_LodErrorsNeverDrop)
+{
+	const std::string filename = tTestHarness::getTempFilename("lods.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+	const float lodTriangleRatios[] = { 0.5f, 0.25f, 0.5f, 0.1f };
+
+	settings.columnCount = 32;
+	settings.rowCount = 32;
+	settings.byPolygonVertex = true;
+	std::copy(std::begin(lodTriangleRatios), std::end(lodTriangleRatios), loadSettings.lodTriangleRatios);
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader modelLoader;
+
+	load(modelLoader, filename, loadSettings);
+
+	const auto& lodVector = modelLoader.m_modelVector[0].lodVector;
+
+	CHECK(lodVector.size() == 4);
+
+	for (size_t lodIndex = 1; lodIndex < lodVector.size(); ++lodIndex)
+	{
+		CHECK(lodVector[lodIndex].error >= lodVector[lodIndex - 1].error);
+	}
+
+	// The tube closes on a uv seam, it has to shrink with the rest.
+	CHECK(lodVector[3].indexVector.size() < modelLoader.m_modelVector[0].indexVector.size() / 4);
+
+	CHECK(modelLoader.selectLod(0, -1.0f) == 0);
+	CHECK(modelLoader.selectLod(0, lodVector[0].error) >= 1);
+	CHECK(modelLoader.selectLod(0, lodVector[3].error) == 4);
+
+	tTestScene::remove(filename);
+}
+
+// Only the layout the settings ask for is kept, plus the full width position
+// stream the CPU passes read with split streams.
+TEST_CASE(ModelLoader_PacksOnlyRequestedLayout)
+{
+	const std::string filename = tTestHarness::getTempFilename("layouts.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+
+	CHECK(tTestScene::write(filename, settings));
+
+	for (int layout = 0; layout < 4; ++layout)
+	{
+		ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+		ModelLoader modelLoader;
+
+		loadSettings.compactVertices = (layout & 1) != 0;
+		loadSettings.splitVertexStreams = (layout & 2) != 0;
+		load(modelLoader, filename, loadSettings);
+
+		const auto& modelRec = modelLoader.m_modelVector[0];
+		const size_t verticeCount = modelRec.verticeVector.size();
+		const bool compactOnly = loadSettings.compactVertices && !loadSettings.splitVertexStreams;
+		const bool splitOnly = !loadSettings.compactVertices && loadSettings.splitVertexStreams;
+		const bool compactSplit = loadSettings.compactVertices && loadSettings.splitVertexStreams;
+
+		CHECK(modelRec.splitVertexStreams == loadSettings.splitVertexStreams);
+		CHECK(modelRec.compactVerticeVector.size() == (compactOnly ? verticeCount : 0));
+		CHECK(modelRec.positionStreamVector.size() == (loadSettings.splitVertexStreams ? verticeCount : 0));
+		CHECK(modelRec.shadingStreamVector.size() == (splitOnly ? verticeCount : 0));
+		CHECK(modelRec.compactPositionStreamVector.size() == (compactSplit ? verticeCount : 0));
+		CHECK(modelRec.compactShadingStreamVector.size() == (compactSplit ? verticeCount : 0));
+
+		if (!compactSplit)
+		{
+			continue;
+		}
+
+		// The streams are split from the same encoding.
+		std::vector<ModelLoader::tCompactSkinnedVertice> compactVector(verticeCount);
+
+		ModelLoader::encodeCompactVertices(modelRec.verticeVector.data(), verticeCount, modelRec.minVertex, modelRec.maxVertex, compactVector.data());
+
+		for (size_t i = 0; i < verticeCount; ++i)
+		{
+			CHECK(0 == memcmp(compactVector[i].point, modelRec.compactPositionStreamVector[i].point, sizeof(compactVector[i].point)));
+			CHECK(compactVector[i].boneIndices == modelRec.compactPositionStreamVector[i].boneIndices);
+			CHECK(0 == memcmp(compactVector[i].normal, modelRec.compactShadingStreamVector[i].normal, sizeof(compactVector[i].normal)));
+		}
+	}
+
+	tTestScene::remove(filename);
+}
+
+TEST_CASE(ModelLoader_SkinsPointsFromPositionStream)
+{
+	const std::string filename = tTestHarness::getTempFilename("positionstream.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+
+	loadSettings.splitVertexStreams = true;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader modelLoader;
+
+	load(modelLoader, filename, loadSettings);
+	modelLoader.advanceTime();
+	modelLoader.loadBoneMatriceVector();
+
+	const auto& modelRec = modelLoader.m_modelVector[0];
+	const size_t verticeCount = modelRec.verticeVector.size();
+	std::vector<DirectX::XMFLOAT3> pointVector(verticeCount);
+	std::vector<DirectX::XMFLOAT3> normalVector(verticeCount);
+	std::vector<DirectX::XMFLOAT3> streamPointVector(verticeCount);
+	float maxError = 0.0f;
+
+	modelLoader.skinVertices(modelRec, pointVector.data(), normalVector.data());
+	modelLoader.skinVertices(modelRec, streamPointVector.data(), nullptr);
+
+	for (size_t i = 0; i < verticeCount; ++i)
+	{
+		maxError = MathHelper::Max(maxError, fabsf(pointVector[i].x - streamPointVector[i].x));
+		maxError = MathHelper::Max(maxError, fabsf(pointVector[i].y - streamPointVector[i].y));
+		maxError = MathHelper::Max(maxError, fabsf(pointVector[i].z - streamPointVector[i].z));
+	}
+
+	CHECK(maxError <= 1.0e-5f);
+
+	tTestScene::remove(filename);
+}
+
+BENCHMARK_CASE(ModelLoader_SkinVerticeStreams)
+{
+	const std::string filename = tTestHarness::getTempFilename("skinstreams.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+
+	settings.columnCount = 512;
+	settings.rowCount = 512;
+	loadSettings.splitVertexStreams = true;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader modelLoader;
+
+	load(modelLoader, filename, loadSettings);
+	modelLoader.advanceTime();
+	modelLoader.loadBoneMatriceVector();
+
+	const auto& modelRec = modelLoader.m_modelVector[0];
+	const size_t verticeCount = modelRec.verticeVector.size();
+	std::vector<DirectX::XMFLOAT3> pointVector(verticeCount);
+	std::vector<DirectX::XMFLOAT3> normalVector(verticeCount);
+
+	tBenchmark("points and normals, interleaved, per vertice", verticeCount).run([&]()
+	{
+		modelLoader.skinVertices(modelRec, pointVector.data(), normalVector.data());
+	});
+
+	tBenchmark("points, position stream, per vertice", verticeCount).run([&]()
+	{
+		modelLoader.skinVertices(modelRec, pointVector.data(), nullptr);
+	});
+
+	tTestScene::remove(filename);
+}
+
+// Three tubes share the material of their lower halves and have one of
+// their own for the upper ones: the merged model has one submesh per
+// material, back to back, holding the ranges of every mesh on it in mesh
+// order, moved to the vertices of that mesh. So do the levels of detail.
+TEST_CASE(ModelLoader_MergesMeshesBySharedMaterial)
+{
+	const std::string filename = tTestHarness::getTempFilename("merged.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+	ModelLoader modelLoader;
+
+	settings.meshCount = 3;
+	settings.sharedMaterial = true;
+	settings.upperMaterial = true;
+	CHECK(tTestScene::write(filename, settings));
+
+	loadSettings.minimalImport = false;
+	loadSettings.mergeMeshes = true;
+	loadSettings.lodTriangleRatios[0] = 0.5f;
+	load(modelLoader, filename, loadSettings);
+
+	const auto& mergedRec = modelLoader.m_mergedModel;
+	const auto& modelVector = modelLoader.m_modelVector;
+
+	CHECK(modelVector.size() == settings.meshCount);
+	CHECK(mergedRec.materialNameVector.size() == settings.meshCount + 1);
+	CHECK(mergedRec.submeshVector.size() == mergedRec.materialNameVector.size());
+	CHECK(mergedRec.lodVector.size() == 1);
+
+	// The vertices of every mesh in mesh order.
+	std::vector<std::uint32_t> baseVertexVector;
+	size_t baseVertex = 0;
+
+	for (const auto& modelRec : modelVector)
+	{
+		baseVertexVector.push_back(static_cast<std::uint32_t>(baseVertex));
+		CHECK((baseVertex + modelRec.verticeVector.size() <= mergedRec.verticeVector.size()) && (0 == memcmp(
+			mergedRec.verticeVector.data() + baseVertex,
+			modelRec.verticeVector.data(),
+			modelRec.verticeVector.size() * sizeof(ModelLoader::tSkinnedVertice))));
+		baseVertex += modelRec.verticeVector.size();
+	}
+
+	CHECK(baseVertex == mergedRec.verticeVector.size());
+
+	std::uint32_t nextStart = 0;
+
+	for (size_t submeshIndex = 0; submeshIndex < mergedRec.submeshVector.size(); ++submeshIndex)
+	{
+		const auto& submeshRec = mergedRec.submeshVector[submeshIndex];
+		const std::string& materialName = mergedRec.materialNameVector[submeshRec.materialIndex];
+		std::vector<std::uint32_t> expectedVector;
+		std::vector<std::uint32_t> expectedLodVector;
+
+		CHECK(submeshRec.materialIndex == submeshIndex);
+		CHECK(submeshRec.startIndex == nextStart);
+		nextStart = submeshRec.startIndex + submeshRec.indexCount;
+
+		for (size_t modelIndex = 0; modelIndex < modelVector.size(); ++modelIndex)
+		{
+			const auto& modelRec = modelVector[modelIndex];
+			const auto& lodRec = modelRec.lodVector[0];
+
+			for (size_t i = 0; i < modelRec.submeshVector.size(); ++i)
+			{
+				const auto& meshSubmeshRec = modelRec.submeshVector[i];
+
+				if (modelRec.materialNameVector[meshSubmeshRec.materialIndex] != materialName)
+				{
+					continue;
+				}
+
+				for (std::uint32_t index = meshSubmeshRec.startIndex; index < meshSubmeshRec.startIndex + meshSubmeshRec.indexCount; ++index)
+				{
+					expectedVector.push_back(modelRec.indexVector[index] + baseVertexVector[modelIndex]);
+				}
+
+				for (std::uint32_t index = lodRec.submeshStartVector[i]; index < lodRec.submeshStartVector[i + 1]; ++index)
+				{
+					expectedLodVector.push_back(lodRec.indexVector[index] + baseVertexVector[modelIndex]);
+				}
+			}
+		}
+
+		const auto& mergedLodRec = mergedRec.lodVector[0];
+		const std::uint32_t lodStart = mergedLodRec.submeshStartVector[submeshIndex];
+		const std::uint32_t lodEnd = mergedLodRec.submeshStartVector[submeshIndex + 1];
+
+		// The shared material has a range in every mesh, the others in one.
+		CHECK(!expectedVector.empty());
+		CHECK(submeshRec.indexCount == expectedVector.size());
+		CHECK((submeshRec.startIndex + expectedVector.size() <= mergedRec.indexVector.size())
+			&& std::equal(expectedVector.begin(), expectedVector.end(), mergedRec.indexVector.begin() + submeshRec.startIndex));
+		CHECK(lodEnd - lodStart == expectedLodVector.size());
+		CHECK((lodStart + expectedLodVector.size() <= mergedLodRec.indexVector.size())
+			&& std::equal(expectedLodVector.begin(), expectedLodVector.end(), mergedLodRec.indexVector.begin() + lodStart));
+	}
+
+	CHECK(nextStart == mergedRec.indexVector.size());
+	CHECK(mergedRec.lodVector[0].submeshStartVector.size() == mergedRec.submeshVector.size() + 1);
+	CHECK(mergedRec.lodVector[0].submeshStartVector.back() == mergedRec.lodVector[0].indexVector.size());
+
+	tTestScene::remove(filename);
+}
+
+// A merged model lists its submeshes by material. With the upper halves
+// of the tubes on materials of their own, the palette range of the upper
+// half of the first tube comes after the lower half of the second one.
+TEST_CASE(ModelLoader_BucketsMergedPaletteRanges)
+{
+	const std::string filename = tTestHarness::getTempFilename("mergedbuckets.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+	ModelLoader modelLoader;
+
+	settings.meshCount = 2;
+	settings.sharedMaterial = true;
+	settings.upperMaterial = true;
+	CHECK(tTestScene::write(filename, settings));
+
+	loadSettings.minimalImport = false;
+	loadSettings.mergeMeshes = true;
+	loadSettings.partitionSkin = true;
+	loadSettings.bucketInfluences = true;
+	load(modelLoader, filename, loadSettings);
+
+	const auto& modelRec = modelLoader.m_mergedModel;
+	const auto& bucketVector = modelRec.influenceBucketVector;
+	const unsigned long influenceCount = _countof(bucketVector[0].influenceStarts) - 2;
+	bool submeshOrderChanged = false;
+
+	CHECK(bucketVector.size() == modelRec.submeshVector.size());
+
+	for (size_t bucketIndex = 0; bucketIndex < bucketVector.size(); ++bucketIndex)
+	{
+		const auto& bucketRec = bucketVector[bucketIndex];
+
+		CHECK(bucketRec.sorted);
+
+		if (bucketIndex > 0)
+		{
+			CHECK(bucketRec.influenceStarts[0] >= bucketVector[bucketIndex - 1].influenceStarts[influenceCount + 1]);
+			submeshOrderChanged = submeshOrderChanged || (bucketRec.submeshIndex < bucketVector[bucketIndex - 1].submeshIndex);
+		}
+
+		for (unsigned long count = 0; count <= influenceCount; ++count)
+		{
+			for (std::uint32_t vertice = bucketRec.influenceStarts[count]; vertice < bucketRec.influenceStarts[count + 1]; ++vertice)
+			{
+				std::uint32_t boneWeights = modelRec.verticeVector[vertice].boneWeights;
+				unsigned long weightCount = 0;
+
+				for (; boneWeights != 0; boneWeights >>= 8)
+				{
+					++weightCount;
+				}
+
+				CHECK(weightCount == count);
+			}
+		}
+	}
+
+	CHECK(submeshOrderChanged);
+
+	tTestScene::remove(filename);
+}
+
+// Sorted or not, the skin is the same. Unsorted vertices keep the order
+// of first use optimizeVertexOrder gave them.
+TEST_CASE(ModelLoader_BucketedSkinningMatchesGeneric)
+{
+	const std::string filename = tTestHarness::getTempFilename("buckets.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+
+	loadSettings.optimizeVertexOrder = true;
+	loadSettings.partitionSkin = true;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader genericLoader;
+	ModelLoader bucketedLoader;
+
+	load(genericLoader, filename, loadSettings);
+	loadSettings.bucketInfluences = true;
+	load(bucketedLoader, filename, loadSettings);
+
+	const auto& genericModelRec = genericLoader.m_modelVector[0];
+	const auto& bucketedModelRec = bucketedLoader.m_modelVector[0];
+	const size_t verticeCount = genericModelRec.verticeVector.size();
+	std::vector<DirectX::XMFLOAT3> genericPointVector(verticeCount);
+	std::vector<DirectX::XMFLOAT3> bucketedPointVector(verticeCount);
+	float maxError = 0.0f;
+	std::uint32_t nextVertice = 0;
+
+	for (ModelLoader* modelLoader : { &genericLoader, &bucketedLoader })
+	{
+		modelLoader->advanceTime();
+		modelLoader->loadBoneMatriceVector();
+	}
+
+	genericLoader.skinVertices(genericModelRec, genericPointVector.data(), nullptr);
+	bucketedLoader.skinVertices(bucketedModelRec, bucketedPointVector.data(), nullptr);
+
+	CHECK(genericModelRec.indexVector.size() == bucketedModelRec.indexVector.size());
+
+	for (size_t i = 0; i < genericModelRec.indexVector.size(); ++i)
+	{
+		const DirectX::XMFLOAT3& genericPoint = genericPointVector[genericModelRec.indexVector[i]];
+		const DirectX::XMFLOAT3& bucketedPoint = bucketedPointVector[bucketedModelRec.indexVector[i]];
+
+		maxError = MathHelper::Max(maxError, fabsf(genericPoint.x - bucketedPoint.x));
+		maxError = MathHelper::Max(maxError, fabsf(genericPoint.y - bucketedPoint.y));
+		maxError = MathHelper::Max(maxError, fabsf(genericPoint.z - bucketedPoint.z));
+
+		CHECK(genericModelRec.indexVector[i] <= nextVertice);
+		nextVertice = MathHelper::Max(nextVertice, genericModelRec.indexVector[i] + 1);
+	}
+
+	CHECK(maxError <= 1.0e-5f);
+	CHECK(!genericModelRec.influenceBucketVector[0].sorted);
+	CHECK(bucketedModelRec.influenceBucketVector[0].sorted);
+
+	tTestScene::remove(filename);
+}
+
+namespace
+{
+	// Every triangle of a culled cluster faces away from the eye, also
+	// pushed out along the normals to the outermost fur shell. points and
+	// normals hold the vertices in the pose cullClusters() saw. Returns
+	// the culled indices.
+	size_t checkCulledClusters(
+		ModelLoader& modelLoader,
+		const decltype(ModelLoader::m_modelVector)::value_type& modelRec,
+		const DirectX::XMFLOAT3* points,
+		const DirectX::XMFLOAT3* normals,
+		const DirectX::XMFLOAT3& eyePosW,
+		float shellOffset)
+	{
+		const DirectX::XMFLOAT4X4 world = MathHelper::Identity4x4();
+		const DirectX::XMVECTOR eye = DirectX::XMLoadFloat3(&eyePosW);
+		std::vector<std::uint32_t> visibleClusterVector;
+		size_t culledIndexCount = 0;
+
+		modelLoader.cullClusters(modelRec, world, eyePosW, shellOffset, visibleClusterVector);
+
+		for (std::uint32_t clusterIndex = 0, visibleIndex = 0; clusterIndex < modelRec.clusterVector.size(); ++clusterIndex)
+		{
+			const auto& clusterRec = modelRec.clusterVector[clusterIndex];
+
+			if ((visibleIndex < visibleClusterVector.size()) && (visibleClusterVector[visibleIndex] == clusterIndex))
+			{
+				++visibleIndex;
+				continue;
+			}
+
+			culledIndexCount += clusterRec.indexCount;
+
+			for (std::uint32_t i = clusterRec.startIndex; i < clusterRec.startIndex + clusterRec.indexCount; i += 3)
+			{
+				DirectX::XMVECTOR corners[3];
+
+				for (int corner = 0; corner < 3; ++corner)
+				{
+					const size_t verticeIndex = modelRec.indexVector[i + corner];
+
+					corners[corner] = DirectX::XMVectorAdd(
+						DirectX::XMLoadFloat3(&points[verticeIndex]),
+						DirectX::XMVectorScale(DirectX::XMLoadFloat3(&normals[verticeIndex]), shellOffset));
+				}
+
+				const DirectX::XMVECTOR faceNormal = DirectX::XMVector3Cross(
+					DirectX::XMVectorSubtract(corners[1], corners[0]),
+					DirectX::XMVectorSubtract(corners[2], corners[0]));
+
+				CHECK(DirectX::XMVectorGetX(DirectX::XMVector3Dot(faceNormal, DirectX::XMVectorSubtract(eye, corners[0]))) <= 0.0f);
+			}
+		}
+
+		return culledIndexCount;
+	}
+
+	// Around the tube, climbing so the eyes also look along it.
+	DirectX::XMFLOAT3 getClusterEye(
+		int eyeIndex,
+		int eyeCount)
+	{
+		const float angle = 2.0f * MathHelper::Pi * eyeIndex / eyeCount;
+
+		return DirectX::XMFLOAT3(6.0f * cosf(angle), 5.0f + 0.5f * eyeIndex, 6.0f * sinf(angle));
+	}
+}
+
+// Every triangle that faces the eye has to be in a visible cluster, also
+// every fur shell pushed out along the vertex normals. Prints the share
+// of the triangles culled around the tube.
+TEST_CASE(ModelLoader_ClusterCullingIsConservative)
+{
+	const std::string filename = tTestHarness::getTempFilename("clusters.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+
+	settings.columnCount = 64;
+	loadSettings.clusterTriangleCount = 16;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader modelLoader;
+
+	load(modelLoader, filename, loadSettings);
+
+	const auto& modelRec = modelLoader.m_modelVector[0];
+	const size_t verticeCount = modelRec.verticeVector.size();
+	const float shellOffsets[] = { 0.0f, 0.4f };
+	const int eyeCount = 16;
+	std::vector<DirectX::XMFLOAT3> pointVector(verticeCount);
+	std::vector<DirectX::XMFLOAT3> normalVector(verticeCount);
+
+	CHECK(!modelRec.clusterVector.empty());
+
+	for (size_t i = 0; i < verticeCount; ++i)
+	{
+		pointVector[i] = modelRec.verticeVector[i].point;
+		normalVector[i] = modelRec.verticeVector[i].normal;
+	}
+
+	for (float shellOffset : shellOffsets)
+	{
+		size_t culledIndexCount = 0;
+
+		for (int eyeIndex = 0; eyeIndex < eyeCount; ++eyeIndex)
+		{
+			culledIndexCount += checkCulledClusters(modelLoader, modelRec, pointVector.data(), normalVector.data(),
+				getClusterEye(eyeIndex, eyeCount), shellOffset);
+		}
+
+		const double culledFraction = static_cast<double>(culledIndexCount) / (eyeCount * modelRec.indexVector.size());
+
+		printf("  shell offset %.1f: %.1f%% of the triangles culled\n", shellOffset, 100.0 * culledFraction);
+
+		CHECK(culledFraction > ((shellOffset == 0.0f) ? 0.2 : 0.0));
+	}
+
+	tTestScene::remove(filename);
+}
+
+// The same in a bent pose. Rings between two bones blend both, so their
+// clusters span a joint, the take bends every joint by up to 20 degrees.
+// The eyes check against the skinned triangles.
+TEST_CASE(ModelLoader_PosedClusterCullingIsConservative)
+{
+	const std::string filename = tTestHarness::getTempFilename("posedclusters.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+
+	settings.columnCount = 64;
+	loadSettings.clusterTriangleCount = 16;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader modelLoader;
+
+	load(modelLoader, filename, loadSettings);
+
+	const auto& modelRec = modelLoader.m_modelVector[0];
+	const size_t verticeCount = modelRec.verticeVector.size();
+	const unsigned long long times[] = { 125, 250, 500, 750 };
+	const float shellOffsets[] = { 0.0f, 0.4f };
+	const int eyeCount = 16;
+	std::vector<DirectX::XMFLOAT3> pointVector(verticeCount);
+	std::vector<DirectX::XMFLOAT3> normalVector(verticeCount);
+	size_t spanningClusterCount = 0;
+
+	for (const auto& clusterRec : modelRec.clusterVector)
+	{
+		spanningClusterCount += (clusterRec.boneCount > 1) ? 1 : 0;
+	}
+
+	CHECK(spanningClusterCount > 0);
+
+	for (unsigned long long time : times)
+	{
+		modelLoader.setAnimationTime(time);
+		modelLoader.loadBoneMatriceVector();
+		modelLoader.skinVertices(modelRec, pointVector.data(), normalVector.data());
+
+		for (float shellOffset : shellOffsets)
+		{
+			size_t culledIndexCount = 0;
+
+			for (int eyeIndex = 0; eyeIndex < eyeCount; ++eyeIndex)
+			{
+				culledIndexCount += checkCulledClusters(modelLoader, modelRec, pointVector.data(), normalVector.data(),
+					getClusterEye(eyeIndex, eyeCount), shellOffset);
+			}
+
+			printf("  %llu ms, shell offset %.1f: %.1f%% of the triangles culled\n", time, shellOffset,
+				100.0 * culledIndexCount / (eyeCount * modelRec.indexVector.size()));
+
+			// Widened, the cones still cull something.
+			CHECK((shellOffset > 0.0f) || (culledIndexCount > 0));
+		}
+	}
+
+	tTestScene::remove(filename);
+}
+
+BENCHMARK_CASE(ModelLoader_SkinInfluenceBuckets)
+{
+	const std::string filename = tTestHarness::getTempFilename("skinbuckets.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+	ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+
+	settings.columnCount = 512;
+	settings.rowCount = 512;
+	loadSettings.optimizeVertexOrder = true;
+	CHECK(tTestScene::write(filename, settings));
+
+	ModelLoader genericLoader;
+	ModelLoader bucketedLoader;
+
+	load(genericLoader, filename, loadSettings);
+	loadSettings.bucketInfluences = true;
+	load(bucketedLoader, filename, loadSettings);
+
+	const size_t verticeCount = genericLoader.m_modelVector[0].verticeVector.size();
+	std::vector<DirectX::XMFLOAT3> pointVector(verticeCount);
+	std::vector<DirectX::XMFLOAT3> normalVector(verticeCount);
+
+	for (ModelLoader* modelLoader : { &genericLoader, &bucketedLoader })
+	{
+		modelLoader->advanceTime();
+		modelLoader->loadBoneMatriceVector();
+	}
+
+	tBenchmark("generic kernel, fetch order, per vertice", verticeCount).run([&]()
+	{
+		genericLoader.skinVertices(genericLoader.m_modelVector[0], pointVector.data(), normalVector.data());
+	});
+
+	tBenchmark("one kernel per influence count, per vertice", verticeCount).run([&]()
+	{
+		bucketedLoader.skinVertices(bucketedLoader.m_modelVector[0], pointVector.data(), normalVector.data());
+	});
+
+	tTestScene::remove(filename);
+}
+
+// Bone indices over 255 would wrap in the 8 bit compact layout and split
+// streams, such a rig keeps the interleaved full width vertices unless
+// partitionSkin makes the indices palette local.
+TEST_CASE(ModelLoader_CompactFallsBackForLargeRigs)
+{
+	const std::string filename = tTestHarness::getTempFilename("largerig.fbx");
+	tTestScene::tSettings settings = tTestScene::getDefaultSettings();
+
+	settings.boneCount = 300;
+	settings.rowCount = 64;
+	CHECK(tTestScene::write(filename, settings));
+
+	for (int split = 0; split < 2; ++split)
+	{
+		ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+		ModelLoader modelLoader;
+
+		loadSettings.compactVertices = true;
+		loadSettings.splitVertexStreams = (split != 0);
+		load(modelLoader, filename, loadSettings);
+
+		const auto& modelRec = modelLoader.m_modelVector[0];
+
+		CHECK(!modelRec.compactVertices);
+		CHECK(!modelRec.splitVertexStreams);
+		CHECK(modelRec.compactVerticeVector.empty());
+		CHECK(modelRec.compactPositionStreamVector.empty());
+		CHECK(modelRec.compactShadingStreamVector.empty());
+		CHECK(modelRec.positionStreamVector.empty());
+		CHECK(modelRec.shadingStreamVector.empty());
+	}
+
+	for (int split = 0; split < 2; ++split)
+	{
+		ModelLoader::tLoadSettings loadSettings = getLoadSettings();
+		ModelLoader modelLoader;
+
+		loadSettings.compactVertices = (split == 0);
+		loadSettings.splitVertexStreams = (split != 0);
+		loadSettings.partitionSkin = true;
+		load(modelLoader, filename, loadSettings);
+
+		const auto& modelRec = modelLoader.m_modelVector[0];
+		const size_t verticeCount = modelRec.verticeVector.size();
+
+		CHECK(modelRec.compactVertices == loadSettings.compactVertices);
+		CHECK(modelRec.splitVertexStreams == loadSettings.splitVertexStreams);
+		CHECK(modelRec.compactVerticeVector.size() == (loadSettings.compactVertices ? verticeCount : 0));
+		CHECK(modelRec.positionStreamVector.size() == (loadSettings.splitVertexStreams ? verticeCount : 0));
+
+		// The palette local indices fit the 8 bit stream unchanged.
+		for (size_t i = 0; i < modelRec.positionStreamVector.size(); ++i)
+		{
+			for (int influence = 0; influence < 4; ++influence)
+			{
+				CHECK(modelRec.positionStreamVector[i].boneIndices[influence] == modelRec.verticeVector[i].boneIndices[influence]);
+			}
+		}
+	}
+
+	tTestScene::remove(filename);
+}
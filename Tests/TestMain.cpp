@@ -0,0 +1,26 @@
+#include "tTestHarness.h"
+#include <cstring>
+
+// FurSimTests [--benchmark] [filter]
+// Runs every test, or every benchmark, whose name contains filter.
+int main(
+	int argc,
+	char** argv)
+{
+	bool benchmarks = false;
+	const char* filter = nullptr;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (0 == strcmp(argv[i], "--benchmark"))
+		{
+			benchmarks = true;
+		}
+		else
+		{
+			filter = argv[i];
+		}
+	}
+
+	return (tTestHarness::run(benchmarks, filter) == 0) ? 0 : 1;
+}
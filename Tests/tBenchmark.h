@@ -0,0 +1,68 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Times a piece of work a few times and prints the median, per run and
+// per item, so runs of different sizes can be compared.
+class tBenchmark
+{
+public:
+	tBenchmark(
+		const std::string& name,
+		size_t itemCount,
+		unsigned long runCount = 7)
+		:_name(name)
+		, _itemCount(itemCount)
+		, _runCount(runCount)
+	{
+	}
+
+	// Returns the median in seconds. setup runs before every timed run
+	// and is not timed.
+	template<class tWork, class tSetup>
+	double run(
+		tWork work,
+		tSetup setup)
+	{
+		std::vector<double> secondVector;
+
+		for (unsigned long i = 0; i < _runCount; ++i)
+		{
+			setup();
+
+			const auto start = std::chrono::high_resolution_clock::now();
+
+			work();
+
+			secondVector.push_back(std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count());
+		}
+
+		std::sort(secondVector.begin(), secondVector.end());
+
+		const double median = secondVector[secondVector.size() / 2];
+
+		printf(
+			"  %-48s %12.3f ms %12.2f ns/item\n",
+			_name.c_str(),
+			median * 1.0e3,
+			(_itemCount > 0) ? median * 1.0e9 / _itemCount : 0.0);
+		fflush(stdout);
+
+		return median;
+	}
+
+	template<class tWork>
+	double run(
+		tWork work)
+	{
+		return run(work, []() {});
+	}
+
+private:
+	std::string _name;
+	size_t _itemCount;
+	unsigned long _runCount;
+};
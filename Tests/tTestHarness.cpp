@@ -0,0 +1,85 @@
+#include "tTestHarness.h"
+#include <cstdio>
+#include <cstring>
+#include <windows.h>
+
+unsigned long tTestHarness::_failedCheckCount = 0;
+
+std::vector<tTestHarness::tCaseRec>& tTestHarness::_getCaseVector()
+{
+	// Cases register from static initializers, in any order of sources.
+	static std::vector<tCaseRec> caseVector;
+
+	return caseVector;
+}
+
+bool tTestHarness::add(
+	const char* name,
+	tCaseFunction caseFunction,
+	bool benchmark)
+{
+	tCaseRec caseRec;
+
+	caseRec.name = name;
+	caseRec.caseFunction = caseFunction;
+	caseRec.benchmark = benchmark;
+	_getCaseVector().push_back(caseRec);
+
+	return true;
+}
+
+void tTestHarness::fail(
+	const char* filename,
+	int line,
+	const char* expression)
+{
+	++_failedCheckCount;
+	printf("  %s(%d): CHECK(%s) failed\n", filename, line, expression);
+}
+
+int tTestHarness::run(
+	bool benchmarks,
+	const char* filter)
+{
+	int failedCaseCount = 0;
+	int runCaseCount = 0;
+
+	for (const auto& caseRec : _getCaseVector())
+	{
+		if ((caseRec.benchmark != benchmarks)
+			|| ((nullptr != filter) && (nullptr == strstr(caseRec.name, filter))))
+		{
+			continue;
+		}
+
+		const unsigned long failedCheckCount = _failedCheckCount;
+
+		printf("%s\n", caseRec.name);
+		fflush(stdout);
+
+		caseRec.caseFunction();
+		++runCaseCount;
+
+		if (_failedCheckCount != failedCheckCount)
+		{
+			++failedCaseCount;
+		}
+	}
+
+	printf("%d of %d %s failed\n", failedCaseCount, runCaseCount, benchmarks ? "benchmarks" : "tests");
+
+	return failedCaseCount;
+}
+
+std::string tTestHarness::getTempFilename(
+	const char* name)
+{
+	char tempPath[MAX_PATH];
+
+	if (0 == GetTempPathA(MAX_PATH, tempPath))
+	{
+		return name;
+	}
+
+	return std::string(tempPath) + "FurSimTests_" + name;
+}
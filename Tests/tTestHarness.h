@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Registry of the test and benchmark cases of every test source. A test
+// fails when one of its CHECKs does, benchmarks only run on request.
+class tTestHarness
+{
+public:
+	typedef void (*tCaseFunction)();
+
+	static bool add(
+		const char* name,
+		tCaseFunction caseFunction,
+		bool benchmark);
+	static void fail(
+		const char* filename,
+		int line,
+		const char* expression);
+
+	// Runs the tests, or the benchmarks, whose name contains filter.
+	// Returns the count of failed cases.
+	static int run(
+		bool benchmarks,
+		const char* filter);
+
+	// Scratch path for the files a case writes, in the temp directory.
+	static std::string getTempFilename(
+		const char* name);
+
+private:
+	typedef struct
+	{
+		const char* name;
+		tCaseFunction caseFunction;
+		bool benchmark;
+	} tCaseRec;
+
+	static std::vector<tCaseRec>& _getCaseVector();
+	static unsigned long _failedCheckCount;
+};
+
+#define TEST_CASE(name) \
+	static void name(); \
+	static const bool name##Registered = tTestHarness::add(#name, name, false); \
+	static void name()
+
+#define BENCHMARK_CASE(name) \
+	static void name(); \
+	static const bool name##Registered = tTestHarness::add(#name, name, true); \
+	static void name()
+
+#define CHECK(expression) \
+	((expression) ? (void)0 : tTestHarness::fail(__FILE__, __LINE__, #expression))
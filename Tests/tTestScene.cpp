@@ -0,0 +1,404 @@
+#include "tTestScene.h"
+#include <algorithm>
+#include <cmath>
+#include <dxgi1_4.h>
+#include <fbxsdk.h>
+#include <vector>
+#include <windows.h>
+
+using namespace fbxsdk;
+
+namespace
+{
+	const double kTubeRadius = 1.0;
+	const double kTubeHeight = 10.0;
+	const double kTubeSpacing = 3.0;
+	const double kFrameRate = 30.0;
+	const double kPi = 3.14159265358979323846;
+
+	std::string getBoneName(
+		unsigned long boneIndex)
+	{
+		return "bone" + std::to_string(boneIndex);
+	}
+
+	// The attribute and the node share the name, the loader reads both.
+	FbxNode* createBone(
+		FbxScene* scenePtr,
+		FbxNode* parentNodePtr,
+		const std::string& name,
+		double offset,
+		bool root)
+	{
+		FbxSkeleton* skeletonPtr = FbxSkeleton::Create(scenePtr, name.c_str());
+		FbxNode* nodePtr = FbxNode::Create(scenePtr, name.c_str());
+
+		skeletonPtr->SetSkeletonType(root ? FbxSkeleton::eRoot : FbxSkeleton::eLimbNode);
+		nodePtr->SetNodeAttribute(skeletonPtr);
+		nodePtr->LclTranslation.Set(FbxDouble3(0.0, offset, 0.0));
+		parentNodePtr->AddChild(nodePtr);
+
+		return nodePtr;
+	}
+
+	// Influences of a control point at height y, centered on the closest
+	// bones. Their count cycles with the control point index.
+	void getInfluences(
+		const tTestScene::tSettings& settings,
+		double y,
+		unsigned long controlPointIndex,
+		std::vector<std::pair<unsigned long, double>>& influenceVector)
+	{
+		const double bonePosition = y / kTubeHeight * (settings.boneCount - 1);
+		const unsigned long closestBone = std::min(static_cast<unsigned long>(bonePosition + 0.5), settings.boneCount - 1);
+		const unsigned long influenceCount = std::min(1 + controlPointIndex % settings.maxInfluenceCount, settings.boneCount);
+		const unsigned long firstBone = std::min(
+			(closestBone > (influenceCount - 1) / 2) ? closestBone - (influenceCount - 1) / 2 : 0,
+			settings.boneCount - influenceCount);
+
+		influenceVector.clear();
+
+		for (unsigned long boneIndex = firstBone; boneIndex < firstBone + influenceCount; ++boneIndex)
+		{
+			influenceVector.emplace_back(boneIndex, 1.0 / (1.0 + fabs(boneIndex - bonePosition)));
+		}
+	}
+
+	void createTube(
+		FbxScene* scenePtr,
+		const tTestScene::tSettings& settings,
+		unsigned long meshIndex,
+		FbxSurfaceMaterial* materialPtr,
+		FbxSurfaceMaterial* upperMaterialPtr,
+		const std::vector<FbxNode*>& boneNodeVector)
+	{
+		const std::string name = "tube" + std::to_string(meshIndex);
+		const int columnCount = static_cast<int>(settings.columnCount);
+		const int ringCount = static_cast<int>(settings.rowCount) + 1;
+		FbxMesh* meshPtr = FbxMesh::Create(scenePtr, name.c_str());
+		FbxNode* meshNodePtr = FbxNode::Create(scenePtr, name.c_str());
+
+		meshNodePtr->SetNodeAttribute(meshPtr);
+		meshNodePtr->AddMaterial(materialPtr);
+
+		if (nullptr != upperMaterialPtr)
+		{
+			meshNodePtr->AddMaterial(upperMaterialPtr);
+		}
+		scenePtr->GetRootNode()->AddChild(meshNodePtr);
+
+		meshPtr->InitControlPoints(ringCount * columnCount);
+
+		FbxVector4* controlPoints = meshPtr->GetControlPoints();
+
+		for (int ring = 0; ring < ringCount; ++ring)
+		{
+			for (int column = 0; column < columnCount; ++column)
+			{
+				const double angle = 2.0 * kPi * column / columnCount;
+
+				controlPoints[ring * columnCount + column] = FbxVector4(
+					meshIndex * kTubeSpacing + kTubeRadius * cos(angle),
+					kTubeHeight * ring / settings.rowCount,
+					kTubeRadius * sin(angle));
+			}
+		}
+
+		const FbxGeometryElement::EMappingMode mappingMode = settings.byPolygonVertex
+			? FbxGeometryElement::eByPolygonVertex
+			: FbxGeometryElement::eByControlPoint;
+		FbxGeometryElementNormal* normalElementPtr = meshPtr->CreateElementNormal();
+		FbxGeometryElementUV* uvElementPtr = meshPtr->CreateElementUV("map1");
+		FbxGeometryElementMaterial* materialElementPtr = meshPtr->CreateElementMaterial();
+
+		normalElementPtr->SetMappingMode(mappingMode);
+		normalElementPtr->SetReferenceMode(FbxGeometryElement::eDirect);
+		uvElementPtr->SetMappingMode(mappingMode);
+		uvElementPtr->SetReferenceMode(FbxGeometryElement::eDirect);
+		materialElementPtr->SetMappingMode(FbxGeometryElement::eByPolygon);
+		materialElementPtr->SetReferenceMode(FbxGeometryElement::eIndexToDirect);
+
+		auto addCorner = [&](int ring, int column)
+		{
+			const int wrappedColumn = column % columnCount;
+			const double angle = 2.0 * kPi * wrappedColumn / columnCount;
+
+			meshPtr->AddPolygon(ring * columnCount + wrappedColumn);
+
+			if (settings.byPolygonVertex)
+			{
+				// Unwrapped, the last column closes the tube at u = 1.
+				normalElementPtr->GetDirectArray().Add(FbxVector4(cos(angle), 0.0, sin(angle)));
+				uvElementPtr->GetDirectArray().Add(FbxVector2(
+					static_cast<float>(column) / columnCount,
+					static_cast<float>(ring) / settings.rowCount));
+			}
+		};
+
+		// Counter clockwise seen from outside the tube.
+		for (int ring = 0; ring + 1 < ringCount; ++ring)
+		{
+			const int material = ((nullptr != upperMaterialPtr) && (2 * ring >= ringCount - 1)) ? 1 : 0;
+
+			for (int column = 0; column < columnCount; ++column)
+			{
+				if (settings.triangles)
+				{
+					meshPtr->BeginPolygon(material);
+					addCorner(ring, column);
+					addCorner(ring + 1, column);
+					addCorner(ring + 1, column + 1);
+					meshPtr->EndPolygon();
+
+					meshPtr->BeginPolygon(material);
+					addCorner(ring, column);
+					addCorner(ring + 1, column + 1);
+					addCorner(ring, column + 1);
+					meshPtr->EndPolygon();
+				}
+				else
+				{
+					meshPtr->BeginPolygon(material);
+					addCorner(ring, column);
+					addCorner(ring + 1, column);
+					addCorner(ring + 1, column + 1);
+					addCorner(ring, column + 1);
+					meshPtr->EndPolygon();
+				}
+			}
+		}
+
+		if (!settings.byPolygonVertex)
+		{
+			for (int ring = 0; ring < ringCount; ++ring)
+			{
+				for (int column = 0; column < columnCount; ++column)
+				{
+					const double angle = 2.0 * kPi * column / columnCount;
+
+					normalElementPtr->GetDirectArray().Add(FbxVector4(cos(angle), 0.0, sin(angle)));
+					uvElementPtr->GetDirectArray().Add(FbxVector2(
+						static_cast<float>(column) / columnCount,
+						static_cast<float>(ring) / settings.rowCount));
+				}
+			}
+		}
+
+		FbxSkin* skinPtr = FbxSkin::Create(scenePtr, (name + "_skin").c_str());
+		std::vector<FbxCluster*> clusterVector(settings.boneCount);
+		std::vector<std::pair<unsigned long, double>> influenceVector;
+
+		for (unsigned long boneIndex = 0; boneIndex < settings.boneCount; ++boneIndex)
+		{
+			FbxCluster* clusterPtr = FbxCluster::Create(scenePtr, "");
+
+			clusterPtr->SetLink(boneNodeVector[boneIndex]);
+			clusterPtr->SetLinkMode(FbxCluster::eNormalize);
+			clusterPtr->SetTransformMatrix(meshNodePtr->EvaluateGlobalTransform());
+			clusterPtr->SetTransformLinkMatrix(boneNodeVector[boneIndex]->EvaluateGlobalTransform());
+			clusterVector[boneIndex] = clusterPtr;
+		}
+
+		for (int controlPointIndex = 0; controlPointIndex < ringCount * columnCount; ++controlPointIndex)
+		{
+			getInfluences(settings, controlPoints[controlPointIndex][1], controlPointIndex, influenceVector);
+
+			for (const auto& influence : influenceVector)
+			{
+				clusterVector[influence.first]->AddControlPointIndex(controlPointIndex, influence.second);
+			}
+		}
+
+		for (auto clusterPtr : clusterVector)
+		{
+			skinPtr->AddCluster(clusterPtr);
+		}
+
+		meshPtr->AddDeformer(skinPtr);
+	}
+
+	// Bends every animated bone around z, each take at its own pace.
+	void createTake(
+		FbxScene* scenePtr,
+		const tTestScene::tSettings& settings,
+		unsigned long takeIndex,
+		const std::vector<FbxNode*>& boneNodeVector)
+	{
+		const std::string name = "take" + std::to_string(takeIndex);
+		FbxAnimStack* animStackPtr = FbxAnimStack::Create(scenePtr, name.c_str());
+		FbxAnimLayer* animLayerPtr = FbxAnimLayer::Create(scenePtr, (name + "_layer").c_str());
+		FbxTime startTime;
+		FbxTime stopTime;
+
+		animStackPtr->AddMember(animLayerPtr);
+		startTime.SetSecondDouble(settings.takeStart);
+		stopTime.SetSecondDouble(settings.takeStart + settings.takeDuration);
+		animStackPtr->LocalStart.Set(startTime);
+		animStackPtr->LocalStop.Set(stopTime);
+		animStackPtr->ReferenceStart.Set(startTime);
+		animStackPtr->ReferenceStop.Set(stopTime);
+
+		const int keyCount = static_cast<int>(settings.takeDuration * kFrameRate) + 1;
+
+		for (unsigned long boneIndex = 0; boneIndex < settings.boneCount; ++boneIndex)
+		{
+			if ((settings.staticBoneStride > 0) && (boneIndex % settings.staticBoneStride == 0))
+			{
+				continue;
+			}
+
+			FbxAnimCurve* curvePtr = boneNodeVector[boneIndex]->LclRotation.GetCurve(animLayerPtr, FBXSDK_CURVENODE_COMPONENT_Z, true);
+
+			curvePtr->KeyModifyBegin();
+
+			for (int key = 0; key < keyCount; ++key)
+			{
+				FbxTime keyTime;
+				const double phase = 2.0 * kPi * (takeIndex + 1) * key / (keyCount - 1);
+
+				keyTime.SetSecondDouble(settings.takeStart + key / kFrameRate);
+
+				const int keyIndex = curvePtr->KeyAdd(keyTime);
+
+				curvePtr->KeySetValue(keyIndex, static_cast<float>(20.0 * sin(phase + boneIndex)));
+				curvePtr->KeySetInterpolation(keyIndex, FbxAnimCurveDef::eInterpolationLinear);
+			}
+
+			curvePtr->KeyModifyEnd();
+		}
+	}
+}
+
+tTestScene::tSettings tTestScene::getDefaultSettings()
+{
+	tSettings settings = {};
+
+	settings.columnCount = 16;
+	settings.rowCount = 16;
+	settings.meshCount = 1;
+	settings.boneCount = 8;
+	settings.maxInfluenceCount = 4;
+	settings.takeCount = 1;
+	settings.takeDuration = 1.0;
+
+	return settings;
+}
+
+bool tTestScene::write(
+	const std::string& filename,
+	const tTestScene::tSettings& settings)
+{
+	FbxManager* managerPtr = FbxManager::Create();
+	FbxIOSettings* ioSettingsPtr = FbxIOSettings::Create(managerPtr, IOSROOT);
+
+	managerPtr->SetIOSettings(ioSettingsPtr);
+
+	FbxScene* scenePtr = FbxScene::Create(managerPtr, "testScene");
+
+	scenePtr->GetGlobalSettings().SetTimeMode(FbxTime::eFrames30);
+
+	if (settings.convertedAxis)
+	{
+		scenePtr->GetGlobalSettings().SetAxisSystem(FbxAxisSystem::MayaZUp);
+		scenePtr->GetGlobalSettings().SetSystemUnit(FbxSystemUnit::m);
+	}
+
+	const double boneSpacing = kTubeHeight / std::max(settings.boneCount - 1, 1UL);
+	std::vector<FbxNode*> boneNodeVector;
+	FbxNode* parentNodePtr = scenePtr->GetRootNode();
+
+	for (unsigned long boneIndex = 0; boneIndex < settings.boneCount; ++boneIndex)
+	{
+		double offset = (boneIndex == 0) ? 0.0 : boneSpacing;
+
+		if (settings.helperBones && (boneIndex == 1))
+		{
+			parentNodePtr = createBone(scenePtr, parentNodePtr, getBoneName(0) + "_helper", 0.5 * boneSpacing, false);
+			offset = 0.5 * boneSpacing;
+		}
+
+		parentNodePtr = createBone(scenePtr, parentNodePtr, getBoneName(boneIndex), offset, boneIndex == 0);
+		boneNodeVector.push_back(parentNodePtr);
+	}
+
+	if (settings.helperBones)
+	{
+		createBone(scenePtr, parentNodePtr, getBoneName(settings.boneCount - 1) + "_end", 0.5 * boneSpacing, false);
+	}
+
+	FbxSurfaceMaterial* materialPtr = nullptr;
+
+	for (unsigned long meshIndex = 0; meshIndex < settings.meshCount; ++meshIndex)
+	{
+		if ((nullptr == materialPtr) || !settings.sharedMaterial)
+		{
+			materialPtr = FbxSurfacePhong::Create(scenePtr, ("material" + std::to_string(meshIndex)).c_str());
+		}
+
+		FbxSurfaceMaterial* upperMaterialPtr = settings.upperMaterial
+			? FbxSurfacePhong::Create(scenePtr, ("upperMaterial" + std::to_string(meshIndex)).c_str())
+			: nullptr;
+
+		createTube(scenePtr, settings, meshIndex, materialPtr, upperMaterialPtr, boneNodeVector);
+	}
+
+	for (unsigned long takeIndex = 0; takeIndex < settings.takeCount; ++takeIndex)
+	{
+		createTake(scenePtr, settings, takeIndex, boneNodeVector);
+	}
+
+	FbxExporter* exporterPtr = FbxExporter::Create(managerPtr, "");
+	const int fileFormat = managerPtr->GetIOPluginRegistry()->GetNativeWriterFormat();
+	const bool written = exporterPtr->Initialize(filename.c_str(), fileFormat, managerPtr->GetIOSettings())
+		&& exporterPtr->Export(scenePtr);
+
+	exporterPtr->Destroy();
+	managerPtr->Destroy();
+
+	return written;
+}
+
+void tTestScene::remove(
+	const std::string& filename)
+{
+	const size_t separator = filename.find_last_of("\\/");
+	const std::string directory = (separator != std::string::npos) ? filename.substr(0, separator + 1) : std::string();
+	WIN32_FIND_DATAA findData;
+	HANDLE findHandle = FindFirstFileA((filename + "*").c_str(), &findData);
+
+	if (INVALID_HANDLE_VALUE == findHandle)
+	{
+		return;
+	}
+
+	do
+	{
+		DeleteFileA((directory + findData.cFileName).c_str());
+	} while (FindNextFileA(findHandle, &findData));
+
+	FindClose(findHandle);
+}
+
+Microsoft::WRL::ComPtr<ID3D12Device> tTestScene::createDevice()
+{
+	Microsoft::WRL::ComPtr<IDXGIFactory4> factoryPtr;
+	Microsoft::WRL::ComPtr<IDXGIAdapter> adapterPtr;
+	Microsoft::WRL::ComPtr<ID3D12Device> devicePtr;
+
+	if (SUCCEEDED(CreateDXGIFactory1(IID_PPV_ARGS(&factoryPtr)))
+		&& SUCCEEDED(factoryPtr->EnumWarpAdapter(IID_PPV_ARGS(&adapterPtr))))
+	{
+		D3D12CreateDevice(adapterPtr.Get(), D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&devicePtr));
+	}
+
+	return devicePtr;
+}
+
+unsigned long tTestScene::getVerticeCount(
+	const tTestScene::tSettings& settings)
+{
+	// The uv seam doubles the first column.
+	const unsigned long columnCount = settings.byPolygonVertex ? settings.columnCount + 1 : settings.columnCount;
+
+	return (settings.rowCount + 1) * columnCount;
+}
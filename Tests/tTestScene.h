@@ -0,0 +1,76 @@
+#pragma once
+#include <d3d12.h>
+#include <string>
+#include <wrl.h>
+
+// Generated FBX scenes for the loader tests: tubes of quads along the y
+// axis, skinned to one chain of bones that the takes bend. Bones are named
+// bone<n>, the helper bones bone0_helper and bone<n - 1>_end, the takes
+// take<n>.
+class tTestScene
+{
+public:
+	typedef struct
+	{
+		// Quads around and along every tube.
+		unsigned long columnCount;
+		unsigned long rowCount;
+
+		// Tubes side by side, each one its own mesh node.
+		unsigned long meshCount;
+
+		// Bones of the chain every tube is skinned to.
+		unsigned long boneCount;
+
+		// Control points get from 1 up to this many influences.
+		unsigned long maxInfluenceCount;
+
+		// Normals and uvs per polygon corner, with a uv seam where the
+		// tube closes. Per control point otherwise.
+		bool byPolygonVertex;
+
+		// Two triangles per quad.
+		bool triangles;
+
+		// Every tube uses the material of the first one.
+		bool sharedMaterial;
+
+		// The upper half of every tube uses a second material of its own.
+		bool upperMaterial;
+
+		// Unweighted static bones the loader can prune, one between the
+		// first two chain bones and one below the last.
+		bool helperBones;
+
+		// Z up and meters, so the loader has to convert the scene.
+		bool convertedAxis;
+
+		// Takes of takeDuration seconds that start at takeStart.
+		unsigned long takeCount;
+		double takeStart;
+		double takeDuration;
+
+		// Every n-th chain bone, the first included, keeps still in the
+		// takes. Zero animates all of them.
+		unsigned long staticBoneStride;
+	} tSettings;
+
+	// One small tube of 8 bones and one take.
+	static tSettings getDefaultSettings();
+
+	static bool write(
+		const std::string& filename,
+		const tSettings& settings);
+
+	// Deletes filename and everything a load saved next to it.
+	static void remove(
+		const std::string& filename);
+
+	// The loader only holds on to the device, WARP keeps the tests off
+	// the GPU.
+	static Microsoft::WRL::ComPtr<ID3D12Device> createDevice();
+
+	// Vertices of one tube as the loader welds them.
+	static unsigned long getVerticeCount(
+		const tSettings& settings);
+};
@@ -0,0 +1,144 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// Monotonic allocator for short lived data. Allocations are never freed
+// one by one, everything is released at once by reset().
+class LinearArena
+{
+public:
+	explicit LinearArena(size_t blockSize = 4 * 1024 * 1024) :
+		mBlockSize(blockSize)
+	{
+	}
+
+	LinearArena(const LinearArena& rhs) = delete;
+	LinearArena& operator=(const LinearArena& rhs) = delete;
+	~LinearArena()
+	{
+		reset();
+	}
+
+	void* allocate(size_t size, size_t alignment)
+	{
+		assert((alignment & (alignment - 1)) == 0);
+
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		size_t offset = (mBlockOffset + alignment - 1) & ~(alignment - 1);
+
+		if (mBlocks.empty() || (offset + size > mBlocks.back().size))
+		{
+			// Requests bigger than a block get a block of their own.
+			size_t blockSize = (size + alignment > mBlockSize) ? size + alignment : mBlockSize;
+			Block block = { static_cast<unsigned char*>(::operator new(blockSize)), blockSize };
+
+			mBlocks.push_back(block);
+			mReservedBytes += blockSize;
+			offset = (reinterpret_cast<size_t>(block.data) + alignment - 1) & ~(alignment - 1);
+			offset -= reinterpret_cast<size_t>(block.data);
+		}
+
+		void* allocation = mBlocks.back().data + offset;
+
+		mBlockOffset = offset + size;
+		mUsedBytes += size;
+
+		return allocation;
+	}
+
+	// Frees every allocation made since the last reset.
+	void reset()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		for (auto& block : mBlocks)
+		{
+			::operator delete(block.data);
+		}
+
+		mBlocks.clear();
+		mBlockOffset = 0;
+		mUsedBytes = 0;
+		mReservedBytes = 0;
+	}
+
+	// Bytes handed out since the last reset. Nothing is freed in between,
+	// so this is also the peak usage of the current scope.
+	size_t usedBytes() const
+	{
+		return mUsedBytes;
+	}
+
+	size_t reservedBytes() const
+	{
+		return mReservedBytes;
+	}
+
+private:
+	struct Block
+	{
+		unsigned char* data;
+		size_t size;
+	};
+
+	std::mutex mMutex;
+	std::vector<Block> mBlocks;
+	size_t mBlockSize = 0;
+	size_t mBlockOffset = 0;
+	size_t mUsedBytes = 0;
+	size_t mReservedBytes = 0;
+};
+
+// Standard library allocator on top of a LinearArena. Nothing is freed
+// before reset(), so a container that regrows keeps every buffer it
+// outgrew: size or reserve it once, up front.
+template<typename T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	ArenaAllocator(LinearArena& arena) :
+		mArena(&arena)
+	{
+	}
+
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& rhs) :
+		mArena(rhs.arena())
+	{
+	}
+
+	T* allocate(size_t count)
+	{
+		return static_cast<T*>(mArena->allocate(count * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T*, size_t)
+	{
+	}
+
+	LinearArena* arena() const
+	{
+		return mArena;
+	}
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& rhs) const
+	{
+		return mArena == rhs.arena();
+	}
+
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& rhs) const
+	{
+		return mArena != rhs.arena();
+	}
+
+private:
+	LinearArena* mArena;
+};
@@ -1,6 +1,8 @@
 #include "MathHelper.h"
 #include <cmath>
 #include <float.h>
+#include <immintrin.h>
+#include <intrin.h>
 
 using namespace DirectX;
 
@@ -75,4 +77,293 @@ XMVECTOR MathHelper::RandHemisphereUnitVec3(XMVECTOR n)
 
 		return XMVector3Normalize(v);
 	}
-}
\ No newline at end of file
+}
+
+namespace
+{
+	// A matrix is four rows of four floats, out = a * b on row vectors:
+	// every out row is the matching a row weighing the rows of b.
+	struct SseKernels
+	{
+		static void Multiply(const float* a, const float* b, float* out)
+		{
+			XMStoreFloat4x4A(
+				reinterpret_cast<XMFLOAT4X4A*>(out),
+				XMMatrixMultiply(
+					XMLoadFloat4x4A(reinterpret_cast<const XMFLOAT4X4A*>(a)),
+					XMLoadFloat4x4A(reinterpret_cast<const XMFLOAT4X4A*>(b))));
+		}
+
+		static void MultiplyTranspose(const float* a, const float* b, float* out)
+		{
+			XMStoreFloat4x4A(
+				reinterpret_cast<XMFLOAT4X4A*>(out),
+				XMMatrixMultiplyTranspose(
+					XMLoadFloat4x4A(reinterpret_cast<const XMFLOAT4X4A*>(a)),
+					XMLoadFloat4x4A(reinterpret_cast<const XMFLOAT4X4A*>(b))));
+		}
+
+		static void Finish()
+		{
+		}
+	};
+
+	// Two rows per register, the rows of b are broadcast to both lanes.
+	struct Avx2Kernels
+	{
+		static void MultiplyRows(const float* a, const float* b, __m256& rows01, __m256& rows23)
+		{
+			const __m256 b0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b));
+			const __m256 b1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b + 4));
+			const __m256 b2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b + 8));
+			const __m256 b3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b + 12));
+			const __m256 a01 = _mm256_loadu_ps(a);
+			const __m256 a23 = _mm256_loadu_ps(a + 8);
+
+			rows01 = _mm256_mul_ps(_mm256_permute_ps(a01, 0x00), b0);
+			rows23 = _mm256_mul_ps(_mm256_permute_ps(a23, 0x00), b0);
+			rows01 = _mm256_fmadd_ps(_mm256_permute_ps(a01, 0x55), b1, rows01);
+			rows23 = _mm256_fmadd_ps(_mm256_permute_ps(a23, 0x55), b1, rows23);
+			rows01 = _mm256_fmadd_ps(_mm256_permute_ps(a01, 0xAA), b2, rows01);
+			rows23 = _mm256_fmadd_ps(_mm256_permute_ps(a23, 0xAA), b2, rows23);
+			rows01 = _mm256_fmadd_ps(_mm256_permute_ps(a01, 0xFF), b3, rows01);
+			rows23 = _mm256_fmadd_ps(_mm256_permute_ps(a23, 0xFF), b3, rows23);
+		}
+
+		static void TransposeRows(__m256 rows01, __m256 rows23, float* out)
+		{
+			// [x0 x2 y0 y2 | x1 x3 y1 y3] and [z0 z2 w0 w2 | z1 z3 w1 w3]
+			const __m256 xy = _mm256_unpacklo_ps(rows01, rows23);
+			const __m256 zw = _mm256_unpackhi_ps(rows01, rows23);
+
+			// [x0 x2 y0 y2 | z0 z2 w0 w2] and [x1 x3 y1 y3 | z1 z3 w1 w3]
+			const __m256 even = _mm256_permute2f128_ps(xy, zw, 0x20);
+			const __m256 odd = _mm256_permute2f128_ps(xy, zw, 0x31);
+
+			// [x | z] and [y | w]
+			const __m256 xz = _mm256_unpacklo_ps(even, odd);
+			const __m256 yw = _mm256_unpackhi_ps(even, odd);
+
+			_mm256_storeu_ps(out, _mm256_permute2f128_ps(xz, yw, 0x20));
+			_mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(xz, yw, 0x31));
+		}
+
+		static void Multiply(const float* a, const float* b, float* out)
+		{
+			__m256 rows01;
+			__m256 rows23;
+
+			MultiplyRows(a, b, rows01, rows23);
+
+			_mm256_storeu_ps(out, rows01);
+			_mm256_storeu_ps(out + 8, rows23);
+		}
+
+		static void MultiplyTranspose(const float* a, const float* b, float* out)
+		{
+			__m256 rows01;
+			__m256 rows23;
+
+			MultiplyRows(a, b, rows01, rows23);
+			TransposeRows(rows01, rows23, out);
+		}
+
+		// Avoids the penalty of legacy SSE code after the 256 bit registers.
+		static void Finish()
+		{
+			_mm256_zeroupper();
+		}
+	};
+
+	// The whole matrix in one register.
+	struct Avx512Kernels
+	{
+		static __m512 MultiplyRows(const float* a, const float* b)
+		{
+			const __m512 rows = _mm512_loadu_ps(a);
+			__m512 out = _mm512_mul_ps(_mm512_permute_ps(rows, 0x00), _mm512_broadcast_f32x4(_mm_loadu_ps(b)));
+
+			out = _mm512_fmadd_ps(_mm512_permute_ps(rows, 0x55), _mm512_broadcast_f32x4(_mm_loadu_ps(b + 4)), out);
+			out = _mm512_fmadd_ps(_mm512_permute_ps(rows, 0xAA), _mm512_broadcast_f32x4(_mm_loadu_ps(b + 8)), out);
+
+			return _mm512_fmadd_ps(_mm512_permute_ps(rows, 0xFF), _mm512_broadcast_f32x4(_mm_loadu_ps(b + 12)), out);
+		}
+
+		static __m512 TransposeRows(__m512 rows)
+		{
+			return _mm512_permutexvar_ps(_mm512_setr_epi32(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15), rows);
+		}
+
+		static void Multiply(const float* a, const float* b, float* out)
+		{
+			_mm512_storeu_ps(out, MultiplyRows(a, b));
+		}
+
+		static void MultiplyTranspose(const float* a, const float* b, float* out)
+		{
+			_mm512_storeu_ps(out, TransposeRows(MultiplyRows(a, b)));
+		}
+
+		static void Finish()
+		{
+			_mm256_zeroupper();
+		}
+	};
+
+	template<typename Kernels>
+	void multiplyMatrices(const XMFLOAT4X4A* a, const XMFLOAT4X4A* b, XMFLOAT4X4A* out, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			Kernels::Multiply(&a[i]._11, &b[i]._11, &out[i]._11);
+		}
+
+		Kernels::Finish();
+	}
+
+	template<typename Kernels>
+	void multiplyParentMatrices(
+		const XMFLOAT4X4A* locals,
+		const std::int32_t* parents,
+		const XMFLOAT4X4A& root,
+		XMFLOAT4X4A* models,
+		size_t first,
+		size_t last)
+	{
+		for (size_t i = first; i < last; ++i)
+		{
+			const XMFLOAT4X4A& parent = (parents[i] < 0) ? root : models[parents[i]];
+
+			Kernels::Multiply(&locals[i]._11, &parent._11, &models[i]._11);
+		}
+
+		Kernels::Finish();
+	}
+
+	template<typename Kernels>
+	void transposedPaletteMatrices(
+		const XMFLOAT4X4A* offsets,
+		const XMFLOAT4X4A* models,
+		const std::uint32_t* paletteIndices,
+		XMFLOAT4X4A* palettes,
+		size_t first,
+		size_t last)
+	{
+		for (size_t i = first; i < last; ++i)
+		{
+			Kernels::MultiplyTranspose(&offsets[i]._11, &models[i]._11, &palettes[paletteIndices[i]]._11);
+		}
+
+		Kernels::Finish();
+	}
+
+	// The CPU has to support the instructions and the OS has to save the
+	// wider registers on a context switch.
+	MathHelper::InstructionSet detectInstructionSet()
+	{
+		int info[4];
+
+		__cpuid(info, 0);
+
+		const int maxLeaf = info[0];
+
+		__cpuid(info, 1);
+
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		const bool fma = (info[2] & (1 << 12)) != 0;
+
+		if (!osxsave || !avx || !fma || (maxLeaf < 7))
+		{
+			return MathHelper::InstructionSetSse;
+		}
+
+		const unsigned long long xcr0 = _xgetbv(0);
+
+		__cpuidex(info, 7, 0);
+
+		const bool avx2 = ((info[1] & (1 << 5)) != 0) && ((xcr0 & 0x06) == 0x06);
+		const bool avx512 = ((info[1] & (1 << 16)) != 0) && ((xcr0 & 0xE6) == 0xE6);
+
+		return avx512 ? MathHelper::InstructionSetAvx512
+			: avx2 ? MathHelper::InstructionSetAvx2
+			: MathHelper::InstructionSetSse;
+	}
+
+	const MathHelper::InstructionSet g_supportedInstructionSet = detectInstructionSet();
+	MathHelper::InstructionSet g_instructionSet = g_supportedInstructionSet;
+}
+
+MathHelper::InstructionSet MathHelper::GetInstructionSet()
+{
+	return g_instructionSet;
+}
+
+void MathHelper::SetInstructionSet(InstructionSet instructionSet)
+{
+	g_instructionSet = Min(instructionSet, g_supportedInstructionSet);
+}
+
+void MathHelper::MultiplyMatrices(
+	const XMFLOAT4X4A* a,
+	const XMFLOAT4X4A* b,
+	XMFLOAT4X4A* out,
+	size_t count)
+{
+	switch (g_instructionSet)
+	{
+	case InstructionSetAvx512:
+		multiplyMatrices<Avx512Kernels>(a, b, out, count);
+		break;
+	case InstructionSetAvx2:
+		multiplyMatrices<Avx2Kernels>(a, b, out, count);
+		break;
+	default:
+		multiplyMatrices<SseKernels>(a, b, out, count);
+		break;
+	}
+}
+
+void MathHelper::MultiplyParentMatrices(
+	const XMFLOAT4X4A* locals,
+	const std::int32_t* parents,
+	const XMFLOAT4X4A& root,
+	XMFLOAT4X4A* models,
+	size_t first,
+	size_t last)
+{
+	switch (g_instructionSet)
+	{
+	case InstructionSetAvx512:
+		multiplyParentMatrices<Avx512Kernels>(locals, parents, root, models, first, last);
+		break;
+	case InstructionSetAvx2:
+		multiplyParentMatrices<Avx2Kernels>(locals, parents, root, models, first, last);
+		break;
+	default:
+		multiplyParentMatrices<SseKernels>(locals, parents, root, models, first, last);
+		break;
+	}
+}
+
+void MathHelper::TransposedPaletteMatrices(
+	const XMFLOAT4X4A* offsets,
+	const XMFLOAT4X4A* models,
+	const std::uint32_t* paletteIndices,
+	XMFLOAT4X4A* palettes,
+	size_t first,
+	size_t last)
+{
+	switch (g_instructionSet)
+	{
+	case InstructionSetAvx512:
+		transposedPaletteMatrices<Avx512Kernels>(offsets, models, paletteIndices, palettes, first, last);
+		break;
+	case InstructionSetAvx2:
+		transposedPaletteMatrices<Avx2Kernels>(offsets, models, paletteIndices, palettes, first, last);
+		break;
+	default:
+		transposedPaletteMatrices<SseKernels>(offsets, models, paletteIndices, palettes, first, last);
+		break;
+	}
+}
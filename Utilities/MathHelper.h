@@ -82,6 +82,47 @@ public:
 	static DirectX::XMVECTOR RandUnitVec3();
 	static DirectX::XMVECTOR RandHemisphereUnitVec3(DirectX::XMVECTOR n);
 
+	// Widest instruction set the batched matrix kernels below may use.
+	// InstructionSetSse is the SSE2 code of DirectXMath.
+	enum InstructionSet
+	{
+		InstructionSetSse,
+		InstructionSetAvx2,
+		InstructionSetAvx512,
+	};
+
+	// The CPU is checked once, SetInstructionSet() can only narrow it down.
+	static InstructionSet GetInstructionSet();
+	static void SetInstructionSet(InstructionSet instructionSet);
+
+	// out[i] = a[i] * b[i], out may be a or b.
+	static void MultiplyMatrices(
+		const DirectX::XMFLOAT4X4A* a,
+		const DirectX::XMFLOAT4X4A* b,
+		DirectX::XMFLOAT4X4A* out,
+		size_t count);
+
+	// models[i] = locals[i] * models[parents[i]] for i in [first, last),
+	// or locals[i] * root when parents[i] is negative. No parent may be in
+	// the range itself, and locals may be models.
+	static void MultiplyParentMatrices(
+		const DirectX::XMFLOAT4X4A* locals,
+		const std::int32_t* parents,
+		const DirectX::XMFLOAT4X4A& root,
+		DirectX::XMFLOAT4X4A* models,
+		size_t first,
+		size_t last);
+
+	// palettes[paletteIndices[i]] = transpose(offsets[i] * models[i]) for
+	// i in [first, last).
+	static void TransposedPaletteMatrices(
+		const DirectX::XMFLOAT4X4A* offsets,
+		const DirectX::XMFLOAT4X4A* models,
+		const std::uint32_t* paletteIndices,
+		DirectX::XMFLOAT4X4A* palettes,
+		size_t first,
+		size_t last);
+
 	static const float Infinity;
 	static const float Pi;
 
@@ -0,0 +1,878 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <ppl.h>
+
+namespace
+{
+	// Scoring constants from Forsyth's paper.
+	const size_t kForsythCacheSize = 32;
+	const float kCacheDecayPower = 1.5f;
+	const float kLastTriangleScore = 0.75f;
+	const float kValenceBoostScale = 2.0f;
+	const float kValenceBoostPower = 0.5f;
+
+	// Overdraw clusters never get smaller than this.
+	const size_t kMinClusterTriangleCount = 64;
+	const size_t kNoTriangle = ~size_t(0);
+	const std::uint32_t kNoVertex = ~std::uint32_t(0);
+
+	// Triangles per task in the simplifier passes.
+	const size_t kSimplifyChunkSize = 16384;
+
+	// Symmetric plane quadric, and the area it was summed from.
+	struct Quadric
+	{
+		double a00, a01, a02, a03;
+		double a11, a12, a13;
+		double a22, a23;
+		double a33;
+		double weight;
+	};
+
+	void AddQuadric(
+		Quadric& quadric,
+		const Quadric& other)
+	{
+		quadric.a00 += other.a00;
+		quadric.a01 += other.a01;
+		quadric.a02 += other.a02;
+		quadric.a03 += other.a03;
+		quadric.a11 += other.a11;
+		quadric.a12 += other.a12;
+		quadric.a13 += other.a13;
+		quadric.a22 += other.a22;
+		quadric.a23 += other.a23;
+		quadric.a33 += other.a33;
+		quadric.weight += other.weight;
+	}
+
+	// Mean squared distance of the point to the planes of the quadric.
+	float QuadricError(
+		const Quadric& quadric,
+		const float* point)
+	{
+		const double x = point[0];
+		const double y = point[1];
+		const double z = point[2];
+		const double error =
+			quadric.a00 * x * x + 2.0 * quadric.a01 * x * y + 2.0 * quadric.a02 * x * z + 2.0 * quadric.a03 * x
+			+ quadric.a11 * y * y + 2.0 * quadric.a12 * y * z + 2.0 * quadric.a13 * y
+			+ quadric.a22 * z * z + 2.0 * quadric.a23 * z
+			+ quadric.a33;
+
+		return (quadric.weight > 0.0) ? static_cast<float>(fabs(error) / quadric.weight) : 0.0f;
+	}
+
+	void TriangleNormal(
+		const float* a,
+		const float* b,
+		const float* c,
+		float* normal)
+	{
+		const float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		const float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+
+		normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+		normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+		normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+	}
+
+	struct Collapse
+	{
+		float cost;
+		std::uint32_t vertex;
+		std::uint32_t target;
+	};
+
+	float VertexScore(
+		int cachePosition,
+		std::uint32_t activeTriangleCount)
+	{
+		if (activeTriangleCount == 0)
+		{
+			// No triangle needs it anymore.
+			return -1.0f;
+		}
+
+		float score = 0.0f;
+
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+			{
+				// Used by the last triangle, fixed score so the strip
+				// does not always turn the same way.
+				score = kLastTriangleScore;
+			}
+			else
+			{
+				const float scaler = 1.0f / (kForsythCacheSize - 3);
+
+				score = powf(1.0f - (cachePosition - 3) * scaler, kCacheDecayPower);
+			}
+		}
+
+		// Vertices with few triangles left are finished first.
+		score += kValenceBoostScale * powf(static_cast<float>(activeTriangleCount), -kValenceBoostPower);
+
+		return score;
+	}
+}
+
+MeshOptimizer::VertexCacheStatistics MeshOptimizer::AnalyzeVertexCache(
+	const std::uint32_t* indices,
+	size_t indexCount,
+	size_t vertexCount,
+	size_t cacheSize)
+{
+	VertexCacheStatistics statistics = { 0.0f, 0.0f };
+
+	if ((indexCount < 3) || (vertexCount == 0))
+	{
+		return statistics;
+	}
+
+	// A vertex is in the FIFO while fewer than cacheSize misses happened
+	// since it was loaded.
+	std::vector<size_t> loadTimes(vertexCount, 0);
+	size_t time = cacheSize + 1;
+	size_t missCount = 0;
+
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		const std::uint32_t vertex = indices[i];
+
+		assert(vertex < vertexCount);
+
+		if (time - loadTimes[vertex] > cacheSize)
+		{
+			loadTimes[vertex] = time++;
+			++missCount;
+		}
+	}
+
+	statistics.Acmr = static_cast<float>(missCount) / static_cast<float>(indexCount / 3);
+	statistics.Atvr = static_cast<float>(missCount) / static_cast<float>(vertexCount);
+
+	return statistics;
+}
+
+void MeshOptimizer::OptimizeVertexCache(
+	std::uint32_t* indices,
+	size_t indexCount,
+	size_t vertexCount)
+{
+	const size_t triangleCount = indexCount / 3;
+
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Triangles of every vertex, the active ones are kept in front.
+	std::vector<std::uint32_t> triangleOffsets(vertexCount + 1, 0);
+	std::vector<std::uint32_t> activeTriangleCounts(vertexCount, 0);
+	std::vector<std::uint32_t> vertexTriangles(triangleCount * 3);
+
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		assert(indices[i] < vertexCount);
+
+		++activeTriangleCounts[indices[i]];
+	}
+
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		triangleOffsets[vertex + 1] = triangleOffsets[vertex] + activeTriangleCounts[vertex];
+		activeTriangleCounts[vertex] = 0;
+	}
+
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		const std::uint32_t vertex = indices[i];
+
+		vertexTriangles[triangleOffsets[vertex] + activeTriangleCounts[vertex]++] = static_cast<std::uint32_t>(i / 3);
+	}
+
+	std::vector<int> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> triangleAdded(triangleCount, false);
+
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		vertexScores[vertex] = VertexScore(-1, activeTriangleCounts[vertex]);
+	}
+
+	size_t bestTriangle = 0;
+
+	for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+	{
+		triangleScores[triangle] =
+			vertexScores[indices[triangle * 3 + 0]]
+			+ vertexScores[indices[triangle * 3 + 1]]
+			+ vertexScores[indices[triangle * 3 + 2]];
+
+		if (triangleScores[triangle] > triangleScores[bestTriangle])
+		{
+			bestTriangle = triangle;
+		}
+	}
+
+	std::vector<std::uint32_t> cache;
+	std::vector<std::uint32_t> newCache;
+	std::vector<std::uint32_t> newIndices(triangleCount * 3);
+	size_t inputCursor = 0;
+
+	cache.reserve(kForsythCacheSize + 3);
+	newCache.reserve(kForsythCacheSize + 3);
+
+	for (size_t outputTriangle = 0; outputTriangle < triangleCount; ++outputTriangle)
+	{
+		if (bestTriangle == kNoTriangle)
+		{
+			// Nothing left around the cache, restart from the input order.
+			while (triangleAdded[inputCursor])
+			{
+				++inputCursor;
+			}
+
+			bestTriangle = inputCursor;
+		}
+
+		const std::uint32_t* triangleVertices = indices + bestTriangle * 3;
+
+		triangleAdded[bestTriangle] = true;
+		newCache.clear();
+
+		for (size_t corner = 0; corner < 3; ++corner)
+		{
+			const std::uint32_t vertex = triangleVertices[corner];
+			std::uint32_t* first = &vertexTriangles[triangleOffsets[vertex]];
+			std::uint32_t* last = first + activeTriangleCounts[vertex];
+			std::uint32_t* found = std::find(first, last, static_cast<std::uint32_t>(bestTriangle));
+
+			assert(found != last);
+
+			std::swap(*found, *(last - 1));
+			--activeTriangleCounts[vertex];
+
+			newIndices[outputTriangle * 3 + corner] = vertex;
+			newCache.push_back(vertex);
+		}
+
+		for (auto vertex : cache)
+		{
+			if ((vertex != triangleVertices[0]) && (vertex != triangleVertices[1]) && (vertex != triangleVertices[2]))
+			{
+				newCache.push_back(vertex);
+			}
+		}
+
+		for (size_t position = 0; position < newCache.size(); ++position)
+		{
+			const std::uint32_t vertex = newCache[position];
+
+			cachePositions[vertex] = (position < kForsythCacheSize) ? static_cast<int>(position) : -1;
+			vertexScores[vertex] = VertexScore(cachePositions[vertex], activeTriangleCounts[vertex]);
+		}
+
+		// Only the triangles around the cache can have a new score.
+		bestTriangle = kNoTriangle;
+
+		float bestScore = -1.0f;
+
+		for (size_t position = 0; position < newCache.size(); ++position)
+		{
+			const std::uint32_t vertex = newCache[position];
+			const std::uint32_t first = triangleOffsets[vertex];
+			const std::uint32_t last = first + activeTriangleCounts[vertex];
+
+			for (std::uint32_t i = first; i < last; ++i)
+			{
+				const std::uint32_t triangle = vertexTriangles[i];
+
+				triangleScores[triangle] =
+					vertexScores[indices[triangle * 3 + 0]]
+					+ vertexScores[indices[triangle * 3 + 1]]
+					+ vertexScores[indices[triangle * 3 + 2]];
+
+				if (triangleScores[triangle] > bestScore)
+				{
+					bestScore = triangleScores[triangle];
+					bestTriangle = triangle;
+				}
+			}
+		}
+
+		if (newCache.size() > kForsythCacheSize)
+		{
+			newCache.resize(kForsythCacheSize);
+		}
+
+		cache.swap(newCache);
+	}
+
+	std::copy(newIndices.begin(), newIndices.end(), indices);
+}
+
+void MeshOptimizer::OptimizeOverdraw(
+	std::uint32_t* indices,
+	size_t indexCount,
+	const float* positions,
+	size_t positionStride,
+	size_t vertexCount,
+	float threshold)
+{
+	const size_t triangleCount = indexCount / 3;
+
+	if (triangleCount <= kMinClusterTriangleCount)
+	{
+		return;
+	}
+
+	const size_t cacheSize = 16;
+	const float originalAcmr = AnalyzeVertexCache(indices, indexCount, vertexCount, cacheSize).Acmr;
+
+	auto position = [&](std::uint32_t vertex)
+	{
+		return reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + vertex * positionStride);
+	};
+
+	// A cluster ends where the cache order restarts, on a triangle that
+	// misses all of its vertices. Moving clusters then costs few misses.
+	std::vector<size_t> clusterStarts(1, 0);
+	std::vector<size_t> loadTimes(vertexCount, 0);
+	size_t time = cacheSize + 1;
+
+	for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+	{
+		size_t missCount = 0;
+
+		for (size_t corner = 0; corner < 3; ++corner)
+		{
+			const std::uint32_t vertex = indices[triangle * 3 + corner];
+
+			if (time - loadTimes[vertex] > cacheSize)
+			{
+				loadTimes[vertex] = time++;
+				++missCount;
+			}
+		}
+
+		if ((missCount == 3) && (triangle - clusterStarts.back() >= kMinClusterTriangleCount))
+		{
+			clusterStarts.push_back(triangle);
+		}
+	}
+
+	const size_t clusterCount = clusterStarts.size();
+
+	clusterStarts.push_back(triangleCount);
+
+	if (clusterCount < 2)
+	{
+		return;
+	}
+
+	float meshCenter[3] = { 0.0f, 0.0f, 0.0f };
+
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		const float* point = position(static_cast<std::uint32_t>(vertex));
+
+		meshCenter[0] += point[0] / vertexCount;
+		meshCenter[1] += point[1] / vertexCount;
+		meshCenter[2] += point[2] / vertexCount;
+	}
+
+	// Clusters that face away from the center are drawn first, they are
+	// the most likely to hide the others.
+	std::vector<float> clusterSortKeys(clusterCount);
+	std::vector<size_t> clusterOrder(clusterCount);
+
+	for (size_t cluster = 0; cluster < clusterCount; ++cluster)
+	{
+		float center[3] = { 0.0f, 0.0f, 0.0f };
+		float normal[3] = { 0.0f, 0.0f, 0.0f };
+		float totalArea = 0.0f;
+
+		for (size_t triangle = clusterStarts[cluster]; triangle < clusterStarts[cluster + 1]; ++triangle)
+		{
+			const float* a = position(indices[triangle * 3 + 0]);
+			const float* b = position(indices[triangle * 3 + 1]);
+			const float* c = position(indices[triangle * 3 + 2]);
+			const float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			const float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			const float cross[3] =
+			{
+				ab[1] * ac[2] - ab[2] * ac[1],
+				ab[2] * ac[0] - ab[0] * ac[2],
+				ab[0] * ac[1] - ab[1] * ac[0]
+			};
+			const float area = sqrtf(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+
+			for (size_t axis = 0; axis < 3; ++axis)
+			{
+				center[axis] += (a[axis] + b[axis] + c[axis]) / 3.0f * area;
+				normal[axis] += cross[axis];
+			}
+
+			totalArea += area;
+		}
+
+		const float normalLength = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		float sortKey = 0.0f;
+
+		if ((totalArea > 0.0f) && (normalLength > 0.0f))
+		{
+			for (size_t axis = 0; axis < 3; ++axis)
+			{
+				sortKey += (center[axis] / totalArea - meshCenter[axis]) * normal[axis] / normalLength;
+			}
+		}
+
+		clusterSortKeys[cluster] = sortKey;
+		clusterOrder[cluster] = cluster;
+	}
+
+	std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](size_t left, size_t right)
+	{
+		return clusterSortKeys[left] > clusterSortKeys[right];
+	});
+
+	std::vector<std::uint32_t> newIndices;
+
+	newIndices.reserve(triangleCount * 3);
+
+	for (auto cluster : clusterOrder)
+	{
+		newIndices.insert(
+			newIndices.end(),
+			indices + clusterStarts[cluster] * 3,
+			indices + clusterStarts[cluster + 1] * 3);
+	}
+
+	const float newAcmr = AnalyzeVertexCache(newIndices.data(), newIndices.size(), vertexCount, cacheSize).Acmr;
+
+	if (newAcmr > originalAcmr * threshold)
+	{
+		return;
+	}
+
+	std::copy(newIndices.begin(), newIndices.end(), indices);
+}
+
+float MeshOptimizer::SimplifyMesh(
+	const std::uint32_t* indices,
+	size_t indexCount,
+	const float* positions,
+	size_t positionStride,
+	size_t vertexCount,
+	const bool* lockedVertices,
+	const std::uint32_t* vertexGroups,
+	size_t targetIndexCount,
+	std::vector<std::uint32_t>& simplifiedIndices)
+{
+	size_t currentIndexCount = indexCount - indexCount % 3;
+
+	simplifiedIndices.assign(indices, indices + currentIndexCount);
+
+	if (currentIndexCount <= targetIndexCount)
+	{
+		return 0.0f;
+	}
+
+	auto position = [&](std::uint32_t vertex)
+	{
+		return reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + vertex * positionStride);
+	};
+
+	// Vertices at the same position are one point of the surface, so
+	// seams do not look like open borders. The vertices of point n are
+	// pointVertices[pointStarts[n]] up to pointStarts[n + 1].
+	std::vector<std::uint32_t> pointOfVertex(vertexCount);
+	std::vector<std::uint32_t> pointVertices(vertexCount);
+	std::vector<std::uint32_t> pointStarts;
+
+	std::iota(pointVertices.begin(), pointVertices.end(), 0);
+
+	concurrency::parallel_sort(pointVertices.begin(), pointVertices.end(), [&](std::uint32_t left, std::uint32_t right)
+	{
+		const int order = memcmp(position(left), position(right), 3 * sizeof(float));
+
+		return (order < 0) || ((order == 0) && (left < right));
+	});
+
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		if ((i == 0) || (memcmp(position(pointVertices[i - 1]), position(pointVertices[i]), 3 * sizeof(float)) != 0))
+		{
+			pointStarts.push_back(static_cast<std::uint32_t>(i));
+		}
+
+		pointOfVertex[pointVertices[i]] = static_cast<std::uint32_t>(pointStarts.size() - 1);
+	}
+
+	const size_t pointCount = pointStarts.size();
+	std::vector<bool> lockedPoints(pointCount, false);
+
+	pointStarts.push_back(static_cast<std::uint32_t>(vertexCount));
+
+	if (nullptr != lockedVertices)
+	{
+		for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+		{
+			if (lockedVertices[vertex])
+			{
+				lockedPoints[pointOfVertex[vertex]] = true;
+			}
+		}
+	}
+
+	// An edge that is not shared by exactly two triangles is a border.
+	{
+		std::vector<std::uint64_t> edges;
+
+		edges.reserve(currentIndexCount);
+
+		for (size_t i = 0; i < currentIndexCount; i += 3)
+		{
+			for (size_t corner = 0; corner < 3; ++corner)
+			{
+				std::uint64_t a = pointOfVertex[simplifiedIndices[i + corner]];
+				std::uint64_t b = pointOfVertex[simplifiedIndices[i + (corner + 1) % 3]];
+
+				if (a != b)
+				{
+					edges.push_back((std::min(a, b) << 32) | std::max(a, b));
+				}
+			}
+		}
+
+		concurrency::parallel_sort(edges.begin(), edges.end());
+
+		for (size_t first = 0; first < edges.size();)
+		{
+			size_t last = first + 1;
+
+			while ((last < edges.size()) && (edges[last] == edges[first]))
+			{
+				++last;
+			}
+
+			if (last - first != 2)
+			{
+				lockedPoints[static_cast<size_t>(edges[first] >> 32)] = true;
+				lockedPoints[static_cast<size_t>(edges[first] & 0xFFFFFFFF)] = true;
+			}
+
+			first = last;
+		}
+	}
+
+	// Plane quadrics of every triangle, summed on their points.
+	std::vector<Quadric> pointQuadrics(pointCount);
+	{
+		const size_t triangleCount = currentIndexCount / 3;
+		std::vector<Quadric> triangleQuadrics(triangleCount);
+
+		concurrency::parallel_for(size_t(0), triangleCount, kSimplifyChunkSize, [&](size_t first)
+		{
+			const size_t last = std::min(first + kSimplifyChunkSize, triangleCount);
+
+			for (size_t triangle = first; triangle < last; ++triangle)
+			{
+				const float* a = position(simplifiedIndices[triangle * 3 + 0]);
+				float normal[3];
+
+				TriangleNormal(a, position(simplifiedIndices[triangle * 3 + 1]), position(simplifiedIndices[triangle * 3 + 2]), normal);
+
+				const double length = sqrt(double(normal[0]) * normal[0] + double(normal[1]) * normal[1] + double(normal[2]) * normal[2]);
+				Quadric& quadric = triangleQuadrics[triangle];
+
+				memset(&quadric, 0, sizeof(quadric));
+
+				if (length <= 0.0)
+				{
+					continue;
+				}
+
+				const double area = 0.5 * length;
+				const double nx = normal[0] / length;
+				const double ny = normal[1] / length;
+				const double nz = normal[2] / length;
+				const double d = -(nx * a[0] + ny * a[1] + nz * a[2]);
+
+				quadric.a00 = area * nx * nx;
+				quadric.a01 = area * nx * ny;
+				quadric.a02 = area * nx * nz;
+				quadric.a03 = area * nx * d;
+				quadric.a11 = area * ny * ny;
+				quadric.a12 = area * ny * nz;
+				quadric.a13 = area * ny * d;
+				quadric.a22 = area * nz * nz;
+				quadric.a23 = area * nz * d;
+				quadric.a33 = area * d * d;
+				quadric.weight = area;
+			}
+		});
+
+		memset(pointQuadrics.data(), 0, pointCount * sizeof(Quadric));
+
+		for (size_t i = 0; i < currentIndexCount; ++i)
+		{
+			AddQuadric(pointQuadrics[pointOfVertex[simplifiedIndices[i]]], triangleQuadrics[i / 3]);
+		}
+	}
+
+	std::vector<std::uint32_t> triangleOffsets(vertexCount + 1);
+	std::vector<std::uint32_t> vertexTriangles;
+	std::vector<std::uint32_t> collapseTargets(vertexCount);
+	std::vector<bool> touchedPoints(pointCount);
+	std::vector<Collapse> collapses;
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> seamPairs;
+	float maxError = 0.0f;
+
+	while (currentIndexCount > targetIndexCount)
+	{
+		const size_t triangleCount = currentIndexCount / 3;
+
+		// Triangles around every vertex, for the flip checks.
+		std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+		vertexTriangles.resize(currentIndexCount);
+
+		for (size_t i = 0; i < currentIndexCount; ++i)
+		{
+			++triangleOffsets[simplifiedIndices[i] + 1];
+		}
+
+		std::partial_sum(triangleOffsets.begin(), triangleOffsets.end(), triangleOffsets.begin());
+
+		{
+			std::vector<std::uint32_t> cursors(triangleOffsets.begin(), triangleOffsets.end() - 1);
+
+			for (size_t i = 0; i < currentIndexCount; ++i)
+			{
+				vertexTriangles[cursors[simplifiedIndices[i]]++] = static_cast<std::uint32_t>(i / 3);
+			}
+		}
+
+		// Both directions of every triangle edge are candidates.
+		collapses.resize(triangleCount * 6);
+
+		concurrency::parallel_for(size_t(0), triangleCount, kSimplifyChunkSize, [&](size_t first)
+		{
+			const size_t last = std::min(first + kSimplifyChunkSize, triangleCount);
+
+			for (size_t triangle = first; triangle < last; ++triangle)
+			{
+				for (size_t edge = 0; edge < 6; ++edge)
+				{
+					const std::uint32_t a = simplifiedIndices[triangle * 3 + edge / 2];
+					const std::uint32_t b = simplifiedIndices[triangle * 3 + (edge / 2 + 1) % 3];
+					Collapse& collapse = collapses[triangle * 6 + edge];
+
+					collapse.vertex = (edge & 1) ? b : a;
+					collapse.target = (edge & 1) ? a : b;
+					collapse.cost = FLT_MAX;
+
+					if (!lockedPoints[pointOfVertex[collapse.vertex]]
+						&& ((nullptr == vertexGroups) || (vertexGroups[collapse.vertex] == vertexGroups[collapse.target])))
+					{
+						collapse.cost = QuadricError(pointQuadrics[pointOfVertex[collapse.vertex]], position(collapse.target));
+					}
+				}
+			}
+		});
+
+		concurrency::parallel_sort(collapses.begin(), collapses.end(), [](const Collapse& left, const Collapse& right)
+		{
+			return (left.cost < right.cost)
+				|| ((left.cost == right.cost) && ((left.vertex < right.vertex)
+					|| ((left.vertex == right.vertex) && (left.target < right.target))));
+		});
+
+		// A collapse removes about two triangles. The cheapest collapses
+		// whose fans do not touch go in this pass, seams included, so the
+		// fans are compared by point.
+		const size_t collapseLimit = std::max<size_t>(1, (currentIndexCount - targetIndexCount) / 6);
+		size_t collapseCount = 0;
+
+		std::iota(collapseTargets.begin(), collapseTargets.end(), 0);
+		std::fill(touchedPoints.begin(), touchedPoints.end(), false);
+
+		for (const auto& collapse : collapses)
+		{
+			if ((collapse.cost == FLT_MAX) || (collapseCount >= collapseLimit))
+			{
+				break;
+			}
+
+			// Every vertex of a seam point folds along its own side of the
+			// seam, onto a distinct neighbor at the target point. A seam
+			// vertex without such a neighbor would tear the seam open, so
+			// seams only shorten along themselves.
+			const std::uint32_t targetPoint = pointOfVertex[collapse.target];
+			const std::uint32_t sourcePoint = pointOfVertex[collapse.vertex];
+			bool valid = (sourcePoint != targetPoint) && !touchedPoints[sourcePoint] && !touchedPoints[targetPoint];
+
+			seamPairs.clear();
+
+			for (std::uint32_t i = pointStarts[sourcePoint]; (i < pointStarts[sourcePoint + 1]) && valid; ++i)
+			{
+				const std::uint32_t vertex = pointVertices[i];
+				std::uint32_t target = (vertex == collapse.vertex) ? collapse.target : kNoVertex;
+
+				// Not in this index list, or folded away already.
+				if (triangleOffsets[vertex] == triangleOffsets[vertex + 1])
+				{
+					continue;
+				}
+
+				for (std::uint32_t j = triangleOffsets[vertex]; (j < triangleOffsets[vertex + 1]) && (target == kNoVertex); ++j)
+				{
+					const std::uint32_t* triangle = &simplifiedIndices[vertexTriangles[j] * 3];
+
+					for (size_t corner = 0; corner < 3; ++corner)
+					{
+						if ((pointOfVertex[triangle[corner]] == targetPoint)
+							&& ((nullptr == vertexGroups) || (vertexGroups[vertex] == vertexGroups[triangle[corner]])))
+						{
+							target = triangle[corner];
+							break;
+						}
+					}
+				}
+
+				valid = (target != kNoVertex);
+
+				for (const auto& seamPair : seamPairs)
+				{
+					valid = valid && (seamPair.second != target);
+				}
+
+				seamPairs.push_back(std::make_pair(vertex, target));
+			}
+
+			// Reject a collapse that flips or flattens a remaining triangle.
+			for (const auto& seamPair : seamPairs)
+			{
+				for (std::uint32_t i = triangleOffsets[seamPair.first]; (i < triangleOffsets[seamPair.first + 1]) && valid; ++i)
+				{
+					const std::uint32_t* triangle = &simplifiedIndices[vertexTriangles[i] * 3];
+
+					if ((triangle[0] == seamPair.second) || (triangle[1] == seamPair.second) || (triangle[2] == seamPair.second))
+					{
+						continue;
+					}
+
+					const float* corners[3];
+					const float* movedCorners[3];
+
+					for (size_t corner = 0; corner < 3; ++corner)
+					{
+						corners[corner] = position(triangle[corner]);
+						movedCorners[corner] = (triangle[corner] == seamPair.first) ? position(seamPair.second) : corners[corner];
+					}
+
+					float normal[3];
+					float movedNormal[3];
+
+					TriangleNormal(corners[0], corners[1], corners[2], normal);
+					TriangleNormal(movedCorners[0], movedCorners[1], movedCorners[2], movedNormal);
+
+					valid = (normal[0] * movedNormal[0] + normal[1] * movedNormal[1] + normal[2] * movedNormal[2]) > 0.0f;
+				}
+			}
+
+			if (!valid)
+			{
+				continue;
+			}
+
+			for (const auto& seamPair : seamPairs)
+			{
+				for (std::uint32_t i = triangleOffsets[seamPair.first]; i < triangleOffsets[seamPair.first + 1]; ++i)
+				{
+					const std::uint32_t* triangle = &simplifiedIndices[vertexTriangles[i] * 3];
+
+					touchedPoints[pointOfVertex[triangle[0]]] = true;
+					touchedPoints[pointOfVertex[triangle[1]]] = true;
+					touchedPoints[pointOfVertex[triangle[2]]] = true;
+				}
+
+				collapseTargets[seamPair.first] = seamPair.second;
+			}
+
+			AddQuadric(pointQuadrics[pointOfVertex[collapse.target]], pointQuadrics[pointOfVertex[collapse.vertex]]);
+			maxError = std::max(maxError, collapse.cost);
+			++collapseCount;
+		}
+
+		if (collapseCount == 0)
+		{
+			// Everything left is locked or would fold over.
+			break;
+		}
+
+		size_t newIndexCount = 0;
+
+		for (size_t i = 0; i < currentIndexCount; i += 3)
+		{
+			const std::uint32_t a = collapseTargets[simplifiedIndices[i + 0]];
+			const std::uint32_t b = collapseTargets[simplifiedIndices[i + 1]];
+			const std::uint32_t c = collapseTargets[simplifiedIndices[i + 2]];
+
+			if ((a != b) && (b != c) && (c != a))
+			{
+				simplifiedIndices[newIndexCount++] = a;
+				simplifiedIndices[newIndexCount++] = b;
+				simplifiedIndices[newIndexCount++] = c;
+			}
+		}
+
+		currentIndexCount = newIndexCount;
+	}
+
+	simplifiedIndices.resize(currentIndexCount);
+
+	return sqrtf(maxError);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(
+	std::uint32_t* indices,
+	size_t indexCount,
+	size_t vertexCount,
+	std::vector<std::uint32_t>& newVertexForOldVertex)
+{
+	const std::uint32_t unused = ~std::uint32_t(0);
+	std::uint32_t nextVertex = 0;
+
+	newVertexForOldVertex.assign(vertexCount, unused);
+
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		std::uint32_t& newVertex = newVertexForOldVertex[indices[i]];
+
+		if (newVertex == unused)
+		{
+			newVertex = nextVertex++;
+		}
+
+		indices[i] = newVertex;
+	}
+
+	for (auto& newVertex : newVertexForOldVertex)
+	{
+		if (newVertex == unused)
+		{
+			newVertex = nextVertex++;
+		}
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Reorders and simplifies indexed triangle lists for the vertex stage.
+// Every function works on 32 bit triangle lists and leaves the vertices
+// to the caller.
+class MeshOptimizer
+{
+public:
+	struct VertexCacheStatistics
+	{
+		// Average cache miss ratio, transformed vertices per triangle.
+		float Acmr;
+
+		// Average transform to vertex ratio, 1 is a perfect score.
+		float Atvr;
+	};
+
+	// Simulates a FIFO post transform cache of cacheSize entries.
+	static VertexCacheStatistics AnalyzeVertexCache(
+		const std::uint32_t* indices,
+		size_t indexCount,
+		size_t vertexCount,
+		size_t cacheSize = 16);
+
+	// Tom Forsyth's linear speed vertex cache optimization, in place.
+	static void OptimizeVertexCache(
+		std::uint32_t* indices,
+		size_t indexCount,
+		size_t vertexCount);
+
+	// Reorders clusters of triangles so the ones facing out of the mesh are
+	// drawn first. The cache order inside a cluster is kept, and nothing
+	// changes if the ACMR would grow by more than the threshold ratio.
+	static void OptimizeOverdraw(
+		std::uint32_t* indices,
+		size_t indexCount,
+		const float* positions,
+		size_t positionStride,
+		size_t vertexCount,
+		float threshold = 1.05f);
+
+	// Quadric error edge collapse down to about targetIndexCount indices.
+	// Vertices never move, a collapse folds a vertex onto a neighbor, so
+	// the result indexes the same vertex buffer. Locked vertices and
+	// vertices on open or non manifold borders never fold. Vertices that
+	// share their position (uv or normal seams) fold together along the
+	// seam, each onto its own side. A vertex only folds onto a neighbor of
+	// its own group, when groups are given.
+	// Returns the largest collapse error as a distance in position units.
+	static float SimplifyMesh(
+		const std::uint32_t* indices,
+		size_t indexCount,
+		const float* positions,
+		size_t positionStride,
+		size_t vertexCount,
+		const bool* lockedVertices,
+		const std::uint32_t* vertexGroups,
+		size_t targetIndexCount,
+		std::vector<std::uint32_t>& simplifiedIndices);
+
+	// Builds a remap of every vertex to its first use in the index order,
+	// unreferenced vertices go last. The indices are remapped in place.
+	static void OptimizeVertexFetch(
+		std::uint32_t* indices,
+		size_t indexCount,
+		size_t vertexCount,
+		std::vector<std::uint32_t>& newVertexForOldVertex);
+};
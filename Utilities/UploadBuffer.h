@@ -44,6 +44,13 @@ public:
 		memcpy(&mMappedData[elementIndex * mElementByteSize], &data, sizeof(T));
 	}
 
+	// Consecutive elements, only for buffers that are not constant buffers.
+	void CopyData(int elementIndex, const T* data, UINT elementCount)
+	{
+		assert(!mIsConstantBuffer);
+		memcpy(&mMappedData[elementIndex * mElementByteSize], data, elementCount * sizeof(T));
+	}
+
 private:
 	Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
 	BYTE* mMappedData = nullptr;
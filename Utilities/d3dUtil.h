@@ -117,8 +117,20 @@ struct SubmeshGeometry
 	DirectX::BoundingBox Bounds;
 };
 
+// A vertex buffer bound to an input slot after the first one.
+struct VertexStream
+{
+	Microsoft::WRL::ComPtr<ID3D12Resource> BufferGPU = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> BufferUploader = nullptr;
+
+	UINT ByteStride = 0;
+	UINT BufferByteSize = 0;
+};
+
 struct MeshGeometry
 {
+	static const UINT MaxVertexStreams = 4;
+
 	std::string Name;
 
 	// System memory copies.  Use Blobs because the vertex/index format can be generic.
@@ -137,6 +149,10 @@ struct MeshGeometry
 	DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
 	UINT IndexBufferByteSize = 0;
 
+	// Slots 1 and up, when the vertex attributes are split over several
+	// buffers. Slot 0 is always VertexBufferGPU.
+	std::vector<VertexStream> ExtraVertexStreams;
+
 	std::unordered_map<std::string, SubmeshGeometry> DrawArgs;
 
 	D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const
@@ -149,6 +165,25 @@ struct MeshGeometry
 		return vbv;
 	}
 
+	// Fills one view per stream, starting at slot 0, and returns how many.
+	UINT VertexBufferViews(D3D12_VERTEX_BUFFER_VIEW (&views)[MaxVertexStreams])const
+	{
+		assert(ExtraVertexStreams.size() < MaxVertexStreams);
+
+		views[0] = VertexBufferView();
+
+		for (size_t i = 0; i < ExtraVertexStreams.size(); ++i)
+		{
+			const VertexStream& stream = ExtraVertexStreams[i];
+
+			views[i + 1].BufferLocation = stream.BufferGPU->GetGPUVirtualAddress();
+			views[i + 1].StrideInBytes = stream.ByteStride;
+			views[i + 1].SizeInBytes = stream.BufferByteSize;
+		}
+
+		return 1 + (UINT)ExtraVertexStreams.size();
+	}
+
 	D3D12_INDEX_BUFFER_VIEW IndexBufferView()const
 	{
 		D3D12_INDEX_BUFFER_VIEW ibv;
@@ -164,6 +199,11 @@ struct MeshGeometry
 	{
 		VertexBufferUploader = nullptr;
 		IndexBufferUploader = nullptr;
+
+		for (auto& stream : ExtraVertexStreams)
+		{
+			stream.BufferUploader = nullptr;
+		}
 	}
 };
 
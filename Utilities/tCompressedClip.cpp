@@ -0,0 +1,500 @@
+#include "tCompressedClip.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	// No component but the largest of a unit quaternion can exceed this.
+	const float kSmallestThreeRange = 0.70710678f;
+
+	// The three smallest components go to xyz in [0, 1], w is the index of
+	// the largest. That one is made positive, -q is the same rotation.
+	XMUSHORTN4 encodeRotation(
+		FXMVECTOR rotation)
+	{
+		XMFLOAT4 quaternion;
+
+		XMStoreFloat4(&quaternion, XMQuaternionNormalize(rotation));
+
+		const float components[4] = { quaternion.x, quaternion.y, quaternion.z, quaternion.w };
+		std::uint16_t largest = 0;
+
+		for (std::uint16_t i = 1; i < 4; ++i)
+		{
+			if (fabsf(components[i]) > fabsf(components[largest]))
+			{
+				largest = i;
+			}
+		}
+
+		const float sign = (components[largest] < 0.0f) ? -1.0f : 1.0f;
+		std::uint16_t smallest[3];
+
+		for (std::uint16_t i = 0, j = 0; i < 4; ++i)
+		{
+			if (i != largest)
+			{
+				const float unit = (sign * components[i] + kSmallestThreeRange) / (2.0f * kSmallestThreeRange);
+
+				smallest[j++] = static_cast<std::uint16_t>(std::min<float>(std::max<float>(unit, 0.0f), 1.0f) * 65535.0f + 0.5f);
+			}
+		}
+
+		XMUSHORTN4 key;
+
+		key.x = smallest[0];
+		key.y = smallest[1];
+		key.z = smallest[2];
+		key.w = largest;
+
+		return key;
+	}
+
+	XMVECTOR decodeRotation(
+		const XMUSHORTN4& key)
+	{
+		XMVECTOR smallest = XMVectorMultiplyAdd(
+			XMLoadUShortN4(&key),
+			XMVectorReplicate(2.0f * kSmallestThreeRange),
+			XMVectorReplicate(-kSmallestThreeRange));
+		XMVECTOR largest = XMVectorSqrt(XMVectorMax(XMVectorZero(), XMVectorSubtract(XMVectorSplatOne(), XMVector3Dot(smallest, smallest))));
+		XMVECTOR packed = XMVectorSelect(largest, smallest, XMVectorSelectControl(1, 1, 1, 0));
+
+		switch (key.w)
+		{
+		case 0:
+			return XMVectorSwizzle<3, 0, 1, 2>(packed);
+		case 1:
+			return XMVectorSwizzle<0, 3, 1, 2>(packed);
+		case 2:
+			return XMVectorSwizzle<0, 1, 3, 2>(packed);
+		default:
+			return packed;
+		}
+	}
+
+	XMUSHORTN4 encodeRange(
+		FXMVECTOR value,
+		FXMVECTOR rangeMin,
+		FXMVECTOR rangeExtent)
+	{
+		// A flat range decodes to its minimum.
+		XMVECTOR inverseExtent = XMVectorSelect(
+			XMVectorZero(),
+			XMVectorReciprocal(rangeExtent),
+			XMVectorGreater(rangeExtent, XMVectorZero()));
+		XMUSHORTN4 key;
+
+		XMStoreUShortN4(&key, XMVectorSetW(XMVectorMultiply(XMVectorSubtract(value, rangeMin), inverseExtent), 0.0f));
+
+		return key;
+	}
+
+	XMVECTOR decodeRange(
+		const XMUSHORTN4& key,
+		FXMVECTOR rangeMin,
+		FXMVECTOR rangeExtent)
+	{
+		return XMVectorMultiplyAdd(XMLoadUShortN4(&key), rangeExtent, rangeMin);
+	}
+
+	// Normalized lerp on the shorter arc, the decoded signs are arbitrary.
+	XMVECTOR blendRotations(
+		FXMVECTOR rotation0,
+		FXMVECTOR rotation1,
+		float t)
+	{
+		XMVECTOR sign = XMVectorSelect(
+			XMVectorSplatOne(),
+			XMVectorNegate(XMVectorSplatOne()),
+			XMVectorLess(XMVector4Dot(rotation0, rotation1), XMVectorZero()));
+
+		return XMQuaternionNormalize(XMVectorLerp(rotation0, XMVectorMultiply(rotation1, sign), t));
+	}
+}
+
+tCompressedClip::tCompressedClip()
+	:_buffer()
+	, _mappedFile()
+	, _data(nullptr)
+	, _size(0)
+	, _header(nullptr)
+	, _channels(nullptr)
+	, _keyFrames(nullptr)
+	, _keyValues(nullptr)
+{
+}
+
+tCompressedClip::~tCompressedClip()
+{
+}
+
+// Every channel is reduced on its own, greedily: the next key is pushed out
+// as far as all the frames it skips still interpolate within tolerance.
+// The error is measured on quantized keys, so it covers both losses. A
+// channel takes O(n log n) in its frames.
+void tCompressedClip::compress(
+	const tTransformKey* keys,
+	size_t boneCount,
+	size_t frameCount,
+	float frameRate,
+	const tTolerances& tolerances,
+	std::uint64_t contentHash)
+{
+	assert((frameCount > 0) && (frameCount <= kMaxFrameCount));
+
+	const size_t channelCount = boneCount * kChannelsPerBone;
+	std::vector<tChannel> channelVector(channelCount);
+	std::vector<std::uint16_t> keyFrameVector;
+	std::vector<XMUSHORTN4> keyValueVector;
+	std::vector<XMVECTOR> rawVector(frameCount);
+	std::vector<XMVECTOR> quantizedVector(frameCount);
+	std::vector<XMUSHORTN4> encodedVector(frameCount);
+
+	for (size_t channelIndex = 0; channelIndex < channelCount; ++channelIndex)
+	{
+		const size_t boneIndex = channelIndex / kChannelsPerBone;
+		const size_t channelType = channelIndex % kChannelsPerBone;
+		tChannel& channel = channelVector[channelIndex];
+		XMVECTOR rangeMin = XMVectorReplicate(FLT_MAX);
+		XMVECTOR rangeMax = XMVectorReplicate(-FLT_MAX);
+
+		for (size_t frame = 0; frame < frameCount; ++frame)
+		{
+			const tTransformKey& key = keys[frame * boneCount + boneIndex];
+
+			rawVector[frame] = (channelType == kTranslationChannel) ? XMLoadFloat3(&key.translation)
+				: (channelType == kRotationChannel) ? XMLoadFloat4(&key.rotation)
+				: XMLoadFloat3(&key.scale);
+			rangeMin = XMVectorMin(rangeMin, rawVector[frame]);
+			rangeMax = XMVectorMax(rangeMax, rawVector[frame]);
+		}
+
+		XMStoreFloat3(&channel.rangeMin, rangeMin);
+		XMStoreFloat3(&channel.rangeExtent, XMVectorSubtract(rangeMax, rangeMin));
+		rangeMin = XMLoadFloat3(&channel.rangeMin);
+
+		XMVECTOR rangeExtent = XMLoadFloat3(&channel.rangeExtent);
+		const float tolerance = (channelType == kTranslationChannel) ? tolerances.translation
+			: (channelType == kRotationChannel) ? tolerances.rotation
+			: tolerances.scale;
+
+		for (size_t frame = 0; frame < frameCount; ++frame)
+		{
+			if (channelType == kRotationChannel)
+			{
+				encodedVector[frame] = encodeRotation(rawVector[frame]);
+				quantizedVector[frame] = decodeRotation(encodedVector[frame]);
+			}
+			else
+			{
+				encodedVector[frame] = encodeRange(rawVector[frame], rangeMin, rangeExtent);
+				quantizedVector[frame] = decodeRange(encodedVector[frame], rangeMin, rangeExtent);
+			}
+		}
+
+		auto error = [&](FXMVECTOR value, size_t frame)
+		{
+			if (channelType == kRotationChannel)
+			{
+				const float cosHalfAngle = fabsf(XMVectorGetX(XMVector4Dot(value, XMQuaternionNormalize(rawVector[frame]))));
+
+				return 2.0f * acosf(std::min<float>(cosHalfAngle, 1.0f));
+			}
+
+			return XMVectorGetX(XMVector3Length(XMVectorSubtract(value, rawVector[frame])));
+		};
+
+		// Frames first up to last are within tolerance between the two keys.
+		auto fits = [&](size_t first, size_t last)
+		{
+			for (size_t frame = first + 1; frame < last; ++frame)
+			{
+				const float t = float(frame - first) / float(last - first);
+				XMVECTOR value = (channelType == kRotationChannel)
+					? blendRotations(quantizedVector[first], quantizedVector[last], t)
+					: XMVectorLerp(quantizedVector[first], quantizedVector[last], t);
+
+				if (error(value, frame) > tolerance)
+				{
+					return false;
+				}
+			}
+
+			return true;
+		};
+
+		channel.firstKey = static_cast<std::uint32_t>(keyFrameVector.size());
+		keyFrameVector.push_back(0);
+		keyValueVector.push_back(encodedVector[0]);
+
+		bool constant = true;
+
+		for (size_t frame = 1; (frame < frameCount) && constant; ++frame)
+		{
+			constant = (error(quantizedVector[0], frame) <= tolerance);
+		}
+
+		for (size_t key = 0; !constant && (key + 1 < frameCount);)
+		{
+			// Steps out twice as far while the keys fit, then back in by
+			// halves, so a frame is checked about log(key gap) times
+			// rather than once per frame of the gap.
+			size_t nextKey = key + 1;
+			size_t step = 1;
+
+			while ((nextKey + step < frameCount) && fits(key, nextKey + step))
+			{
+				nextKey += step;
+				step *= 2;
+			}
+
+			while (step > 1)
+			{
+				step /= 2;
+
+				if ((nextKey + step < frameCount) && fits(key, nextKey + step))
+				{
+					nextKey += step;
+				}
+			}
+
+			keyFrameVector.push_back(static_cast<std::uint16_t>(nextKey));
+			keyValueVector.push_back(encodedVector[nextKey]);
+			key = nextKey;
+		}
+
+		channel.keyCount = static_cast<std::uint32_t>(keyFrameVector.size()) - channel.firstKey;
+	}
+
+	size_t keyFramesOffset;
+	size_t keyValuesOffset;
+	const size_t size = _layoutSize(channelCount, keyFrameVector.size(), keyFramesOffset, keyValuesOffset);
+	tHeader header;
+
+	header.magic = kMagic;
+	header.version = kVersion;
+	header.contentHash = contentHash;
+	header.boneCount = static_cast<std::uint32_t>(boneCount);
+	header.frameCount = static_cast<std::uint32_t>(frameCount);
+	header.frameRate = frameRate;
+	header.keyCount = static_cast<std::uint32_t>(keyFrameVector.size());
+
+	_mappedFile.close();
+	_buffer.assign(size, 0);
+
+	memcpy(_buffer.data(), &header, sizeof(header));
+	memcpy(_buffer.data() + sizeof(header), channelVector.data(), channelCount * sizeof(tChannel));
+	memcpy(_buffer.data() + keyFramesOffset, keyFrameVector.data(), keyFrameVector.size() * sizeof(std::uint16_t));
+	memcpy(_buffer.data() + keyValuesOffset, keyValueVector.data(), keyValueVector.size() * sizeof(XMUSHORTN4));
+
+	_bind(_buffer.data(), _buffer.size());
+}
+
+bool tCompressedClip::save(
+	const char* filename) const
+{
+	if (nullptr == _data)
+	{
+		return false;
+	}
+
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+
+	file.write(reinterpret_cast<const char*>(_data), _size);
+
+	if (!file)
+	{
+		// Never leave a partial clip behind.
+		file.close();
+		remove(filename);
+		return false;
+	}
+
+	return true;
+}
+
+bool tCompressedClip::open(
+	const char* filename,
+	std::uint64_t contentHash)
+{
+	_buffer.clear();
+	_bind(nullptr, 0);
+
+	if (!_mappedFile.open(filename))
+	{
+		return false;
+	}
+
+	if (!_bind(_mappedFile.data(), _mappedFile.size())
+		|| (_header->contentHash != contentHash))
+	{
+		_bind(nullptr, 0);
+		_mappedFile.close();
+		return false;
+	}
+
+	return true;
+}
+
+void tCompressedClip::decode(
+	float time,
+	tTransformKey* keys) const
+{
+	assert(nullptr != _header);
+
+	for (size_t boneIndex = 0; boneIndex < _header->boneCount; ++boneIndex)
+	{
+		decodeBone(time, boneIndex, keys[boneIndex]);
+	}
+}
+
+void tCompressedClip::decodeBone(
+	float time,
+	size_t boneIndex,
+	tTransformKey& key) const
+{
+	assert((nullptr != _header) && (boneIndex < _header->boneCount));
+
+	const float frame = std::min<float>(std::max<float>(time * _header->frameRate, 0.0f), float(_header->frameCount - 1));
+	const size_t channelIndex = boneIndex * kChannelsPerBone;
+
+	XMStoreFloat3(&key.translation, _decodeChannel(channelIndex + kTranslationChannel, frame));
+	XMStoreFloat4(&key.rotation, _decodeChannel(channelIndex + kRotationChannel, frame));
+	XMStoreFloat3(&key.scale, _decodeChannel(channelIndex + kScaleChannel, frame));
+}
+
+size_t tCompressedClip::boneCount() const
+{
+	return (nullptr != _header) ? _header->boneCount : 0;
+}
+
+size_t tCompressedClip::frameCount() const
+{
+	return (nullptr != _header) ? _header->frameCount : 0;
+}
+
+float tCompressedClip::frameRate() const
+{
+	return (nullptr != _header) ? _header->frameRate : 0.0f;
+}
+
+float tCompressedClip::duration() const
+{
+	return ((nullptr != _header) && (_header->frameRate > 0.0f))
+		? (_header->frameCount - 1) / _header->frameRate
+		: 0.0f;
+}
+
+size_t tCompressedClip::size() const
+{
+	return _size;
+}
+
+size_t tCompressedClip::uncompressedSize() const
+{
+	return boneCount() * frameCount() * sizeof(tTransformKey);
+}
+
+size_t tCompressedClip::_layoutSize(
+	size_t channelCount,
+	size_t keyCount,
+	size_t& keyFramesOffset,
+	size_t& keyValuesOffset)
+{
+	keyFramesOffset = sizeof(tHeader) + channelCount * sizeof(tChannel);
+	keyValuesOffset = keyFramesOffset + ((keyCount * sizeof(std::uint16_t) + 7) & ~size_t(7));
+
+	return keyValuesOffset + keyCount * sizeof(XMUSHORTN4);
+}
+
+// Points the accessors into data after checking it holds a whole clip.
+bool tCompressedClip::_bind(
+	const unsigned char* data,
+	size_t size)
+{
+	_data = nullptr;
+	_size = 0;
+	_header = nullptr;
+	_channels = nullptr;
+	_keyFrames = nullptr;
+	_keyValues = nullptr;
+
+	if ((nullptr == data) || (size < sizeof(tHeader)))
+	{
+		return false;
+	}
+
+	const tHeader* header = reinterpret_cast<const tHeader*>(data);
+	const size_t channelCount = size_t(header->boneCount) * kChannelsPerBone;
+	size_t keyFramesOffset;
+	size_t keyValuesOffset;
+
+	if ((header->magic != kMagic)
+		|| (header->version != kVersion)
+		|| (header->frameCount == 0)
+		|| (header->frameCount > kMaxFrameCount)
+		|| (_layoutSize(channelCount, header->keyCount, keyFramesOffset, keyValuesOffset) != size))
+	{
+		return false;
+	}
+
+	const tChannel* channels = reinterpret_cast<const tChannel*>(data + sizeof(tHeader));
+
+	for (size_t channelIndex = 0; channelIndex < channelCount; ++channelIndex)
+	{
+		if ((channels[channelIndex].keyCount == 0)
+			|| (channels[channelIndex].firstKey > header->keyCount)
+			|| (channels[channelIndex].keyCount > header->keyCount - channels[channelIndex].firstKey))
+		{
+			return false;
+		}
+	}
+
+	_data = data;
+	_size = size;
+	_header = header;
+	_channels = channels;
+	_keyFrames = reinterpret_cast<const std::uint16_t*>(data + keyFramesOffset);
+	_keyValues = reinterpret_cast<const XMUSHORTN4*>(data + keyValuesOffset);
+
+	return true;
+}
+
+// Finds the keys around frame with a binary search, so any frame can be
+// decoded without walking the ones before it.
+XMVECTOR tCompressedClip::_decodeChannel(
+	size_t channelIndex,
+	float frame) const
+{
+	const tChannel& channel = _channels[channelIndex];
+	const std::uint16_t* keyFrames = _keyFrames + channel.firstKey;
+	const XMUSHORTN4* keyValues = _keyValues + channel.firstKey;
+
+	// The first key of a channel is always frame 0.
+	const size_t key = std::upper_bound(keyFrames, keyFrames + channel.keyCount, static_cast<std::uint16_t>(frame)) - keyFrames - 1;
+	const size_t nextKey = std::min<size_t>(key + 1, channel.keyCount - 1);
+	const float t = (nextKey == key)
+		? 0.0f
+		: (frame - keyFrames[key]) / float(keyFrames[nextKey] - keyFrames[key]);
+
+	if ((channelIndex % kChannelsPerBone) == kRotationChannel)
+	{
+		return blendRotations(decodeRotation(keyValues[key]), decodeRotation(keyValues[nextKey]), t);
+	}
+
+	XMVECTOR rangeMin = XMLoadFloat3(&channel.rangeMin);
+	XMVECTOR rangeExtent = XMLoadFloat3(&channel.rangeExtent);
+
+	return XMVectorLerp(
+		decodeRange(keyValues[key], rangeMin, rangeExtent),
+		decodeRange(keyValues[nextKey], rangeMin, rangeExtent),
+		t);
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include "tMappedFile.h"
+#include <cstdint>
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+#include <vector>
+
+// Animation clip of a fixed set of bones, with a translation, rotation and
+// scale channel per bone. Every channel only keeps the keys that linear
+// interpolation needs to stay within the tolerances. Rotations are stored
+// as their three smallest components, translations and scales as 16 bit
+// fractions of their channel range. Any time can be decoded directly.
+class tCompressedClip
+{
+public:
+	// Local transform of a bone, rotation is a quaternion.
+	typedef struct
+	{
+		DirectX::XMFLOAT3 translation;
+		DirectX::XMFLOAT4 rotation;
+		DirectX::XMFLOAT3 scale;
+	} tTransformKey;
+
+	// Largest error a dropped key may have once interpolated. rotation
+	// is an angle in radians, the others are distances.
+	typedef struct
+	{
+		float translation;
+		float rotation;
+		float scale;
+	} tTolerances;
+
+	tCompressedClip();
+	~tCompressedClip();
+
+	tCompressedClip(const tCompressedClip& rhs) = delete;
+	tCompressedClip& operator=(const tCompressedClip& rhs) = delete;
+
+	// keys holds boneCount keys for every frame, frame after frame.
+	// contentHash identifies the source, open() checks it.
+	void compress(
+		const tTransformKey* keys,
+		size_t boneCount,
+		size_t frameCount,
+		float frameRate,
+		const tTolerances& tolerances,
+		std::uint64_t contentHash);
+	bool save(
+		const char* filename) const;
+
+	// Maps the file instead of reading it, the keys are decoded in place.
+	bool open(
+		const char* filename,
+		std::uint64_t contentHash);
+
+	// Writes the keys of every bone at time, in seconds from the start.
+	void decode(
+		float time,
+		tTransformKey* keys) const;
+	void decodeBone(
+		float time,
+		size_t boneIndex,
+		tTransformKey& key) const;
+
+	size_t boneCount() const;
+	size_t frameCount() const;
+	float frameRate() const;
+	float duration() const;
+
+	// Bytes of the compressed clip, and of the keys it was built from.
+	size_t size() const;
+	size_t uncompressedSize() const;
+
+private:
+	enum
+	{
+		kMagic = 0x50494C43, // "CLIP"
+		kVersion = 1,
+		kChannelsPerBone = 3,
+		kTranslationChannel = 0,
+		kRotationChannel = 1,
+		kScaleChannel = 2,
+		kMaxFrameCount = 0x10000,
+	};
+
+	typedef struct
+	{
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint64_t contentHash;
+		std::uint32_t boneCount;
+		std::uint32_t frameCount;
+		float frameRate;
+		std::uint32_t keyCount;
+	} tHeader;
+
+	// Keys firstKey up to firstKey + keyCount. Rotations ignore the range.
+	typedef struct
+	{
+		DirectX::XMFLOAT3 rangeMin;
+		std::uint32_t firstKey;
+		DirectX::XMFLOAT3 rangeExtent;
+		std::uint32_t keyCount;
+	} tChannel;
+
+	// The header is followed by the channel table, the frame of every key
+	// padded to 8 bytes, then the value of every key.
+	static size_t _layoutSize(
+		size_t channelCount,
+		size_t keyCount,
+		size_t& keyFramesOffset,
+		size_t& keyValuesOffset);
+	bool _bind(
+		const unsigned char* data,
+		size_t size);
+	DirectX::XMVECTOR _decodeChannel(
+		size_t channelIndex,
+		float frame) const;
+
+	std::vector<unsigned char> _buffer;
+	tMappedFile _mappedFile;
+	const unsigned char* _data;
+	size_t _size;
+	const tHeader* _header;
+	const tChannel* _channels;
+	const std::uint16_t* _keyFrames;
+	const DirectX::PackedVector::XMUSHORTN4* _keyValues;
+};
@@ -0,0 +1,96 @@
+#include "tMappedFile.h"
+
+tMappedFile::tMappedFile()
+	:_fileHandle(INVALID_HANDLE_VALUE)
+	, _mappingHandle(nullptr)
+	, _data(nullptr)
+	, _size(0)
+{
+}
+
+tMappedFile::~tMappedFile()
+{
+	close();
+}
+
+bool tMappedFile::open(
+	const char* filename)
+{
+	close();
+
+	_fileHandle = CreateFileA(
+		filename,
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		nullptr,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+		nullptr);
+
+	if (INVALID_HANDLE_VALUE == _fileHandle)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+
+	if ((!GetFileSizeEx(_fileHandle, &fileSize))
+		|| (0 == fileSize.QuadPart))
+	{
+		close();
+		return false;
+	}
+
+	_mappingHandle = CreateFileMappingA(_fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if (nullptr == _mappingHandle)
+	{
+		close();
+		return false;
+	}
+
+	_data = static_cast<const unsigned char*>(MapViewOfFile(_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+
+	if (nullptr == _data)
+	{
+		close();
+		return false;
+	}
+
+	_size = static_cast<size_t>(fileSize.QuadPart);
+
+	return true;
+}
+
+void tMappedFile::close()
+{
+	if (nullptr != _data)
+	{
+		UnmapViewOfFile(_data);
+		_data = nullptr;
+	}
+
+	if (nullptr != _mappingHandle)
+	{
+		CloseHandle(_mappingHandle);
+		_mappingHandle = nullptr;
+	}
+
+	if (INVALID_HANDLE_VALUE != _fileHandle)
+	{
+		CloseHandle(_fileHandle);
+		_fileHandle = INVALID_HANDLE_VALUE;
+	}
+
+	_size = 0;
+}
+
+const unsigned char* tMappedFile::data() const
+{
+	return _data;
+}
+
+size_t tMappedFile::size() const
+{
+	return _size;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <windows.h>
+
+// Read only memory mapping of a whole file.
+class tMappedFile
+{
+public:
+	tMappedFile();
+	~tMappedFile();
+
+	tMappedFile(const tMappedFile& rhs) = delete;
+	tMappedFile& operator=(const tMappedFile& rhs) = delete;
+
+	bool open(
+		const char* filename);
+	void close();
+
+	const unsigned char* data() const;
+	size_t size() const;
+
+private:
+	HANDLE _fileHandle;
+	HANDLE _mappingHandle;
+	const unsigned char* _data;
+	size_t _size;
+};